@@ -0,0 +1 @@
+#include <../private/support/ZstdCompressionAlgorithm.h>
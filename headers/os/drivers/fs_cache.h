@@ -77,6 +77,8 @@ extern const void *block_cache_get(void *cache, off_t blockNumber);
 extern status_t block_cache_set_dirty(void *cache, off_t blockNumber,
 					bool isDirty, int32 transaction);
 extern void block_cache_put(void *cache, off_t blockNumber);
+extern status_t block_cache_prefetch(void *cache, off_t blockNumber,
+					size_t *_numBlocks);
 
 /* file cache */
 extern void *file_cache_create(dev_t mountID, ino_t vnodeID, off_t size);
@@ -91,6 +93,10 @@ extern status_t file_cache_read(void *cacheRef, void *cookie, off_t offset,
 					void *bufferBase, size_t *_size);
 extern status_t file_cache_write(void *cacheRef, void *cookie, off_t offset,
 					const void *buffer, size_t *_size);
+extern status_t file_cache_read_direct(void *cacheRef, void *cookie,
+					off_t offset, void *bufferBase, size_t *_size);
+extern status_t file_cache_write_direct(void *cacheRef, void *cookie,
+					off_t offset, const void *buffer, size_t *_size);
 
 /* file map */
 extern void *file_map_create(dev_t mountID, ino_t vnodeID, off_t size);
@@ -19,6 +19,11 @@ typedef struct index_info {
 	gid_t	gid;
 } index_info;
 
+/* fs_create_index() flags */
+#define B_TRIGRAM_INDEX		0x0001
+	/* additionally index all substrings of three characters of a string
+	   attribute, to speed up substring and case-insensitive queries */
+
 
 #ifdef  __cplusplus
 extern "C" {
@@ -850,6 +850,7 @@
 #define block_cache_get					fssh_block_cache_get
 #define block_cache_set_dirty			fssh_block_cache_set_dirty
 #define block_cache_put					fssh_block_cache_put
+#define block_cache_prefetch			fssh_block_cache_prefetch
 
 /* file cache */
 #define file_cache_create				fssh_file_cache_create
@@ -861,6 +862,8 @@
 
 #define file_cache_read					fssh_file_cache_read
 #define file_cache_write				fssh_file_cache_write
+#define file_cache_read_direct			fssh_file_cache_read_direct
+#define file_cache_write_direct			fssh_file_cache_write_direct
 
 /* file map */
 #define file_map_create					fssh_file_map_create
@@ -879,6 +882,8 @@
 
 #define index_info	fssh_index_info
 
+#define B_TRIGRAM_INDEX	FSSH_B_TRIGRAM_INDEX
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // #pragma mark - fssh_fs_info.h
@@ -91,6 +91,8 @@ extern fssh_status_t	fssh_block_cache_set_dirty(void *_cache,
 							int32_t transaction);
 extern void				fssh_block_cache_put(void *_cache,
 							fssh_off_t blockNumber);
+extern fssh_status_t	fssh_block_cache_prefetch(void *_cache,
+							fssh_off_t blockNumber, fssh_size_t *_numBlocks);
 
 /* file cache */
 extern void *			fssh_file_cache_create(fssh_mount_id mountID,
@@ -109,6 +111,12 @@ extern fssh_status_t	fssh_file_cache_read(void *_cacheRef, void *cookie,
 extern fssh_status_t	fssh_file_cache_write(void *_cacheRef, void *cookie,
 							fssh_off_t offset, const void *buffer,
 							fssh_size_t *_size);
+extern fssh_status_t	fssh_file_cache_read_direct(void *_cacheRef,
+							void *cookie, fssh_off_t offset, void *bufferBase,
+							fssh_size_t *_size);
+extern fssh_status_t	fssh_file_cache_write_direct(void *_cacheRef,
+							void *cookie, fssh_off_t offset,
+							const void *buffer, fssh_size_t *_size);
 
 /* file map */
 extern void *			fssh_file_map_create(fssh_mount_id mountID,
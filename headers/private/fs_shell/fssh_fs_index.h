@@ -19,6 +19,9 @@ typedef struct fssh_index_info {
 	fssh_gid_t	gid;
 } fssh_index_info;
 
+/* fssh_fs_create_index() flags */
+#define FSSH_B_TRIGRAM_INDEX	0x0001
+
 
 #ifdef  __cplusplus
 extern "C" {
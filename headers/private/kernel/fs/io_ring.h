@@ -0,0 +1,28 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _KERNEL_IO_RING_H
+#define _KERNEL_IO_RING_H
+
+
+#include <OS.h>
+
+
+struct io_ring_params;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// user-space exported calls
+extern int		_user_io_ring_create(struct io_ring_params* params);
+extern ssize_t	_user_io_ring_enter(int fd, uint32 toSubmit, uint32 minComplete,
+					uint32 flags, bigtime_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _KERNEL_IO_RING_H */
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef KERNEL_UTIL_CRC32C_H
+#define KERNEL_UTIL_CRC32C_H
+
+
+#include <SupportDefs.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void	crc32c_init(void);
+uint32	crc32c(uint32 crc, const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	/* KERNEL_UTIL_CRC32C_H */
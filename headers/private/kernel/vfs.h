@@ -112,6 +112,7 @@ status_t	vfs_synchronous_io(io_request* request,
 				void* cookie);
 status_t	vfs_get_vnode_cache(struct vnode *vnode, struct VMCache **_cache,
 				bool allocate);
+status_t	vfs_set_vnode_cache(struct vnode *vnode, struct VMCache *cache);
 status_t	vfs_get_file_map(struct vnode *vnode, off_t offset, size_t size,
 				struct file_io_vec *vecs, size_t *_count);
 status_t	vfs_get_fs_node_from_path(fs_volume *volume, const char *path,
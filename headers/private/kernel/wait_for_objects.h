@@ -11,6 +11,7 @@
 #include <lock.h>
 
 
+struct pollfd;
 struct select_sync;
 
 
@@ -40,6 +41,9 @@ extern void		put_select_sync(select_sync* sync);
 extern status_t	notify_select_events(select_info* info, uint16 events);
 extern void		notify_select_events_list(select_info* list, uint16 events);
 
+extern ssize_t	poll_fds(struct pollfd* fds, int numFDs, bigtime_t timeout,
+					bool kernel);
+
 extern ssize_t	_user_wait_for_objects(object_wait_info* userInfos,
 					int numInfos, uint32 flags, bigtime_t timeout);
 
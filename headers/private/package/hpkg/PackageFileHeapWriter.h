@@ -63,17 +63,30 @@ private:
 			struct Chunk;
 			struct ChunkSegment;
 			struct ChunkBuffer;
+			struct CompressionJob;
+			struct CompressionPool;
 
 			friend struct ChunkBuffer;
+			friend struct CompressionPool;
 
 private:
 			void				_Uninit();
 
+			void				_RemoveDataRanges(
+									const ::BPrivate::RangeArray<uint64>&
+										ranges);
+
 			status_t			_FlushPendingData();
+			status_t			_WriteQueuedChunks(int32 maxQueued);
 			status_t			_WriteChunk(const void* data, size_t size,
 									bool mayCompress);
-			status_t			_WriteDataCompressed(const void* data,
-									size_t size);
+			status_t			_CompressChunk(const void* data, size_t size,
+									void* compressedDataBuffer,
+									size_t& _compressedSize) const;
+			status_t			_WriteChunkData(const void* data, size_t size,
+									const void* compressedData,
+									size_t compressedSize,
+									status_t compressionError);
 			status_t			_WriteDataUncompressed(const void* data,
 									size_t size);
 
@@ -87,6 +100,7 @@ private:
 			size_t				fPendingDataSize;
 			Array<uint64>		fOffsets;
 			CompressionAlgorithmOwner* fCompressionAlgorithm;
+			CompressionPool*	fCompressionPool;
 };
 
 
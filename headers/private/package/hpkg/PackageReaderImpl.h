@@ -41,6 +41,13 @@ public:
 			status_t			ParseContent(BLowLevelPackageContentHandler*
 										contentHandler);
 
+			status_t			ParsePackageAttributes(
+									BPackageContentHandler* contentHandler);
+									// only the package attributes section
+			status_t			ParseTOC(
+									BPackageContentHandler* contentHandler);
+									// only the TOC section
+
 			BPositionIO*		PackageFile() const;
 
 			uint64				HeapOffset() const;
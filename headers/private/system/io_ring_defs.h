@@ -0,0 +1,112 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef _SYSTEM_IO_RING_DEFS_H
+#define _SYSTEM_IO_RING_DEFS_H
+
+
+#include <OS.h>
+
+
+/*!	An I/O ring is a pair of single producer/single consumer queues living in
+	an area shared between a team and the kernel. The team appends
+	io_ring_submission entries to the submission queue and advances
+	submission_tail, the kernel consumes them (advancing submission_head),
+	executes them asynchronously, and appends io_ring_completion entries to
+	the completion queue (advancing completion_tail). The team consumes the
+	completions and advances completion_head.
+	All indices are free running; an index is mapped to its queue slot by
+	and'ing it with the respective mask.
+*/
+
+
+#define IO_RING_MAX_ENTRIES			4096
+#define IO_RING_MAX_WORKERS			64
+#define IO_RING_DEFAULT_WORKERS		4
+
+// io_ring_params::flags
+#define IO_RING_SETUP_SQ_POLL		0x01
+	// a kernel thread polls the submission queue, so that submitting doesn't
+	// require a syscall as long as the thread is busy
+
+// _kern_io_ring_enter() flags
+#define IO_RING_ENTER_GET_EVENTS	0x01
+	// wait until at least minComplete completions are available
+#define IO_RING_ENTER_SQ_WAKEUP		0x02
+	// wake up the submission queue polling thread
+
+// io_ring_header::flags (set by the kernel)
+#define IO_RING_SQ_NEED_WAKEUP		0x01
+	// the submission queue polling thread went to sleep; it needs to be woken
+	// up via _kern_io_ring_enter() with IO_RING_ENTER_SQ_WAKEUP
+
+enum {
+	IO_RING_OP_NOP = 0,
+	IO_RING_OP_READ,		// fd, offset, address, length
+	IO_RING_OP_WRITE,		// fd, offset, address, length
+	IO_RING_OP_FSYNC,		// fd
+	IO_RING_OP_OPEN,		// fd (directory or -1), address (path),
+							// op_flags (open mode), mode (permissions)
+	IO_RING_OP_CLOSE,		// fd
+	IO_RING_OP_POLL,		// fd, op_flags (poll events), offset (timeout in
+							// microseconds, negative for infinite)
+	IO_RING_OP_SEND,		// fd, address, length, op_flags (message flags)
+	IO_RING_OP_RECV,		// fd, address, length, op_flags (message flags)
+
+	IO_RING_OP_COUNT
+};
+
+
+typedef struct io_ring_submission {
+	uint8		opcode;
+	uint8		flags;
+	uint16		reserved0;
+	int32		fd;
+	off_t		offset;			// -1 for the current file position
+	uint64		address;
+	uint32		length;
+	uint32		op_flags;
+	uint32		mode;
+	uint32		reserved1;
+	uint64		user_data;		// passed back unchanged in the completion
+} io_ring_submission;
+
+typedef struct io_ring_completion {
+	uint64		user_data;
+	int64		result;			// the operation's return value or error code
+	uint32		flags;
+	uint32		reserved;
+} io_ring_completion;
+
+typedef struct io_ring_header {
+	uint32		submission_head;	// written by the kernel
+	uint32		submission_tail;	// written by the team
+	uint32		submission_mask;
+	uint32		submission_entries;
+	uint32		completion_head;	// written by the team
+	uint32		completion_tail;	// written by the kernel
+	uint32		completion_mask;
+	uint32		completion_entries;
+	uint32		flags;
+	uint32		dropped;			// submissions rejected as invalid
+	uint32		submission_offset;	// queue offsets relative to the header
+	uint32		completion_offset;
+} io_ring_header;
+
+typedef struct io_ring_params {
+	// input
+	uint32		submission_entries;	// must be a power of two
+	uint32		completion_entries;	// 0 for twice the submission entries
+	uint32		flags;
+	uint32		worker_count;		// 0 for IO_RING_DEFAULT_WORKERS
+	bigtime_t	poll_idle_time;		// IO_RING_SETUP_SQ_POLL only
+
+	// output
+	area_id		area;
+	void*		address;			// the io_ring_header
+	size_t		size;
+} io_ring_params;
+
+
+#endif	/* _SYSTEM_IO_RING_DEFS_H */
@@ -27,6 +27,7 @@ struct fd_info;
 struct fd_set;
 struct fs_info;
 struct iovec;
+struct io_ring_params;
 struct msqid_ds;
 struct net_stat;
 struct pollfd;
@@ -288,6 +289,11 @@ extern ssize_t		_kern_select(int numfds, struct fd_set *readSet,
 extern ssize_t		_kern_poll(struct pollfd *fds, int numFDs,
 						bigtime_t timeout);
 
+/* I/O ring functions */
+extern int			_kern_io_ring_create(struct io_ring_params *params);
+extern ssize_t		_kern_io_ring_enter(int fd, uint32 toSubmit,
+						uint32 minComplete, uint32 flags, bigtime_t timeout);
+
 extern int			_kern_open_attr_dir(int fd, const char *path,
 						bool traverseLeafLink);
 extern ssize_t		_kern_read_attr(int fd, const char *attribute, off_t pos,
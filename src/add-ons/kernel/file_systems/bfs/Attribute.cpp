@@ -57,12 +57,13 @@ Attribute::InitCheck()
 status_t
 Attribute::CheckAccess(const char* name, int openMode)
 {
-	// Opening the name attribute using this function is not allowed,
-	// also using the reserved indices name, last_modified, and size
-	// shouldn't be allowed.
+	// Opening the name attribute or the inline file data using this function
+	// is not allowed, also using the reserved indices name, last_modified,
+	// and size shouldn't be allowed.
 	// TODO: we might think about allowing to update those values, but
 	//	really change their corresponding values in the bfs_inode structure
-	if (name[0] == FILE_NAME_NAME && name[1] == '\0'
+	if ((name[0] == FILE_NAME_NAME || name[0] == INLINE_DATA_NAME)
+		&& name[1] == '\0'
 // TODO: reenable this check -- some WonderBrush locale files used them
 /*		|| !strcmp(name, "name")
 		|| !strcmp(name, "last_modified")
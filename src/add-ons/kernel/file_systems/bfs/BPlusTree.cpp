@@ -31,6 +31,12 @@ namespace BFS {
 #endif
 
 
+#if !_BOOT_MODE
+static const size_t kMaxPrefetchBlocks = 16;
+	// how many blocks are read ahead at once when iterating
+#endif
+
+
 /*!	Simple array used for the duplicate handling in the B+Tree. This is an
 	on disk structure.
 */
@@ -1004,6 +1010,30 @@ BPlusTree::_RemoveIterator(TreeIterator* iterator)
 	MutexLocker _(fIteratorLock);
 	fIterators.Remove(iterator);
 }
+
+
+/*!	Starts reading in the node at \a offset, as well as the nodes that follow
+	it in the same block run. Since leaf nodes are usually allocated in order,
+	this lets a walk along the leaf chain avoid waiting for each node in turn.
+	The stream must be locked.
+*/
+void
+BPlusTree::_PrefetchNodes(off_t offset)
+{
+	off_t fileOffset;
+	block_run run;
+	if (offset < 0 || offset >= fStream->Size()
+		|| fStream->FindBlockRun(offset, run, fileOffset) != B_OK)
+		return;
+
+	Volume* volume = fStream->GetVolume();
+	uint32 blockOffset = (offset - fileOffset) >> volume->BlockShift();
+	if (blockOffset >= run.Length())
+		return;
+
+	volume->Prefetch(volume->ToBlock(run) + blockOffset,
+		min_c(run.Length() - blockOffset, kMaxPrefetchBlocks));
+}
 #endif // !_BOOT_MODE
 
 
@@ -2561,6 +2591,9 @@ TreeIterator::TreeIterator(BPlusTree* tree)
 	fCurrentNodeOffset(BPLUSTREE_NULL)
 {
 #if !_BOOT_MODE
+	fPrefetchValues = false;
+	fPrefetchedNode = BPLUSTREE_NULL;
+
 	tree->_AddIterator(this);
 #endif
 }
@@ -2727,6 +2760,14 @@ TreeIterator::Traverse(int8 direction, void* key, uint16* keyLength,
 		}
 	}
 
+#if !_BOOT_MODE
+	if (fCurrentNodeOffset != fPrefetchedNode) {
+		// we just entered this node
+		_Prefetch(node, forward);
+		fPrefetchedNode = fCurrentNodeOffset;
+	}
+#endif
+
 	if (node->all_key_count == 0)
 		RETURN_ERROR(B_ERROR);	// B_ENTRY_NOT_FOUND ?
 
@@ -2882,6 +2923,52 @@ TreeIterator::Stop()
 }
 
 
+#if !_BOOT_MODE
+/*!	Starts reading in what will likely be needed after the leaf \a node has
+	been entered: the following nodes in the iteration direction, and, if
+	enabled via SetPrefetchValues(), the blocks its values point to, which
+	are the inodes for directories and indices.
+*/
+void
+TreeIterator::_Prefetch(const bplustree_node* node, bool forward)
+{
+	off_t nextOffset = forward ? node->RightLink() : node->LeftLink();
+	if (nextOffset != BPLUSTREE_NULL)
+		fTree->_PrefetchNodes(nextOffset);
+
+	if (!fPrefetchValues)
+		return;
+
+	Volume* volume = fTree->fStream->GetVolume();
+	const off_t* values = node->Values();
+	off_t start = 0;
+	size_t count = 0;
+
+	// coalesce adjacent blocks, as inodes are usually allocated in order
+	for (int32 i = 0; i < node->NumKeys(); i++) {
+		off_t value = BFS_ENDIAN_TO_HOST_INT64(values[i]);
+		if (bplustree_node::IsDuplicate(value))
+			continue;
+
+		if (count > 0 && value == start + (off_t)count
+			&& count < kMaxPrefetchBlocks) {
+			count++;
+			continue;
+		}
+
+		if (count > 0)
+			volume->Prefetch(start, count);
+
+		start = value;
+		count = 1;
+	}
+
+	if (count > 0)
+		volume->Prefetch(start, count);
+}
+#endif // !_BOOT_MODE
+
+
 #ifdef DEBUG
 void
 TreeIterator::Dump()
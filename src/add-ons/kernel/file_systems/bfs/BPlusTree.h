@@ -346,6 +346,7 @@ private:
 									int8 change);
 			void				_AddIterator(TreeIterator* iterator);
 			void				_RemoveIterator(TreeIterator* iterator);
+			void				_PrefetchNodes(off_t offset);
 
 			status_t			_ValidateChildren(TreeCheck& check,
 									uint32 level, off_t offset,
@@ -402,6 +403,11 @@ public:
 
 			BPlusTree*			Tree() const { return fTree; }
 
+#if !_BOOT_MODE
+			void				SetPrefetchValues(bool prefetch)
+									{ fPrefetchValues = prefetch; }
+#endif
+
 #ifdef DEBUG
 			void				Dump();
 #endif
@@ -415,6 +421,11 @@ private:
 									int8 change);
 			void				Stop();
 
+#if !_BOOT_MODE
+			void				_Prefetch(const bplustree_node* node,
+									bool forward);
+#endif
+
 private:
 			BPlusTree*			fTree;
 			off_t				fCurrentNodeOffset;
@@ -424,6 +435,11 @@ private:
 			uint16				fDuplicate;
 			uint16				fNumDuplicates;
 			bool				fIsFragment;
+#if !_BOOT_MODE
+			bool				fPrefetchValues;
+									// values are block numbers worth reading
+			off_t				fPrefetchedNode;
+#endif
 };
 
 
@@ -198,6 +198,63 @@ struct check_cookie {
 };
 
 
+static const size_t kDefragmentBufferSize = 256 * 1024;
+static const off_t kMaxDefragmentDirectoryBlocks = 256;
+	// the B+tree of a directory is moved in a single transaction
+static const int32 kMaxDefragmentRuns = 65536;
+
+
+struct defrag_cookie {
+	defrag_cookie()
+		:
+		iterator(NULL),
+		buffer(NULL)
+	{
+	}
+
+	block_run			current;
+	Stack<block_run>	stack;
+	TreeIterator*		iterator;
+	defrag_control		control;
+	uint8*				buffer;
+	bigtime_t			start_time;
+	off_t				moved_blocks;
+		// since start_time, used for throttling
+};
+
+
+static const int32 kMaxDiscardRanges = 4096;
+static const uint32 kDiscardTrimRanges = 128;
+static const bigtime_t kDiscardInterval = 1000000;
+
+
+struct discard_range {
+	off_t				start;
+	off_t				length;
+};
+
+
+/*!	Freed ranges first go into the \c pending array; they are moved over to
+	\c ready only once the transaction that freed them is safely in the log,
+	so that they could not come back after a crash.
+*/
+struct discard_queue {
+	BlockAllocator*		allocator;
+	discard_range		pending[kMaxDiscardRanges];
+	discard_range		ready[kMaxDiscardRanges];
+	int32				pending_count;
+	int32				ready_count;
+	bool				pending_overflow;
+		// some freed ranges did not fit into the pending array
+	sem_id				sem;
+	thread_id			thread;
+	uint32				max_rate;
+		// in KB per second, 0 means unlimited
+	bigtime_t			last_time;
+	bool				quit;
+};
+
+
 class AllocationBlock : public CachedBlock {
 public:
 	AllocationBlock(Volume* volume);
@@ -251,6 +308,139 @@ private:
 };
 
 
+static const int32 kMaxFreeExtentWalk = 1024;
+	// how many extents an allocation looks at by offset
+static const int32 kInitialExtentChanges = 64;
+
+
+struct FreeExtentKey {
+	off_t	start;
+	uint32	length;
+};
+
+
+struct FreeExtent {
+	off_t End() const { return key.start + key.length; }
+
+	FreeExtentKey				key;
+	SplayTreeLink<FreeExtent>	offsetLink;
+	SplayTreeLink<FreeExtent>	sizeLink;
+	FreeExtent*					nextByOffset;
+};
+
+
+/*!	A change to the free extent index within the current transaction, so
+	that it can be undone if the transaction is aborted. A \c length of 0
+	marks the start of a (sub) transaction.
+*/
+struct free_extent_change {
+	off_t	start;
+	uint32	length;
+	bool	freed;
+};
+
+
+struct FreeExtentOffsetDefinition {
+	typedef off_t		KeyType;
+	typedef FreeExtent	NodeType;
+
+	static const KeyType& GetKey(const NodeType* node)
+	{
+		return node->key.start;
+	}
+
+	static SplayTreeLink<NodeType>* GetLink(NodeType* node)
+	{
+		return &node->offsetLink;
+	}
+
+	static int Compare(const KeyType& key, const NodeType* node)
+	{
+		if (key == node->key.start)
+			return 0;
+		return key < node->key.start ? -1 : 1;
+	}
+
+	static NodeType** GetListLink(NodeType* node)
+	{
+		return &node->nextByOffset;
+	}
+};
+
+
+struct FreeExtentSizeDefinition {
+	typedef FreeExtentKey	KeyType;
+	typedef FreeExtent		NodeType;
+
+	static const KeyType& GetKey(const NodeType* node)
+	{
+		return node->key;
+	}
+
+	static SplayTreeLink<NodeType>* GetLink(NodeType* node)
+	{
+		return &node->sizeLink;
+	}
+
+	static int Compare(const KeyType& key, const NodeType* node)
+	{
+		if (key.length != node->key.length)
+			return key.length < node->key.length ? -1 : 1;
+		if (key.start != node->key.start)
+			return key.start < node->key.start ? -1 : 1;
+		return 0;
+	}
+};
+
+
+typedef IteratableSplayTree<FreeExtentOffsetDefinition> FreeExtentOffsetTree;
+typedef SplayTree<FreeExtentSizeDefinition> FreeExtentSizeTree;
+
+
+/*!	Keeps the free ranges of the block bitmap in memory, ordered by offset
+	and by size, so that allocating and trimming do not have to scan the
+	bitmap. Like block_runs, an extent never crosses an allocation group.
+	If it runs out of memory, the index invalidates itself, and the
+	BlockAllocator goes back to scanning the bitmap.
+*/
+class FreeExtentIndex {
+public:
+	FreeExtentIndex(uint32 groupShift);
+	~FreeExtentIndex();
+
+	bool IsValid() const { return fValid; }
+	int32 CountExtents() const { return fCount; }
+
+	void MakeEmpty();
+	void Invalidate();
+
+	void Add(off_t start, uint32 length);
+	void Remove(off_t start, uint32 length);
+
+	FreeExtent* FindAt(off_t block);
+	FreeExtent* FindFrom(off_t block);
+	FreeExtent* FindBestFit(uint32 length);
+	FreeExtent* FindLargest() { return fSizeTree.FindMax(); }
+
+	FreeExtentOffsetTree::Iterator GetIterator()
+		{ return fOffsetTree.GetIterator(); }
+	FreeExtentOffsetTree::Iterator GetIterator(off_t block)
+		{ return fOffsetTree.GetIterator(block, true, true); }
+
+private:
+	bool _InSameGroup(off_t a, off_t b) const
+		{ return (a >> fGroupShift) == (b >> fGroupShift); }
+	void _Insert(FreeExtent* extent);
+	void _Remove(FreeExtent* extent);
+
+	FreeExtentOffsetTree	fOffsetTree;
+	FreeExtentSizeTree		fSizeTree;
+	uint32					fGroupShift;
+	int32					fCount;
+	bool					fValid;
+};
+
+
 AllocationBlock::AllocationBlock(Volume* volume)
 	: CachedBlock(volume)
 {
@@ -533,21 +723,232 @@ AllocationGroup::Free(Transaction& transaction, uint16 start, int32 length)
 //	#pragma mark -
 
 
+FreeExtentIndex::FreeExtentIndex(uint32 groupShift)
+	:
+	fGroupShift(groupShift),
+	fCount(0),
+	fValid(true)
+{
+}
+
+
+FreeExtentIndex::~FreeExtentIndex()
+{
+	MakeEmpty();
+}
+
+
+void
+FreeExtentIndex::MakeEmpty()
+{
+	FreeExtentOffsetTree::Iterator iterator = fOffsetTree.GetIterator();
+	while (FreeExtent* extent = iterator.Next())
+		delete extent;
+
+	fOffsetTree = FreeExtentOffsetTree();
+	fSizeTree = FreeExtentSizeTree();
+	fCount = 0;
+	fValid = true;
+}
+
+
+void
+FreeExtentIndex::Invalidate()
+{
+	if (!fValid)
+		return;
+
+	MakeEmpty();
+	fValid = false;
+}
+
+
+/*!	Adds the free range, and merges it with its neighbours. */
+void
+FreeExtentIndex::Add(off_t start, uint32 length)
+{
+	if (!fValid || length == 0)
+		return;
+
+	FreeExtent* previous = fOffsetTree.FindClosest(start, false, false);
+	if (previous != NULL && previous->End() > start) {
+		FATAL(("free extent %" B_PRIdOFF ", %" B_PRIu32 " overlaps %"
+			B_PRIdOFF ", %" B_PRIu32 "\n", start, length, previous->key.start,
+			previous->key.length));
+		Invalidate();
+		return;
+	}
+
+	FreeExtent* next = fOffsetTree.Lookup(start + length);
+	if (next != NULL && !_InSameGroup(start, next->key.start))
+		next = NULL;
+	if (previous != NULL && (previous->End() != start
+			|| !_InSameGroup(previous->key.start, start)))
+		previous = NULL;
+
+	if (previous != NULL) {
+		_Remove(previous);
+		previous->key.length += length;
+		if (next != NULL) {
+			_Remove(next);
+			previous->key.length += next->key.length;
+			delete next;
+			fCount--;
+		}
+		_Insert(previous);
+		return;
+	}
+
+	if (next != NULL) {
+		_Remove(next);
+		next->key.start = start;
+		next->key.length += length;
+		_Insert(next);
+		return;
+	}
+
+	FreeExtent* extent = new(std::nothrow) FreeExtent;
+	if (extent == NULL) {
+		Invalidate();
+		return;
+	}
+
+	extent->key.start = start;
+	extent->key.length = length;
+	_Insert(extent);
+	fCount++;
+}
+
+
+/*!	Removes the range, which must be completely free, from the index. */
+void
+FreeExtentIndex::Remove(off_t start, uint32 length)
+{
+	if (!fValid || length == 0)
+		return;
+
+	FreeExtent* extent = FindAt(start);
+	if (extent == NULL || extent->End() < start + length) {
+		FATAL(("allocated range %" B_PRIdOFF ", %" B_PRIu32 " was not free\n",
+			start, length));
+		Invalidate();
+		return;
+	}
+
+	off_t end = extent->End();
+	_Remove(extent);
+
+	if (extent->key.start == start) {
+		if (end == start + length) {
+			delete extent;
+			fCount--;
+			return;
+		}
+
+		extent->key.start += length;
+		extent->key.length -= length;
+		_Insert(extent);
+		return;
+	}
+
+	extent->key.length = start - extent->key.start;
+	_Insert(extent);
+
+	if (end > start + length) {
+		// the range was in the middle of the extent
+		FreeExtent* tail = new(std::nothrow) FreeExtent;
+		if (tail == NULL) {
+			Invalidate();
+			return;
+		}
+
+		tail->key.start = start + length;
+		tail->key.length = end - tail->key.start;
+		_Insert(tail);
+		fCount++;
+	}
+}
+
+
+//!	Returns the extent that contains \a block, if any.
+FreeExtent*
+FreeExtentIndex::FindAt(off_t block)
+{
+	FreeExtent* extent = fOffsetTree.FindClosest(block, false, true);
+	if (extent == NULL || extent->End() <= block)
+		return NULL;
+
+	return extent;
+}
+
+
+//!	Returns the first extent that contains or follows \a block, if any.
+FreeExtent*
+FreeExtentIndex::FindFrom(off_t block)
+{
+	FreeExtent* extent = FindAt(block);
+	if (extent != NULL)
+		return extent;
+
+	return fOffsetTree.FindClosest(block, true, false);
+}
+
+
+//!	Returns the smallest extent with at least \a length blocks, if any.
+FreeExtent*
+FreeExtentIndex::FindBestFit(uint32 length)
+{
+	FreeExtentKey key;
+	key.start = 0;
+	key.length = length;
+	return fSizeTree.FindClosest(key, true, true);
+}
+
+
+void
+FreeExtentIndex::_Insert(FreeExtent* extent)
+{
+	fOffsetTree.Insert(extent);
+	fSizeTree.Insert(extent);
+}
+
+
+void
+FreeExtentIndex::_Remove(FreeExtent* extent)
+{
+	fOffsetTree.Remove(extent);
+	fSizeTree.Remove(extent);
+}
+
+
+//	#pragma mark -
+
+
 BlockAllocator::BlockAllocator(Volume* volume)
 	:
 	fVolume(volume),
 	fGroups(NULL),
+	fFreeExtents(NULL),
+	fExtentChanges(NULL),
+	fExtentChangeCount(0),
+	fExtentChangeCapacity(0),
 	fCheckBitmap(NULL),
-	fCheckCookie(NULL)
+	fCheckCookie(NULL),
+	fDefragCookie(NULL),
+	fDiscardQueue(NULL)
 {
 	recursive_lock_init(&fLock, "bfs allocator");
+	mutex_init(&fDefragLock, "bfs defragmenter");
 }
 
 
 BlockAllocator::~BlockAllocator()
 {
 	recursive_lock_destroy(&fLock);
+	mutex_destroy(&fDefragLock);
 	delete[] fGroups;
+	delete fFreeExtents;
+	free(fExtentChanges);
 }
 
 
@@ -563,6 +964,12 @@ BlockAllocator::Initialize(bool full)
 	if (fGroups == NULL)
 		return B_NO_MEMORY;
 
+	// Without the index, we just have to scan the bitmap
+	if (!fVolume->IsReadOnly()) {
+		fFreeExtents = new(std::nothrow) FreeExtentIndex(
+			fVolume->AllocationGroupShift());
+	}
+
 	if (!full)
 		return B_OK;
 
@@ -621,6 +1028,7 @@ BlockAllocator::InitializeAndClearBitmap(Transaction& transaction)
 		fGroups[i].fFirstFree = fGroups[i].fLargestStart = 0;
 		fGroups[i].fFreeBits = fGroups[i].fLargestLength = fGroups[i].fNumBits;
 		fGroups[i].fLargestValid = true;
+		_AddFreeExtent(i, 0, fGroups[i].fNumBits);
 
 		offset += fBlocksPerGroup;
 	}
@@ -633,6 +1041,7 @@ BlockAllocator::InitializeAndClearBitmap(Transaction& transaction)
 		FATAL(("could not allocate reserved space for block bitmap/log!\n"));
 		return B_ERROR;
 	}
+	_RemoveFreeExtent(0, 0, reservedBlocks);
 	fVolume->SuperBlock().used_blocks
 		= HOST_ENDIAN_TO_BFS_INT64(reservedBlocks);
 
@@ -687,6 +1096,7 @@ BlockAllocator::_Initialize(BlockAllocator* allocator)
 					// block is in use
 					if (range > 0) {
 						groups[i].AddFreeRange(start, range);
+						allocator->_AddFreeExtent(i, start, range);
 						range = 0;
 					}
 				} else if (range++ == 0) {
@@ -695,8 +1105,10 @@ BlockAllocator::_Initialize(BlockAllocator* allocator)
 				}
 			}
 		}
-		if (range)
+		if (range) {
 			groups[i].AddFreeRange(start, range);
+			allocator->_AddFreeExtent(i, start, range);
+		}
 
 		freeBlocks += groups[i].fFreeBits;
 
@@ -718,6 +1130,9 @@ BlockAllocator::_Initialize(BlockAllocator* allocator)
 					"bitmap/log!\n"));
 				volume->Panic();
 			} else {
+				// the index is updated from the bitmap on the next mount
+				if (allocator->fFreeExtents != NULL)
+					allocator->fFreeExtents->Invalidate();
 				transaction.Done();
 				FATAL(("Space for block bitmap or log area was not "
 					"reserved!\n"));
@@ -774,7 +1189,11 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 	int32 bestStart = -1;
 	int32 bestLength = -1;
 
-	for (int32 i = 0; i < fNumGroups + 1; i++, groupIndex++, start = 0) {
+	bool found = _FindFreeExtent(groupIndex, start, maximum, bestGroup,
+		bestStart, bestLength);
+
+	for (int32 i = 0; !found && i < fNumGroups + 1;
+			i++, groupIndex++, start = 0) {
 		groupIndex = groupIndex % fNumGroups;
 		AllocationGroup& group = fGroups[groupIndex];
 
@@ -918,6 +1337,9 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, int32 groupIndex,
 	if (fGroups[bestGroup].Allocate(transaction, bestStart, bestLength) != B_OK)
 		RETURN_ERROR(B_IO_ERROR);
 
+	_RemoveFreeExtent(bestGroup, bestStart, bestLength);
+	_LogFreeExtentChange(bestGroup, bestStart, bestLength, false);
+
 	CHECK_ALLOCATION_GROUP(bestGroup);
 
 	run.allocation_group = HOST_ENDIAN_TO_BFS_INT32(bestGroup);
@@ -1063,6 +1485,11 @@ BlockAllocator::Free(Transaction& transaction, block_run run)
 	if (fGroups[group].Free(transaction, start, length) != B_OK)
 		RETURN_ERROR(B_IO_ERROR);
 
+	_AddFreeExtent(group, start, length);
+	_LogFreeExtentChange(group, start, length, true);
+	if (fDiscardQueue != NULL)
+		_QueueDiscard(fVolume->ToBlock(run), length);
+
 	CHECK_ALLOCATION_GROUP(group);
 
 #ifdef DEBUG
@@ -1085,97 +1512,329 @@ BlockAllocator::BitmapSize() const
 }
 
 
-#ifdef DEBUG_FRAGMENTER
 void
-BlockAllocator::Fragment()
+BlockAllocator::_AddFreeExtent(int32 group, int32 start, int32 length)
 {
-	AllocationBlock cached(fVolume);
-	RecursiveLocker lock(fLock);
-
-	// only leave 4 block holes
-	static const uint32 kMask = 0x0f0f0f0f;
-	uint32 valuesPerBlock = fVolume->BlockSize() / 4;
-
-	for (int32 i = 0; i < fNumGroups; i++) {
-		AllocationGroup& group = fGroups[i];
-
-		for (uint32 block = 0; block < group.NumBlocks(); block++) {
-			Transaction transaction(fVolume, 0);
-
-			if (cached.SetToWritable(transaction, group, block) != B_OK)
-				return;
+	if (fFreeExtents != NULL) {
+		fFreeExtents->Add(((off_t)group << fVolume->AllocationGroupShift())
+			+ start, length);
+	}
+}
 
-			for (int32 index = 0; index < valuesPerBlock; index++) {
-				cached.Block(index) |= HOST_ENDIAN_TO_BFS_INT32(kMask);
-			}
 
-			transaction.Done();
-		}
+void
+BlockAllocator::_RemoveFreeExtent(int32 group, int32 start, int32 length)
+{
+	if (fFreeExtents != NULL) {
+		fFreeExtents->Remove(((off_t)group << fVolume->AllocationGroupShift())
+			+ start, length);
 	}
 }
-#endif	// DEBUG_FRAGMENTER
 
 
-#ifdef DEBUG_ALLOCATION_GROUPS
-void
-BlockAllocator::_CheckGroup(int32 groupIndex) const
+/*!	Uses the free extent index to find a range for AllocateBlocks(): if
+	there is enough space right at \a start, it is used, so that files can
+	grow contiguously. Otherwise, like the bitmap scan, the first extent
+	after \a start in the group, or in the groups following it, that can
+	hold \a maximum blocks is chosen; if there is none, the largest one
+	there is.
+	Returns \c false if the index cannot be used, and the bitmap has to be
+	scanned instead.
+*/
+bool
+BlockAllocator::_FindFreeExtent(int32 groupIndex, uint16 start, uint16 maximum,
+	int32& bestGroup, int32& bestStart, int32& bestLength)
 {
-	AllocationBlock cached(fVolume);
-	ASSERT_LOCKED_RECURSIVE(&fLock);
+	if (fFreeExtents == NULL || !fFreeExtents->IsValid())
+		return false;
 
-	AllocationGroup& group = fGroups[groupIndex];
+	uint32 groupShift = fVolume->AllocationGroupShift();
+	off_t goal = ((off_t)(groupIndex % fNumGroups) << groupShift) + start;
 
-	int32 currentStart = 0, currentLength = 0;
-	int32 firstFree = -1;
-	int32 largestStart = -1;
-	int32 largestLength = 0;
-	int32 currentBit = 0;
+	off_t block;
+	uint32 length;
 
-	for (uint32 block = 0; block < group.NumBlocks(); block++) {
-		if (cached.SetTo(group, block) < B_OK) {
-			panic("setting group block %d failed\n", (int)block);
-			return;
+	FreeExtent* extent = fFreeExtents->FindAt(goal);
+	if (extent != NULL && extent->End() - goal >= maximum) {
+		block = goal;
+		length = maximum;
+	} else {
+		extent = fFreeExtents->FindLargest();
+		if (extent == NULL) {
+			// the volume is full
+			bestLength = 0;
+			return true;
 		}
 
-		for (uint32 bit = 0; bit < cached.NumBlockBits(); bit++) {
-			if (!cached.IsUsed(bit)) {
-				if (firstFree < 0) {
-					firstFree = currentBit;
-					if (!group.fLargestValid) {
-						if (firstFree >= 0 && firstFree < group.fFirstFree) {
-							// mostly harmless but noteworthy
-							dprintf("group %d first free too late: should be "
-								"%d, is %d\n", (int)groupIndex, (int)firstFree,
-								(int)group.fFirstFree);
-						}
-						return;
-					}
+		if (extent->key.length >= maximum) {
+			// Walk the extents by offset, starting at the goal, and wrapping
+			// around to the first group. On a badly fragmented volume, we
+			// give up after a while, and just take the best fitting one.
+			FreeExtentOffsetTree::Iterator iterator
+				= fFreeExtents->GetIterator(goal);
+			bool wrapped = false;
+			FreeExtent* found = NULL;
+
+			for (int32 i = 0; i < kMaxFreeExtentWalk; i++) {
+				FreeExtent* next = iterator.Next();
+				if (next == NULL) {
+					if (wrapped)
+						break;
+					iterator = fFreeExtents->GetIterator();
+					wrapped = true;
+					continue;
 				}
+				if (wrapped && next->key.start >= goal)
+					break;
 
-				if (currentLength == 0) {
-					// start new range
-					currentStart = currentBit;
-				}
-				currentLength++;
-			} else if (currentLength) {
-				// end of a range
-				if (currentLength > largestLength) {
-					largestStart = currentStart;
-					largestLength = currentLength;
+				if (next->key.length >= maximum) {
+					found = next;
+					break;
 				}
-				currentLength = 0;
 			}
-			currentBit++;
+
+			if (found == NULL)
+				found = fFreeExtents->FindBestFit(maximum);
+			if (found != NULL)
+				extent = found;
 		}
+
+		block = extent->key.start;
+		length = min_c(extent->key.length, maximum);
 	}
 
-	if (currentLength > largestLength) {
-		largestStart = currentStart;
-		largestLength = currentLength;
+	// The index is not rolled back with a failed transaction, so we better
+	// make sure it is still right
+	if (CheckBlocks(block, length, false) != B_OK) {
+		FATAL(("free extent index is out of sync, scanning the bitmap "
+			"instead\n"));
+		fFreeExtents->Invalidate();
+		return false;
 	}
 
-	if (firstFree >= 0 && firstFree < group.fFirstFree) {
-		// mostly harmless but noteworthy
+	bestGroup = block >> groupShift;
+	bestStart = block & ((1L << groupShift) - 1);
+	bestLength = length;
+	return true;
+}
+
+
+/*!	Is called by the Journal whenever it starts a transaction, or a sub
+	transaction, to mark where the index changes belonging to it begin.
+*/
+void
+BlockAllocator::TransactionStarted()
+{
+	if (fFreeExtents == NULL)
+		return;
+
+	RecursiveLocker locker(fLock);
+	_LogFreeExtentChange(0, 0, 0, false);
+}
+
+
+/*!	Is called by the Journal when the (sub) transaction started last is
+	done. The index is not part of the transaction, so if it has been
+	aborted, the changes it made to the index are undone in reverse order.
+	Otherwise, they are kept as part of the parent transaction, if any.
+*/
+void
+BlockAllocator::TransactionDone(bool success)
+{
+	if (fFreeExtents == NULL)
+		return;
+
+	RecursiveLocker locker(fLock);
+
+	int32 mark = fExtentChangeCount - 1;
+	while (mark >= 0 && fExtentChanges[mark].length != 0)
+		mark--;
+
+	if (!success) {
+		for (int32 i = fExtentChangeCount - 1; i > mark; i--) {
+			free_extent_change& change = fExtentChanges[i];
+			if (change.freed)
+				fFreeExtents->Remove(change.start, change.length);
+			else
+				fFreeExtents->Add(change.start, change.length);
+		}
+	}
+
+	if (mark <= 0) {
+		// this was the outermost transaction
+		fExtentChangeCount = 0;
+	} else if (success) {
+		memmove(&fExtentChanges[mark], &fExtentChanges[mark + 1],
+			(fExtentChangeCount - mark - 1) * sizeof(free_extent_change));
+		fExtentChangeCount--;
+	} else
+		fExtentChangeCount = mark;
+}
+
+
+/*!	Remembers a change to the index made within a transaction, or marks the
+	start of one, if \a length is 0. If there is no memory left to do so,
+	the index is dropped, as it could no longer be rolled back.
+*/
+void
+BlockAllocator::_LogFreeExtentChange(int32 group, int32 start, int32 length,
+	bool freed)
+{
+	ASSERT_LOCKED_RECURSIVE(&fLock);
+
+	if (fFreeExtents == NULL || !fFreeExtents->IsValid()
+		|| (length != 0 && fExtentChangeCount == 0)) {
+		// there is nothing to roll back
+		return;
+	}
+
+	if (fExtentChangeCount == fExtentChangeCapacity) {
+		int32 capacity = max_c(kInitialExtentChanges,
+			fExtentChangeCapacity * 2);
+		free_extent_change* changes = (free_extent_change*)realloc(
+			fExtentChanges, capacity * sizeof(free_extent_change));
+		if (changes == NULL) {
+			fFreeExtents->Invalidate();
+			fExtentChangeCount = 0;
+			return;
+		}
+
+		fExtentChanges = changes;
+		fExtentChangeCapacity = capacity;
+	}
+
+	free_extent_change& change = fExtentChanges[fExtentChangeCount++];
+	change.start = ((off_t)group << fVolume->AllocationGroupShift()) + start;
+	change.length = length;
+	change.freed = freed;
+}
+
+
+/*!	Recreates the free extent index from the check bitmap after it has been
+	written back.
+*/
+void
+BlockAllocator::_RebuildFreeExtents()
+{
+	if (fFreeExtents == NULL)
+		return;
+
+	fFreeExtents->MakeEmpty();
+
+	uint32 groupShift = fVolume->AllocationGroupShift();
+	off_t numBlocks = fVolume->NumBlocks();
+	off_t start = -1;
+
+	for (off_t block = 0; block < numBlocks; block++) {
+		bool used = _CheckBitmapIsUsedAt(block);
+		if (start >= 0
+			&& (used || (block >> groupShift) != (start >> groupShift))) {
+			// end of a free range, or of an allocation group
+			fFreeExtents->Add(start, block - start);
+			start = -1;
+		}
+		if (!used && start < 0)
+			start = block;
+	}
+	if (start >= 0)
+		fFreeExtents->Add(start, numBlocks - start);
+}
+
+
+#ifdef DEBUG_FRAGMENTER
+void
+BlockAllocator::Fragment()
+{
+	AllocationBlock cached(fVolume);
+	RecursiveLocker lock(fLock);
+
+	// only leave 4 block holes
+	static const uint32 kMask = 0x0f0f0f0f;
+	uint32 valuesPerBlock = fVolume->BlockSize() / 4;
+
+	for (int32 i = 0; i < fNumGroups; i++) {
+		AllocationGroup& group = fGroups[i];
+
+		for (uint32 block = 0; block < group.NumBlocks(); block++) {
+			Transaction transaction(fVolume, 0);
+
+			if (cached.SetToWritable(transaction, group, block) != B_OK)
+				return;
+
+			for (int32 index = 0; index < valuesPerBlock; index++) {
+				cached.Block(index) |= HOST_ENDIAN_TO_BFS_INT32(kMask);
+			}
+
+			transaction.Done();
+		}
+	}
+
+	if (fFreeExtents != NULL)
+		fFreeExtents->Invalidate();
+}
+#endif	// DEBUG_FRAGMENTER
+
+
+#ifdef DEBUG_ALLOCATION_GROUPS
+void
+BlockAllocator::_CheckGroup(int32 groupIndex) const
+{
+	AllocationBlock cached(fVolume);
+	ASSERT_LOCKED_RECURSIVE(&fLock);
+
+	AllocationGroup& group = fGroups[groupIndex];
+
+	int32 currentStart = 0, currentLength = 0;
+	int32 firstFree = -1;
+	int32 largestStart = -1;
+	int32 largestLength = 0;
+	int32 currentBit = 0;
+
+	for (uint32 block = 0; block < group.NumBlocks(); block++) {
+		if (cached.SetTo(group, block) < B_OK) {
+			panic("setting group block %d failed\n", (int)block);
+			return;
+		}
+
+		for (uint32 bit = 0; bit < cached.NumBlockBits(); bit++) {
+			if (!cached.IsUsed(bit)) {
+				if (firstFree < 0) {
+					firstFree = currentBit;
+					if (!group.fLargestValid) {
+						if (firstFree >= 0 && firstFree < group.fFirstFree) {
+							// mostly harmless but noteworthy
+							dprintf("group %d first free too late: should be "
+								"%d, is %d\n", (int)groupIndex, (int)firstFree,
+								(int)group.fFirstFree);
+						}
+						return;
+					}
+				}
+
+				if (currentLength == 0) {
+					// start new range
+					currentStart = currentBit;
+				}
+				currentLength++;
+			} else if (currentLength) {
+				// end of a range
+				if (currentLength > largestLength) {
+					largestStart = currentStart;
+					largestLength = currentLength;
+				}
+				currentLength = 0;
+			}
+			currentBit++;
+		}
+	}
+
+	if (currentLength > largestLength) {
+		largestStart = currentStart;
+		largestLength = currentLength;
+	}
+
+	if (firstFree >= 0 && firstFree < group.fFirstFree) {
+		// mostly harmless but noteworthy
 		dprintf("group %d first free too late: should be %d, is %d\n",
 			(int)groupIndex, (int)firstFree, (int)group.fFirstFree);
 	}
@@ -1202,19 +1861,64 @@ BlockAllocator::Trim(uint64 offset, uint64 size, uint64& trimmedSize)
 	MemoryDeleter deleter(trimData);
 	RecursiveLocker locker(fLock);
 
+	uint32 blockShift = fVolume->BlockShift();
+
+	trimData->range_count = 0;
+	trimmedSize = 0;
+
+	if (fFreeExtents != NULL && fFreeExtents->IsValid()) {
+		off_t firstBlock = offset >> blockShift;
+		off_t lastBlock = fVolume->NumBlocks();
+		if (firstBlock >= lastBlock)
+			return B_OK;
+		if (size < ((uint64)lastBlock << blockShift) - offset)
+			lastBlock = (offset + size) >> blockShift;
+
+		// adjacent extents of different allocation groups are trimmed as one
+		off_t freeStart = 0;
+		off_t freeLength = 0;
+
+		FreeExtentOffsetTree::Iterator iterator
+			= fFreeExtents->GetIterator();
+		while (FreeExtent* extent = iterator.Next()) {
+			if (extent->key.start >= lastBlock)
+				break;
+
+			off_t start = max_c(extent->key.start, firstBlock);
+			off_t end = min_c(extent->End(), lastBlock);
+			if (start >= end)
+				continue;
+
+			if (freeLength > 0 && freeStart + freeLength == start) {
+				freeLength += end - start;
+				continue;
+			}
+
+			if (freeLength > 0) {
+				status_t status = _TrimNext(*trimData, kTrimRanges,
+					freeStart << blockShift, freeLength << blockShift, false,
+					trimmedSize);
+				if (status != B_OK)
+					return status;
+			}
+
+			freeStart = start;
+			freeLength = end - start;
+		}
+
+		return _TrimNext(*trimData, kTrimRanges, freeStart << blockShift,
+			freeLength << blockShift, true, trimmedSize);
+	}
+
 	// TODO: take given offset and size into account!
 	int32 lastGroup = fNumGroups - 1;
 	uint32 firstBlock = 0;
 	uint32 firstBit = 0;
 	uint64 currentBlock = 0;
-	uint32 blockShift = fVolume->BlockShift();
 
 	uint64 firstFree = 0;
 	size_t freeLength = 0;
 
-	trimData->range_count = 0;
-	trimmedSize = 0;
-
 	AllocationBlock cached(fVolume);
 	for (int32 groupIndex = 0; groupIndex <= lastGroup; groupIndex++) {
 		AllocationGroup& group = fGroups[groupIndex];
@@ -1284,6 +1988,12 @@ BlockAllocator::StartChecking(const check_control* control)
 
 	recursive_lock_lock(&fLock);
 
+	if (fDefragCookie != NULL) {
+		recursive_lock_unlock(&fLock);
+		fVolume->GetJournal(0)->Unlock(NULL, true);
+		return B_BUSY;
+	}
+
 	size_t size = BitmapSize();
 	fCheckBitmap = (uint32*)malloc(size);
 	if (fCheckBitmap == NULL) {
@@ -1751,6 +2461,8 @@ BlockAllocator::_WriteBackCheckBitmap()
 			}
 			transaction.Done();
 		}
+
+		_RebuildFreeExtents();
 	}
 
 	return B_OK;
@@ -2218,11 +2930,6 @@ BlockAllocator::_TrimNext(fs_trim_data& trimData, uint32 maxRanges,
 	if (!pushed || force) {
 		// Trim now
 		trimData.trimmed_size = 0;
-dprintf("TRIM FS:\n");
-for (uint32 i = 0; i < trimData.range_count; i++) {
-	dprintf("[%3" B_PRIu32 "] %" B_PRIu64 " : %" B_PRIu64 "\n", i,
-		trimData.ranges[i].offset, trimData.ranges[i].size);
-}
 		if (ioctl(fVolume->Device(), B_TRIM_DEVICE, &trimData,
 				sizeof(fs_trim_data)) != 0) {
 			return errno;
@@ -2239,32 +2946,1022 @@ for (uint32 i = 0; i < trimData.range_count; i++) {
 }
 
 
-//	#pragma mark - debugger commands
+//	#pragma mark - Online discard
 
 
-#ifdef BFS_DEBUGGER_COMMANDS
+static int
+compare_discard_ranges(const void* _a, const void* _b)
+{
+	const discard_range* a = (const discard_range*)_a;
+	const discard_range* b = (const discard_range*)_b;
 
-void
-BlockAllocator::Dump(int32 index)
+	if (a->start == b->start)
+		return 0;
+	return a->start < b->start ? -1 : 1;
+}
+
+
+/*!	Sorts the \a count ranges in \a ranges, and merges those that overlap
+	or touch each other. Returns the resulting number of ranges.
+*/
+static int32
+merge_discard_ranges(discard_range* ranges, int32 count)
 {
-	kprintf("allocation groups: %" B_PRId32 " (base %p)\n", fNumGroups, fGroups);
-	kprintf("blocks per group: %" B_PRId32 "\n", fBlocksPerGroup);
+	if (count < 2)
+		return count;
 
-	for (int32 i = 0; i < fNumGroups; i++) {
-		if (index != -1 && i != index)
+	qsort(ranges, count, sizeof(discard_range), &compare_discard_ranges);
+
+	int32 last = 0;
+	for (int32 i = 1; i < count; i++) {
+		discard_range& previous = ranges[last];
+		off_t end = ranges[i].start + ranges[i].length;
+
+		if (ranges[i].start <= previous.start + previous.length) {
+			if (end > previous.start + previous.length)
+				previous.length = end - previous.start;
 			continue;
+		}
 
-		AllocationGroup& group = fGroups[i];
+		ranges[++last] = ranges[i];
+	}
 
-		kprintf("[%3" B_PRId32 "] num bits:       %" B_PRIu32 "  (%p)\n", i,
-			group.NumBits(), &group);
-		kprintf("      num blocks:     %" B_PRIu32 "\n", group.NumBlocks());
-		kprintf("      start:          %" B_PRId32 "\n", group.Start());
-		kprintf("      first free:     %" B_PRId32 "\n", group.fFirstFree);
-		kprintf("      largest start:  %" B_PRId32 "%s\n", group.fLargestStart,
-			group.fLargestValid ? "" : "  (invalid)");
-		kprintf("      largest length: %" B_PRId32 "\n", group.fLargestLength);
-		kprintf("      free bits:      %" B_PRId32 "\n", group.fFreeBits);
+	return last + 1;
+}
+
+
+/*!	Enables the online discard mode: from then on, the blocks freed by a
+	transaction are trimmed in the background once the transaction has been
+	written to the log. \a maxRate limits the amount of trimmed data in KB
+	per second; 0 means there is no limit.
+	Must be called while the volume is being mounted, before it is used.
+*/
+status_t
+BlockAllocator::StartDiscarding(uint32 maxRate)
+{
+	if (fVolume->IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+	if (fDiscardQueue != NULL)
+		return B_BUSY;
+
+	discard_queue* queue = new(std::nothrow) discard_queue;
+	if (queue == NULL)
+		return B_NO_MEMORY;
+
+	queue->allocator = this;
+	queue->pending_count = 0;
+	queue->ready_count = 0;
+	queue->pending_overflow = false;
+	queue->max_rate = maxRate;
+	queue->last_time = system_time();
+	queue->quit = false;
+
+	queue->sem = create_sem(0, "bfs discard");
+	if (queue->sem < 0) {
+		status_t status = queue->sem;
+		delete queue;
+		return status;
+	}
+
+	queue->thread = spawn_kernel_thread(&_DiscardThread, "bfs discard",
+		B_LOW_PRIORITY, queue);
+	if (queue->thread < 0) {
+		status_t status = queue->thread;
+		delete_sem(queue->sem);
+		delete queue;
+		return status;
+	}
+
+	fDiscardQueue = queue;
+	resume_thread(queue->thread);
+	return B_OK;
+}
+
+
+/*!	Stops the discard thread. The ranges that have not been trimmed yet are
+	forgotten; they will be trimmed with the next full Trim().
+*/
+void
+BlockAllocator::StopDiscarding()
+{
+	discard_queue* queue = fDiscardQueue;
+	if (queue == NULL)
+		return;
+
+	RecursiveLocker locker(fLock);
+	queue->quit = true;
+	fDiscardQueue = NULL;
+	locker.Unlock();
+
+	delete_sem(queue->sem);
+	wait_for_thread(queue->thread, NULL);
+
+	delete queue;
+}
+
+
+/*!	Is called by the Journal as soon as the current transaction has been
+	written to the log, and the drive cache has been flushed. Since the
+	journal serializes all transactions, every pending range now belongs to
+	a transaction that either cannot be undone anymore, or has been aborted;
+	the latter is caught when checking the bitmap before trimming.
+*/
+void
+BlockAllocator::FreedBlocksCommitted()
+{
+	if (fDiscardQueue == NULL)
+		return;
+
+	RecursiveLocker locker(fLock);
+
+	discard_queue* queue = fDiscardQueue;
+	if (queue == NULL || queue->quit || queue->pending_count == 0)
+		return;
+
+	int32 previousCount = queue->ready_count;
+	int32 count = min_c(queue->pending_count,
+		kMaxDiscardRanges - queue->ready_count);
+
+	memcpy(&queue->ready[queue->ready_count], queue->pending,
+		count * sizeof(discard_range));
+	queue->ready_count = merge_discard_ranges(queue->ready,
+		queue->ready_count + count);
+
+	// whatever did not fit is left to the next full Trim()
+	queue->pending_count = 0;
+	queue->pending_overflow = false;
+
+	if (previousCount < kMaxDiscardRanges / 2
+		&& queue->ready_count >= kMaxDiscardRanges / 2) {
+		// don't wait for the timeout before making room again
+		release_sem_etc(queue->sem, 1, B_DO_NOT_RESCHEDULE);
+	}
+}
+
+
+/*!	Remembers the freed range for the discard thread. Must be called with
+	fLock held.
+*/
+void
+BlockAllocator::_QueueDiscard(off_t start, off_t length)
+{
+	discard_queue* queue = fDiscardQueue;
+	if (queue->quit)
+		return;
+
+	if (queue->pending_count > 0) {
+		// blocks are often freed in order
+		discard_range& last = queue->pending[queue->pending_count - 1];
+		if (last.start + last.length == start) {
+			last.length += length;
+			return;
+		}
+		if (start + length == last.start) {
+			last.start = start;
+			last.length += length;
+			return;
+		}
+	}
+
+	if (queue->pending_count == kMaxDiscardRanges) {
+		queue->pending_count = merge_discard_ranges(queue->pending,
+			queue->pending_count);
+		if (queue->pending_count == kMaxDiscardRanges) {
+			// The ready ranges might now overlap with blocks whose freeing
+			// is not yet in the log, and we can no longer tell which
+			queue->pending_overflow = true;
+			return;
+		}
+	}
+
+	discard_range& range = queue->pending[queue->pending_count++];
+	range.start = start;
+	range.length = length;
+}
+
+
+/*!	Trims the ready ranges, as far as the rate limit allows. Only blocks that
+	are still free, and have not been freed again by a transaction that is
+	not yet in the log, are trimmed.
+	Like Trim(), this holds the allocator lock during the trim requests, so
+	that the blocks cannot be reused in the mean time; the rate limit and the
+	batch size keep this short.
+*/
+status_t
+BlockAllocator::_DiscardReady(fs_trim_data& trimData, uint32 maxRanges)
+{
+	RecursiveLocker locker(fLock);
+
+	discard_queue* queue = fDiscardQueue;
+	if (queue == NULL || queue->quit || queue->ready_count == 0
+		|| queue->pending_overflow) {
+		return B_OK;
+	}
+
+	if (fFreeExtents == NULL || !fFreeExtents->IsValid()) {
+		// Without the index, it's too expensive to find out which blocks
+		// are still free; leave them to the next full Trim()
+		queue->ready_count = 0;
+		return B_OK;
+	}
+
+	uint32 blockShift = fVolume->BlockShift();
+
+	off_t budget = -1;
+	if (queue->max_rate != 0) {
+		bigtime_t now = system_time();
+		bigtime_t elapsed = min_c(now - queue->last_time,
+			2 * kDiscardInterval);
+		budget = (((off_t)queue->max_rate << 10) * elapsed / 1000000)
+			>> blockShift;
+		if (budget == 0)
+			return B_OK;
+
+		queue->last_time = now;
+	}
+
+	queue->pending_count = merge_discard_ranges(queue->pending,
+		queue->pending_count);
+
+	trimData.range_count = 0;
+	uint64 trimmedSize = 0;
+	int32 index = 0;
+
+	while (index < queue->ready_count && budget != 0) {
+		discard_range& range = queue->ready[index];
+		off_t end = range.start + range.length;
+		if (budget > 0 && range.length > budget)
+			end = range.start + budget;
+
+		off_t block = range.start;
+		while (block < end) {
+			FreeExtent* extent = fFreeExtents->FindFrom(block);
+			if (extent == NULL || extent->key.start >= end)
+				break;
+
+			off_t start = max_c(extent->key.start, block);
+			block = min_c(extent->End(), end);
+
+			status_t status = _DiscardUnlessPending(trimData, maxRanges,
+				start, block, trimmedSize);
+			if (status != B_OK)
+				return status;
+		}
+
+		if (budget > 0)
+			budget -= end - range.start;
+
+		if (end < range.start + range.length) {
+			range.length -= end - range.start;
+			range.start = end;
+			break;
+		}
+
+		index++;
+	}
+
+	if (trimData.range_count > 0) {
+		status_t status = _TrimNext(trimData, maxRanges, 0, 0, true,
+			trimmedSize);
+		if (status != B_OK)
+			return status;
+	}
+
+	queue->ready_count -= index;
+	memmove(queue->ready, &queue->ready[index],
+		queue->ready_count * sizeof(discard_range));
+
+	return B_OK;
+}
+
+
+/*!	Adds the blocks from \a start to \a end to \a trimData, except those
+	that are part of a pending range, or that are not actually free: freed
+	ranges stay queued even if their transaction is aborted.
+*/
+status_t
+BlockAllocator::_DiscardUnlessPending(fs_trim_data& trimData,
+	uint32 maxRanges, off_t start, off_t end, uint64& trimmedSize)
+{
+	discard_queue* queue = fDiscardQueue;
+	uint32 blockShift = fVolume->BlockShift();
+
+	// find the first pending range that ends after start
+	int32 first = 0;
+	int32 last = queue->pending_count;
+	while (first < last) {
+		int32 middle = (first + last) / 2;
+		discard_range& pending = queue->pending[middle];
+		if (pending.start + pending.length <= start)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	for (int32 i = first; start < end; i++) {
+		off_t pieceEnd = end;
+		off_t next = end;
+		if (i < queue->pending_count && queue->pending[i].start < end) {
+			pieceEnd = max_c(queue->pending[i].start, start);
+			next = min_c(queue->pending[i].start + queue->pending[i].length,
+				end);
+		}
+
+		if (pieceEnd > start
+			&& CheckBlocks(start, pieceEnd - start, false) == B_OK) {
+			status_t status = _TrimNext(trimData, maxRanges,
+				start << blockShift, (pieceEnd - start) << blockShift, false,
+				trimmedSize);
+			if (status != B_OK)
+				return status;
+		}
+
+		start = next;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Trims the ready ranges once per kDiscardInterval, or as soon as the
+	queue gets crowded, until the discard mode is stopped, or the device
+	turns out not to support trimming.
+*/
+status_t
+BlockAllocator::_DiscardThread(void* _queue)
+{
+	discard_queue* queue = (discard_queue*)_queue;
+
+	fs_trim_data* trimData = (fs_trim_data*)malloc(sizeof(fs_trim_data)
+		+ sizeof(uint64) * kDiscardTrimRanges);
+	if (trimData == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter deleter(trimData);
+
+	while (acquire_sem_etc(queue->sem, 1, B_RELATIVE_TIMEOUT,
+			kDiscardInterval) != B_BAD_SEM_ID) {
+		status_t status = queue->allocator->_DiscardReady(*trimData,
+			kDiscardTrimRanges);
+		if (status != B_OK) {
+			INFORM(("bfs: online discard disabled: %s\n", strerror(status)));
+
+			RecursiveLocker locker(queue->allocator->fLock);
+			queue->quit = true;
+			queue->pending_count = 0;
+			queue->ready_count = 0;
+			break;
+		}
+	}
+
+	return B_OK;
+}
+
+
+//	#pragma mark - Online defragmentation
+
+
+/*!	Collects the block runs that contain the first \a size bytes of the
+	stream of \a inode in \a runs; if that is \c NULL, they are only counted.
+	\a _fragments is set to the number of physically contiguous pieces the
+	runs form.
+*/
+static status_t
+get_stream_runs(Inode* inode, off_t size, block_run* runs, int32& _count,
+	int32& _fragments)
+{
+	Volume* volume = inode->GetVolume();
+	int32 count = 0;
+	int32 fragments = 0;
+	off_t nextBlock = -1;
+
+	for (off_t pos = 0; pos < size;) {
+		block_run run;
+		off_t offset;
+		status_t status = inode->FindBlockRun(pos, run, offset);
+		if (status != B_OK)
+			return status;
+
+		// ignore the preallocated blocks at the end of the stream
+		off_t end = offset + ((off_t)run.Length() << volume->BlockShift());
+		if (end > size) {
+			run.length = HOST_ENDIAN_TO_BFS_INT16((size - offset
+				+ volume->BlockSize() - 1) >> volume->BlockShift());
+			end = size;
+		}
+
+		if (runs != NULL)
+			runs[count] = run;
+		count++;
+
+		if (volume->ToBlock(run) != nextBlock)
+			fragments++;
+		nextBlock = volume->ToBlock(run) + run.Length();
+		pos = end;
+	}
+
+	_count = count;
+	_fragments = fragments;
+	return B_OK;
+}
+
+
+static int32
+count_fragments(Volume* volume, const block_run* runs, int32 count)
+{
+	int32 fragments = 0;
+	off_t nextBlock = -1;
+
+	for (int32 i = 0; i < count; i++) {
+		if (volume->ToBlock(runs[i]) != nextBlock)
+			fragments++;
+		nextBlock = volume->ToBlock(runs[i]) + runs[i].Length();
+	}
+
+	return fragments;
+}
+
+
+/*!	Starts an online defragmentation run. Unlike checking, it does not lock
+	the volume: every node is processed in transactions of its own, so that
+	the volume can be used normally in the mean time.
+*/
+status_t
+BlockAllocator::StartDefragmenting(const defrag_control* control)
+{
+	if (control == NULL || control->magic != BFS_IOCTL_DEFRAG_MAGIC)
+		return B_BAD_VALUE;
+	if (fVolume->IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+
+	MutexLocker defragLocker(fDefragLock);
+	RecursiveLocker locker(fLock);
+
+	if (fCheckCookie != NULL || fDefragCookie != NULL)
+		return B_BUSY;
+
+	defrag_cookie* cookie = new(std::nothrow) defrag_cookie();
+	if (cookie == NULL)
+		return B_NO_MEMORY;
+
+	cookie->buffer = (uint8*)malloc(kDefragmentBufferSize);
+	if (cookie->buffer == NULL) {
+		delete cookie;
+		return B_NO_MEMORY;
+	}
+
+	memcpy(&cookie->control, control, sizeof(defrag_control));
+	memset(&cookie->control.stats, 0, sizeof(control->stats));
+	cookie->control.status = B_OK;
+
+	cookie->start_time = system_time();
+	cookie->moved_blocks = 0;
+	cookie->stack.Push(fVolume->Root());
+
+	fDefragCookie = cookie;
+	return B_OK;
+}
+
+
+status_t
+BlockAllocator::StopDefragmenting(defrag_control* control)
+{
+	// wait for DefragmentNextNode() to finish with the cookie
+	MutexLocker defragLocker(fDefragLock);
+	RecursiveLocker locker(fLock);
+
+	defrag_cookie* cookie = fDefragCookie;
+	if (cookie == NULL)
+		return B_NO_INIT;
+
+	fDefragCookie = NULL;
+	locker.Unlock();
+
+	if (cookie->iterator != NULL) {
+		delete cookie->iterator;
+
+		// the current directory inode is still locked in memory
+		put_vnode(fVolume->FSVolume(), fVolume->ToVnode(cookie->current));
+	}
+
+	if (control != NULL)
+		memcpy(control, &cookie->control, sizeof(defrag_control));
+
+	free(cookie->buffer);
+	delete cookie;
+	return B_OK;
+}
+
+
+/*!	Processes the next node of the volume, and fills in \a control with the
+	results. The volume is traversed the same way CheckNextNode() does; a
+	directory is processed before its entries are.
+	Returns \c B_ENTRY_NOT_FOUND when all nodes have been processed.
+*/
+status_t
+BlockAllocator::DefragmentNextNode(defrag_control* control)
+{
+	// This cannot use fLock, as the node is moved in transactions
+	MutexLocker defragLocker(fDefragLock);
+
+	defrag_cookie* cookie = fDefragCookie;
+	if (cookie == NULL)
+		return B_NO_INIT;
+
+	while (true) {
+		if (cookie->iterator == NULL) {
+			if (!cookie->stack.Pop(&cookie->current)) {
+				cookie->control.status = B_ENTRY_NOT_FOUND;
+				memcpy(control, &cookie->control, sizeof(defrag_control));
+				return B_ENTRY_NOT_FOUND;
+			}
+
+			Vnode vnode(fVolume, cookie->current);
+			Inode* inode;
+			if (vnode.Get(&inode) != B_OK) {
+				FATAL(("defrag: Could not open inode at %" B_PRIdOFF "\n",
+					fVolume->ToBlock(cookie->current)));
+				continue;
+			}
+
+			if (inode->GetName(cookie->control.name) != B_OK)
+				strcpy(cookie->control.name, "(dir has no name)");
+
+			// move the directory before we iterate over it
+			cookie->control.status = _DefragmentNode(inode);
+
+			BPlusTree* tree = inode->Tree();
+			if (tree != NULL) {
+				cookie->iterator = new(std::nothrow) TreeIterator(tree);
+				if (cookie->iterator == NULL)
+					RETURN_ERROR(B_NO_MEMORY);
+
+				// the inode must stay locked in memory until the iterator is
+				// freed
+				vnode.Keep();
+			}
+
+			memcpy(control, &cookie->control, sizeof(defrag_control));
+			return B_OK;
+		}
+
+		char name[B_FILE_NAME_LENGTH];
+		uint16 length;
+		ino_t id;
+
+		status_t status = cookie->iterator->GetNextEntry(name, &length,
+			B_FILE_NAME_LENGTH, &id);
+		if (status != B_OK) {
+			delete cookie->iterator;
+			cookie->iterator = NULL;
+
+			put_vnode(fVolume->FSVolume(), fVolume->ToVnode(cookie->current));
+
+			if (status == B_ENTRY_NOT_FOUND)
+				continue;
+
+			return status;
+		}
+
+		// ignore "." and ".." entries
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			continue;
+
+		Vnode vnode(fVolume, id);
+		Inode* inode;
+		if (vnode.Get(&inode) != B_OK)
+			continue;
+
+		if (inode->IsDirectory()) {
+			cookie->stack.Push(inode->BlockRun());
+			continue;
+		}
+
+		strlcpy(cookie->control.name, name, B_FILE_NAME_LENGTH);
+		cookie->control.status = _DefragmentNode(inode);
+
+		memcpy(control, &cookie->control, sizeof(defrag_control));
+		return B_OK;
+	}
+	// is never reached
+}
+
+
+/*!	Moves the stream of \a inode into as few block runs as possible next to
+	the inode, if that reduces the number of its fragments. The B+tree of a
+	directory is also moved when it lives in another allocation group than
+	its inode, so that directories are clustered with their contents.
+
+	File data is copied directly on the device, without holding any lock;
+	only allocating the new blocks, and switching the stream over to them are
+	done in transactions. If the file has been written to in the mean time,
+	the new blocks are just freed again.
+	Since inode IDs are their block numbers in BFS, inodes themselves are
+	never moved.
+*/
+status_t
+BlockAllocator::_DefragmentNode(Inode* inode)
+{
+	defrag_control& control = fDefragCookie->control;
+	control.inode = inode->ID();
+	control.mode = inode->Mode();
+	control.fragments = 0;
+	control.new_fragments = 0;
+	control.stats.nodes++;
+
+	bool isFile = inode->IsFile();
+	if (isFile ? (control.flags & BFS_DEFRAGMENT_FILES) == 0
+			: !inode->IsDirectory()
+				|| (control.flags & BFS_DEFRAGMENT_DIRECTORIES) == 0) {
+		return B_OK;
+	}
+
+	if (isFile) {
+		// all of the file's data has to be in place before it can be moved
+		status_t status = inode->AllocateDelayed();
+		if (status == B_OK)
+			status = file_cache_sync(inode->FileCache());
+		if (status != B_OK)
+			return status;
+	}
+
+	// find out how the stream is laid out
+
+	data_stream stream;
+	int32 changeCounter;
+	int32 count;
+	int32 fragments;
+	bool misplaced;
+
+	{
+		// Writers keep the inode read locked until their I/O has completed,
+		// and count their change before that; holding the write lock makes
+		// sure no write that the change counter already knows about is
+		// still in progress while we copy the data.
+		WriteLocker locker(inode->Lock());
+
+		// data kept in the inode has no blocks to move
+		if (inode->HasDelayedAllocation() || inode->HasInlineData())
+			return B_OK;
+
+		stream = inode->Node().data;
+		changeCounter = inode->DataChangeCounter();
+
+		status_t status = get_stream_runs(inode, stream.Size(), NULL, count,
+			fragments);
+		if (status != B_OK)
+			return status;
+
+		misplaced = !isFile && fragments > 0
+			&& stream.direct[0].AllocationGroup()
+				!= inode->BlockRun().AllocationGroup();
+	}
+
+	control.fragments = fragments;
+	control.new_fragments = fragments;
+	if (fragments > 1)
+		control.stats.fragmented_nodes++;
+
+	off_t numBlocks = (stream.Size() + fVolume->BlockSize() - 1)
+		>> fVolume->BlockShift();
+	uint32 maxRunLength = min_c(fGroups[0].NumBits(), MAX_BLOCK_RUN_LENGTH);
+	int32 neededRuns = (numBlocks + maxRunLength - 1) / maxRunLength;
+
+	if (numBlocks == 0 || (neededRuns >= fragments && !misplaced)
+		|| neededRuns > NUM_DIRECT_BLOCKS || count > kMaxDefragmentRuns
+		|| (!isFile && numBlocks > kMaxDefragmentDirectoryBlocks))
+		return B_OK;
+
+	block_run* runs = (block_run*)malloc(count * sizeof(block_run));
+	if (runs == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter runsDeleter(runs);
+	block_run newRuns[NUM_DIRECT_BLOCKS];
+	int32 newCount = 0;
+
+	Transaction transaction(fVolume, inode->BlockNumber());
+
+	if (!isFile) {
+		// the B+tree is copied through the log, so we can do it all at once
+		inode->WriteLockInTransaction(transaction);
+	}
+
+	status_t status;
+
+	{
+		// the stream might have changed while we didn't hold the lock
+		InodeReadLocker locker(inode);
+
+		if (memcmp(&stream, &inode->Node().data, sizeof(data_stream)) != 0)
+			status = B_BUSY;
+		else {
+			int32 runCount;
+			status = get_stream_runs(inode, stream.Size(), NULL, runCount,
+				fragments);
+			if (status == B_OK && runCount != count)
+				status = B_BUSY;
+			if (status == B_OK) {
+				status = get_stream_runs(inode, stream.Size(), runs, count,
+					fragments);
+			}
+		}
+	}
+
+	if (status == B_OK) {
+		status = _AllocateContiguous(transaction, inode, numBlocks, newRuns,
+			newCount);
+	}
+	if (status == B_OK
+		&& count_fragments(fVolume, newRuns, newCount) >= fragments
+		&& !misplaced) {
+		// the free space isn't any better than what we have
+		for (int32 i = 0; i < newCount; i++)
+			Free(transaction, newRuns[i]);
+
+		status = B_DEVICE_FULL;
+	}
+
+	if (status == B_OK && !isFile) {
+		status = _MoveDirectoryData(transaction, inode, runs, count, newRuns,
+			newCount);
+		if (status == B_OK)
+			status = inode->ReplaceStream(transaction, newRuns, newCount);
+	}
+
+	if (status == B_DEVICE_FULL) {
+		// there is nothing we can do about this node
+		transaction.Done();
+		return B_OK;
+	}
+	if (status != B_OK) {
+		// keep the allocator in sync with the aborted transaction
+		for (int32 i = 0; i < newCount; i++)
+			Free(transaction, newRuns[i]);
+
+		return status;
+	}
+
+	status = transaction.Done();
+	if (status != B_OK || !isFile) {
+		if (status == B_OK) {
+			control.new_fragments = count_fragments(fVolume, newRuns,
+				newCount);
+			control.stats.relocated_nodes++;
+		}
+		return status;
+	}
+
+	// The new blocks of the file are allocated now; copy the data over.
+	// If we crash before the stream has been switched, the new blocks are
+	// lost until the next check run.
+
+	status = _MoveFileData(inode, runs, count, newRuns, newCount);
+	if (status == B_OK) {
+		// the data must be on disk before the stream refers to it
+		ioctl(fVolume->Device(), B_FLUSH_DRIVE_CACHE);
+	}
+
+	if (status == B_OK) {
+		Transaction switchTransaction(fVolume, inode->BlockNumber());
+		inode->WriteLockInTransaction(switchTransaction);
+
+		if (inode->IsDeleted() || inode->HasDelayedAllocation()
+			|| inode->DataChangeCounter() != changeCounter
+			|| memcmp(&stream, &inode->Node().data, sizeof(data_stream))
+				!= 0) {
+			// the file has been changed while we copied it
+			status = B_BUSY;
+		}
+		if (status == B_OK) {
+			status = inode->ReplaceStream(switchTransaction, newRuns,
+				newCount);
+		}
+		if (status == B_OK) {
+			status = switchTransaction.Done();
+			if (status != B_OK && inode->Map() != NULL) {
+				// the old stream is back in place
+				file_map_invalidate(inode->Map(), 0, stream.Size());
+			}
+		}
+	}
+
+	if (status != B_OK) {
+		// free the new blocks again
+		Transaction freeTransaction(fVolume, inode->BlockNumber());
+		for (int32 i = 0; i < newCount; i++)
+			Free(freeTransaction, newRuns[i]);
+		freeTransaction.Done();
+
+		return status;
+	}
+
+	control.new_fragments = count_fragments(fVolume, newRuns, newCount);
+	control.stats.relocated_nodes++;
+	return B_OK;
+}
+
+
+/*!	Allocates \a numBlocks close to \a inode, using the same placement
+	policy as Allocate(), but in runs that are as large as possible.
+*/
+status_t
+BlockAllocator::_AllocateContiguous(Transaction& transaction, Inode* inode,
+	off_t numBlocks, block_run* runs, int32& count)
+{
+	uint32 maxRunLength = min_c(fGroups[0].NumBits(), MAX_BLOCK_RUN_LENGTH);
+	int32 group = inode->BlockRun().AllocationGroup();
+	uint16 start = 0;
+
+	if (inode->IsContainer()) {
+		// directory data goes right behind the inode
+		start = inode->BlockRun().Start();
+	} else {
+		// file data starts in the next allocation group
+		group = (group + 1) % fNumGroups;
+	}
+
+	count = 0;
+
+	while (numBlocks > 0) {
+		if (count == NUM_DIRECT_BLOCKS)
+			return B_DEVICE_FULL;
+
+		uint16 length = min_c(numBlocks, maxRunLength);
+		status_t status = AllocateBlocks(transaction, group, start, length,
+			length, runs[count]);
+		if (status != B_OK) {
+			for (int32 i = 0; i < count; i++)
+				Free(transaction, runs[i]);
+
+			return status;
+		}
+
+		group = runs[count].AllocationGroup();
+		start = runs[count].Start() + runs[count].Length();
+		numBlocks -= length;
+		count++;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Copies the file data from the block runs \a from to \a to directly on
+	the device; both must cover the same number of blocks.
+*/
+status_t
+BlockAllocator::_MoveFileData(Inode* inode, const block_run* from,
+	int32 fromCount, const block_run* to, int32 toCount)
+{
+	uint8* buffer = fDefragCookie->buffer;
+	uint32 blockShift = fVolume->BlockShift();
+	uint32 bufferBlocks = kDefragmentBufferSize >> blockShift;
+
+	int32 toIndex = 0;
+	uint32 toOffset = 0;
+
+	for (int32 i = 0; i < fromCount; i++) {
+		off_t block = fVolume->ToBlock(from[i]);
+		uint32 left = from[i].Length();
+
+		while (left > 0) {
+			if (toIndex >= toCount)
+				RETURN_ERROR(B_BAD_VALUE);
+
+			uint32 blocks = min_c(min_c(left, bufferBlocks),
+				to[toIndex].Length() - toOffset);
+			ssize_t bytes = (ssize_t)blocks << blockShift;
+
+			if (read_pos(fVolume->Device(), block << blockShift, buffer,
+					bytes) != bytes
+				|| write_pos(fVolume->Device(),
+					(fVolume->ToBlock(to[toIndex]) + toOffset) << blockShift,
+					buffer, bytes) != bytes) {
+				RETURN_ERROR(B_IO_ERROR);
+			}
+
+			block += blocks;
+			left -= blocks;
+			toOffset += blocks;
+			if (toOffset == to[toIndex].Length()) {
+				toIndex++;
+				toOffset = 0;
+			}
+
+			_ThrottleDefragmenting(blocks);
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Copies the B+tree of a directory from the block runs \a from to \a to
+	through the block cache, as part of \a transaction.
+*/
+status_t
+BlockAllocator::_MoveDirectoryData(Transaction& transaction, Inode* inode,
+	const block_run* from, int32 fromCount, const block_run* to,
+	int32 toCount)
+{
+	int32 toIndex = 0;
+	uint32 toOffset = 0;
+	off_t moved = 0;
+
+	for (int32 i = 0; i < fromCount; i++) {
+		for (uint32 j = 0; j < from[i].Length(); j++) {
+			if (toIndex >= toCount)
+				RETURN_ERROR(B_BAD_VALUE);
+
+			CachedBlock source(fVolume);
+			const uint8* data = source.SetTo(fVolume->ToBlock(from[i]) + j);
+			if (data == NULL)
+				RETURN_ERROR(B_IO_ERROR);
+
+			CachedBlock target(fVolume);
+			uint8* block = target.SetToWritable(transaction,
+				fVolume->ToBlock(to[toIndex]) + toOffset, true);
+			if (block == NULL)
+				RETURN_ERROR(B_IO_ERROR);
+
+			memcpy(block, data, fVolume->BlockSize());
+			moved++;
+
+			if (++toOffset == to[toIndex].Length()) {
+				toIndex++;
+				toOffset = 0;
+			}
+		}
+	}
+
+	_ThrottleDefragmenting(moved);
+	return B_OK;
+}
+
+
+/*!	Waits as long as needed to keep the rate of the data moved below the
+	limit the defragmentation was started with.
+*/
+void
+BlockAllocator::_ThrottleDefragmenting(off_t movedBlocks)
+{
+	defrag_cookie* cookie = fDefragCookie;
+	cookie->control.stats.moved_blocks += movedBlocks;
+
+	uint32 rate = cookie->control.max_rate;
+	if (rate == 0)
+		return;
+
+	cookie->moved_blocks += movedBlocks;
+
+	// the rate is given in KB per second
+	off_t bytes = cookie->moved_blocks << fVolume->BlockShift();
+	bigtime_t due = cookie->start_time + bytes * 15625 / ((off_t)rate * 16);
+	bigtime_t now = system_time();
+
+	if (due > now)
+		snooze(due - now);
+	else if (now - due > 1000000) {
+		// don't let an idle period turn into a burst afterwards
+		cookie->start_time = now;
+		cookie->moved_blocks = 0;
+	}
+}
+
+
+//	#pragma mark - debugger commands
+
+
+#ifdef BFS_DEBUGGER_COMMANDS
+
+void
+BlockAllocator::Dump(int32 index)
+{
+	kprintf("allocation groups: %" B_PRId32 " (base %p)\n", fNumGroups, fGroups);
+	kprintf("blocks per group: %" B_PRId32 "\n", fBlocksPerGroup);
+
+	for (int32 i = 0; i < fNumGroups; i++) {
+		if (index != -1 && i != index)
+			continue;
+
+		AllocationGroup& group = fGroups[i];
+
+		kprintf("[%3" B_PRId32 "] num bits:       %" B_PRIu32 "  (%p)\n", i,
+			group.NumBits(), &group);
+		kprintf("      num blocks:     %" B_PRIu32 "\n", group.NumBlocks());
+		kprintf("      start:          %" B_PRId32 "\n", group.Start());
+		kprintf("      first free:     %" B_PRId32 "\n", group.fFirstFree);
+		kprintf("      largest start:  %" B_PRId32 "%s\n", group.fLargestStart,
+			group.fLargestValid ? "" : "  (invalid)");
+		kprintf("      largest length: %" B_PRId32 "\n", group.fLargestLength);
+		kprintf("      free bits:      %" B_PRId32 "\n", group.fFreeBits);
+	}
+
+	if (fFreeExtents != NULL) {
+		kprintf("free extents: %" B_PRId32 "%s\n",
+			fFreeExtents->CountExtents(),
+			fFreeExtents->IsValid() ? "" : "  (invalid)");
 	}
 }
 
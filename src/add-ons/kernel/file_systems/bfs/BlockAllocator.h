@@ -11,6 +11,8 @@
 
 class AllocationGroup;
 class BPlusTree;
+class FreeExtentIndex;
+struct free_extent_change;
 class Inode;
 class Transaction;
 class Volume;
@@ -18,6 +20,9 @@ struct disk_super_block;
 struct block_run;
 struct check_control;
 struct check_cookie;
+struct defrag_control;
+struct defrag_cookie;
+struct discard_queue;
 
 
 //#define DEBUG_ALLOCATION_GROUPS
@@ -49,6 +54,12 @@ public:
 			status_t		Trim(uint64 offset, uint64 size,
 								uint64& trimmedSize);
 
+			status_t		StartDiscarding(uint32 maxRate);
+			void			StopDiscarding();
+			void			FreedBlocksCommitted();
+			void			TransactionStarted();
+			void			TransactionDone(bool success);
+
 			status_t		StartChecking(const check_control* control);
 			status_t		StopChecking(check_control* control);
 			status_t		CheckNextNode(check_control* control);
@@ -60,6 +71,11 @@ public:
 								bool allocated = true);
 			status_t		CheckInode(Inode* inode, const char* name);
 
+			status_t		StartDefragmenting(
+								const defrag_control* control);
+			status_t		StopDefragmenting(defrag_control* control);
+			status_t		DefragmentNextNode(defrag_control* control);
+
 			size_t			BitmapSize() const;
 
 #ifdef BFS_DEBUGGER_COMMANDS
@@ -75,6 +91,17 @@ private:
 #ifdef DEBUG_ALLOCATION_GROUPS
 			void			_CheckGroup(int32 group) const;
 #endif
+			void			_AddFreeExtent(int32 group, int32 start,
+								int32 length);
+			void			_RemoveFreeExtent(int32 group, int32 start,
+								int32 length);
+			void			_LogFreeExtentChange(int32 group, int32 start,
+								int32 length, bool freed);
+			bool			_FindFreeExtent(int32 groupIndex, uint16 start,
+								uint16 maximum, int32& bestGroup,
+								int32& bestStart, int32& bestLength);
+			void			_RebuildFreeExtents();
+
 			bool			_IsValidCheckControl(const check_control* control);
 			bool			_CheckBitmapIsUsedAt(off_t block) const;
 			void			_SetCheckBitmapAt(off_t block);
@@ -90,6 +117,27 @@ private:
 								uint64 offset, uint64 size, bool force,
 								uint64& trimmedSize);
 
+			void			_QueueDiscard(off_t start, off_t length);
+			status_t		_DiscardReady(fs_trim_data& trimData,
+								uint32 maxRanges);
+			status_t		_DiscardUnlessPending(fs_trim_data& trimData,
+								uint32 maxRanges, off_t start, off_t end,
+								uint64& trimmedSize);
+	static	status_t		_DiscardThread(void* _allocator);
+
+			status_t		_DefragmentNode(Inode* inode);
+			status_t		_AllocateContiguous(Transaction& transaction,
+								Inode* inode, off_t numBlocks,
+								block_run* runs, int32& count);
+			status_t		_MoveFileData(Inode* inode,
+								const block_run* from, int32 fromCount,
+								const block_run* to, int32 toCount);
+			status_t		_MoveDirectoryData(Transaction& transaction,
+								Inode* inode, const block_run* from,
+								int32 fromCount, const block_run* to,
+								int32 toCount);
+			void			_ThrottleDefragmenting(off_t movedBlocks);
+
 	static	status_t		_Initialize(BlockAllocator* self);
 
 private:
@@ -99,9 +147,17 @@ private:
 			int32			fNumGroups;
 			uint32			fBlocksPerGroup;
 			uint32			fNumBlocks;
+			FreeExtentIndex* fFreeExtents;
+			free_extent_change* fExtentChanges;
+			int32			fExtentChangeCount;
+			int32			fExtentChangeCapacity;
 
 			uint32*			fCheckBitmap;
 			check_cookie*	fCheckCookie;
+			defrag_cookie*	fDefragCookie;
+			mutex			fDefragLock;
+				// serializes the defragmenter's calls
+			discard_queue*	fDiscardQueue;
 };
 
 #ifdef BFS_DEBUGGER_COMMANDS
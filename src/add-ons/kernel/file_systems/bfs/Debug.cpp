@@ -74,6 +74,7 @@ dump_super_block(const disk_super_block* superBlock)
 		(superBlock->magic3 == SUPER_BLOCK_MAGIC3 ? "valid" : "INVALID"));
 	dump_block_run("  root_dir       = ", superBlock->root_dir);
 	dump_block_run("  indices        = ", superBlock->indices);
+	kprintf("  features       = %#08x\n", (unsigned)superBlock->Features());
 }
 
 
@@ -209,6 +209,189 @@ Index::Create(Transaction& transaction, const char* name, uint32 type)
 }
 
 
+/*!	Fills this newly created trigram index with the trigrams of all values
+	of the index of \a attribute, so that it knows about the same entries as
+	that one does. This must be done in the transaction that created it, so
+	that no one ever sees the trigram index only partially filled.
+	Fails with \c B_BUFFER_OVERFLOW if the attribute index has too many
+	entries to do this in a single transaction.
+*/
+status_t
+Index::FillTrigramIndex(Transaction& transaction, const char* attribute)
+{
+	Index attributeIndex(fVolume);
+	status_t status = attributeIndex.SetTo(attribute);
+	if (status != B_OK)
+		return status;
+
+	uint32 type = attributeIndex.Type();
+	if (type != B_STRING_TYPE && type != B_MIME_STRING_TYPE)
+		return B_BAD_TYPE;
+
+	BPlusTree* attributeTree = attributeIndex.Node()->Tree();
+	BPlusTree* tree = Node()->Tree();
+	if (attributeTree == NULL || tree == NULL)
+		return B_BAD_VALUE;
+
+	uint32* trigrams = (uint32*)malloc((MAX_INDEX_KEY_LENGTH + 1)
+		* sizeof(uint32));
+	if (trigrams == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter deleter(trigrams);
+
+	Node()->WriteLockInTransaction(transaction);
+
+	TreeIterator iterator(attributeTree);
+	uint8 key[BPLUSTREE_MAX_KEY_LENGTH + 1];
+	int32 count = 0;
+
+	while (true) {
+		uint16 keyLength;
+		uint16 duplicate;
+		off_t value;
+
+		status = iterator.GetNextEntry(key, &keyLength, sizeof(key), &value,
+			&duplicate);
+		if (status == B_ENTRY_NOT_FOUND)
+			break;
+		if (status != B_OK)
+			return status;
+
+		// the key is only retrieved with the first of its duplicates
+		if (duplicate < 2) {
+			count = GetTrigrams(key,
+				min_c(keyLength, MAX_INDEX_KEY_LENGTH + 1), trigrams);
+		}
+
+		for (int32 i = 0; i < count; i++) {
+			uint8 trigramKey[TRIGRAM_KEY_LENGTH];
+			GetTrigramKey(trigrams[i], trigramKey);
+
+			status = tree->Insert(transaction, trigramKey, TRIGRAM_KEY_LENGTH,
+				value);
+			if (status != B_OK)
+				return status;
+		}
+
+		if (transaction.IsTooLarge()) {
+			FATAL(("index \"%s\" is too large to build its trigram index\n",
+				attribute));
+			return B_BUFFER_OVERFLOW;
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns whether or not \a name is the name of a trigram index. A trigram
+	index "<attribute>:trigrams" contains every sequence of three consecutive
+	bytes of the values of the string attribute it belongs to, folded to
+	lower case. It allows queries to answer substring and case-insensitive
+	patterns without walking the whole attribute index.
+	These names are reserved: attributes named like this are not indexed.
+*/
+/*static*/ bool
+Index::IsTrigramIndex(const char* name)
+{
+	size_t length = strlen(name);
+	size_t suffixLength = strlen(TRIGRAM_INDEX_SUFFIX);
+
+	return length > suffixLength
+		&& !strcmp(name + length - suffixLength, TRIGRAM_INDEX_SUFFIX);
+}
+
+
+/*!	Fills \a name with the name of the trigram index of \a attribute; the
+	buffer must be at least B_FILE_NAME_LENGTH bytes large.
+*/
+/*static*/ status_t
+Index::GetTrigramIndexName(const char* attribute, char* name)
+{
+	if (strlcpy(name, attribute, B_FILE_NAME_LENGTH) >= B_FILE_NAME_LENGTH
+		|| strlcat(name, TRIGRAM_INDEX_SUFFIX, B_FILE_NAME_LENGTH)
+			>= B_FILE_NAME_LENGTH)
+		return B_NAME_TOO_LONG;
+
+	return B_OK;
+}
+
+
+static inline uint8
+fold_case(uint8 c)
+{
+	// only ASCII characters are folded, the bytes of multi-byte UTF-8
+	// characters are taken as they are
+	if (c >= 'A' && c <= 'Z')
+		return c + 'a' - 'A';
+	return c;
+}
+
+
+/*static*/ uint32
+Index::MakeTrigram(uint8 a, uint8 b, uint8 c)
+{
+	return ((uint32)fold_case(a) << 16) | ((uint32)fold_case(b) << 8)
+		| fold_case(c);
+}
+
+
+/*!	Converts a trigram to its index key. The keys sort in the same order as
+	the trigrams themselves.
+*/
+/*static*/ void
+Index::GetTrigramKey(uint32 trigram, uint8* key)
+{
+	key[0] = (trigram >> 16) & 0xff;
+	key[1] = (trigram >> 8) & 0xff;
+	key[2] = trigram & 0xff;
+}
+
+
+static int
+compare_trigrams(const void* _a, const void* _b)
+{
+	uint32 a = *(const uint32*)_a;
+	uint32 b = *(const uint32*)_b;
+
+	if (a < b)
+		return -1;
+	return a > b ? 1 : 0;
+}
+
+
+/*!	Stores the sorted and unique trigrams of the string \a key in
+	\a trigrams, and returns their number. The array must be able to hold
+	at least \a length entries.
+*/
+/*static*/ int32
+Index::GetTrigrams(const uint8* key, uint16 length, uint32* trigrams)
+{
+	// the terminating null byte might be part of the key
+	const uint8* end = (const uint8*)memchr(key, '\0', length);
+	if (end != NULL)
+		length = end - key;
+
+	if (length < TRIGRAM_KEY_LENGTH)
+		return 0;
+
+	int32 count = 0;
+	for (uint16 i = 0; i + TRIGRAM_KEY_LENGTH <= length; i++)
+		trigrams[count++] = MakeTrigram(key[i], key[i + 1], key[i + 2]);
+
+	qsort(trigrams, count, sizeof(uint32), &compare_trigrams);
+
+	int32 unique = 1;
+	for (int32 i = 1; i < count; i++) {
+		if (trigrams[i] != trigrams[unique - 1])
+			trigrams[unique++] = trigrams[i];
+	}
+
+	return unique;
+}
+
+
 /*!	Updates the specified index, the oldKey will be removed from, the newKey
 	inserted into the tree.
 	If the method returns B_BAD_INDEX, it means the index couldn't be found -
@@ -245,6 +428,19 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 	fVolume->UpdateLiveQueries(inode, name, type, oldKey, oldLength,
 		newKey, newLength);
 
+	// the names of trigram indices are reserved
+	if (IsTrigramIndex(name))
+		return B_BAD_INDEX;
+
+	// the trigram index is maintained independently from the attribute
+	// index, as it is useful even without it
+	if (type == B_STRING_TYPE && fVolume->HasTrigramIndices()) {
+		status_t status = _UpdateTrigrams(transaction, name, oldKey,
+			oldLength, newKey, newLength, inode);
+		if (status != B_OK)
+			return status;
+	}
+
 	if (((name != fName || strcmp(name, fName)) && SetTo(name) != B_OK)
 		|| fNode == NULL)
 		return B_BAD_INDEX;
@@ -258,6 +454,7 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 	Node()->WriteLockInTransaction(transaction);
 
 	status_t status = B_OK;
+	int32 delta = 0;
 
 	if (oldKey != NULL) {
 		status = tree->Remove(transaction, (const uint8*)oldKey, oldLength,
@@ -267,6 +464,8 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 			INFORM(("Could not find value in index \"%s\"!\n", name));
 		} else if (status != B_OK)
 			return status;
+		else
+			delta--;
 	}
 
 	// add the new key to the tree
@@ -274,8 +473,104 @@ Index::Update(Transaction& transaction, const char* name, int32 type,
 	if (newKey != NULL) {
 		status = tree->Insert(transaction, (const uint8*)newKey, newLength,
 			inode->ID());
+		if (status == B_OK)
+			delta++;
+	}
+
+	IndexStatistics* statistics = fVolume->GetIndexStatistics();
+	if (statistics != NULL)
+		statistics->Update(name, delta);
+
+	RETURN_ERROR(status);
+}
+
+
+/*!	Updates the trigram index of the attribute \a name, if there is one.
+	Only the trigrams that differ between the old and the new key are
+	removed from, or inserted into the tree.
+*/
+status_t
+Index::_UpdateTrigrams(Transaction& transaction, const char* name,
+	const uint8* oldKey, uint16 oldLength, const uint8* newKey,
+	uint16 newLength, Inode* inode)
+{
+	char indexName[B_FILE_NAME_LENGTH];
+	if (IsTrigramIndex(name)
+		|| GetTrigramIndexName(name, indexName) != B_OK)
+		return B_OK;
+
+	Index index(fVolume);
+	if (index.SetTo(indexName) != B_OK)
+		return B_OK;
+
+	BPlusTree* tree = index.Node()->Tree();
+	if (tree == NULL)
+		return B_BAD_VALUE;
+
+	uint32* oldTrigrams = (uint32*)malloc(2 * (MAX_INDEX_KEY_LENGTH + 1)
+		* sizeof(uint32));
+	if (oldTrigrams == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter deleter(oldTrigrams);
+	uint32* newTrigrams = oldTrigrams + MAX_INDEX_KEY_LENGTH + 1;
+
+	int32 oldCount = 0;
+	if (oldKey != NULL) {
+		oldCount = GetTrigrams(oldKey,
+			min_c(oldLength, MAX_INDEX_KEY_LENGTH + 1), oldTrigrams);
+	}
+	int32 newCount = 0;
+	if (newKey != NULL) {
+		newCount = GetTrigrams(newKey,
+			min_c(newLength, MAX_INDEX_KEY_LENGTH + 1), newTrigrams);
+	}
+
+	index.Node()->WriteLockInTransaction(transaction);
+
+	// both arrays are sorted, so we can just merge them
+	status_t status = B_OK;
+	int32 oldIndex = 0;
+	int32 newIndex = 0;
+	int32 delta = 0;
+
+	while (oldIndex < oldCount || newIndex < newCount) {
+		uint8 key[TRIGRAM_KEY_LENGTH];
+
+		if (newIndex == newCount || (oldIndex < oldCount
+				&& oldTrigrams[oldIndex] < newTrigrams[newIndex])) {
+			GetTrigramKey(oldTrigrams[oldIndex++], key);
+
+			status = tree->Remove(transaction, key, TRIGRAM_KEY_LENGTH,
+				inode->ID());
+			if (status == B_OK)
+				delta--;
+			else if (status == B_ENTRY_NOT_FOUND) {
+				// the value predates the index
+				status = B_OK;
+			} else
+				break;
+		} else if (oldIndex == oldCount
+			|| newTrigrams[newIndex] < oldTrigrams[oldIndex]) {
+			GetTrigramKey(newTrigrams[newIndex++], key);
+
+			status = tree->Insert(transaction, key, TRIGRAM_KEY_LENGTH,
+				inode->ID());
+			if (status != B_OK)
+				break;
+
+			delta++;
+		} else {
+			// the trigram is part of both keys
+			oldIndex++;
+			newIndex++;
+		}
 	}
 
+	IndexStatistics* statistics = fVolume->GetIndexStatistics();
+	if (statistics != NULL)
+		statistics->Update(indexName, delta);
+
 	RETURN_ERROR(status);
 }
 
@@ -395,3 +690,126 @@ Index::UpdateLastModified(Transaction& transaction, Inode* inode,
 	return status;
 }
 
+
+//	#pragma mark - IndexStatistics
+
+
+struct IndexStatistics::Entry : DoublyLinkedListLinkImpl<Entry> {
+	char	name[B_FILE_NAME_LENGTH];
+	off_t	entries;
+};
+
+
+IndexStatistics::IndexStatistics()
+	:
+	fChangeCounter(0)
+{
+	mutex_init(&fLock, "bfs index statistics");
+}
+
+
+IndexStatistics::~IndexStatistics()
+{
+	MakeEmpty();
+	mutex_destroy(&fLock);
+}
+
+
+/*!	Returns the number of entries in the index \a name, or -1 if it is not
+	known yet.
+*/
+off_t
+IndexStatistics::CountEntries(const char* name)
+{
+	MutexLocker locker(fLock);
+
+	Entry* entry = _Find(name);
+	if (entry == NULL)
+		return -1;
+
+	return entry->entries;
+}
+
+
+/*!	Returns a counter that changes with every update of any index. Pass it
+	to SetEntries() to make sure no entries were added or removed while the
+	index was counted.
+*/
+int32
+IndexStatistics::ChangeCounter()
+{
+	MutexLocker locker(fLock);
+	return fChangeCounter;
+}
+
+
+void
+IndexStatistics::SetEntries(const char* name, off_t entries,
+	int32 changeCounter)
+{
+	MutexLocker locker(fLock);
+
+	if (changeCounter != fChangeCounter || _Find(name) != NULL)
+		return;
+
+	Entry* entry = new(std::nothrow) Entry;
+	if (entry == NULL)
+		return;
+
+	strlcpy(entry->name, name, sizeof(entry->name));
+	entry->entries = entries;
+	fEntries.Add(entry);
+}
+
+
+void
+IndexStatistics::Update(const char* name, int32 delta)
+{
+	MutexLocker locker(fLock);
+
+	fChangeCounter++;
+
+	Entry* entry = _Find(name);
+	if (entry != NULL)
+		entry->entries = max_c(entry->entries + delta, 0);
+}
+
+
+void
+IndexStatistics::Remove(const char* name)
+{
+	MutexLocker locker(fLock);
+
+	fChangeCounter++;
+
+	Entry* entry = _Find(name);
+	if (entry != NULL) {
+		fEntries.Remove(entry);
+		delete entry;
+	}
+}
+
+
+void
+IndexStatistics::MakeEmpty()
+{
+	MutexLocker locker(fLock);
+
+	fChangeCounter++;
+
+	while (Entry* entry = fEntries.RemoveHead())
+		delete entry;
+}
+
+
+IndexStatistics::Entry*
+IndexStatistics::_Find(const char* name)
+{
+	EntryList::Iterator iterator = fEntries.GetIterator();
+	while (Entry* entry = iterator.Next()) {
+		if (!strcmp(entry->name, name))
+			return entry;
+	}
+
+	return NULL;
+}
@@ -14,6 +14,10 @@ class Volume;
 class Inode;
 
 
+#define TRIGRAM_INDEX_SUFFIX	":trigrams"
+#define TRIGRAM_KEY_LENGTH		3
+
+
 class Index {
 public:
 							Index(Volume* volume);
@@ -23,11 +27,22 @@ public:
 			void			Unset();
 
 			Inode*			Node() const { return fNode; };
+			const char*		Name() const { return fName; }
 			uint32			Type();
 			size_t			KeySize();
 
 			status_t		Create(Transaction& transaction, const char* name,
 								uint32 type);
+			status_t		FillTrigramIndex(Transaction& transaction,
+								const char* attribute);
+
+	static	bool			IsTrigramIndex(const char* name);
+	static	status_t		GetTrigramIndexName(const char* attribute,
+								char* name);
+	static	uint32			MakeTrigram(uint8 a, uint8 b, uint8 c);
+	static	void			GetTrigramKey(uint32 trigram, uint8* key);
+	static	int32			GetTrigrams(const uint8* key, uint16 length,
+								uint32* trigrams);
 
 			status_t		Update(Transaction& transaction, const char* name,
 								int32 type, const uint8* oldKey,
@@ -53,6 +68,12 @@ public:
 			status_t		UpdateLastModified(Transaction& transaction,
 								Inode* inode, bigtime_t modified = -1);
 
+private:
+			status_t		_UpdateTrigrams(Transaction& transaction,
+								const char* name, const uint8* oldKey,
+								uint16 oldLength, const uint8* newKey,
+								uint16 newLength, Inode* inode);
+
 private:
 							Index(const Index& other);
 							Index& operator=(const Index& other);
@@ -65,4 +86,36 @@ private:
 };
 
 
+
+/*!	Keeps track of the number of entries in the indices of a volume, so that
+	queries can estimate how expensive it is to walk an index. The count of
+	an index becomes known once it has been walked completely, and is then
+	kept up to date with every change to it.
+*/
+class IndexStatistics {
+public:
+							IndexStatistics();
+							~IndexStatistics();
+
+			off_t			CountEntries(const char* name);
+			int32			ChangeCounter();
+			void			SetEntries(const char* name, off_t entries,
+								int32 changeCounter);
+			void			Update(const char* name, int32 delta);
+			void			Remove(const char* name);
+			void			MakeEmpty();
+
+private:
+			struct Entry;
+			typedef DoublyLinkedList<Entry> EntryList;
+
+			Entry*			_Find(const char* name);
+
+private:
+			mutex			fLock;
+			EntryList		fEntries;
+			int32			fChangeCounter;
+};
+
+
 #endif	// INDEX_H
@@ -12,6 +12,10 @@
 #include "BPlusTree.h"
 #include "Index.h"
 
+#if !defined(FS_SHELL) && !defined(_BOOT_MODE)
+#	include <low_resource_manager.h>
+#endif
+
 
 #if BFS_TRACING && !defined(FS_SHELL) && !defined(_BOOT_MODE)
 namespace BFSInodeTracing {
@@ -344,7 +348,12 @@ Inode::Inode(Volume* volume, ino_t id)
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fLastTransaction(-1),
+	fDelayedSize(0),
+	fReservedBlocks(0),
+	fAllocationPending(0),
+	fDataChangeCounter(0)
 {
 	PRINT(("Inode::Inode(volume = %p, id = %Ld) @ %p\n", volume, id, this));
 
@@ -377,7 +386,12 @@ Inode::Inode(Volume* volume, Transaction& transaction, ino_t id, mode_t mode,
 	fTree(NULL),
 	fAttributes(NULL),
 	fCache(NULL),
-	fMap(NULL)
+	fMap(NULL),
+	fLastTransaction(-1),
+	fDelayedSize(0),
+	fReservedBlocks(0),
+	fAllocationPending(0),
+	fDataChangeCounter(0)
 {
 	PRINT(("Inode::Inode(volume = %p, transaction = %p, id = %Ld) @ %p\n",
 		volume, &transaction, id, this));
@@ -417,6 +431,9 @@ Inode::~Inode()
 {
 	PRINT(("Inode::~Inode() @ %p\n", this));
 
+	if (fReservedBlocks != 0)
+		fVolume->UnreserveBlocks(fReservedBlocks);
+
 	file_cache_delete(FileCache());
 	file_map_delete(Map());
 	delete fTree;
@@ -488,6 +505,65 @@ Inode::WriteLockInTransaction(Transaction& transaction)
 }
 
 
+/*!	Locks the file data from \a start to \a end (exclusive) against other
+	writers; it waits until no other locked range overlaps with it.
+	Must not be called with a transaction running, or the inode locked.
+*/
+void
+Inode::LockRange(locked_range& range, off_t start, off_t end)
+{
+	range.start = start;
+	range.end = end;
+
+#ifdef FS_SHELL
+	// there is no one to run in parallel with, anyway
+	mutex_lock(&fVolume->RangeLock());
+#else
+	range.condition.Init(&range, "bfs locked range");
+
+	MutexLocker locker(fVolume->RangeLock());
+
+	while (true) {
+		locked_range* other = NULL;
+		LockedRangeList::Iterator iterator = fLockedRanges.GetIterator();
+		while (iterator.HasNext()) {
+			locked_range* next = iterator.Next();
+			if (next->start < end && start < next->end) {
+				other = next;
+				break;
+			}
+		}
+		if (other == NULL)
+			break;
+
+		ConditionVariableEntry entry;
+		other->condition.Add(&entry);
+		locker.Unlock();
+
+		entry.Wait();
+
+		locker.Lock();
+	}
+
+	fLockedRanges.Add(&range);
+#endif
+}
+
+
+void
+Inode::UnlockRange(locked_range& range)
+{
+#ifdef FS_SHELL
+	mutex_unlock(&fVolume->RangeLock());
+#else
+	MutexLocker locker(fVolume->RangeLock());
+
+	fLockedRanges.Remove(&range);
+	range.condition.NotifyAll();
+#endif
+}
+
+
 status_t
 Inode::WriteBack(Transaction& transaction)
 {
@@ -496,6 +572,7 @@ Inode::WriteBack(Transaction& transaction)
 		return B_IO_ERROR;
 
 	memcpy(node.WritableNode(), &Node(), sizeof(bfs_inode));
+	fLastTransaction = transaction.ID();
 	return B_OK;
 }
 
@@ -563,7 +640,9 @@ Inode::_MakeSpaceForSmallData(Transaction& transaction, bfs_inode* node,
 		int32 index = 0, maxIndex = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
 			// should not remove those
-			if (*item->Name() == FILE_NAME_NAME || !strcmp(name, item->Name()))
+			if (*item->Name() == FILE_NAME_NAME
+				|| *item->Name() == INLINE_DATA_NAME
+				|| !strcmp(name, item->Name()))
 				continue;
 
 			if (max == NULL || max->Size() < item->Size()) {
@@ -1469,17 +1548,34 @@ Inode::FindBlockRun(off_t pos, block_run& run, off_t& offset)
 
 			off_t start = pos - data->MaxIndirectRange();
 			int32 index = start / indirectSize;
+			int32 arrayLength = data->double_indirect.Length();
+
+			// Streams are usually read sequentially, so start reading in the
+			// rest of the array blocks while we're at it
+			off_t arrayBlock = fVolume->ToBlock(data->double_indirect)
+				+ index / runsPerBlock;
+			if (index / runsPerBlock + 1 < arrayLength) {
+				fVolume->Prefetch(arrayBlock + 1,
+					arrayLength - index / runsPerBlock - 1);
+			}
 
-			block_run* indirect = (block_run*)cached.SetTo(
-				fVolume->ToBlock(data->double_indirect) + index / runsPerBlock);
+			block_run* indirect = (block_run*)cached.SetTo(arrayBlock);
 			if (indirect == NULL)
 				RETURN_ERROR(B_ERROR);
 
 			int32 current = (start % indirectSize) / directSize;
 
-			indirect = (block_run*)cached.SetTo(
-				fVolume->ToBlock(indirect[index % runsPerBlock])
-				+ current / runsPerBlock);
+			// Likewise, read in the rest of this indirect run's blocks
+			block_run indirectRun = indirect[index % runsPerBlock];
+			int32 indirectLength = indirectRun.Length();
+			off_t indirectBlock = fVolume->ToBlock(indirectRun)
+				+ current / runsPerBlock;
+			if (current / runsPerBlock + 1 < indirectLength) {
+				fVolume->Prefetch(indirectBlock + 1,
+					indirectLength - current / runsPerBlock - 1);
+			}
+
+			indirect = (block_run*)cached.SetTo(indirectBlock);
 			if (indirect == NULL)
 				RETURN_ERROR(B_ERROR);
 
@@ -1546,8 +1642,11 @@ Inode::FindBlockRun(off_t pos, block_run& run, off_t& offset)
 }
 
 
+/*!	Reads from the file's data stream. If \a direct is \c true, suitably
+	aligned requests bypass the file cache (O_DIRECT).
+*/
 status_t
-Inode::ReadAt(off_t pos, uint8* buffer, size_t* _length)
+Inode::ReadAt(off_t pos, uint8* buffer, size_t* _length, bool direct)
 {
 	size_t length = *_length;
 
@@ -1555,14 +1654,31 @@ Inode::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 	if (pos < 0)
 		return B_BAD_VALUE;
 
-	InodeReadLocker locker(this);
-
-	if (pos >= Size() || length == 0) {
+	if (length == 0) {
 		*_length = 0;
 		return B_NO_ERROR;
 	}
 
-	locker.Unlock();
+	// Only a read at the end of the file has to wait for the lock, so that
+	// reads do not queue up behind a file that is growing. If the unlocked
+	// size is outdated, the file cache limits the read to the actual size.
+	if (pos >= Size()) {
+		InodeReadLocker locker(this);
+
+		if (pos >= Size()) {
+			*_length = 0;
+			return B_NO_ERROR;
+		}
+	}
+
+	if (direct && !HasInlineData()) {
+		// writing back the cached pages of the file must not wait for us
+		status_t status = AllocateDelayed();
+		if (status != B_OK)
+			return status;
+
+		return file_cache_read_direct(FileCache(), NULL, pos, buffer, _length);
+	}
 
 	return file_cache_read(FileCache(), NULL, pos, buffer, _length);
 }
@@ -1570,8 +1686,40 @@ Inode::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 
 status_t
 Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
-	size_t* _length)
+	size_t* _length, bool direct)
 {
+	// set/check boundaries for pos/length
+	if (pos < 0)
+		return B_BAD_VALUE;
+
+	size_t length = *_length;
+	off_t end = pos + length;
+
+	// Unless the journal is already serializing us, only the range written
+	// to is locked, so that writes to other parts of the file can run in
+	// parallel. A write that grows the file locks everything from the
+	// current end of the file on, including the gap that might have to be
+	// filled with zeros.
+	InodeRangeLocker rangeLocker;
+	if (!transaction.IsStarted() && IsFile()) {
+		while (true) {
+			off_t size;
+			{
+				InodeReadLocker locker(this);
+				size = Size();
+			}
+
+			bool grows = end > size;
+			off_t lockStart = grows ? min_c(pos, size) : pos;
+			rangeLocker.Lock(this, lockStart, grows ? kEndOfFile : end);
+
+			// the file might have been truncated in the mean time
+			InodeReadLocker locker(this);
+			if (grows ? Size() >= lockStart : end <= Size())
+				break;
+		}
+	}
+
 	InodeReadLocker locker(this);
 
 	// update the last modification time in memory, it will be written
@@ -1582,35 +1730,50 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 
 	// TODO: support INODE_LOGGED!
 
-	size_t length = *_length;
-	bool changeSize = (uint64)pos + (uint64)length > (uint64)Size();
-
-	// set/check boundaries for pos/length
-	if (pos < 0)
-		return B_BAD_VALUE;
+	bool changeSize = (uint64)end > (uint64)Size();
 
 	locker.Unlock();
 
+	// data kept in the inode is always written through the file cache
+	if (HasInlineData())
+		direct = false;
+
+	if (!direct && _CanDelayAllocation())
+		return _WriteDelayed(pos, buffer, _length);
+
+	if (IsFile()) {
+		// the data may bypass the file cache, so any delayed blocks must be
+		// allocated first
+		status_t status = AllocateDelayed();
+		if (status != B_OK) {
+			*_length = 0;
+			return status;
+		}
+	}
+
 	// the transaction doesn't have to be started already
-	if (changeSize && !transaction.IsStarted())
+	bool ownTransaction = false;
+	if (changeSize && !transaction.IsStarted()) {
 		transaction.Start(fVolume, BlockNumber());
+		ownTransaction = true;
+	}
 
 	WriteLocker writeLocker(fLock);
 
 	// Work around possible race condition: Someone might have shrunken the file
 	// while we had no lock.
-	if (!transaction.IsStarted()
-		&& (uint64)pos + (uint64)length > (uint64)Size()) {
+	if (!transaction.IsStarted() && (uint64)end > (uint64)Size()) {
 		writeLocker.Unlock();
 		transaction.Start(fVolume, BlockNumber());
+		ownTransaction = true;
 		writeLocker.Lock();
 	}
 
 	off_t oldSize = Size();
 
-	if ((uint64)pos + (uint64)length > (uint64)oldSize) {
+	if ((uint64)end > (uint64)oldSize) {
 		// let's grow the data stream to the size needed
-		status_t status = SetFileSize(transaction, pos + length);
+		status_t status = SetFileSize(transaction, end);
 		if (status != B_OK) {
 			*_length = 0;
 			WriteLockInTransaction(transaction);
@@ -1632,6 +1795,17 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 
 	writeLocker.Unlock();
 
+	if (ownTransaction && rangeLocker.IsLocked()) {
+		// The range lock keeps other writers out of the part we are about to
+		// write, so the journal doesn't have to be held while the data is
+		// copied.
+		status_t status = transaction.Done();
+		if (status != B_OK) {
+			*_length = 0;
+			return status;
+		}
+	}
+
 	if (oldSize < pos)
 		FillGapWithZeros(oldSize, pos);
 
@@ -1640,10 +1814,28 @@ Inode::WriteAt(Transaction& transaction, off_t pos, const uint8* buffer,
 	if (length == 0)
 		return B_OK;
 
-	status_t status = file_cache_write(FileCache(), NULL, pos, buffer, _length);
+	status_t status;
+	if (direct) {
+		status = file_cache_write_direct(FileCache(), NULL, pos, buffer,
+			_length);
+	} else
+		status = file_cache_write(FileCache(), NULL, pos, buffer, _length);
 
 	if (transaction.IsStarted())
 		WriteLockInTransaction(transaction);
+	else if (status != B_OK && oldSize < end) {
+		// The growth has already been committed; don't leave the rest of
+		// the new blocks behind with whatever they contained before
+		Transaction undo(fVolume, BlockNumber());
+		WriteLockInTransaction(undo);
+
+		if (Size() == end
+			&& SetFileSize(undo, max_c(oldSize, pos + (off_t)*_length))
+				== B_OK
+			&& WriteBack(undo) == B_OK) {
+			undo.Done();
+		}
+	}
 
 	return status;
 }
@@ -1676,6 +1868,443 @@ Inode::FillGapWithZeros(off_t pos, off_t newSize)
 }
 
 
+/*!	Allocates the blocks for the part of the file that has only been
+	reserved by a delayed write so far.
+	If  canWait is \c false, and the journal is currently in use, this
+	method returns \c B_WOULD_BLOCK, and lets another thread do the
+	allocation instead: the page writer must not wait for a transaction that
+	may in turn be waiting for the pages it is writing.
+*/
+status_t
+Inode::AllocateDelayed(bool canWait)
+{
+	if (!HasDelayedAllocation())
+		return B_OK;
+
+	Transaction transaction;
+	status_t status = transaction.Start(fVolume, BlockNumber(), canWait);
+	if (status == B_WOULD_BLOCK) {
+		if (atomic_test_and_set(&fAllocationPending, 1, 0) == 0) {
+			acquire_vnode(fVolume->FSVolume(), ID());
+
+			thread_id thread = spawn_kernel_thread(&_AllocateDelayedThread,
+				"bfs delayed allocation", B_NORMAL_PRIORITY, this);
+			if (thread >= 0)
+				resume_thread(thread);
+			else {
+				atomic_set(&fAllocationPending, 0);
+				put_vnode(fVolume->FSVolume(), ID());
+			}
+		}
+		return B_WOULD_BLOCK;
+	}
+	if (status != B_OK)
+		return status;
+
+	// We cannot use WriteLockInTransaction() here, as we might be called
+	// from the vnode's release.
+	WriteLocker locker(fLock);
+
+	status = _AllocateDelayed(transaction);
+	status_t doneStatus = transaction.Done();
+
+	return status != B_OK ? status : doneStatus;
+}
+
+
+/*!	Delayed allocation is used for files that are written through the file
+	cache, as long as the system is not low on memory; in that case, the
+	cache would write the data back right away anyway.
+*/
+bool
+Inode::_CanDelayAllocation() const
+{
+#if defined(FS_SHELL) || defined(_BOOT_MODE)
+	return false;
+#else
+	return IsFile() && FileCache() != NULL && !HasInlineData()
+		&& low_resource_state(B_KERNEL_RESOURCE_PAGES) == B_NO_LOW_RESOURCE;
+#endif
+}
+
+
+/*!	The delayed allocation variant of WriteAt(): if the file grows, only
+	its size is changed in memory, and the blocks needed are reserved. They
+	are allocated at once when the data is written back, so that the block
+	allocator gets to see the whole range instead of many small appends, and
+	writes do not need a transaction of their own.
+*/
+status_t
+Inode::_WriteDelayed(off_t pos, const uint8* buffer, size_t* _length)
+{
+	size_t length = *_length;
+
+	WriteLocker locker(fLock);
+
+	off_t oldSize = Size();
+
+	if ((uint64)pos + (uint64)length > (uint64)oldSize) {
+		status_t status = _DelayAllocation(pos + length);
+		if (status != B_OK) {
+			*_length = 0;
+			RETURN_ERROR(status);
+		}
+	}
+
+	locker.Unlock();
+
+	// If the file cache decides to write the data out directly, the blocks
+	// must already be there; in this case, we allocate them, and try again.
+
+	if (oldSize < pos) {
+		if (FillGapWithZeros(oldSize, pos) == B_WOULD_BLOCK
+			&& AllocateDelayed() == B_OK)
+			FillGapWithZeros(oldSize, pos);
+	}
+
+	if (length == 0)
+		return B_OK;
+
+	status_t status = file_cache_write(FileCache(), NULL, pos, buffer,
+		_length);
+	if (status == B_WOULD_BLOCK) {
+		status = AllocateDelayed();
+		if (status == B_OK) {
+			*_length = length;
+			status = file_cache_write(FileCache(), NULL, pos, buffer, _length);
+		}
+	}
+
+	return status;
+}
+
+
+/*!	Grows the file to  size without allocating any blocks for it. Enough
+	blocks to cover the new size are reserved, though, so that the later
+	allocation cannot fail for lack of space.
+	The inode must be write locked.
+*/
+status_t
+Inode::_DelayAllocation(off_t size)
+{
+	const data_stream& data = Node().data;
+	off_t allocated = max_c(data.MaxDirectRange(),
+		max_c(data.MaxIndirectRange(), data.MaxDoubleIndirectRange()));
+
+	// the indirect blocks are not accounted for, but _GrowStream() will
+	// still fail gracefully in the unlikely case they do not fit anymore
+	off_t blocksNeeded = (round_up(size, fVolume->BlockSize()) - allocated)
+		>> fVolume->BlockShift();
+	if (blocksNeeded > fReservedBlocks) {
+		status_t status = fVolume->ReserveBlocks(
+			blocksNeeded - fReservedBlocks);
+		if (status != B_OK)
+			return status;
+
+		fReservedBlocks = blocksNeeded;
+	}
+
+	fDelayedSize = size;
+
+	file_cache_set_size(FileCache(), size);
+	file_map_set_size(Map(), size);
+	return B_OK;
+}
+
+
+/*!	Allocates the blocks for the delayed part of the file within
+	 transaction. The inode must be write locked.
+*/
+status_t
+Inode::_AllocateDelayed(Transaction& transaction)
+{
+	off_t oldSize = StreamSize();
+	off_t size = fDelayedSize;
+	if (size <= oldSize)
+		return B_OK;
+
+	// small files might not need any blocks at all
+	status_t status = _ResizeInlineData(transaction, size);
+	if (status != B_DEVICE_FULL) {
+		if (status != B_OK)
+			return status;
+
+		_CancelDelayedAllocation();
+		return WriteBack(transaction);
+	}
+
+	T(Resize(this, oldSize, size, false));
+
+	// The reservation is kept until the blocks have actually been allocated;
+	// _GrowStream() may use the reserved blocks.
+	status = _GrowStream(transaction, size);
+	if (status != B_OK) {
+		// the delayed part stays as is, and the allocation can be retried
+		_ShrinkStream(transaction, oldSize);
+		WriteBack(transaction);
+		return status;
+	}
+
+	fVolume->UnreserveBlocks(fReservedBlocks);
+	fReservedBlocks = 0;
+	fDelayedSize = 0;
+
+	// the file map only knew the delayed part as a sparse range
+	file_map_invalidate(Map(), oldSize, size - oldSize);
+
+	return WriteBack(transaction);
+}
+
+
+//!	Forgets about the delayed part of the file. The inode must be write locked.
+void
+Inode::_CancelDelayedAllocation()
+{
+	if (fReservedBlocks != 0) {
+		fVolume->UnreserveBlocks(fReservedBlocks);
+		fReservedBlocks = 0;
+	}
+
+	fDelayedSize = 0;
+
+	file_cache_set_size(FileCache(), StreamSize());
+	file_map_set_size(Map(), StreamSize());
+}
+
+
+/*static*/ status_t
+Inode::_AllocateDelayedThread(void* _inode)
+{
+	Inode* inode = (Inode*)_inode;
+	inode->AllocateDelayed();
+
+	atomic_set(&inode->fAllocationPending, 0);
+	put_vnode(inode->fVolume->FSVolume(), inode->ID());
+	return B_OK;
+}
+
+
+/*!	Reads the data of a file that keeps it in its small_data section
+	(INODE_INLINE_DATA). Anything beyond the end of the data is filled
+	with zeros.
+*/
+status_t
+Inode::ReadInlineData(off_t pos, uint8* buffer, size_t length)
+{
+	NodeGetter node(fVolume, this);
+	if (node.Node() == NULL)
+		return B_IO_ERROR;
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+	small_data* item = FindSmallData(node.Node(), nameTag);
+
+	size_t bytes = 0;
+	if (item != NULL && pos < item->DataSize()) {
+		bytes = min_c(length, (size_t)(item->DataSize() - pos));
+		memcpy(buffer, item->Data() + pos, bytes);
+	}
+
+	memset(buffer + bytes, 0, length - bytes);
+	return B_OK;
+}
+
+
+/*!	Stores the data of a file that keeps it in its small_data section when
+	the file cache writes it back. Anything beyond the end of the file is
+	ignored.
+	If \a canWait is \c false, and the journal is currently in use, this
+	method returns \c B_WOULD_BLOCK, and the data has to be written later,
+	for the same reason as in AllocateDelayed().
+*/
+status_t
+Inode::WriteInlineData(off_t pos, const uint8* buffer, size_t length,
+	bool canWait)
+{
+	Transaction transaction;
+	status_t status = transaction.Start(fVolume, BlockNumber(), canWait);
+	if (status != B_OK)
+		return status;
+
+	InodeReadLocker locker(this);
+
+	if (!HasInlineData()) {
+		// the data has been moved into blocks of its own in the mean time
+		locker.Unlock();
+		transaction.Done();
+		return B_BUSY;
+	}
+
+	if (pos < Size()) {
+		NodeGetter node(fVolume, transaction, this);
+		if (node.WritableNode() == NULL)
+			return B_IO_ERROR;
+
+		RecursiveLocker smallDataLocker(fSmallDataLock);
+
+		const char nameTag[2] = {INLINE_DATA_NAME, 0};
+		small_data* item = FindSmallData(node.Node(), nameTag);
+		if (item == NULL || pos >= item->DataSize())
+			RETURN_ERROR(B_BAD_DATA);
+
+		memcpy(item->Data() + pos, buffer,
+			min_c(length, (size_t)(item->DataSize() - pos)));
+	}
+
+	locker.Unlock();
+	return transaction.Done();
+}
+
+
+/*!	Returns how many bytes of file data could be kept in the small_data
+	section of \a node. There is always enough room left for the longest
+	possible name, so that renaming the file never has to move the data out
+	of the inode.
+	You need to hold the fSmallDataLock when you call this method.
+*/
+size_t
+Inode::_InlineDataCapacity(const bfs_inode* node) const
+{
+	ASSERT_LOCKED_RECURSIVE(&fSmallDataLock);
+
+	// the name and the inline data itself may change their size
+	int32 used = 0;
+	small_data* item = NULL;
+	while (_GetNextSmallData(const_cast<bfs_inode*>(node), &item) == B_OK) {
+		if (item->NameSize() == 1 && (*item->Name() == FILE_NAME_NAME
+				|| *item->Name() == INLINE_DATA_NAME))
+			continue;
+
+		used += item->Size();
+	}
+
+	int32 capacity = (int32)fVolume->InodeSize() - (int32)sizeof(bfs_inode)
+		- used
+		- (int32)(sizeof(small_data) + FILE_NAME_NAME_LENGTH + 3
+			+ B_FILE_NAME_LENGTH)
+		- (int32)(sizeof(small_data) + INLINE_DATA_NAME_LENGTH + 3 + 1)
+		- (int32)sizeof(small_data);
+
+	return capacity > 0 ? capacity : 0;
+}
+
+
+/*!	Resizes the data of a file that keeps it in its small_data section, or
+	moves the data of a file that does not have any blocks yet there, if the
+	volume supports it. The data is initialized from \a data if given,
+	otherwise the current data is kept, and the rest is cleared. A \a size
+	of zero removes the data from the inode.
+	Returns \c B_DEVICE_FULL, and leaves the file alone if the data does
+	not fit into the inode.
+	The inode must be write locked, and you need to write it back yourself.
+*/
+status_t
+Inode::_ResizeInlineData(Transaction& transaction, off_t size,
+	const uint8* data)
+{
+	if (!HasInlineData()
+		&& (!fVolume->SupportsInlineData() || !IsFile() || size == 0
+			|| StreamSize() != 0 || Node().data.MaxDirectRange() != 0))
+		return B_DEVICE_FULL;
+
+	NodeGetter node(fVolume, transaction, this);
+	if (node.WritableNode() == NULL)
+		return B_IO_ERROR;
+
+	const char nameTag[2] = {INLINE_DATA_NAME, 0};
+
+	if (size == 0) {
+		status_t status = _RemoveSmallData(transaction, node, nameTag);
+		if (status != B_OK && status != B_ENTRY_NOT_FOUND)
+			return status;
+
+		Node().flags &= HOST_ENDIAN_TO_BFS_INT32(~INODE_INLINE_DATA);
+		Node().data.size = 0;
+		return B_OK;
+	}
+
+	RecursiveLocker locker(fSmallDataLock);
+
+	if ((uint64)size > _InlineDataCapacity(node.Node()))
+		return B_DEVICE_FULL;
+
+	uint8* buffer = (uint8*)calloc(1, size);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter bufferDeleter(buffer);
+
+	if (data != NULL)
+		memcpy(buffer, data, size);
+	else {
+		small_data* item = FindSmallData(node.Node(), nameTag);
+		if (item != NULL)
+			memcpy(buffer, item->Data(), min_c((off_t)item->DataSize(), size));
+	}
+
+	status_t status = _AddSmallData(transaction, node, nameTag,
+		INLINE_DATA_TYPE, 0, buffer, size);
+	if (status != B_OK)
+		return status;
+
+	Node().flags |= HOST_ENDIAN_TO_BFS_INT32(INODE_INLINE_DATA);
+	Node().data.size = HOST_ENDIAN_TO_BFS_INT64(size);
+	return B_OK;
+}
+
+
+/*!	Moves the data of a file that keeps it in its small_data section into
+	blocks of its own, as the file is about to grow to \a size, and would no
+	longer fit.
+	The inode must be write locked.
+*/
+status_t
+Inode::_ConvertInlineData(Transaction& transaction, off_t size)
+{
+	off_t oldSize = Size();
+
+	// the file cache might have newer data than the inode
+	uint8* buffer = (uint8*)malloc(oldSize);
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+
+	MemoryDeleter bufferDeleter(buffer);
+
+	size_t length = oldSize;
+	status_t status = file_cache_read(FileCache(), NULL, 0, buffer, &length);
+	if (status == B_OK && length != (size_t)oldSize)
+		status = B_IO_ERROR;
+	if (status != B_OK)
+		return status;
+
+	T(Resize(this, oldSize, size, false));
+
+	status = _ResizeInlineData(transaction, 0);
+	if (status == B_OK)
+		status = _GrowStream(transaction, size);
+	if (status != B_OK) {
+		// the data still fits where it was before
+		_ShrinkStream(transaction, 0);
+		_ResizeInlineData(transaction, oldSize, buffer);
+		WriteBack(transaction);
+		return status;
+	}
+
+	file_cache_set_size(FileCache(), size);
+	file_map_set_size(Map(), size);
+	file_map_invalidate(Map(), 0, size);
+
+	status = WriteBack(transaction);
+	if (status != B_OK)
+		return status;
+
+	// write the data again, so that it ends up in the new blocks
+	length = oldSize;
+	return file_cache_write(FileCache(), NULL, 0, buffer, &length);
+}
+
+
 /*!	Allocates \a length blocks, and clears their contents. Growing
 	the indirect and double indirect range uses this method.
 	The allocated block_run is saved in "run"
@@ -1743,10 +2372,11 @@ Inode::_GrowStream(Transaction& transaction, off_t size)
 			minimum = data->double_indirect.Length();
 	}
 
-	// do we have enough free blocks on the disk?
+	// do we have enough free blocks on the disk? The ones reserved for our
+	// delayed allocation are ours to use.
 	off_t blocksNeeded = (bytes + fVolume->BlockSize() - 1)
 		>> fVolume->BlockShift();
-	if (blocksNeeded > fVolume->FreeBlocks())
+	if (blocksNeeded > fVolume->FreeBlocks() + fReservedBlocks)
 		return B_DEVICE_FULL;
 
 	off_t blocksRequested = blocksNeeded;
@@ -2244,12 +2874,88 @@ Inode::_ShrinkStream(Transaction& transaction, off_t size)
 }
 
 
+/*!	Replaces the blocks of the data stream with the direct \a runs, which
+	must already contain a copy of the stream's data; the previous blocks
+	are freed, including its preallocated ones.
+	The runs must cover the whole stream, and there must not be more of them
+	than fit into the direct range.
+*/
+status_t
+Inode::ReplaceStream(Transaction& transaction, const block_run* runs,
+	int32 count)
+{
+	if (count > NUM_DIRECT_BLOCKS)
+		return B_BAD_VALUE;
+
+	WriteLockInTransaction(transaction);
+
+	data_stream* data = &Node().data;
+	off_t size = data->Size();
+
+	off_t allocated = 0;
+	for (int32 i = 0; i < count; i++)
+		allocated += (off_t)runs[i].Length() << fVolume->BlockShift();
+	if (allocated < size)
+		return B_BAD_VALUE;
+
+	status_t status = _ShrinkStream(transaction, 0);
+	if (status != B_OK)
+		return status;
+
+	for (int32 i = 0; i < NUM_DIRECT_BLOCKS; i++) {
+		if (i < count)
+			data->direct[i] = runs[i];
+		else
+			data->direct[i].SetTo(0, 0, 0);
+	}
+
+	data->max_direct_range = HOST_ENDIAN_TO_BFS_INT64(allocated);
+	data->size = HOST_ENDIAN_TO_BFS_INT64(size);
+
+	// the file cache needs to learn about the new blocks
+	if (Map() != NULL)
+		file_map_invalidate(Map(), 0, size);
+
+	return WriteBack(transaction);
+}
+
+
 status_t
 Inode::SetFileSize(Transaction& transaction, off_t size)
 {
 	if (size < 0)
 		return B_BAD_VALUE;
 
+	if (HasDelayedAllocation()) {
+		if (size <= StreamSize())
+			_CancelDelayedAllocation();
+		else if (size <= fDelayedSize) {
+			// the file shrinks, but only within its delayed part
+			fDelayedSize = size;
+			file_cache_set_size(FileCache(), size);
+			file_map_set_size(Map(), size);
+			return B_OK;
+		} else {
+			status_t status = _AllocateDelayed(transaction);
+			if (status != B_OK)
+				return status;
+		}
+	}
+
+	if (HasInlineData() || size > Size()) {
+		status_t status = _ResizeInlineData(transaction, size);
+		if (status == B_OK) {
+			file_cache_set_size(FileCache(), size);
+			file_map_set_size(Map(), size);
+			return WriteBack(transaction);
+		}
+		if (status != B_DEVICE_FULL)
+			return status;
+
+		if (HasInlineData())
+			return _ConvertInlineData(transaction, size);
+	}
+
 	off_t oldSize = Size();
 
 	if (size == oldSize)
@@ -2364,8 +3070,13 @@ Inode::Free(Transaction& transaction)
 status_t
 Inode::Sync()
 {
-	if (FileCache())
+	if (FileCache()) {
+		status_t status = AllocateDelayed();
+		if (status != B_OK)
+			return status;
+
 		return file_cache_sync(FileCache());
+	}
 
 	// We may also want to flush the attribute's data stream to
 	// disk here... (do we?)
@@ -2867,8 +3578,10 @@ AttributeIterator::GetNext(char* name, size_t* _length, uint32* _type,
 
 		int32 index = 0;
 		for (; !item->IsLast(node); item = item->Next(), index++) {
-			if (item->NameSize() == FILE_NAME_NAME_LENGTH
-				&& *item->Name() == FILE_NAME_NAME)
+			if ((item->NameSize() == FILE_NAME_NAME_LENGTH
+					&& *item->Name() == FILE_NAME_NAME)
+				|| (item->NameSize() == INLINE_DATA_NAME_LENGTH
+					&& *item->Name() == INLINE_DATA_NAME))
 				continue;
 
 			if (index >= fCurrentSmallData)
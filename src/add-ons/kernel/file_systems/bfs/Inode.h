@@ -27,6 +27,24 @@ class Transaction;
 #define BFS_DO_NOT_PUBLISH_VNODE	0x80000000
 
 
+/*!	A range of a file's data that is locked against other writers, see
+	Inode::LockRange(). The end is exclusive.
+*/
+struct locked_range : DoublyLinkedListLinkImpl<locked_range> {
+	off_t				start;
+	off_t				end;
+#ifndef FS_SHELL
+	ConditionVariable	condition;
+		// notified when the range is unlocked
+#endif
+};
+
+typedef DoublyLinkedList<locked_range> LockedRangeList;
+
+static const off_t kEndOfFile = 0x7fffffffffffffffLL;
+	// the end of a range that includes everything written beyond the file
+
+
 class Inode : public TransactionListener {
 	typedef DoublyLinkedListLink<Inode> Link;
 
@@ -45,6 +63,9 @@ public:
 			rw_lock&			Lock() { return fLock; }
 			ReadLocker			ReadLock() { return ReadLocker(fLock); }
 			void				WriteLockInTransaction(Transaction& transaction);
+			void				LockRange(locked_range& range, off_t start,
+									off_t end);
+			void				UnlockRange(locked_range& range);
 
 			recursive_lock&		SmallDataLock() { return fSmallDataLock; }
 
@@ -91,7 +112,12 @@ public:
 			uint32				Type() const { return fNode.Type(); }
 			int32				Flags() const { return fNode.Flags(); }
 
-			off_t				Size() const { return fNode.data.Size(); }
+			off_t				Size() const
+									{ return max_c(fNode.data.Size(),
+										fDelayedSize); }
+			off_t				StreamSize() const
+									{ return fNode.data.Size(); }
+									// the size covered by allocated blocks
 			off_t				AllocatedSize() const;
 			off_t				LastModified() const
 									{ return fNode.LastModifiedTime(); }
@@ -145,11 +171,26 @@ public:
 			status_t			FindBlockRun(off_t pos, block_run& run,
 									off_t& offset);
 
-			status_t			ReadAt(off_t pos, uint8* buffer, size_t* length);
+			status_t			ReadAt(off_t pos, uint8* buffer, size_t* length,
+									bool direct = false);
 			status_t			WriteAt(Transaction& transaction, off_t pos,
-									const uint8* buffer, size_t* length);
+									const uint8* buffer, size_t* length,
+									bool direct = false);
 			status_t			FillGapWithZeros(off_t oldSize, off_t newSize);
 
+			bool				HasDelayedAllocation() const
+									{ return fDelayedSize > StreamSize(); }
+			status_t			AllocateDelayed(bool canWait = true);
+
+			bool				HasInlineData() const
+									{ return (Flags() & INODE_INLINE_DATA)
+										!= 0; }
+			status_t			ReadInlineData(off_t pos, uint8* buffer,
+									size_t length);
+			status_t			WriteInlineData(off_t pos,
+									const uint8* buffer, size_t length,
+									bool canWait = true);
+
 			status_t			SetFileSize(Transaction& transaction,
 									off_t size);
 			status_t			Append(Transaction& transaction, off_t bytes);
@@ -159,8 +200,17 @@ public:
 			status_t			Free(Transaction& transaction);
 			status_t			Sync();
 
+			status_t			ReplaceStream(Transaction& transaction,
+									const block_run* runs, int32 count);
+			int32				DataChangeCounter() const
+									{ return fDataChangeCounter; }
+			void				DataChanged()
+									{ atomic_add(&fDataChangeCounter, 1); }
+
 			bfs_inode&			Node() { return fNode; }
 			const bfs_inode&	Node() const { return fNode; }
+			int32				LastTransaction() const
+									{ return fLastTransaction; }
 
 			// create/remove inodes
 			status_t			Remove(Transaction& transaction,
@@ -254,6 +304,21 @@ private:
 			status_t			_ShrinkStream(Transaction& transaction,
 									off_t size);
 
+			bool				_CanDelayAllocation() const;
+			status_t			_WriteDelayed(off_t pos, const uint8* buffer,
+									size_t* _length);
+			status_t			_DelayAllocation(off_t size);
+			status_t			_AllocateDelayed(Transaction& transaction);
+			void				_CancelDelayedAllocation();
+	static	status_t			_AllocateDelayedThread(void* _inode);
+
+			size_t				_InlineDataCapacity(
+									const bfs_inode* node) const;
+			status_t			_ResizeInlineData(Transaction& transaction,
+									off_t size, const uint8* data = NULL);
+			status_t			_ConvertInlineData(Transaction& transaction,
+									off_t size);
+
 private:
 			rw_lock				fLock;
 			Volume*				fVolume;
@@ -268,6 +333,18 @@ private:
 			off_t				fOldLastModified;
 				// we need those values to ensure we will remove
 				// the correct keys from the indices
+			int32				fLastTransaction;
+				// the last transaction that wrote back the inode
+			off_t				fDelayedSize;
+			off_t				fReservedBlocks;
+			int32				fAllocationPending;
+				// file data written beyond the allocated stream; its blocks
+				// are only reserved until the data is written back
+			int32				fDataChangeCounter;
+				// incremented whenever file data is written to disk
+
+			LockedRangeList		fLockedRanges;
+				// guarded by the volume's range lock
 
 			mutable recursive_lock fSmallDataLock;
 			SinglyLinkedList<AttributeIterator> fIterators;
@@ -335,6 +412,52 @@ private:
 };
 
 
+class InodeRangeLocker {
+public:
+	InodeRangeLocker()
+		:
+		fInode(NULL)
+	{
+	}
+
+	InodeRangeLocker(Inode* inode, off_t start, off_t end)
+		:
+		fInode(NULL)
+	{
+		Lock(inode, start, end);
+	}
+
+	~InodeRangeLocker()
+	{
+		Unlock();
+	}
+
+	void Lock(Inode* inode, off_t start, off_t end)
+	{
+		Unlock();
+		inode->LockRange(fRange, start, end);
+		fInode = inode;
+	}
+
+	void Unlock()
+	{
+		if (fInode != NULL) {
+			fInode->UnlockRange(fRange);
+			fInode = NULL;
+		}
+	}
+
+	bool IsLocked() const
+	{
+		return fInode != NULL;
+	}
+
+private:
+	Inode*			fInode;
+	locked_range	fRange;
+};
+
+
 class NodeGetter : public CachedBlock {
 public:
 	NodeGetter(Volume* volume)
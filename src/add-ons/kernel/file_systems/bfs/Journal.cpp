@@ -404,6 +404,7 @@ Journal::Journal(Volume* volume)
 	fMaxTransactionSize(fLogSize / 2 - 5),
 	fUsed(0),
 	fUnwrittenTransactions(0),
+	fDetachedTransactionID(-1),
 	fHasSubtransaction(false),
 	fSeparateSubTransactions(false)
 {
@@ -758,12 +759,14 @@ Journal::_WriteTransactionToLog()
 	if (runArrays.CountBlocks() == 0) {
 		// nothing has changed during this transaction
 		if (detached) {
+			fDetachedTransactionID = fTransactionID;
 			fTransactionID = cache_detach_sub_transaction(fVolume->BlockCache(),
 				fTransactionID, NULL, NULL);
 			fUnwrittenTransactions = 1;
 		} else {
 			cache_end_transaction(fVolume->BlockCache(), fTransactionID, NULL,
 				NULL);
+			fDetachedTransactionID = -1;
 			fUnwrittenTransactions = 0;
 		}
 		return B_OK;
@@ -889,6 +892,7 @@ Journal::_WriteTransactionToLog()
 	mutex_unlock(&fEntriesLock);
 
 	if (detached) {
+		fDetachedTransactionID = fTransactionID;
 		fTransactionID = cache_detach_sub_transaction(fVolume->BlockCache(),
 			fTransactionID, _TransactionWritten, logEntry);
 		fUnwrittenTransactions = 1;
@@ -903,7 +907,14 @@ Journal::_WriteTransactionToLog()
 	} else {
 		cache_end_transaction(fVolume->BlockCache(), fTransactionID,
 			_TransactionWritten, logEntry);
+		fDetachedTransactionID = -1;
 		fUnwrittenTransactions = 0;
+
+		// The blocks freed by the transaction can now be discarded; with a
+		// detached sub transaction, this has to wait, as it might have freed
+		// blocks as well.
+		if (status == B_OK)
+			fVolume->Allocator().FreedBlocksCommitted();
 	}
 
 	return status;
@@ -943,6 +954,42 @@ Journal::_FlushLog(bool canWait, bool flushBlocks)
 }
 
 
+/*!	Makes sure the transaction with the given ID is in the log on disk.
+	If it is still part of the current batch, all transactions that have been
+	batched together so far are written into the log as a single entry. This
+	is a group commit: callers that had to wait for another commit in progress
+	will usually find their transaction already written by it, and return
+	without any I/O of their own.
+	Unlike FlushLogAndBlocks(), this does not write back the blocks to their
+	final location.
+*/
+status_t
+Journal::Commit(int32 transactionID)
+{
+	status_t status = recursive_lock_lock(&fLock);
+	if (status != B_OK)
+		return status;
+
+	if (transactionID == fDetachedTransactionID) {
+		// Only the main part of that transaction has been written to the
+		// log; the changes might also have been part of the sub transaction
+		// that was detached from it, and now lives on as the current one.
+		transactionID = fTransactionID;
+	}
+
+	if (recursive_lock_get_recursion(&fLock) == 1
+		&& transactionID == fTransactionID && fUnwrittenTransactions != 0
+		&& _TransactionSize() != 0) {
+		status = _WriteTransactionToLog();
+		if (status < B_OK)
+			FATAL(("writing current log entry failed: %s\n", strerror(status)));
+	}
+
+	recursive_lock_unlock(&fLock);
+	return status;
+}
+
+
 /*!	Flushes the current log entry to disk, and also writes back all dirty
 	blocks for this volume (completing all open transactions).
 */
@@ -953,10 +1000,54 @@ Journal::FlushLogAndBlocks()
 }
 
 
+/*!	Changes the size of the log area to \a length blocks. The log must not
+	contain any transactions while its size changes, so all pending
+	transactions are written back first. The caller is responsible for the
+	blocks that are added to, or removed from the log area.
+	Fails with \c B_BUSY if called from inside a transaction, or if the log
+	could not be emptied.
+*/
 status_t
-Journal::Lock(Transaction* owner, bool separateSubTransactions)
+Journal::Resize(uint32 length)
 {
-	status_t status = recursive_lock_lock(&fLock);
+	RecursiveLocker locker(fLock);
+	if (recursive_lock_get_recursion(&fLock) > 1) {
+		// we can't do this from inside a transaction
+		return B_BUSY;
+	}
+
+	if (fUnwrittenTransactions != 0 && _TransactionSize() != 0) {
+		status_t status = _WriteTransactionToLog();
+		if (status != B_OK)
+			return status;
+	}
+
+	status_t status = fVolume->FlushDevice();
+	if (status != B_OK)
+		return status;
+
+	MutexLocker entriesLocker(fEntriesLock);
+	if (!fEntries.IsEmpty() || fVolume->LogStart() != fVolume->LogEnd())
+		return B_BUSY;
+
+	disk_super_block& superBlock = fVolume->SuperBlock();
+	superBlock.log_blocks.length = HOST_ENDIAN_TO_BFS_INT16(length);
+	superBlock.log_start = superBlock.log_end = 0;
+	fVolume->LogStart() = fVolume->LogEnd() = 0;
+
+	fLogSize = length;
+	fMaxTransactionSize = fLogSize / 2 - 5;
+	fUsed = 0;
+
+	return fVolume->WriteSuperBlock();
+}
+
+
+status_t
+Journal::Lock(Transaction* owner, bool separateSubTransactions, bool canWait)
+{
+	status_t status = canWait ? recursive_lock_lock(&fLock)
+		: recursive_lock_trylock(&fLock);
 	if (status != B_OK)
 		return status;
 
@@ -995,6 +1086,7 @@ Journal::Lock(Transaction* owner, bool separateSubTransactions)
 
 		cache_add_transaction_listener(fVolume->BlockCache(), fTransactionID,
 			TRANSACTION_IDLE, _TransactionIdle, this);
+		fVolume->Allocator().TransactionStarted();
 	}
 	return B_OK;
 }
@@ -1012,6 +1104,8 @@ Journal::Unlock(Transaction* owner, bool success)
 			if (status != B_OK)
 				return status;
 
+			fVolume->Allocator().TransactionDone(success);
+
 			// Unlocking the inodes might trigger new transactions, but we
 			// cannot reuse the current one anymore, as this one is already
 			// closed.
@@ -1155,18 +1249,18 @@ TransactionListener::~TransactionListener()
 
 
 status_t
-Transaction::Start(Volume* volume, off_t refBlock)
+Transaction::Start(Volume* volume, off_t refBlock, bool canWait)
 {
 	// has it already been started?
 	if (fJournal != NULL)
 		return B_OK;
 
 	fJournal = volume->GetJournal(refBlock);
-	if (fJournal != NULL && fJournal->Lock(this, false) == B_OK)
+	if (fJournal != NULL && fJournal->Lock(this, false, canWait) == B_OK)
 		return B_OK;
 
 	fJournal = NULL;
-	return B_ERROR;
+	return canWait ? B_ERROR : B_WOULD_BLOCK;
 }
 
 
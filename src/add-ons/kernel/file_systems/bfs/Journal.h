@@ -26,7 +26,8 @@ public:
 			status_t		InitCheck();
 
 			status_t		Lock(Transaction* owner,
-								bool separateSubTransactions);
+								bool separateSubTransactions,
+								bool canWait = true);
 			status_t		Unlock(Transaction* owner, bool success);
 
 			status_t		ReplayLog();
@@ -35,7 +36,9 @@ public:
 			size_t			CurrentTransactionSize() const;
 			bool			CurrentTransactionTooLarge() const;
 
+			status_t		Commit(int32 transactionID);
 			status_t		FlushLogAndBlocks();
+			status_t		Resize(uint32 length);
 			Volume*			GetVolume() const { return fVolume; }
 			int32			TransactionID() const { return fTransactionID; }
 
@@ -74,6 +77,7 @@ private:
 			LogEntryList	fEntries;
 			bigtime_t		fTimestamp;
 			int32			fTransactionID;
+			int32			fDetachedTransactionID;
 			bool			fHasSubtransaction;
 			bool			fSeparateSubTransactions;
 };
@@ -132,7 +136,7 @@ public:
 			fJournal->Unlock(this, false);
 	}
 
-	status_t Start(Volume* volume, off_t refBlock);
+	status_t Start(Volume* volume, off_t refBlock, bool canWait = true);
 	bool IsStarted() const { return fJournal != NULL; }
 
 	status_t Done()
@@ -41,6 +41,32 @@
 using namespace QueryParser;
 
 
+static const off_t kMaxCost = 1LL << 62;
+static const off_t kMaxProbeEntries = 256;
+static const off_t kEstimatedEntriesPerNode = 32;
+static const int32 kMaxTrigramProbes = 8;
+static const int32 kMaxCachedQueries = 32;
+static const size_t kMaxCachedResultsSize = 64 * 1024;
+
+
+struct CachedQuery : DoublyLinkedListLinkImpl<CachedQuery> {
+	char*		query;
+	uint32		flags;
+	const char*	attributes;
+	size_t		attributesSize;
+	uint8*		results;
+	size_t		resultsSize;
+	int32		referenceCount;
+};
+
+
+static inline size_t
+aligned_result_size(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+
 enum ops {
 	OP_NONE,
 
@@ -88,8 +114,8 @@ public:
 									size_t size = 0) = 0;
 	virtual	void				Complement() = 0;
 
-	virtual	void				CalculateScore(Index& index) = 0;
-	virtual	int32				Score() const = 0;
+	virtual	void				CalculateCost(Volume* volume, Index& index) = 0;
+	virtual	off_t				Cost() const = 0;
 
 	virtual	status_t			InitCheck() = 0;
 
@@ -134,8 +160,10 @@ public:
 									TreeIterator* iterator,
 									struct dirent* dirent, size_t bufferSize);
 
-	virtual	void				CalculateScore(Index &index);
-	virtual	int32				Score() const { return fScore; }
+	virtual	void				CalculateCost(Volume* volume, Index& index);
+	virtual	off_t				Cost() const { return fCost; }
+
+			const char*			Attribute() const { return fAttribute; }
 
 #ifdef DEBUG
 	virtual	void				PrintToStream();
@@ -152,6 +180,14 @@ private:
 	inline	bool				_IsOperatorChar(char c) const;
 			status_t			_ConvertValue(type_code type);
 			bool				_CompareTo(const uint8* value, uint16 size);
+			void				_CalculateIndexCost(Volume* volume,
+									Index& index);
+			off_t				_CalculateTrigramCost(Volume* volume,
+									Index& index);
+			int32				_GetPatternTrigrams(uint32* trigrams,
+									int32 maxCount) const;
+			off_t				_EstimateEntries(Volume* volume,
+									Index& index);
 			uint8*				_Value() const { return (uint8*)&fValue; }
 
 private:
@@ -163,8 +199,16 @@ private:
 			bool				fIsPattern;
 			bool				fIsSpecialTime;
 
-			int32				fScore;
+			off_t				fCost;
 			bool				fHasIndex;
+
+			bool				fCountEntries;
+			off_t				fEntriesSeen;
+			int32				fChangeCounter;
+
+			bool				fUseTrigrams;
+			uint8				fTrigramKey[TRIGRAM_KEY_LENGTH];
+			char				fTrigramIndex[B_FILE_NAME_LENGTH];
 };
 
 
@@ -185,8 +229,8 @@ public:
 									size_t size = 0);
 	virtual	void				Complement();
 
-	virtual	void				CalculateScore(Index& index);
-	virtual	int32				Score() const;
+	virtual	void				CalculateCost(Volume* volume, Index& index);
+	virtual	off_t				Cost() const;
 
 	virtual	status_t			InitCheck();
 
@@ -214,7 +258,11 @@ Equation::Equation(char** _expression)
 	fAttribute(NULL),
 	fString(NULL),
 	fType(0),
-	fIsPattern(false)
+	fIsPattern(false),
+	fCost(0),
+	fHasIndex(false),
+	fCountEntries(false),
+	fUseTrigrams(false)
 {
 	char* string = *_expression;
 	char* start = string;
@@ -480,10 +528,35 @@ Equation::Complement()
 
 
 status_t
-Equation::PrepareQuery(Volume* /*volume*/, Index& index,
+Equation::PrepareQuery(Volume* volume, Index& index,
 	TreeIterator** iterator, bool queryNonIndexed)
 {
-	status_t status = index.SetTo(fAttribute);
+	fCountEntries = false;
+
+	if (fUseTrigrams) {
+		// The trigram index only narrows down the candidates, every one of
+		// them is matched against the whole pattern
+		fHasIndex = false;
+
+		if (index.SetTo(fTrigramIndex) != B_OK
+			|| _ConvertValue(B_STRING_TYPE) != B_OK)
+			return B_ENTRY_NOT_FOUND;
+
+		BPlusTree* tree = index.Node()->Tree();
+		if (tree == NULL)
+			return B_ERROR;
+
+		*iterator = new(std::nothrow) TreeIterator(tree);
+		if (*iterator == NULL)
+			return B_NO_MEMORY;
+
+		(*iterator)->SetPrefetchValues(true);
+		return (*iterator)->Find(fTrigramKey, TRIGRAM_KEY_LENGTH);
+	}
+
+	// attributes named like a trigram index are never indexed
+	status_t status = Index::IsTrigramIndex(fAttribute)
+		? B_ENTRY_NOT_FOUND : index.SetTo(fAttribute);
 
 	// if we should query attributes without an index, we can just proceed here
 	if (status != B_OK && !queryNonIndexed)
@@ -503,6 +576,15 @@ Equation::PrepareQuery(Volume* /*volume*/, Index& index,
 			return B_ENTRY_NOT_FOUND;
 
 		fHasIndex = false;
+
+		// we are going to see every entry of the name index, so we can as
+		// well count them for the statistics
+		IndexStatistics* statistics = volume->GetIndexStatistics();
+		if (statistics != NULL && statistics->CountEntries("name") < 0) {
+			fCountEntries = true;
+			fEntriesSeen = 0;
+			fChangeCounter = statistics->ChangeCounter();
+		}
 	} else {
 		fHasIndex = true;
 		type = index.Type();
@@ -519,6 +601,9 @@ Equation::PrepareQuery(Volume* /*volume*/, Index& index,
 	if (*iterator == NULL)
 		return B_NO_MEMORY;
 
+	// every matching entry will be checked against its inode
+	(*iterator)->SetPrefetchValues(true);
+
 	if ((fOp == OP_EQUAL || fOp == OP_GREATER_THAN
 			|| fOp == OP_GREATER_THAN_OR_EQUAL || fIsPattern)
 		&& fHasIndex) {
@@ -588,8 +673,22 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 
 		status_t status = iterator->GetNextEntry(&indexValue, &keyLength,
 			(uint16)sizeof(indexValue), &offset, &duplicate);
-		if (status != B_OK)
+		if (status != B_OK) {
+			IndexStatistics* statistics = volume->GetIndexStatistics();
+			if (fCountEntries && status == B_ENTRY_NOT_FOUND
+				&& statistics != NULL) {
+				statistics->SetEntries("name", fEntriesSeen, fChangeCounter);
+			}
+			fCountEntries = false;
 			return status;
+		}
+
+		fEntriesSeen++;
+
+		// all candidates of the trigram index share the same key
+		if (fUseTrigrams && (keyLength != TRIGRAM_KEY_LENGTH
+				|| memcmp(&indexValue, fTrigramKey, TRIGRAM_KEY_LENGTH) != 0))
+			return B_ENTRY_NOT_FOUND;
 
 		// only compare against the index entry when this is the correct
 		// index for the equation
@@ -683,37 +782,270 @@ Equation::GetNextMatching(Volume* volume, TreeIterator* iterator,
 }
 
 
+/*!	Estimates how many index entries have to be visited to find all entries
+	that match this equation. If the equation is a pattern, and its attribute
+	has a trigram index, that one is used instead of the attribute index
+	when it promises to be cheaper.
+*/
+void
+Equation::CalculateCost(Volume* volume, Index& index)
+{
+	fUseTrigrams = false;
+
+	_CalculateIndexCost(volume, index);
+
+	if (!fIsPattern || fOp != OP_EQUAL || !volume->HasTrigramIndices())
+		return;
+
+	// A pattern without a prefix has to look at every entry of its index,
+	// not just at the matching ones
+	off_t indexCost = fCost;
+	if (getFirstPatternSymbol(fString) <= 0 && index.Node() != NULL
+		&& !strcmp(index.Name(), fAttribute))
+		indexCost = _EstimateEntries(volume, index);
+
+	off_t trigramCost = _CalculateTrigramCost(volume, index);
+	if (trigramCost < indexCost) {
+		fCost = trigramCost;
+		fUseTrigrams = true;
+	}
+}
+
+
+/*!	Estimates the cost of the equation using its attribute index. The index
+	is probed for up to kMaxProbeEntries entries, the rest is extrapolated
+	from the index statistics.
+*/
 void
-Equation::CalculateScore(Index &index)
+Equation::_CalculateIndexCost(Volume* volume, Index& index)
 {
-	// As always, these values could be tuned and refined.
-	// And the code could also need some real world testing :-)
+	fCost = kMaxCost;
 
 	// do we have to operate on a "foreign" index?
-	if (fOp == OP_UNEQUAL || index.SetTo(fAttribute) < B_OK) {
-		fScore = 0;
+	if (fOp == OP_UNEQUAL || Index::IsTrigramIndex(fAttribute)
+		|| index.SetTo(fAttribute) != B_OK) {
+		// we would have to walk the whole name index, any real index is to
+		// be preferred over it
+		if (index.SetTo("name") == B_OK) {
+			fCost = _EstimateEntries(volume, index)
+				+ (fOp == OP_UNEQUAL ? 0 : 1);
+		}
 		return;
 	}
 
-	// if we have a pattern, how much does it help our search?
-	if (fIsPattern)
-		fScore = getFirstPatternSymbol(fString) << 3;
-	else {
-		// Score by operator
-		if (fOp == OP_EQUAL)
-			// higher than pattern="255 chars+*"
-			fScore = 2048;
-		else
-			// the pattern search is regarded cheaper when you have at
-			// least one character to set your index to
-			fScore = 5;
+	TreeIterator* iterator = NULL;
+	status_t status = PrepareQuery(volume, index, &iterator, false);
+	ObjectDeleter<TreeIterator> iteratorDeleter(iterator);
+	if (status != B_OK) {
+		// there is no matching entry at all
+		if (status == B_ENTRY_NOT_FOUND)
+			fCost = 0;
+		return;
 	}
 
-	// take index size into account (1024 is the current node size
-	// in our B+trees)
-	// 2048 * 2048 == 4194304 is the maximum score (for an empty
-	// tree, since the header + 1 node are already 2048 bytes)
-	fScore = fScore * ((2048 * 1024LL) / index.Node()->Size());
+	// don't read in the inodes just to find out how many there are
+	iterator->SetPrefetchValues(false);
+
+	// PrepareQuery() only positions the iterator if it can
+	bool fromStart = fIsPattern ? getFirstPatternSymbol(fString) <= 0
+		: fOp == OP_LESS_THAN || fOp == OP_LESS_THAN_OR_EQUAL;
+
+	IndexStatistics* statistics = volume->GetIndexStatistics();
+	int32 changeCounter = statistics != NULL
+		? statistics->ChangeCounter() : 0;
+
+	off_t visited = 0;
+	off_t matching = 0;
+	bool keyMatches = false;
+
+	while (visited < kMaxProbeEntries) {
+		union value indexValue;
+		uint16 keyLength;
+		uint16 duplicate;
+		off_t offset;
+
+		status = iterator->GetNextEntry(&indexValue, &keyLength,
+			(uint16)sizeof(indexValue), &offset, &duplicate);
+		if (status != B_OK) {
+			// we have seen all there is
+			if (fromStart && status == B_ENTRY_NOT_FOUND && statistics != NULL)
+				statistics->SetEntries(index.Name(), visited, changeCounter);
+
+			fCost = matching;
+			return;
+		}
+
+		visited++;
+
+		if (duplicate < 2)
+			keyMatches = _CompareTo((uint8*)&indexValue, keyLength);
+
+		if (keyMatches)
+			matching++;
+		else if (fOp == OP_LESS_THAN || fOp == OP_LESS_THAN_OR_EQUAL
+			|| (fOp == OP_EQUAL && !fIsPattern)) {
+			// there won't be any more matches
+			fCost = matching;
+			return;
+		}
+	}
+
+	// Extrapolate the rest from the entries we've seen so far - if the
+	// iterator could be positioned, we assume it starts in the middle of
+	// the index
+	off_t remaining = _EstimateEntries(volume, index) / (fromStart ? 1 : 2)
+		- visited;
+	fCost = matching + max_c(remaining, 0) * matching / visited;
+}
+
+
+/*!	Looks up the trigrams of the pattern in the trigram index of the
+	attribute, and chooses the one with the fewest entries for the query.
+	Returns the number of entries of that trigram, or kMaxCost if the
+	trigram index cannot be used.
+	The trigram index has been filled from the attribute index when it was
+	created, so a trigram it does not contain cannot match anything the
+	attribute index knows about.
+*/
+off_t
+Equation::_CalculateTrigramCost(Volume* volume, Index& index)
+{
+	if (Index::GetTrigramIndexName(fAttribute, fTrigramIndex) != B_OK
+		|| index.SetTo(fTrigramIndex) != B_OK)
+		return kMaxCost;
+
+	BPlusTree* tree = index.Node()->Tree();
+	if (tree == NULL)
+		return kMaxCost;
+
+	uint32 trigrams[kMaxTrigramProbes];
+	int32 count = _GetPatternTrigrams(trigrams, kMaxTrigramProbes);
+
+	off_t cost = kMaxCost;
+	for (int32 i = 0; i < count && cost > 0; i++) {
+		uint8 key[TRIGRAM_KEY_LENGTH];
+		Index::GetTrigramKey(trigrams[i], key);
+
+		TreeIterator iterator(tree);
+		off_t entries = 0;
+
+		if (iterator.Find(key, TRIGRAM_KEY_LENGTH) == B_OK) {
+			while (entries < kMaxProbeEntries) {
+				union value indexValue;
+				uint16 keyLength;
+				uint16 duplicate;
+				off_t offset;
+
+				if (iterator.GetNextEntry(&indexValue, &keyLength,
+						(uint16)sizeof(indexValue), &offset, &duplicate) != B_OK
+					|| keyLength != TRIGRAM_KEY_LENGTH
+					|| memcmp(&indexValue, key, TRIGRAM_KEY_LENGTH) != 0)
+					break;
+
+				entries++;
+			}
+		}
+
+		// a trigram that common won't help much
+		if (entries < kMaxProbeEntries && entries < cost) {
+			memcpy(fTrigramKey, key, TRIGRAM_KEY_LENGTH);
+			cost = entries;
+		}
+	}
+
+	return cost;
+}
+
+
+/*!	Collects the trigrams that every string matching the pattern must
+	contain. Only runs of at least three literal characters contribute to
+	them; a set like "[aA]" counts as a literal, as trigrams ignore the case
+	anyway. Returns the number of trigrams found.
+*/
+int32
+Equation::_GetPatternTrigrams(uint32* trigrams, int32 maxCount) const
+{
+	const char* pattern = fString;
+	uint8 run[TRIGRAM_KEY_LENGTH];
+	int32 runLength = 0;
+	int32 count = 0;
+
+	while (*pattern != '\0' && count < maxCount) {
+		char c = *pattern++;
+		bool literal = true;
+
+		switch (c) {
+			case '*':
+			case '?':
+				literal = false;
+				break;
+
+			case '\\':
+				c = *pattern++;
+				if (c == '\0')
+					return 0;
+				break;
+
+			case '[':
+				if ((pattern[0] | 0x20) >= 'a' && (pattern[0] | 0x20) <= 'z'
+					&& (pattern[0] | 0x20) == (pattern[1] | 0x20)
+					&& pattern[2] == ']') {
+					c = pattern[0];
+					pattern += 3;
+					break;
+				}
+
+				// any other set ends the run
+				literal = false;
+				while (*pattern != ']') {
+					if (*pattern == '\\')
+						pattern++;
+					if (*pattern == '\0')
+						return 0;
+					pattern++;
+				}
+				pattern++;
+				break;
+		}
+
+		if (!literal) {
+			runLength = 0;
+			continue;
+		}
+
+		if (runLength == TRIGRAM_KEY_LENGTH) {
+			run[0] = run[1];
+			run[1] = run[2];
+			runLength--;
+		}
+		run[runLength++] = c;
+
+		if (runLength == TRIGRAM_KEY_LENGTH)
+			trigrams[count++] = Index::MakeTrigram(run[0], run[1], run[2]);
+	}
+
+	return count;
+}
+
+
+/*!	Returns the number of entries in the index, either as known by the index
+	statistics, or as guessed from the size of its B+tree.
+*/
+off_t
+Equation::_EstimateEntries(Volume* volume, Index& index)
+{
+	IndexStatistics* statistics = volume->GetIndexStatistics();
+	if (statistics != NULL) {
+		off_t entries = statistics->CountEntries(index.Name());
+		if (entries >= 0)
+			return entries;
+	}
+
+	BPlusTree* tree = index.Node()->Tree();
+	if (tree == NULL)
+		return 0;
+
+	return index.Node()->Size() / tree->NodeSize() * kEstimatedEntriesPerNode;
 }
 
 
@@ -915,19 +1247,25 @@ Operator::Match(Inode* inode, const char* attribute, int32 type,
 	const uint8* key, size_t size)
 {
 	if (fOp == OP_AND) {
-		status_t status = fLeft->Match(inode, attribute, type, key, size);
+		// start with the term that matches less entries, as it's more
+		// likely to fail
+		Term* first = fLeft;
+		Term* second = fRight;
+		if (fRight->Cost() < fLeft->Cost()) {
+			first = fRight;
+			second = fLeft;
+		}
+
+		status_t status = first->Match(inode, attribute, type, key, size);
 		if (status != MATCH_OK)
 			return status;
 
-		return fRight->Match(inode, attribute, type, key, size);
+		return second->Match(inode, attribute, type, key, size);
 	} else {
-		// choose the term with the better score for OP_OR
-		Term* first;
-		Term* second;
-		if (fRight->Score() > fLeft->Score()) {
-			first = fLeft;
-			second = fRight;
-		} else {
+		// for OP_OR, start with the term that matches more entries
+		Term* first = fLeft;
+		Term* second = fRight;
+		if (fRight->Cost() > fLeft->Cost()) {
 			first = fRight;
 			second = fLeft;
 		}
@@ -955,29 +1293,30 @@ Operator::Complement()
 
 
 void
-Operator::CalculateScore(Index &index)
+Operator::CalculateCost(Volume* volume, Index& index)
 {
-	fLeft->CalculateScore(index);
-	fRight->CalculateScore(index);
+	fLeft->CalculateCost(volume, index);
+	fRight->CalculateCost(volume, index);
 }
 
 
-int32
-Operator::Score() const
+off_t
+Operator::Cost() const
 {
-	if (fOp == OP_AND) {
-		// return the one with the better score
-		if (fRight->Score() > fLeft->Score())
-			return fRight->Score();
+	off_t left = fLeft->Cost();
+	off_t right = fRight->Cost();
 
-		return fLeft->Score();
+	if (fOp == OP_AND) {
+		// only the cheaper side is walked, the entries it finds are then
+		// matched against the other side
+		return min_c(left, right);
 	}
 
-	// for OP_OR, be honest, and return the one with the worse score
-	if (fRight->Score() < fLeft->Score())
-		return fRight->Score();
+	// for OP_OR, both sides have to be walked
+	if (left > kMaxCost - right)
+		return kMaxCost;
 
-	return fLeft->Score();
+	return left + right;
 }
 
 
@@ -1077,10 +1416,17 @@ Equation::PrintToStream()
 
 
 Expression::Expression(char* expr)
+	:
+	fString(NULL),
+	fPosition(NULL),
+	fTerm(NULL)
 {
 	if (expr == NULL)
 		return;
 
+	// keep the original query around, so that its results can be cached
+	fString = strdup(expr);
+
 	fTerm = ParseOr(&expr);
 	if (fTerm != NULL && fTerm->InitCheck() < B_OK) {
 		FATAL(("Corrupt tree in expression!\n"));
@@ -1100,6 +1446,7 @@ Expression::Expression(char* expr)
 Expression::~Expression()
 {
 	delete fTerm;
+	free(fString);
 }
 
 
@@ -1234,6 +1581,14 @@ Query::Query(Volume* volume, Expression* expression, uint32 flags)
 	fCurrent(NULL),
 	fIterator(NULL),
 	fIndex(volume),
+	fCostCalculated(false),
+	fCached(NULL),
+	fCachedOffset(0),
+	fResults(NULL),
+	fResultsSize(0),
+	fResultsAllocated(0),
+	fCacheGeneration(0),
+	fCollectResults(false),
 	fFlags(flags),
 	fPort(-1)
 {
@@ -1243,10 +1598,6 @@ Query::Query(Volume* volume, Expression* expression, uint32 flags)
 	if (volume == NULL || expression == NULL || expression->Root() == NULL)
 		return;
 
-	// create index on the stack and delete it afterwards
-	fExpression->Root()->CalculateScore(fIndex);
-	fIndex.Unset();
-
 	Rewind();
 
 	if ((fFlags & B_LIVE_QUERY) != 0)
@@ -1258,6 +1609,12 @@ Query::~Query()
 {
 	if ((fFlags & B_LIVE_QUERY) != 0)
 		fVolume->RemoveQuery(this);
+
+	delete fIterator;
+
+	if (fCached != NULL)
+		fVolume->GetQueryCache()->Put(fCached);
+	free(fResults);
 }
 
 
@@ -1272,6 +1629,38 @@ Query::Rewind()
 	fIterator = NULL;
 	fCurrent = NULL;
 
+	QueryCache* cache = fVolume->GetQueryCache();
+	if (fCached != NULL) {
+		cache->Put(fCached);
+		fCached = NULL;
+	}
+
+	free(fResults);
+	fResults = NULL;
+	fResultsSize = 0;
+	fResultsAllocated = 0;
+	fCollectResults = false;
+
+	// maybe we have run this query just recently
+
+	if (cache != NULL && fExpression->String() != NULL) {
+		fCached = cache->Lookup(fExpression->String(), fFlags,
+			fCacheGeneration);
+		if (fCached != NULL) {
+			fCachedOffset = 0;
+			return B_OK;
+		}
+
+		fCollectResults = true;
+	}
+
+	if (!fCostCalculated) {
+		// create index on the stack and delete it afterwards
+		fExpression->Root()->CalculateCost(fVolume, fIndex);
+		fIndex.Unset();
+		fCostCalculated = true;
+	}
+
 	// put the whole expression on the stack
 
 	Stack<Term*> stack;
@@ -1286,9 +1675,9 @@ Query::Rewind()
 				stack.Push(op->Left());
 				stack.Push(op->Right());
 			} else {
-				// For OP_AND, we can use the scoring system to decide which
-				// path to add
-				if (op->Right()->Score() > op->Left()->Score())
+				// For OP_AND, we only walk the index that is expected to
+				// return the fewest entries
+				if (op->Right()->Cost() < op->Left()->Cost())
 					stack.Push(op->Right());
 				else
 					stack.Push(op->Left());
@@ -1305,13 +1694,29 @@ Query::Rewind()
 status_t
 Query::GetNextEntry(struct dirent* dirent, size_t size)
 {
+	if (fCached != NULL) {
+		if (fCachedOffset >= fCached->resultsSize)
+			return B_ENTRY_NOT_FOUND;
+
+		const struct dirent* result
+			= (const struct dirent*)(fCached->results + fCachedOffset);
+		if (result->d_reclen > size)
+			return B_BUFFER_OVERFLOW;
+
+		memcpy(dirent, result, result->d_reclen);
+		fCachedOffset += aligned_result_size(result->d_reclen);
+		return B_OK;
+	}
+
 	// If we don't have an equation to use yet/anymore, get a new one
 	// from the stack
 	while (true) {
 		if (fIterator == NULL) {
 			if (!fStack.Pop(&fCurrent)
-				|| fCurrent == NULL)
+				|| fCurrent == NULL) {
+				_StoreResults();
 				return B_ENTRY_NOT_FOUND;
+			}
 
 			status_t status = fCurrent->PrepareQuery(fVolume, fIndex,
 				&fIterator, fFlags & B_QUERY_NON_INDEXED);
@@ -1334,6 +1739,7 @@ Query::GetNextEntry(struct dirent* dirent, size_t size)
 			fCurrent = NULL;
 		} else {
 			// only return if we have another entry
+			_AddResult(dirent);
 			return B_OK;
 		}
 	}
@@ -1444,3 +1850,285 @@ Query::LiveUpdateRenameMove(Inode* inode, ino_t oldDirectoryID,
 	notify_query_entry_created(fPort, fToken, fVolume->ID(),
 		newDirectoryID, newName, inode->ID());
 }
+
+
+void
+Query::_AddResult(const struct dirent* dirent)
+{
+	if (!fCollectResults)
+		return;
+
+	size_t size = aligned_result_size(dirent->d_reclen);
+	if (fResultsSize + size > kMaxCachedResultsSize) {
+		// too many results to be worth caching
+		fCollectResults = false;
+		return;
+	}
+
+	if (fResultsSize + size > fResultsAllocated) {
+		size_t allocated = min_c(max_c(fResultsAllocated * 2, 1024),
+			kMaxCachedResultsSize);
+		uint8* results = (uint8*)realloc(fResults, allocated);
+		if (results == NULL) {
+			fCollectResults = false;
+			return;
+		}
+
+		fResults = results;
+		fResultsAllocated = allocated;
+	}
+
+	memcpy(fResults + fResultsSize, dirent, dirent->d_reclen);
+	fResultsSize += size;
+}
+
+
+/*!	Passes the results of a completed query on to the cache, together with
+	the attributes it depends on.
+*/
+void
+Query::_StoreResults()
+{
+	QueryCache* cache = fVolume->GetQueryCache();
+	if (!fCollectResults || cache == NULL)
+		return;
+
+	fCollectResults = false;
+
+	// collect the names of all attributes in the expression
+
+	size_t attributesSize = 0;
+	char* attributes = NULL;
+
+	for (int32 pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			attributes = (char*)malloc(attributesSize);
+			if (attributes == NULL)
+				return;
+			attributesSize = 0;
+		}
+
+		Stack<Term*> stack;
+		stack.Push(fExpression->Root());
+
+		Term* term;
+		while (stack.Pop(&term)) {
+			if (term->Op() < OP_EQUATION) {
+				Operator* op = (Operator*)term;
+				stack.Push(op->Left());
+				stack.Push(op->Right());
+				continue;
+			}
+
+			const char* attribute = ((Equation*)term)->Attribute();
+			size_t length = strlen(attribute) + 1;
+			if (attributes != NULL)
+				memcpy(attributes + attributesSize, attribute, length);
+			attributesSize += length;
+		}
+	}
+
+	cache->Store(fExpression->String(), fFlags, attributes, attributesSize,
+		fResults, fResultsSize, fCacheGeneration);
+
+	free(attributes);
+}
+
+
+//	#pragma mark - QueryCache
+
+
+QueryCache::QueryCache(Volume* volume)
+	:
+	fVolume(volume),
+	fCount(0),
+	fGeneration(0),
+	fInTransaction(false)
+{
+	mutex_init(&fLock, "bfs query cache");
+}
+
+
+QueryCache::~QueryCache()
+{
+	while (CachedQuery* cached = fEntries.Head())
+		_Remove(cached);
+
+	mutex_destroy(&fLock);
+}
+
+
+/*!	Returns the cached results of \a query, if any. You have to Put() them
+	when you're done with them.
+	If the query is not in the cache, \a generation is set to the value you
+	need to pass to Store() when the query is complete.
+*/
+CachedQuery*
+QueryCache::Lookup(const char* query, uint32 flags, int32& generation)
+{
+	MutexLocker locker(fLock);
+
+	generation = fGeneration;
+	flags &= B_QUERY_NON_INDEXED;
+
+	CachedQueryList::Iterator iterator = fEntries.GetIterator();
+	while (CachedQuery* cached = iterator.Next()) {
+		if (cached->flags != flags || strcmp(cached->query, query))
+			continue;
+
+		// move it to the end of the LRU list
+		fEntries.Remove(cached);
+		fEntries.Add(cached);
+
+		cached->referenceCount++;
+		return cached;
+	}
+
+	return NULL;
+}
+
+
+void
+QueryCache::Put(CachedQuery* cached)
+{
+	MutexLocker locker(fLock);
+
+	if (--cached->referenceCount == 0) {
+		free(cached->query);
+		delete cached;
+	}
+}
+
+
+/*!	Adds the results of \a query to the cache, unless an attribute has been
+	changed since the query was started.
+*/
+void
+QueryCache::Store(const char* query, uint32 flags, const char* attributes,
+	size_t attributesSize, const uint8* results, size_t resultsSize,
+	int32 generation)
+{
+	size_t querySize = strlen(query) + 1;
+
+	CachedQuery* cached = new(std::nothrow) CachedQuery;
+	if (cached == NULL)
+		return;
+
+	// the query, its attributes, and its results share a single allocation
+	cached->query = (char*)malloc(querySize + attributesSize + resultsSize);
+	if (cached->query == NULL) {
+		delete cached;
+		return;
+	}
+
+	memcpy(cached->query, query, querySize);
+	cached->flags = flags & B_QUERY_NON_INDEXED;
+	cached->attributes = cached->query + querySize;
+	cached->attributesSize = attributesSize;
+	memcpy((char*)cached->attributes, attributes, attributesSize);
+	cached->results = (uint8*)cached->attributes + attributesSize;
+	cached->resultsSize = resultsSize;
+	memcpy(cached->results, results, resultsSize);
+	cached->referenceCount = 1;
+
+	MutexLocker locker(fLock);
+
+	if (fInTransaction || generation != fGeneration) {
+		// the results may already be outdated
+		locker.Unlock();
+		free(cached->query);
+		delete cached;
+		return;
+	}
+
+	fEntries.Add(cached);
+	fCount++;
+
+	while (fCount > kMaxCachedQueries)
+		_Remove(fEntries.Head());
+}
+
+
+/*!	Removes all queries depending on \a attribute from the cache, or all of
+	them, if \a attribute is \c NULL.
+	This must be called from within the transaction that makes the change.
+	Until that transaction is done, no new results are accepted, as queries
+	running concurrently may or may not see the change.
+*/
+void
+QueryCache::Invalidate(const char* attribute)
+{
+	MutexLocker locker(fLock);
+
+	fGeneration++;
+
+	CachedQuery* cached = fEntries.Head();
+	while (cached != NULL) {
+		CachedQuery* next = fEntries.GetNext(cached);
+
+		bool dependsOn = attribute == NULL;
+		for (size_t offset = 0; !dependsOn && offset < cached->attributesSize;
+				offset += strlen(cached->attributes + offset) + 1) {
+			dependsOn = !strcmp(cached->attributes + offset, attribute);
+		}
+
+		if (dependsOn)
+			_Remove(cached);
+
+		cached = next;
+	}
+
+	if (!fInTransaction) {
+		Journal* journal = fVolume->GetJournal(0);
+		Transaction* transaction = journal != NULL
+			? journal->CurrentTransaction() : NULL;
+		if (transaction != NULL) {
+			transaction->AddListener(this);
+			fInTransaction = true;
+		}
+	}
+}
+
+
+/*!	Removes all queries from the cache. Unlike Invalidate(), this may be
+	called outside of a transaction, after the changes have been made.
+*/
+void
+QueryCache::MakeEmpty()
+{
+	MutexLocker locker(fLock);
+
+	fGeneration++;
+
+	while (CachedQuery* cached = fEntries.Head())
+		_Remove(cached);
+}
+
+
+void
+QueryCache::TransactionDone(bool success)
+{
+	MutexLocker locker(fLock);
+	fGeneration++;
+}
+
+
+void
+QueryCache::RemovedFromTransaction()
+{
+	MutexLocker locker(fLock);
+	fInTransaction = false;
+}
+
+
+void
+QueryCache::_Remove(CachedQuery* cached)
+{
+	fEntries.Remove(cached);
+	fCount--;
+
+	if (--cached->referenceCount == 0) {
+		free(cached->query);
+		delete cached;
+	}
+}
@@ -8,6 +8,7 @@
 #include "system_dependencies.h"
 
 #include "Index.h"
+#include "Journal.h"
 
 
 class Volume;
@@ -15,6 +16,7 @@ class Term;
 class Equation;
 class TreeIterator;
 class Query;
+struct CachedQuery;
 
 
 class Expression {
@@ -24,6 +26,7 @@ public:
 
 			status_t		InitCheck();
 			const char*		Position() const { return fPosition; }
+			const char*		String() const { return fString; }
 			Term*			Root() const { return fTerm; }
 
 protected:
@@ -38,6 +41,7 @@ private:
 							Expression& operator=(const Expression& other);
 								// no implementation
 
+			char*			fString;
 			char*			fPosition;
 			Term*			fTerm;
 };
@@ -63,6 +67,10 @@ public:
 
 			Expression*		GetExpression() const { return fExpression; }
 
+private:
+			void			_AddResult(const struct dirent* dirent);
+			void			_StoreResults();
+
 private:
 			Volume*			fVolume;
 			Expression*		fExpression;
@@ -70,10 +78,56 @@ private:
 			TreeIterator*	fIterator;
 			Index			fIndex;
 			Stack<Equation*> fStack;
+			bool			fCostCalculated;
+
+			CachedQuery*	fCached;
+			size_t			fCachedOffset;
+			uint8*			fResults;
+			size_t			fResultsSize;
+			size_t			fResultsAllocated;
+			int32			fCacheGeneration;
+			bool			fCollectResults;
 
 			uint32			fFlags;
 			port_id			fPort;
 			int32			fToken;
 };
 
+
+/*!	Keeps the results of recently completed queries, so that running the
+	same query again does not need to walk the indices. Any change to an
+	attribute a query depends on removes its results from the cache.
+*/
+class QueryCache : public TransactionListener {
+public:
+							QueryCache(Volume* volume);
+	virtual					~QueryCache();
+
+			CachedQuery*	Lookup(const char* query, uint32 flags,
+								int32& generation);
+			void			Put(CachedQuery* cached);
+			void			Store(const char* query, uint32 flags,
+								const char* attributes, size_t attributesSize,
+								const uint8* results, size_t resultsSize,
+								int32 generation);
+			void			Invalidate(const char* attribute);
+			void			MakeEmpty();
+
+	virtual	void			TransactionDone(bool success);
+	virtual	void			RemovedFromTransaction();
+
+private:
+			typedef DoublyLinkedList<CachedQuery> CachedQueryList;
+
+			void			_Remove(CachedQuery* cached);
+
+private:
+			Volume*			fVolume;
+			mutex			fLock;
+			CachedQueryList	fEntries;
+			int32			fCount;
+			int32			fGeneration;
+			bool			fInTransaction;
+};
+
 #endif	// QUERY_H
@@ -8,7 +8,9 @@
 
 
 #include "Attribute.h"
+#include "BPlusTree.h"
 #include "Debug.h"
+#include "Index.h"
 #include "Inode.h"
 #include "Journal.h"
 #include "Query.h"
@@ -26,6 +28,10 @@ static const int32 kDesiredAllocationGroups = 56;
 	// file on a 1 GB disk without the need for double indirect
 	// blocks).
 
+static const uint32 kMinLogSize = 512;
+	// The smallest log area (in blocks) a volume can be initialized
+	// with, or resized to; it is also the default for small volumes.
+
 
 class DeviceOpener {
 public:
@@ -281,16 +287,25 @@ Volume::Volume(fs_volume* volume)
 	fRootNode(NULL),
 	fIndicesNode(NULL),
 	fDirtyCachedBlocks(0),
+	fReservedBlocks(0),
+	fQueryCache(NULL),
+	fIndexStatistics(NULL),
+	fTrigramIndices(0),
 	fFlags(0),
 	fCheckingThread(-1)
 {
 	mutex_init(&fLock, "bfs volume");
 	mutex_init(&fQueryLock, "bfs queries");
+	mutex_init(&fRangeLock, "bfs ranges");
 }
 
 
 Volume::~Volume()
 {
+	delete fQueryCache;
+	delete fIndexStatistics;
+
+	mutex_destroy(&fRangeLock);
 	mutex_destroy(&fQueryLock);
 	mutex_destroy(&fLock);
 }
@@ -348,6 +363,12 @@ Volume::Mount(const char* deviceName, uint32 flags)
 		return B_BAD_VALUE;
 	}
 
+	if ((fSuperBlock.Features() & ~SUPER_BLOCK_KNOWN_FEATURES) != 0) {
+		FATAL(("volume uses unsupported features %#" B_PRIx32 "!\n",
+			fSuperBlock.Features() & ~SUPER_BLOCK_KNOWN_FEATURES));
+		return B_NOT_SUPPORTED;
+	}
+
 	// initialize short hands to the superblock (to save byte swapping)
 	fBlockSize = fSuperBlock.BlockSize();
 	fBlockShift = fSuperBlock.BlockShift();
@@ -377,6 +398,11 @@ Volume::Mount(const char* deviceName, uint32 flags)
 		return status;
 	}
 
+	fQueryCache = new(std::nothrow) QueryCache(this);
+	fIndexStatistics = new(std::nothrow) IndexStatistics;
+	if (fQueryCache == NULL || fIndexStatistics == NULL)
+		return B_NO_MEMORY;
+
 	// replaying the log is the first thing we will do on this disk
 	status = fJournal->ReplayLog();
 	if (status != B_OK) {
@@ -421,6 +447,7 @@ Volume::Mount(const char* deviceName, uint32 flags)
 				}
 			} else {
 				// we don't use the vnode layer to access the indices node
+				_CountTrigramIndices();
 			}
 		} else {
 			FATAL(("could not create root node: publish_vnode() failed!\n"));
@@ -444,6 +471,7 @@ Volume::Unmount()
 {
 	put_vnode(fVolume, ToVnode(Root()));
 
+	fBlockAllocator.StopDiscarding();
 	fBlockAllocator.Uninitialize();
 
 	// This will also flush the log & all blocks to disk
@@ -452,6 +480,11 @@ Volume::Unmount()
 
 	delete fIndicesNode;
 
+	delete fQueryCache;
+	fQueryCache = NULL;
+	delete fIndexStatistics;
+	fIndexStatistics = NULL;
+
 	block_cache_delete(fBlockCache, !IsReadOnly());
 	close(fDevice);
 
@@ -466,6 +499,110 @@ Volume::Sync()
 }
 
 
+/*!	Reserves \a numBlocks free blocks for a later allocation, so that
+	delayed allocations cannot run out of space when they are finally made.
+	Reserved blocks are no longer counted as free.
+*/
+status_t
+Volume::ReserveBlocks(off_t numBlocks)
+{
+	MutexLocker locker(fLock);
+
+	if (numBlocks > FreeBlocks())
+		return B_DEVICE_FULL;
+
+	fReservedBlocks += numBlocks;
+	return B_OK;
+}
+
+
+void
+Volume::UnreserveBlocks(off_t numBlocks)
+{
+	MutexLocker locker(fLock);
+
+	ASSERT(numBlocks <= fReservedBlocks);
+	fReservedBlocks -= numBlocks;
+}
+
+
+/*!	Returns the maximum number of blocks the log area can span. The log has
+	to remain a single block_run in the first allocation group.
+*/
+uint32
+Volume::MaxLogSize() const
+{
+	off_t maxSize = (1LL << AllocationGroupShift()) - ToBlock(Log());
+	if (maxSize <= 0)
+		return 0;
+
+	return min_c(maxSize, MAX_BLOCK_RUN_LENGTH);
+}
+
+
+/*!	Changes the size of the log area to \a length blocks while the volume is
+	mounted. Since the log has to stay contiguous, it can only grow as long
+	as the blocks directly behind it are still free.
+*/
+status_t
+Volume::ResizeLog(uint32 length)
+{
+	if (IsReadOnly())
+		return B_READ_ONLY_DEVICE;
+	if (length < kMinLogSize || length > MaxLogSize())
+		return B_BAD_VALUE;
+
+	off_t logEnd = ToBlock(Log()) + Log().Length();
+	uint32 oldLength = Log().Length();
+	if (length == oldLength)
+		return B_OK;
+
+	block_run run;
+	if (length > oldLength) {
+		// claim the blocks behind the current log area
+		Transaction transaction(this, 0);
+
+		status_t status = fBlockAllocator.AllocateBlocks(transaction, 0,
+			logEnd, length - oldLength, length - oldLength, run);
+		if (status != B_OK)
+			return status;
+		if (ToBlock(run) != logEnd)
+			return B_BUSY;
+
+		status = transaction.Done();
+		if (status != B_OK)
+			return status;
+	} else {
+		run = ToBlockRun(logEnd - (oldLength - length));
+		run.length = HOST_ENDIAN_TO_BFS_INT16(oldLength - length);
+	}
+
+	bool freeRun = length < oldLength;
+
+	status_t status = fJournal->Resize(length);
+	if (status != B_OK) {
+		// give back the blocks we claimed for the larger log
+		freeRun = length > oldLength;
+	}
+
+	if (freeRun) {
+		Transaction transaction(this, 0);
+
+		status_t freeStatus = Free(transaction, run);
+		if (freeStatus == B_OK)
+			freeStatus = transaction.Done();
+		if (status == B_OK)
+			status = freeStatus;
+	}
+
+	if (status == B_OK) {
+		INFORM(("bfs: log resized from %" B_PRIu32 " to %" B_PRIu32
+			" blocks\n", oldLength, length));
+	}
+	return status;
+}
+
+
 status_t
 Volume::ValidateBlockRun(block_run run)
 {
@@ -561,6 +698,13 @@ Volume::UpdateLiveQueries(Inode* inode, const char* attribute, int32 type,
 	const uint8* oldKey, size_t oldLength, const uint8* newKey,
 	size_t newLength)
 {
+	if (fQueryCache != NULL) {
+		// creating, removing, or renaming an entry changes the results of
+		// every query
+		fQueryCache->Invalidate(strcmp(attribute, "name") != 0
+			? attribute : NULL);
+	}
+
 	MutexLocker _(fQueryLock);
 
 	SinglyLinkedList<Query>::Iterator iterator = fQueries.GetIterator();
@@ -576,6 +720,9 @@ void
 Volume::UpdateLiveQueriesRenameMove(Inode* inode, ino_t oldDirectoryID,
 	const char* oldName, ino_t newDirectoryID, const char* newName)
 {
+	if (fQueryCache != NULL)
+		fQueryCache->Invalidate(NULL);
+
 	MutexLocker _(fQueryLock);
 
 	size_t oldLength = strlen(oldName);
@@ -664,7 +811,7 @@ Volume::Identify(int fd, disk_super_block* superBlock)
 
 status_t
 Volume::Initialize(int fd, const char* name, uint32 blockSize,
-	uint32 flags)
+	uint32 flags, uint32 logSize)
 {
 	// although there is no really good reason for it, we won't
 	// accept '/' in disk names (mkbfs does this, too - and since
@@ -695,24 +842,44 @@ Volume::Initialize(int fd, const char* name, uint32 blockSize,
 	// create valid superblock
 
 	fSuperBlock.Initialize(name, numBlocks, blockSize);
+	if ((flags & VOLUME_INLINE_DATA) != 0) {
+		fSuperBlock.features = HOST_ENDIAN_TO_BFS_INT32(
+			SUPER_BLOCK_FEATURE_INLINE_DATA);
+	}
 
 	// initialize short hands to the superblock (to save byte swapping)
 	fBlockSize = fSuperBlock.BlockSize();
 	fBlockShift = fSuperBlock.BlockShift();
 	fAllocationGroupShift = fSuperBlock.AllocationGroupShift();
 
-	// determine log size depending on the size of the volume
-	off_t logSize = 2048;
-	if (numBlocks <= 20480)
-		logSize = 512;
-	if (deviceSize > 1LL * 1024 * 1024 * 1024)
-		logSize = 4096;
-
 	// since the allocator has not been initialized yet, we
 	// cannot use BlockAllocator::BitmapSize() here
 	off_t bitmapBlocks = (numBlocks + blockSize * 8 - 1) / (blockSize * 8);
 
 	fSuperBlock.log_blocks = ToBlockRun(bitmapBlocks + 1);
+
+	if (logSize != 0) {
+		if (logSize < kMinLogSize || logSize > MaxLogSize())
+			return B_BAD_VALUE;
+	} else {
+		// determine log size depending on the size of the volume; larger
+		// logs allow for larger transactions that don't need to be split
+		logSize = 2048;
+		if (numBlocks <= 20480)
+			logSize = 512;
+		if (deviceSize > 1LL * 1024 * 1024 * 1024)
+			logSize = 4096;
+		if (deviceSize > 64LL * 1024 * 1024 * 1024)
+			logSize = 16384;
+		if (deviceSize > 1024LL * 1024 * 1024 * 1024)
+			logSize = 32768;
+
+		// leave some room in the first allocation group for the root
+		// directory and the indices
+		while (logSize > 4096 && logSize > MaxLogSize() / 2)
+			logSize /= 2;
+	}
+
 	fSuperBlock.log_blocks.length = HOST_ENDIAN_TO_BFS_INT16(logSize);
 	fSuperBlock.log_start = fSuperBlock.log_end = HOST_ENDIAN_TO_BFS_INT64(
 		ToBlock(Log()));
@@ -803,3 +970,25 @@ Volume::_EraseUnusedBootBlock()
 
 	return B_OK;
 }
+
+
+/*!	Counts the trigram indices of the volume, so that index updates can
+	skip looking for them when there are none.
+*/
+void
+Volume::_CountTrigramIndices()
+{
+	BPlusTree* tree = fIndicesNode->Tree();
+	if (tree == NULL)
+		return;
+
+	TreeIterator iterator(tree);
+	char name[B_FILE_NAME_LENGTH];
+	uint16 length;
+	ino_t id;
+
+	while (iterator.GetNextEntry(name, &length, sizeof(name), &id) == B_OK) {
+		if (Index::IsTrigramIndex(name))
+			fTrigramIndices++;
+	}
+}
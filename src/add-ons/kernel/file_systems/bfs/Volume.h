@@ -14,7 +14,9 @@
 
 class Journal;
 class Inode;
+class IndexStatistics;
 class Query;
+class QueryCache;
 
 
 enum volume_flags {
@@ -23,6 +25,7 @@ enum volume_flags {
 
 enum volume_initialize_flags {
 	VOLUME_NO_INDICES	= 0x0001,
+	VOLUME_INLINE_DATA	= 0x0002,
 };
 
 typedef DoublyLinkedList<Inode> InodeList;
@@ -36,7 +39,8 @@ public:
 			status_t		Mount(const char* device, uint32 flags);
 			status_t		Unmount();
 			status_t		Initialize(int fd, const char* name,
-								uint32 blockSize, uint32 flags);
+								uint32 blockSize, uint32 flags,
+								uint32 logSize = 0);
 
 			bool			IsInitializing() const { return fVolume == NULL; }
 
@@ -51,6 +55,8 @@ public:
 			block_run		Indices() const { return fSuperBlock.indices; }
 			Inode*			IndicesNode() const { return fIndicesNode; }
 			block_run		Log() const { return fSuperBlock.log_blocks; }
+			uint32			MaxLogSize() const;
+			status_t		ResizeLog(uint32 length);
 			vint32&			LogStart() { return fLogStart; }
 			vint32&			LogEnd() { return fLogEnd; }
 			int				Device() const { return fDevice; }
@@ -64,13 +70,17 @@ public:
 			off_t			UsedBlocks() const
 								{ return fSuperBlock.UsedBlocks(); }
 			off_t			FreeBlocks() const
-								{ return NumBlocks() - UsedBlocks(); }
+								{ return NumBlocks() - UsedBlocks()
+									- fReservedBlocks; }
 
 			uint32			DeviceBlockSize() const { return fDeviceBlockSize; }
 			uint32			BlockSize() const { return fBlockSize; }
 			uint32			BlockShift() const { return fBlockShift; }
 			uint32			InodeSize() const
 								{ return fSuperBlock.InodeSize(); }
+			bool			SupportsInlineData() const
+								{ return (fSuperBlock.Features()
+									& SUPER_BLOCK_FEATURE_INLINE_DATA) != 0; }
 			uint32			AllocationGroups() const
 								{ return fSuperBlock.AllocationGroups(); }
 			uint32			AllocationGroupShift() const
@@ -100,6 +110,8 @@ public:
 
 			// block bitmap
 			BlockAllocator&	Allocator();
+			mutex&			RangeLock() { return fRangeLock; }
+				// guards the locked ranges of all inodes
 			status_t		AllocateForInode(Transaction& transaction,
 								const Inode* parent, mode_t type,
 								block_run& run);
@@ -110,6 +122,8 @@ public:
 								off_t numBlocks, block_run& run,
 								uint16 minimum = 1);
 			status_t		Free(Transaction& transaction, block_run run);
+			status_t		ReserveBlocks(off_t numBlocks);
+			void			UnreserveBlocks(off_t numBlocks);
 			void			SetCheckingThread(thread_id thread)
 								{ fCheckingThread = thread; }
 			bool			IsCheckingThread() const
@@ -131,11 +145,19 @@ public:
 			bool			CheckForLiveQuery(const char* attribute);
 			void			AddQuery(Query* query);
 			void			RemoveQuery(Query* query);
+			QueryCache*		GetQueryCache() const { return fQueryCache; }
+			IndexStatistics* GetIndexStatistics() const
+								{ return fIndexStatistics; }
+			bool			HasTrigramIndices() const
+								{ return fTrigramIndices > 0; }
+			void			UpdateTrigramIndices(int32 delta)
+								{ atomic_add(&fTrigramIndices, delta); }
 
 			status_t		Sync();
 			Journal*		GetJournal(off_t refBlock) const;
 
 			void*			BlockCache() { return fBlockCache; }
+			void			Prefetch(off_t block, size_t numBlocks);
 
 	static	status_t		CheckSuperBlock(const uint8* data,
 								uint32* _offset = NULL);
@@ -143,6 +165,7 @@ public:
 
 private:
 			status_t		_EraseUnusedBootBlock();
+			void			_CountTrigramIndices();
 
 protected:
 			fs_volume*		fVolume;
@@ -164,9 +187,16 @@ protected:
 			Inode*			fIndicesNode;
 
 			vint32			fDirtyCachedBlocks;
+			off_t			fReservedBlocks;
+				// blocks promised to delayed allocations, guarded by fLock
+
+			mutex			fRangeLock;
 
 			mutex			fQueryLock;
 			SinglyLinkedList<Query> fQueries;
+			QueryCache*		fQueryCache;
+			IndexStatistics* fIndexStatistics;
+			vint32			fTrigramIndices;
 
 			uint32			fFlags;
 
@@ -231,6 +261,16 @@ Volume::FlushDevice()
 }
 
 
+/*!	Asynchronously reads in the given blocks; this is only a hint, and
+	therefore doesn't report any errors.
+*/
+inline void
+Volume::Prefetch(off_t block, size_t numBlocks)
+{
+	block_cache_prefetch(fBlockCache, block, &numBlocks);
+}
+
+
 inline Journal*
 Volume::GetJournal(off_t /*refBlock*/) const
 {
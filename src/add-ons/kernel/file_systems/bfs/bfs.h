@@ -76,7 +76,8 @@ struct disk_super_block {
 	int32		magic3;
 	inode_addr	root_dir;
 	inode_addr	indices;
-	int32		_reserved[8];
+	uint32		features;
+	int32		_reserved[7];
 	int32		pad_to_block[87];
 		// this also contains parts of the boot block
 
@@ -97,6 +98,7 @@ struct disk_super_block {
 	int32 Flags() const { return BFS_ENDIAN_TO_HOST_INT32(flags); }
 	off_t LogStart() const { return BFS_ENDIAN_TO_HOST_INT64(log_start); }
 	off_t LogEnd() const { return BFS_ENDIAN_TO_HOST_INT64(log_end); }
+	uint32 Features() const { return BFS_ENDIAN_TO_HOST_INT32(features); }
 
 	// implemented in Volume.cpp:
 	bool IsValid() const;
@@ -112,6 +114,12 @@ struct disk_super_block {
 #define SUPER_BLOCK_DISK_CLEAN		'CLEN'		/* CLEN */
 #define SUPER_BLOCK_DISK_DIRTY		'DIRT'		/* DIRT */
 
+// Features that older implementations don't know about; a volume using any
+// unknown feature must not be mounted
+#define SUPER_BLOCK_FEATURE_INLINE_DATA	0x00000001
+	// small files may keep their data in the small_data section
+#define SUPER_BLOCK_KNOWN_FEATURES		SUPER_BLOCK_FEATURE_INLINE_DATA
+
 //**************************************
 
 #define NUM_DIRECT_BLOCKS			12
@@ -171,6 +179,12 @@ struct small_data {
 #define FILE_NAME_NAME			0x13
 #define FILE_NAME_NAME_LENGTH	1
 
+// Files with the INODE_INLINE_DATA flag keep their data in the small_data
+// section, too
+#define INLINE_DATA_TYPE		'RAWT'
+#define INLINE_DATA_NAME		0x14
+#define INLINE_DATA_NAME_LENGTH	1
+
 // The maximum key length of attribute data that is put  in the index.
 // This excludes a terminating null byte.
 // This must be smaller than or equal as BPLUSTREE_MAX_KEY_LENGTH.
@@ -258,6 +272,7 @@ enum inode_flags {
 	INODE_DELETED			= 0x00000010,
 	INODE_NOT_READY			= 0x00000020,	// used during Inode construction
 	INODE_LONG_SYMLINK		= 0x00000040,	// symlink in data stream
+	INODE_INLINE_DATA		= 0x00000080,	// file data in small_data section
 
 	INODE_PERMANENT_FLAGS	= 0x0000ffff,
 
@@ -277,7 +292,8 @@ struct file_cookie {
 	int		open_mode;
 };
 
-#define BFS_OPEN_MODE_USER_MASK		0x7fffffff
+#define BFS_OPEN_MODE_USER_MASK		0x3fffffff
+#define BFS_OPEN_MODE_DEFRAGMENTING	0x40000000
 #define BFS_OPEN_MODE_CHECKING		0x80000000
 
 // notify every second if the file size has changed
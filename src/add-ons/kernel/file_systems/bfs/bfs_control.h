@@ -23,6 +23,12 @@
 
 #define BFS_IOCTL_UPDATE_BOOT_BLOCK	14204
 
+/* ioctl to change the size of the log while the volume is mounted - parameter
+ * is a uint32 * with the new size in blocks; if it is zero, the size is left
+ * alone. The current log size is stored back on return.
+ */
+#define BFS_IOCTL_RESIZE_LOG		14205
+
 struct update_boot_block {
 	uint32			offset;
 	const uint8*	data;
@@ -97,5 +103,43 @@ struct check_control {
 /* check control magic value */
 #define BFS_IOCTL_CHECK_MAGIC	'BChk'
 
+/* ioctls to defragment the volume while it is mounted
+ * all calls use a struct defrag_control as single parameter
+ */
+#define BFS_IOCTL_START_DEFRAGMENTING	14206
+#define BFS_IOCTL_STOP_DEFRAGMENTING	14207
+#define BFS_IOCTL_DEFRAGMENT_NEXT_NODE	14208
+
+/* All fields except "magic", "flags", and "max_rate" must be set to zero
+ * before BFS_IOCTL_START_DEFRAGMENTING is called.
+ */
+struct defrag_control {
+	uint32		magic;
+	uint32		flags;
+	uint32		max_rate;
+		/* in KB per second of data moved, zero means unlimited */
+	char		name[B_FILE_NAME_LENGTH];
+	ino_t		inode;
+	uint32		mode;
+	uint32		fragments;
+	uint32		new_fragments;
+		/* of the current node before and after it has been processed */
+	struct {
+		uint64	nodes;
+		uint64	fragmented_nodes;
+		uint64	relocated_nodes;
+		uint64	moved_blocks;
+	} stats;
+	status_t	status;
+};
+
+/* values for the flags field */
+#define BFS_DEFRAGMENT_FILES		1
+#define BFS_DEFRAGMENT_DIRECTORIES	2
+	/* also moves the B+tree of a directory next to its inode */
+
+/* defrag control magic value */
+#define BFS_IOCTL_DEFRAG_MAGIC		'BDfr'
+
 
 #endif	/* BFS_CONTROL_H */
@@ -14,6 +14,7 @@ parse_initialize_parameters(const char* parameterString,
 	initialize_parameters& parameters)
 {
 	parameters.flags = 0;
+	parameters.logSize = 0;
 	parameters.verbose = false;
 
 	void *handle = parse_driver_settings_string(parameterString);
@@ -22,6 +23,8 @@ parse_initialize_parameters(const char* parameterString,
 
 	if (get_driver_boolean_parameter(handle, "noindex", false, true))
 		parameters.flags |= VOLUME_NO_INDICES;
+	if (get_driver_boolean_parameter(handle, "inline_data", false, true))
+		parameters.flags |= VOLUME_INLINE_DATA;
 	if (get_driver_boolean_parameter(handle, "verbose", false, true))
 		parameters.verbose = true;
 
@@ -31,6 +34,11 @@ parse_initialize_parameters(const char* parameterString,
 	if (string != NULL)
 		blockSize = strtoul(string, NULL, 0);
 
+	// the log size is given in blocks, 0 lets the volume size decide
+	string = get_driver_parameter(handle, "log_size", NULL, NULL);
+	if (string != NULL)
+		parameters.logSize = strtoul(string, NULL, 0);
+
 	delete_driver_settings(handle);
 
 	if (blockSize != 1024 && blockSize != 2048 && blockSize != 4096
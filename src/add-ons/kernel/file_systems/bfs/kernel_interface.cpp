@@ -91,8 +91,21 @@ iterative_io_get_vecs_hook(void* cookie, io_request* request, off_t offset,
 {
 	Inode* inode = (Inode*)cookie;
 
-	return file_map_translate(inode->Map(), offset, size, vecs, _count,
-		inode->GetVolume()->BlockSize());
+	status_t status = file_map_translate(inode->Map(), offset, size, vecs,
+		_count, inode->GetVolume()->BlockSize());
+
+#ifndef FS_SHELL
+	if ((status == B_OK || status == B_BUFFER_OVERFLOW)
+		&& io_request_is_write(request)) {
+		// a delayed allocation has not been made in time
+		for (size_t i = 0; i < *_count; i++) {
+			if (vecs[i].offset < 0)
+				RETURN_ERROR(B_BAD_VALUE);
+		}
+	}
+#endif
+
+	return status;
 }
 
 
@@ -178,6 +191,22 @@ bfs_mount(fs_volume* _volume, const char* device, uint32 flags,
 	_volume->ops = &gBFSVolumeOps;
 	*_rootID = volume->ToVnode(volume->Root());
 
+	void* handle = parse_driver_settings_string(args);
+	if (handle != NULL) {
+		if (!volume->IsReadOnly()
+			&& get_driver_boolean_parameter(handle, "discard", false, true)) {
+			const char* rate = get_driver_parameter(handle, "discard_rate",
+				NULL, NULL);
+			status = volume->Allocator().StartDiscarding(
+				rate != NULL ? strtoul(rate, NULL, 0) : 0);
+			if (status != B_OK) {
+				INFORM(("could not enable online discard: %s\n",
+					strerror(status)));
+			}
+		}
+		delete_driver_settings(handle);
+	}
+
 	INFORM(("mounted \"%s\" (root node at %" B_PRIdINO ", device = %s)\n",
 		volume->Name(), *_rootID, device));
 	return B_OK;
@@ -387,6 +416,80 @@ bfs_remove_vnode(fs_volume* _volume, fs_vnode* _node, bool reenter)
 }
 
 
+/*!	bfs_read_pages() and bfs_write_pages() for files that keep their data
+	in the inode.
+*/
+static status_t
+inline_data_pages(Inode* inode, off_t pos, const iovec* vecs, size_t count,
+	size_t* _numBytes, bool write)
+{
+	size_t bytesLeft = *_numBytes;
+	status_t status = B_OK;
+
+	for (size_t i = 0; i < count && bytesLeft > 0; i++) {
+		size_t length = min_c(vecs[i].iov_len, bytesLeft);
+
+		if (!write) {
+			status = inode->ReadInlineData(pos, (uint8*)vecs[i].iov_base,
+				length);
+		} else if (pos < inode->Size()) {
+			status = inode->WriteInlineData(pos,
+				(const uint8*)vecs[i].iov_base, length, false);
+		}
+		if (status != B_OK)
+			break;
+
+		pos += length;
+		bytesLeft -= length;
+	}
+
+	*_numBytes -= bytesLeft;
+	return status;
+}
+
+
+#ifndef FS_SHELL
+//!	bfs_io() for files that keep their data in the inode
+static status_t
+inline_data_io(Inode* inode, io_request* request)
+{
+	off_t pos = io_request_offset(request);
+	off_t length = io_request_length(request);
+	bool write = io_request_is_write(request);
+
+	size_t bufferSize = inode->GetVolume()->InodeSize();
+	uint8* buffer = (uint8*)malloc(bufferSize);
+	if (buffer == NULL) {
+		notify_io_request(request, B_NO_MEMORY);
+		return B_NO_MEMORY;
+	}
+
+	status_t status = B_OK;
+	while (length > 0 && status == B_OK) {
+		size_t bytes = min_c(length, (off_t)bufferSize);
+
+		if (write) {
+			status = read_from_io_request(request, buffer, bytes);
+			if (status == B_OK && pos < inode->Size())
+				status = inode->WriteInlineData(pos, buffer, bytes, false);
+		} else {
+			status = inode->ReadInlineData(pos, buffer, bytes);
+			if (status == B_OK)
+				status = write_to_io_request(request, buffer, bytes);
+		}
+
+		pos += bytes;
+		length -= bytes;
+	}
+
+	free(buffer);
+
+	notify_io_request(request, status);
+	return status;
+}
+#endif	// !FS_SHELL
+
+
 static bool
 bfs_can_page(fs_volume* _volume, fs_vnode* _v, void* _cookie)
 {
@@ -407,6 +510,11 @@ bfs_read_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 
 	InodeReadLocker _(inode);
 
+	if (inode->HasInlineData()) {
+		return inline_data_pages(inode, pos, vecs, count, _numBytes,
+			false);
+	}
+
 	uint32 vecIndex = 0;
 	size_t vecOffset = 0;
 	size_t bytesLeft = *_numBytes;
@@ -450,12 +558,19 @@ bfs_write_pages(fs_volume* _volume, fs_vnode* _node, void* _cookie,
 	if (inode->FileCache() == NULL)
 		RETURN_ERROR(B_BAD_VALUE);
 
+	status_t status = inode->AllocateDelayed(false);
+	if (status != B_OK)
+		return status;
+
+	if (inode->HasInlineData())
+		return inline_data_pages(inode, pos, vecs, count, _numBytes, true);
+
 	InodeReadLocker _(inode);
+	inode->DataChanged();
 
 	uint32 vecIndex = 0;
 	size_t vecOffset = 0;
 	size_t bytesLeft = *_numBytes;
-	status_t status;
 
 	while (true) {
 		file_io_vec fileVecs[8];
@@ -502,9 +617,41 @@ bfs_io(fs_volume* _volume, fs_vnode* _node, void* _cookie, io_request* request)
 		RETURN_ERROR(B_BAD_VALUE);
 	}
 
+#ifndef FS_SHELL
+	if (io_request_is_write(request) && inode->HasDelayedAllocation()
+		&& io_request_offset(request) + io_request_length(request)
+			> inode->StreamSize()) {
+		// The data is written back, so its blocks are needed now; if that
+		// fails, the pages stay modified, and will be written later.
+		status_t status = inode->AllocateDelayed(false);
+		if (status != B_OK) {
+			notify_io_request(request, status);
+			return status;
+		}
+	}
+#endif
+
+#ifndef FS_SHELL
+	if (io_request_is_write(request) && inode->HasInlineData()) {
+		// needs a transaction, and locks the node itself
+		return inline_data_io(inode, request);
+	}
+#endif
+
 	// We lock the node here and will unlock it in the "finished" hook.
 	rw_lock_read_lock(&inode->Lock());
 
+#ifndef FS_SHELL
+	if (inode->HasInlineData()) {
+		status_t status = inline_data_io(inode, request);
+		rw_lock_read_unlock(&inode->Lock());
+		return status;
+	}
+
+	if (io_request_is_write(request))
+		inode->DataChanged();
+#endif
+
 	return do_iterative_fd_io(volume->Device(), request,
 		iterative_io_get_vecs_hook, iterative_io_finished_hook, inode);
 }
@@ -522,9 +669,24 @@ bfs_get_file_map(fs_volume* _volume, fs_vnode* _node, off_t offset, size_t size,
 	block_run run;
 	off_t fileOffset;
 
+	// data kept in the inode cannot be mapped to blocks
+	if (inode->HasInlineData())
+		return B_BAD_VALUE;
+
 	//FUNCTION_START(("offset = %Ld, size = %lu\n", offset, size));
 
 	while (true) {
+		off_t streamSize = inode->StreamSize();
+		if (inode->HasDelayedAllocation()
+			&& offset >= round_up(streamSize, volume->BlockSize())) {
+			// the delayed part of the file has no blocks yet
+			vecs[index].offset = -1;
+			vecs[index].length = round_up(inode->Size(), volume->BlockSize())
+				- offset;
+			*_count = index + 1;
+			return B_OK;
+		}
+
 		status_t status = inode->FindBlockRun(offset, run, fileOffset);
 		if (status != B_OK)
 			return status;
@@ -534,16 +696,17 @@ bfs_get_file_map(fs_volume* _volume, fs_vnode* _node, off_t offset, size_t size,
 			- offset + fileOffset;
 
 		// are we already done?
+		bool streamEnd = (uint64)offset + (uint64)vecs[index].length
+			>= (uint64)streamSize;
+		if (streamEnd && (uint64)offset + (uint64)vecs[index].length
+				> (uint64)streamSize) {
+			// make sure the extent ends with the last official file
+			// block (without taking any preallocations into account)
+			vecs[index].length = round_up(streamSize - offset,
+				volume->BlockSize());
+		}
 		if ((uint64)size <= (uint64)vecs[index].length
-			|| (uint64)offset + (uint64)vecs[index].length
-				>= (uint64)inode->Size()) {
-			if ((uint64)offset + (uint64)vecs[index].length
-					> (uint64)inode->Size()) {
-				// make sure the extent ends with the last official file
-				// block (without taking any preallocations into account)
-				vecs[index].length = round_up(inode->Size() - offset,
-					volume->BlockSize());
-			}
+			|| (streamEnd && !inode->HasDelayedAllocation())) {
 			*_count = index + 1;
 			return B_OK;
 		}
@@ -687,6 +850,10 @@ bfs_ioctl(fs_volume* _volume, fs_vnode* _node, void* _cookie, uint32 cmd,
 			if (status == B_OK) {
 				file_cookie* cookie = (file_cookie*)_cookie;
 				cookie->open_mode &= ~BFS_OPEN_MODE_CHECKING;
+
+				// the indices may have been rebuilt
+				volume->GetIndexStatistics()->MakeEmpty();
+				volume->GetQueryCache()->MakeEmpty();
 			}
 			if (status == B_OK)
 				status = user_memcpy(buffer, &control, sizeof(check_control));
@@ -728,6 +895,75 @@ bfs_ioctl(fs_volume* _volume, fs_vnode* _node, void* _cookie, uint32 cmd,
 
 			return volume->WriteSuperBlock();
 		}
+		case BFS_IOCTL_RESIZE_LOG:
+		{
+			uint32 length;
+			if (bufferLength != sizeof(uint32))
+				return B_BAD_VALUE;
+			if (user_memcpy(&length, buffer, sizeof(uint32)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			if (length != 0) {
+				status_t status = volume->ResizeLog(length);
+				if (status != B_OK)
+					return status;
+			}
+
+			length = volume->Log().Length();
+			return user_memcpy(buffer, &length, sizeof(uint32));
+		}
+		case BFS_IOCTL_START_DEFRAGMENTING:
+		{
+			BlockAllocator& allocator = volume->Allocator();
+			defrag_control control;
+			if (user_memcpy(&control, buffer, sizeof(defrag_control)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			status_t status = allocator.StartDefragmenting(&control);
+			if (status == B_OK) {
+				file_cookie* cookie = (file_cookie*)_cookie;
+				cookie->open_mode |= BFS_OPEN_MODE_DEFRAGMENTING;
+			}
+
+			return status;
+		}
+		case BFS_IOCTL_STOP_DEFRAGMENTING:
+		{
+			// only the one that started it may stop it
+			file_cookie* cookie = (file_cookie*)_cookie;
+			if ((cookie->open_mode & BFS_OPEN_MODE_DEFRAGMENTING) == 0)
+				return B_NOT_ALLOWED;
+
+			BlockAllocator& allocator = volume->Allocator();
+			defrag_control control;
+
+			status_t status = allocator.StopDefragmenting(&control);
+			if (status == B_OK) {
+				cookie->open_mode &= ~BFS_OPEN_MODE_DEFRAGMENTING;
+
+				status = user_memcpy(buffer, &control, sizeof(defrag_control));
+			}
+
+			return status;
+		}
+		case BFS_IOCTL_DEFRAGMENT_NEXT_NODE:
+		{
+			file_cookie* cookie = (file_cookie*)_cookie;
+			if ((cookie->open_mode & BFS_OPEN_MODE_DEFRAGMENTING) == 0)
+				return B_NOT_ALLOWED;
+
+			BlockAllocator& allocator = volume->Allocator();
+			defrag_control control;
+
+			status_t status = allocator.DefragmentNextNode(&control);
+			if (status == B_OK || status == B_ENTRY_NOT_FOUND) {
+				if (user_memcpy(buffer, &control, sizeof(defrag_control))
+						!= B_OK)
+					return B_BAD_ADDRESS;
+			}
+
+			return status;
+		}
 
 #ifdef DEBUG_FRAGMENTER
 		case 56741:
@@ -786,8 +1022,20 @@ bfs_fsync(fs_volume* _volume, fs_vnode* _node)
 {
 	FUNCTION();
 
+	Volume* volume = (Volume*)_volume->private_volume;
 	Inode* inode = (Inode*)_node->private_node;
-	return inode->Sync();
+
+	status_t status = inode->Sync();
+	if (status != B_OK)
+		return status;
+
+	// Make sure the metadata changes (like the file size) are on disk, too.
+	// Transactions are batched, so this commits those of everyone else as
+	// well.
+	if (volume->IsReadOnly())
+		return B_OK;
+
+	return volume->GetJournal(0)->Commit(inode->LastTransaction());
 }
 
 
@@ -824,6 +1072,11 @@ bfs_write_stat(fs_volume* _volume, fs_vnode* _node, const struct stat* stat,
 	bool isOwnerOrRoot = uid == 0 || uid == (uid_t)node.UserID();
 	bool hasWriteAccess = inode->CheckPermissions(W_OK) == B_OK;
 
+	// resizing the file must not interfere with writes still in progress
+	InodeRangeLocker rangeLocker;
+	if ((mask & B_STAT_SIZE) != 0 && inode->IsFile())
+		rangeLocker.Lock(inode, 0, kEndOfFile);
+
 	Transaction transaction(volume, inode->BlockNumber());
 	inode->WriteLockInTransaction(transaction);
 
@@ -969,12 +1222,6 @@ bfs_create(fs_volume* _volume, fs_vnode* _directory, const char* name,
 	status_t status = Inode::Create(transaction, directory, name,
 		S_FILE | (mode & S_IUMSK), openMode, 0, &created, _vnodeID, &inode);
 
-	// Disable the file cache, if requested?
-	if (status == B_OK && (openMode & O_NOCACHE) != 0
-		&& inode->FileCache() != NULL) {
-		status = file_cache_disable(inode->FileCache());
-	}
-
 	entry_cache_add(volume->ID(), directory->ID(), name, *_vnodeID);
 
 	if (status == B_OK)
@@ -1316,15 +1563,6 @@ bfs_open(fs_volume* _volume, fs_vnode* _node, int openMode, void** _cookie)
 	cookie->last_size = inode->Size();
 	cookie->last_notification = system_time();
 
-	// Disable the file cache, if requested?
-	CObjectDeleter<void> fileCacheEnabler(file_cache_enable);
-	if ((openMode & O_NOCACHE) != 0 && inode->FileCache() != NULL) {
-		status = file_cache_disable(inode->FileCache());
-		if (status != B_OK)
-			return status;
-		fileCacheEnabler.SetTo(inode->FileCache());
-	}
-
 	// Should we truncate the file?
 	if ((openMode & O_TRUNC) != 0) {
 		if ((openMode & O_RWMASK) == O_RDONLY)
@@ -1342,7 +1580,6 @@ bfs_open(fs_volume* _volume, fs_vnode* _node, int openMode, void** _cookie)
 			return status;
 	}
 
-	fileCacheEnabler.Detach();
 	cookieDeleter.Detach();
 	*_cookie = cookie;
 	return B_OK;
@@ -1361,7 +1598,11 @@ bfs_read(fs_volume* _volume, fs_vnode* _node, void* _cookie, off_t pos,
 		return inode->IsDirectory() ? B_IS_A_DIRECTORY : B_BAD_VALUE;
 	}
 
-	return inode->ReadAt(pos, (uint8*)buffer, _length);
+	// O_NOCACHE (aka O_DIRECT) only bypasses the file cache for this cookie
+	file_cookie* cookie = (file_cookie*)_cookie;
+
+	return inode->ReadAt(pos, (uint8*)buffer, _length,
+		(cookie->open_mode & O_NOCACHE) != 0);
 }
 
 
@@ -1392,7 +1633,7 @@ bfs_write(fs_volume* _volume, fs_vnode* _node, void* _cookie, off_t pos,
 		// regular files aren't logged)
 
 	status_t status = inode->WriteAt(transaction, pos, (const uint8*)buffer,
-		_length);
+		_length, (cookie->open_mode & O_NOCACHE) != 0);
 	if (status == B_OK)
 		status = transaction.Done();
 	if (status == B_OK) {
@@ -1435,6 +1676,11 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 	bool needsTrimming = false;
 
 	if (!volume->IsReadOnly() && !volume->IsCheckingThread()) {
+		// the size index should see the final size of the file, and the
+		// allocation may also be able to trim its preallocation right away
+		if ((cookie->open_mode & O_RWMASK) != 0)
+			inode->AllocateDelayed();
+
 		InodeReadLocker locker(inode);
 		needsTrimming = inode->NeedsTrimming();
 
@@ -1502,9 +1748,10 @@ bfs_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 		FATAL(("check process was aborted!\n"));
 		volume->Allocator().StopChecking(NULL);
 	}
-
-	if ((cookie->open_mode & O_NOCACHE) != 0 && inode->FileCache() != NULL)
-		file_cache_enable(inode->FileCache());
+	if ((cookie->open_mode & BFS_OPEN_MODE_DEFRAGMENTING) != 0) {
+		// the defragmenter exited without stopping
+		volume->Allocator().StopDefragmenting(NULL);
+	}
 
 	delete cookie;
 	return B_OK;
@@ -1660,6 +1907,9 @@ bfs_open_dir(fs_volume* _volume, fs_vnode* _node, void** _cookie)
 	if (iterator == NULL)
 		RETURN_ERROR(B_NO_MEMORY);
 
+	// directory listings are usually followed by a stat() of each entry
+	iterator->SetPrefetchValues(true);
+
 	*_cookie = iterator;
 	return B_OK;
 }
@@ -2124,13 +2374,42 @@ bfs_create_index(fs_volume* _volume, const char* name, uint32 type,
 	if (geteuid() != 0)
 		return B_NOT_ALLOWED;
 
+	// a trigram index is a string index in its own right, named after the
+	// attribute it belongs to; only it may use such a name
+	const char* attribute = name;
+	char trigramName[B_FILE_NAME_LENGTH];
+	if (Index::IsTrigramIndex(name))
+		return B_BAD_VALUE;
+	if ((flags & B_TRIGRAM_INDEX) != 0) {
+		if (type != B_STRING_TYPE && type != B_MIME_STRING_TYPE)
+			return B_BAD_TYPE;
+
+		status_t status = Index::GetTrigramIndexName(name, trigramName);
+		if (status != B_OK)
+			return status;
+
+		name = trigramName;
+		type = B_STRING_TYPE;
+	}
+
 	Transaction transaction(volume, volume->Indices());
 
 	Index index(volume);
 	status_t status = index.Create(transaction, name, type);
 
-	if (status == B_OK)
+	// A trigram index knows about the same entries as the attribute index;
+	// the query planner relies on that
+	if (status == B_OK && name == trigramName)
+		status = index.FillTrigramIndex(transaction, attribute);
+
+	if (status == B_OK) {
+		volume->GetIndexStatistics()->Remove(name);
+		volume->GetQueryCache()->Invalidate(name);
+
 		status = transaction.Done();
+		if (status == B_OK && Index::IsTrigramIndex(name))
+			volume->UpdateTrigramIndices(1);
+	}
 
 	RETURN_ERROR(status);
 }
@@ -2157,8 +2436,14 @@ bfs_remove_index(fs_volume* _volume, const char* name)
 	Transaction transaction(volume, volume->Indices());
 
 	status_t status = indices->Remove(transaction, name);
-	if (status == B_OK)
+	if (status == B_OK) {
+		volume->GetIndexStatistics()->Remove(name);
+		volume->GetQueryCache()->Invalidate(name);
+
 		status = transaction.Done();
+		if (status == B_OK && Index::IsTrigramIndex(name))
+			volume->UpdateTrigramIndices(-1);
+	}
 
 	RETURN_ERROR(status);
 }
@@ -2318,7 +2603,7 @@ bfs_initialize(int fd, partition_id partitionID, const char* name,
 	// initialize the volume
 	Volume volume(NULL);
 	status = volume.Initialize(fd, name, parameters.blockSize,
-		parameters.flags);
+		parameters.flags, parameters.logSize);
 	if (status < B_OK) {
 		INFORM(("Initializing volume failed: %s\n", strerror(status)));
 		return status;
@@ -12,6 +12,7 @@
 
 #include "fssh_api_wrapper.h"
 #include "fssh_auto_deleter.h"
+#include <kernel/util/SplayTree.h>
 
 #else	// !FS_SHELL
 
@@ -19,6 +20,7 @@
 #include <util/AutoLock.h>
 #include <util/DoublyLinkedList.h>
 #include <util/SinglyLinkedList.h>
+#include <util/SplayTree.h>
 #include <util/Stack.h>
 
 #include <ByteOrder.h>
@@ -26,6 +28,7 @@
 #ifndef _BOOT_MODE
 #	include <tracing.h>
 
+#	include <condition_variable.h>
 #	include <driver_settings.h>
 #	include <fs_attr.h>
 #	include <fs_cache.h>
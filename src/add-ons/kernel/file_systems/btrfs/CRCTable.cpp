@@ -9,7 +9,12 @@
 
 #include "system_dependencies.h"
 
+#ifndef FS_SHELL
+#	include <util/crc32c.h>
+#endif
 
+
+#ifdef FS_SHELL
 //! CRC 03667067501 table, as generated by crc_table.cpp
 static uint32 kCrcTable[256] = { 
 	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb, 
@@ -45,12 +50,13 @@ static uint32 kCrcTable[256] = {
 	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e, 
 	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e, 0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351 
 };
+#endif	// FS_SHELL
 
 
-/*! \brief Calculates the UDF crc checksum for the given byte stream.
+/*! \brief Calculates the CRC-32C checksum for the given byte stream.
 
-	Based on crc code from UDF-2.50 6.5, as permitted.
-	This is reversed.
+	In the kernel, this uses the shared crc32c() implementation; the table
+	is only used by the fs_shell.
 
 	\param data Pointer to the byte stream.
 	\param length Length of the byte stream in bytes.
@@ -61,8 +67,12 @@ uint32
 calculate_crc(uint32 crc, uint8* data, uint16 length)
 {
 	if (data) {
+#ifdef FS_SHELL
 		for ( ; length > 0; length--, data++)
 			crc = kCrcTable[(crc ^ *data) & 0xff] ^ (crc >> 8);
+#else
+		crc = crc32c(crc, data, length);
+#endif
 	}
 	return crc;
 }
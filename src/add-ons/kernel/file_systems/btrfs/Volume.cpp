@@ -12,6 +12,7 @@
 #include "BPlusTree.h"
 #include "CachedBlock.h"
 #include "Chunk.h"
+#include "CRCTable.h"
 #include "Inode.h"
 
 
@@ -193,6 +194,17 @@ btrfs_super_block::IsValid()
 	// TODO: check some more values!
 	if (strncmp(magic, BTRFS_SUPER_BLOCK_MAGIC, sizeof(magic)) != 0)
 		return false;
+
+	if (ChecksumType() == BTRFS_CHECKSUM_TYPE_CRC32) {
+		// the checksum covers everything after itself
+		uint32 crc = ~calculate_crc((uint32)~0,
+			(uint8*)this + sizeof(checksum),
+			sizeof(btrfs_super_block) - sizeof(checksum));
+		if (crc != B_LENDIAN_TO_HOST_INT32(*(uint32*)checksum)) {
+			ERROR("invalid superblock checksum!\n");
+			return false;
+		}
+	}
 	
 	return true;
 }
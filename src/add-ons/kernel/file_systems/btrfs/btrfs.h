@@ -173,6 +173,9 @@ struct btrfs_super_block {
 	char	label[256];
 	uint64	reserved[32];
 	uint8	system_chunk_array[2048];
+	uint8	_reserved2[1237];
+		// root backups, and padding to 4096 bytes, the size covered
+		// by the checksum
 
 	bool IsValid();
 		// implemented in Volume.cpp
@@ -189,6 +192,8 @@ struct btrfs_super_block {
 	uint64 LogRoot() const
 		{ return B_LENDIAN_TO_HOST_INT64(log_root); }
 	uint8 ChunkRootLevel() const { return chunk_root_level; }
+	uint16 ChecksumType() const
+		{ return B_LENDIAN_TO_HOST_INT16(checksum_type); }
 } _PACKED;
 
 
@@ -302,6 +307,8 @@ struct btrfs_extent_data {
 
 #define BTRFS_SUPER_BLOCK_MAGIC			"_BHRfS_M"
 
+#define BTRFS_CHECKSUM_TYPE_CRC32		0
+
 #define BTRFS_OBJECT_ID_ROOT_TREE		1
 #define BTRFS_OBJECT_ID_EXTENT_TREE		2
 #define BTRFS_OBJECT_ID_DEV_TREE		4
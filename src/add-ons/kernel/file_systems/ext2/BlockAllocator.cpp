@@ -13,7 +13,7 @@
 #include <util/AutoLock.h>
 
 #include "BitmapBlock.h"
-#include "Inode.h"
+#include "Volume.h"
 
 
 #undef ASSERT
@@ -28,6 +28,31 @@
 #define ERROR(x...) dprintf("\33[34mext2:\33[0m " x)
 
 
+/*!	Shrinks the range from \a start to \a end so that it doesn't contain any
+	of the blocks reserved in \a preallocations, except for those of \a own.
+	The range is empty afterwards if it starts within a reservation that
+	reaches beyond its end.
+*/
+static void
+exclude_preallocations(PreallocationList& preallocations,
+	const Preallocation* own, fsblock_t& start, fsblock_t& end)
+{
+	PreallocationList::Iterator iterator = preallocations.GetIterator();
+	while (Preallocation* preallocation = iterator.Next()) {
+		if (preallocation == own)
+			continue;
+
+		fsblock_t reservedEnd = preallocation->start + preallocation->length;
+		if (preallocation->start <= start && start < reservedEnd) {
+			start = reservedEnd;
+			// the range moved, the ones we already looked at might apply now
+			iterator = preallocations.GetIterator();
+		} else if (start < preallocation->start && preallocation->start < end)
+			end = preallocation->start;
+	}
+}
+
+
 class AllocationBlockGroup : public TransactionListener {
 public:
 						AllocationBlockGroup();
@@ -45,6 +70,12 @@ public:
 			status_t	FreeAll(Transaction& transaction);
 			status_t	Check(uint32 start, uint32 length);
 
+			uint32		FreeRangeLength(fsblock_t start, uint32 maximum);
+			void		FindFreeRange(fsblock_t goal, uint32 needed,
+							uint32 wanted, PreallocationList& preallocations,
+							const Preallocation* own, fsblock_t& start,
+							uint32& length);
+
 			uint32		NumBits() const;
 			uint32		FreeBits() const;
 			fsblock_t	Start() const;
@@ -274,6 +305,105 @@ AllocationBlockGroup::Allocate(Transaction& transaction, fsblock_t _start,
 }
 
 
+/*!	Returns how many blocks starting at \a start (and at most \a maximum)
+	are free.
+*/
+uint32
+AllocationBlockGroup::FreeRangeLength(fsblock_t _start, uint32 maximum)
+{
+	if (_start < fStart || _start >= fStart + fNumBits)
+		return 0;
+
+	uint32 start = _start - fStart;
+	uint32 end;
+
+	if ((fGroupDescriptor->Flags() & EXT2_BLOCK_GROUP_BLOCK_UNINIT) != 0) {
+		// The bitmap isn't initialized yet, all blocks after the group's
+		// meta data are free
+		if (start < fLargestStart)
+			return 0;
+		end = fLargestStart + fLargestLength;
+	} else {
+		BitmapBlock block(fVolume, fNumBits);
+		if (!block.SetTo(fBitmapBlock))
+			return 0;
+
+		end = start;
+		block.FindNextMarked(end);
+	}
+
+	return min_c(end - start, maximum);
+}
+
+
+/*!	Looks for a free range at or after \a goal, that doesn't contain any
+	blocks reserved for others. It takes the free range beginning right at
+	the goal if it has at least \a needed blocks, since the caller can then
+	continue without a gap; otherwise, the first range with at least
+	\a wanted blocks is taken. If there is no such range, the largest range
+	found is returned; \a length is 0 if there is none at all.
+*/
+void
+AllocationBlockGroup::FindFreeRange(fsblock_t goal, uint32 needed,
+	uint32 wanted, PreallocationList& preallocations, const Preallocation* own,
+	fsblock_t& _start, uint32& _length)
+{
+	_start = 0;
+	_length = 0;
+
+	if (IsFull())
+		return;
+
+	bool uninitialized
+		= (fGroupDescriptor->Flags() & EXT2_BLOCK_GROUP_BLOCK_UNINIT) != 0;
+
+	BitmapBlock block(fVolume, fNumBits);
+	if (!uninitialized && !block.SetTo(fBitmapBlock))
+		return;
+
+	uint32 pos = goal > fStart ? goal - fStart : 0;
+
+	while (pos < fNumBits) {
+		uint32 end;
+		if (uninitialized) {
+			if (pos < fLargestStart)
+				pos = fLargestStart;
+			end = fLargestStart + fLargestLength;
+			if (pos >= end)
+				break;
+		} else {
+			block.FindNextUnmarked(pos);
+			if (pos >= fNumBits)
+				break;
+			end = pos;
+			block.FindNextMarked(end);
+		}
+
+		fsblock_t rangeStart = fStart + pos;
+		fsblock_t rangeEnd = fStart + end;
+		exclude_preallocations(preallocations, own, rangeStart, rangeEnd);
+
+		if (rangeEnd > rangeStart) {
+			uint32 length = rangeEnd - rangeStart;
+			if (rangeStart == goal && length >= needed) {
+				_start = rangeStart;
+				_length = length;
+				return;
+			}
+			if (length > _length) {
+				_start = rangeStart;
+				_length = length;
+				if (length >= wanted)
+					return;
+			}
+		}
+
+		// Both ends only ever move forward, so this makes progress
+		pos = max_c(rangeStart, rangeEnd) - fStart;
+	}
+}
+
+
 status_t
 AllocationBlockGroup::Free(Transaction& transaction, uint32 start,
 	uint32 length)
@@ -539,7 +669,8 @@ BlockAllocator::BlockAllocator(Volume* volume)
 	fGroups(NULL),
 	fBlocksPerGroup(0),
 	fNumBlocks(0),
-	fNumGroups(0)
+	fNumGroups(0),
+	fGroupsPerFlex(1)
 {
 	mutex_init(&fLock, "ext2 block allocator");
 }
@@ -561,6 +692,7 @@ BlockAllocator::Initialize()
 	fNumGroups = fVolume->NumGroups();
 	fFirstBlock = fVolume->FirstDataBlock();
 	fNumBlocks = fVolume->NumBlocks();
+	fGroupsPerFlex = fVolume->GroupsPerFlex();
 	
 	TRACE("BlockAllocator::Initialize(): blocks per group: %" B_PRIu32
 		", block groups: %" B_PRIu32 ", first block: %" B_PRIu64
@@ -591,9 +723,20 @@ BlockAllocator::Initialize()
 }
 
 
+/*!	Allocates between \a minimum and \a maximum blocks in a single range.
+	If \a start is a valid block, it is used as the goal: the range is looked
+	for at or after it within its block group first, and the caller can
+	pass the block right after its last allocation to continue contiguously.
+	If that fails, the block groups of the goal's flex group (or of
+	\a blockGroup if there is no goal) are tried first, and then the rest of
+	the volume.
+	If a \a preallocation is given, the blocks reserved in it are used when
+	the goal continues them, and a new window is reserved otherwise.
+*/
 status_t
 BlockAllocator::AllocateBlocks(Transaction& transaction, uint32 minimum,
-	uint32 maximum, uint32& blockGroup, fsblock_t& start, uint32& length)
+	uint32 maximum, uint32& blockGroup, fsblock_t& start, uint32& length,
+	Preallocation* preallocation)
 {
 	TRACE("BlockAllocator::AllocateBlocks()\n");
 	MutexLocker lock(fLock);
@@ -604,47 +747,71 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, uint32 minimum,
 		" %" B_PRIu64 ", num groups: %" B_PRIu32 "\n", transaction.ID(),
 		minimum, maximum, blockGroup, start, fNumGroups);
 
+	if (preallocation != NULL && preallocation->length > 0) {
+		if (preallocation->start == start
+			&& _AllocatePreallocated(transaction, preallocation, minimum,
+				maximum, start, length) == B_OK) {
+			blockGroup = (start - fFirstBlock) / fBlocksPerGroup;
+			return B_OK;
+		}
+
+		// The file isn't written sequentially anymore, or the reserved blocks
+		// have been taken in the mean time
+		_RemovePreallocation(preallocation);
+	}
+
+	uint32 wanted = maximum;
+	if (preallocation != NULL && preallocation->window > wanted)
+		wanted = preallocation->window;
+	if (wanted > fBlocksPerGroup)
+		wanted = fBlocksPerGroup;
+
 	fsblock_t bestStart = 0;
 	uint32 bestLength = 0;
 	uint32 bestGroup = 0;
+	bool contiguous = false;
+
+	if (start >= fFirstBlock && start < fNumBlocks) {
+		blockGroup = (start - fFirstBlock) / fBlocksPerGroup;
+		bestGroup = blockGroup;
+		fGroups[blockGroup].FindFreeRange(start, maximum, wanted,
+			fPreallocations, preallocation, bestStart, bestLength);
+
+		TRACE("BlockAllocator::AllocateBlocks(): Found %" B_PRIu32 " blocks "
+			"at %" B_PRIu64 " near goal %" B_PRIu64 "\n", bestLength,
+			bestStart, start);
+
+		contiguous = bestStart == start && bestLength >= maximum;
+	} else if (blockGroup >= fNumGroups)
+		blockGroup = 0;
 
-	uint32 groupNum = blockGroup;
+	if (!contiguous && bestLength < wanted) {
+		// Look at the largest ranges of all groups, starting with the flex
+		// group, so that the file stays close to its inode and meta data
+		uint32 firstGroup = blockGroup & ~(fGroupsPerFlex - 1);
 
-	AllocationBlockGroup* last = &fGroups[fNumGroups];
-	AllocationBlockGroup* group = &fGroups[blockGroup];
+		for (uint32 i = 0; i < fNumGroups; i++) {
+			uint32 groupNum = (firstGroup + i) % fNumGroups;
+			AllocationBlockGroup& group = fGroups[groupNum];
 
-	for (int32 iterations = 0; iterations < 2; iterations++) {
-		for (; group < last; ++group, ++groupNum) {
 			TRACE("BlockAllocator::AllocateBlocks(): Group %" B_PRIu32
 				" has largest length of %" B_PRIu32 "\n", groupNum,
-				group->LargestLength());
-
-			if (group->LargestLength() > bestLength) {
-				if (start <= group->LargestStart()) {
-					bestStart = group->LargestStart();
-					bestLength = group->LargestLength();
-					bestGroup = groupNum;
-
-					TRACE("BlockAllocator::AllocateBlocks(): Found a better "
-						"range: block group: %" B_PRIu32 ", %" B_PRIu64 "-%"
-						B_PRIu64 "\n", groupNum, bestStart,
-						bestStart + bestLength);
-
-					if (bestLength >= maximum)
-						break;
-				}
-			}
-
-			start = 0;
-		}
+				group.LargestLength());
 
-		if (bestLength >= maximum)
-			break;
+			if (group.LargestLength() > bestLength) {
+				bestStart = group.LargestStart();
+				bestLength = group.LargestLength();
+				bestGroup = groupNum;
 
-		groupNum = 0;
+				TRACE("BlockAllocator::AllocateBlocks(): Found a better "
+					"range: block group: %" B_PRIu32 ", %" B_PRIu64 "-%"
+					B_PRIu64 "\n", groupNum, bestStart,
+					bestStart + bestLength);
 
-		group = &fGroups[0];
-		last = &fGroups[blockGroup + 1];
+				if (bestLength >= wanted)
+					break;
+			}
+		}
 	}
 
 	if (bestLength < minimum) {
@@ -654,8 +821,12 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, uint32 minimum,
 		return B_DEVICE_FULL;
 	}
 
-	if (bestLength > maximum)
+	uint32 reserved = 0;
+	if (bestLength > maximum) {
+		if (preallocation != NULL)
+			reserved = min_c(bestLength, wanted) - maximum;
 		bestLength = maximum;
+	}
 
 	TRACE("BlockAllocator::AllocateBlocks(): Selected range: block group %"
 		B_PRIu32 ", %" B_PRIu64 "-%" B_PRIu64 "\n", bestGroup, bestStart,
@@ -673,87 +844,26 @@ BlockAllocator::AllocateBlocks(Transaction& transaction, uint32 minimum,
 	length = bestLength;
 	blockGroup = bestGroup;
 
-	return B_OK;
-}
-
-
-status_t
-BlockAllocator::Allocate(Transaction& transaction, Inode* inode,
-	off_t numBlocks, uint32 minimum, fsblock_t& start, uint32& allocated)
-{
-	if (numBlocks <= 0)
-		return B_ERROR;
-	if (start > fNumBlocks)
-		return B_BAD_VALUE;
-
-	uint32 group = inode->ID() / fVolume->InodesPerGroup();
-	uint32 preferred = 0;
-
-	if (inode->Size() > 0) {
-		// Try to allocate near it's last blocks
-		ext2_data_stream* dataStream = &inode->Node().stream;
-		uint32 numBlocks = inode->Size() / fVolume->BlockSize() + 1;
-		uint32 lastBlock = 0;
-
-		// DANGER! What happens with sparse files?
-		if (numBlocks < EXT2_DIRECT_BLOCKS) {
-			// Only direct blocks
-			lastBlock = dataStream->direct[numBlocks];
-		} else {
-			numBlocks -= EXT2_DIRECT_BLOCKS - 1;
-			uint32 numIndexes = fVolume->BlockSize() / 4;
-				// block size / sizeof(int32)
-			uint32 numIndexes2 = numIndexes * numIndexes;
-			uint32 numIndexes3 = numIndexes2 * numIndexes;
-			uint32 indexesInIndirect = numIndexes;
-			uint32 indexesInDoubleIndirect = indexesInIndirect
-				+ numIndexes2;
-			// uint32 indexesInTripleIndirect = indexesInDoubleIndirect
-				// + numIndexes3;
-
-			uint32 doubleIndirectBlock = EXT2_DIRECT_BLOCKS + 1;
-			uint32 indirectBlock = EXT2_DIRECT_BLOCKS;
-
-			CachedBlock cached(fVolume);
-			uint32* indirectData;
-
-			if (numBlocks > indexesInDoubleIndirect) {
-				// Triple indirect blocks
-				indirectData = (uint32*)cached.SetTo(EXT2_DIRECT_BLOCKS + 2);
-				if (indirectData == NULL)
-					return B_IO_ERROR;
-
-				uint32 index = (numBlocks - indexesInDoubleIndirect)
-					/ numIndexes3;
-				doubleIndirectBlock = indirectData[index];
-			}
-
-			if (numBlocks > indexesInIndirect) {
-				// Double indirect blocks
-				indirectData = (uint32*)cached.SetTo(doubleIndirectBlock);
-				if (indirectData == NULL)
-					return B_IO_ERROR;
-
-				uint32 index = (numBlocks - indexesInIndirect) / numIndexes2;
-				indirectBlock = indirectData[index];
-			}
-
-			indirectData = (uint32*)cached.SetTo(indirectBlock);
-				if (indirectData == NULL)
-					return B_IO_ERROR;
-
-			uint32 index = numBlocks / numIndexes;
-			lastBlock = indirectData[index];
+	if (reserved > 0) {
+		// Keep the rest of the window for the next allocations of this file;
+		// the largest ranges of the groups may overlap other reservations
+		fsblock_t reservedStart = bestStart + bestLength;
+		fsblock_t reservedEnd = reservedStart + reserved;
+		exclude_preallocations(fPreallocations, preallocation, reservedStart,
+			reservedEnd);
+
+		if (reservedStart == bestStart + bestLength
+			&& reservedEnd > reservedStart) {
+			preallocation->start = reservedStart;
+			preallocation->length = reservedEnd - reservedStart;
+			fPreallocations.Add(preallocation);
+
+			TRACE("BlockAllocator::AllocateBlocks(): Reserved %" B_PRIu64 "-%"
+				B_PRIu64 "\n", reservedStart, reservedEnd);
 		}
-
-		group = (lastBlock - fFirstBlock) / fBlocksPerGroup;
-		preferred = (lastBlock - fFirstBlock) % fBlocksPerGroup + 1;
 	}
 
-	// TODO: Apply some more policies
-
-	return AllocateBlocks(transaction, minimum, minimum + 8, group, start,
-		allocated);
+	return B_OK;
 }
 
 
@@ -814,6 +924,17 @@ BlockAllocator::Free(Transaction& transaction, fsblock_t start, uint32 length)
 }
 
 
+/*!	Gives the blocks reserved in \a preallocation back to the pool; the owner
+	has to call this before it goes away.
+*/
+void
+BlockAllocator::ReleasePreallocation(Preallocation* preallocation)
+{
+	MutexLocker lock(fLock);
+	_RemovePreallocation(preallocation);
+}
+
+
 /*static*/ status_t
 BlockAllocator::_Initialize(BlockAllocator* allocator)
 {
@@ -866,3 +987,52 @@ BlockAllocator::_Initialize(BlockAllocator* allocator)
 
 	return B_OK;
 }
+
+
+status_t
+BlockAllocator::_AllocatePreallocated(Transaction& transaction,
+	Preallocation* preallocation, uint32 minimum, uint32 maximum,
+	fsblock_t& start, uint32& length)
+{
+	uint32 group = (preallocation->start - fFirstBlock) / fBlocksPerGroup;
+	if (group >= fNumGroups)
+		return B_BAD_VALUE;
+
+	uint32 count = fGroups[group].FreeRangeLength(preallocation->start,
+		min_c(maximum, preallocation->length));
+	if (count == 0 || count < minimum)
+		return B_DEVICE_FULL;
+
+	TRACE("BlockAllocator::_AllocatePreallocated(): %" B_PRIu32 " blocks at %"
+		B_PRIu64 "\n", count, preallocation->start);
+
+	status_t status = fGroups[group].Allocate(transaction,
+		preallocation->start, count);
+	if (status != B_OK)
+		return status;
+
+	start = preallocation->start;
+	length = count;
+
+	preallocation->start += count;
+	preallocation->length -= count;
+	if (preallocation->length == 0)
+		_RemovePreallocation(preallocation);
+
+	return B_OK;
+}
+
+
+void
+BlockAllocator::_RemovePreallocation(Preallocation* preallocation)
+{
+	if (preallocation->start == 0) {
+		// not reserved
+		return;
+	}
+
+	fPreallocations.Remove(preallocation);
+
+	preallocation->start = 0;
+	preallocation->length = 0;
+}
@@ -10,16 +10,40 @@
 
 
 #include <lock.h>
+#include <util/DoublyLinkedList.h>
 
 #include "ext2.h"
 #include "Transaction.h"
 
 
 class AllocationBlockGroup;
-class Inode;
 class Volume;
 
 
+/*!	Blocks set aside in memory for the sequential growth of a file, like the
+	per-inode preallocations of the Linux mballoc allocator. They stay free in
+	the bitmap, but the allocator doesn't pick them when searching free space
+	for anyone else, so that the file can continue in one extent.
+	\c window is set by the owner, and is the size of the range to reserve
+	once the current one is used up.
+*/
+struct Preallocation : DoublyLinkedListLinkImpl<Preallocation> {
+	Preallocation()
+		:
+		start(0),
+		length(0),
+		window(0)
+	{
+	}
+
+	fsblock_t	start;
+	uint32		length;
+	uint32		window;
+};
+
+typedef DoublyLinkedList<Preallocation> PreallocationList;
+
+
 class BlockAllocator {
 public:
 						BlockAllocator(Volume* volume);
@@ -29,17 +53,20 @@ public:
 
 			status_t	AllocateBlocks(Transaction& transaction,
 							uint32 minimum, uint32 maximum, uint32& blockGroup,
-							fsblock_t& start, uint32& length);
-			status_t	Allocate(Transaction& transaction, Inode* inode,
-							off_t numBlocks, uint32 minimum, fsblock_t& start,
-							uint32& length);
+							fsblock_t& start, uint32& length,
+							Preallocation* preallocation = NULL);
 			status_t	Free(Transaction& transaction, fsblock_t start,
 							uint32 length);
+			void		ReleasePreallocation(Preallocation* preallocation);
 
 			uint32		FreeBlocks();
 
 protected:
 	static	status_t	_Initialize(BlockAllocator* allocator);
+			status_t	_AllocatePreallocated(Transaction& transaction,
+							Preallocation* preallocation, uint32 minimum,
+							uint32 maximum, fsblock_t& start, uint32& length);
+			void		_RemovePreallocation(Preallocation* preallocation);
 
 
 			Volume*		fVolume;
@@ -50,6 +77,9 @@ protected:
 			fsblock_t	fNumBlocks;
 			uint32		fNumGroups;
 			fsblock_t	fFirstBlock;
+			uint32		fGroupsPerFlex;
+
+			PreallocationList fPreallocations;
 };
 
 #endif	// BLOCKALLOCATOR_H
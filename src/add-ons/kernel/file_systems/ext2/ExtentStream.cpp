@@ -27,6 +27,11 @@
 #define ERROR(x...)	dprintf("\33[34mext2:\33[0m ExtentStream::" x)
 
 
+static const off_t kMinPreallocation = 16;
+	// files with fewer blocks don't reserve any
+static const off_t kMaxPreallocationSize = 8 * 1024 * 1024;
+
+
 ExtentStream::ExtentStream(Volume* volume, ext2_extent_stream* stream,
 	off_t size)
 	:
@@ -145,8 +150,16 @@ ExtentStream::FindBlock(off_t offset, fsblock_t& block, uint32 *_count)
 }
 
 
+/*!	Appends blocks to the stream until it has \a numBlocks blocks, and sets
+	\a numBlocks to the number of blocks allocated, including those for the
+	extent tree.
+	The new blocks continue the last extent if possible; \a goal is where to
+	start looking for them when the stream is still empty. The blocks can
+	be taken from the file's \a preallocation.
+*/
 status_t
-ExtentStream::Enlarge(Transaction& transaction, off_t& numBlocks)
+ExtentStream::Enlarge(Transaction& transaction, off_t& numBlocks,
+	fsblock_t goal, Preallocation* preallocation)
 {
 	TRACE("Enlarge(): current size: %" B_PRIdOFF ", target size: %" B_PRIdOFF
 		"\n", fNumBlocks, numBlocks);
@@ -155,15 +168,26 @@ ExtentStream::Enlarge(Transaction& transaction, off_t& numBlocks)
 	numBlocks = targetBlocks - fNumBlocks;
 	uint32 allocated = 0;
 
+	fsblock_t lastBlock = _LastBlock();
+	if (lastBlock != 0)
+		fAllocatedPos = lastBlock;
+	else if (goal != 0)
+		fAllocatedPos = goal;
+
+	if (preallocation != NULL)
+		preallocation->window = _PreallocationWindow(targetBlocks);
+
 	while (fNumBlocks < targetBlocks) {
 		// allocate new blocks
 		uint32 blockGroup = (fAllocatedPos - fFirstBlock)
 				/ fVolume->BlocksPerGroup();
 		
 		if (allocated == 0) {
+			off_t maximum = min_c(targetBlocks - fNumBlocks,
+				EXT2_EXTENT_MAX_LENGTH);
 			status_t status = fVolume->AllocateBlocks(transaction, 1,
-				targetBlocks - fNumBlocks, blockGroup, fAllocatedPos,
-				allocated);
+				maximum, blockGroup, fAllocatedPos, allocated,
+				preallocation);
 			if (status != B_OK) {
 				ERROR("Enlarge(): AllocateBlocks() failed()\n");
 				return status;
@@ -208,6 +232,7 @@ ExtentStream::Enlarge(Transaction& transaction, off_t& numBlocks)
 				stream->extent_entries[stream->extent_header.NumEntries() - 1]
 					.SetLength(last.Length() + allocated);
 				fNumBlocks += allocated;
+				fAllocatedPos += allocated;
 				allocated = 0;
 				TRACE("Enlarge() entry extended\n");
 				continue;
@@ -364,6 +389,7 @@ ExtentStream::Enlarge(Transaction& transaction, off_t& numBlocks)
 		ASSERT(stream->extent_header.IsValid());
 
 		fNumBlocks += allocated;
+		fAllocatedPos += allocated;
 		allocated = 0;
 	}
 	
@@ -478,6 +504,53 @@ ExtentStream::Init()
 }
 
 
+/*!	Returns the block following the last extent of the stream, or 0 if the
+	stream doesn't have any.
+*/
+fsblock_t
+ExtentStream::_LastBlock()
+{
+	ext2_extent_stream *stream = fStream;
+	CachedBlock cached(fVolume);
+	while (stream->extent_header.Depth() != 0) {
+		if (stream->extent_header.NumEntries() == 0)
+			return 0;
+		int32 lastIndex = stream->extent_header.NumEntries() - 1;
+		stream = (ext2_extent_stream *)cached.SetTo(
+			stream->extent_index[lastIndex].PhysicalBlock());
+		if (stream == NULL)
+			return 0;
+	}
+
+	if (stream->extent_header.NumEntries() == 0)
+		return 0;
+
+	const ext2_extent_entry& last
+		= stream->extent_entries[stream->extent_header.NumEntries() - 1];
+	return last.PhysicalBlock() + last.Length();
+}
+
+
+/*!	Returns how many blocks to reserve for a file growing to \a numBlocks:
+	the size rounded up to the next power of two, so that the reservation
+	grows with the file, up to kMaxPreallocationSize.
+*/
+uint32
+ExtentStream::_PreallocationWindow(off_t numBlocks)
+{
+	if (numBlocks < kMinPreallocation)
+		return 0;
+
+	off_t maxWindow = min_c(kMaxPreallocationSize >> fVolume->BlockShift(),
+		EXT2_EXTENT_MAX_LENGTH);
+	off_t window = kMinPreallocation;
+	while (window < numBlocks && window < maxWindow)
+		window <<= 1;
+
+	return min_c(window, maxWindow);
+}
+
+
 status_t
 ExtentStream::_Check(ext2_extent_stream *stream, fileblock_t &block)
 {
@@ -13,6 +13,7 @@
 #include "Transaction.h"
 
 
+struct Preallocation;
 class Volume;
 
 
@@ -25,13 +26,18 @@ public:
 
 	status_t		FindBlock(off_t offset, fsblock_t& block,
 						uint32 *_count = NULL);
-	status_t		Enlarge(Transaction& transaction, off_t& numBlocks);
+	status_t		Enlarge(Transaction& transaction, off_t& numBlocks,
+						fsblock_t goal = 0,
+						Preallocation* preallocation = NULL);
 	status_t		Shrink(Transaction& transaction, off_t& numBlocks);
 	void			Init();
 	
 	bool			Check();
 
 private:
+	fsblock_t		_LastBlock();
+	uint32			_PreallocationWindow(off_t numBlocks);
+
 	status_t		_Check(ext2_extent_stream *stream, fileblock_t &block);
 	status_t		_CheckBlock(ext2_extent_stream *stream, fsblock_t block);
 
@@ -85,6 +85,7 @@ Inode::~Inode()
 {
 	TRACE("Inode destructor\n");
 
+	ReleasePreallocation();
 	DeleteFileCache();
 
 	TRACE("Inode destructor: Done\n");
@@ -825,7 +826,8 @@ Inode::_EnlargeDataStream(Transaction& transaction, off_t size)
 	off_t end = size == 0 ? 0 : (size - 1) / fVolume->BlockSize() + 1;
 	if (Flags() & EXT2_INODE_EXTENTS) {
 		ExtentStream stream(fVolume, &fNode.extent_stream, Size());
-		stream.Enlarge(transaction, end);
+		stream.Enlarge(transaction, end, _AllocationGoal(),
+			IsFile() ? &fPreallocation : NULL);
 		ASSERT(stream.Check());
 	} else {
 		DataStream stream(fVolume, &fNode.stream, oldSize);
@@ -863,6 +865,9 @@ Inode::_ShrinkDataStream(Transaction& transaction, off_t size)
 		return B_OK;
 	}
 
+	// The reserved blocks won't follow the end of the file anymore
+	ReleasePreallocation();
+
 	off_t end = size == 0 ? 0 : (size - 1) / fVolume->BlockSize() + 1;
 	if (Flags() & EXT2_INODE_EXTENTS) {
 		ExtentStream stream(fVolume, &fNode.extent_stream, Size());
@@ -878,6 +883,27 @@ Inode::_ShrinkDataStream(Transaction& transaction, off_t size)
 }
 
 
+/*!	Returns where the first data blocks of the inode should go: to the start
+	of its block group, or of its flex group if the volume has them. Like
+	Linux, files skip the first group of a flex group, since that holds the
+	bitmaps and inode tables of the others.
+*/
+fsblock_t
+Inode::_AllocationGoal() const
+{
+	uint32 group = (fID - 1) / fVolume->InodesPerGroup();
+	uint32 groupsPerFlex = fVolume->GroupsPerFlex();
+	if (groupsPerFlex > 1) {
+		group &= ~(groupsPerFlex - 1);
+		if (IsFile() && group + 1 < fVolume->NumGroups())
+			group++;
+	}
+
+	return fVolume->FirstDataBlock()
+		+ (fsblock_t)group * fVolume->BlocksPerGroup();
+}
+
+
 uint64
 Inode::_NumBlocks()
 {
@@ -120,6 +120,10 @@ public:
 
 			status_t	Sync();
 
+			void		ReleasePreallocation()
+							{ fVolume->ReleasePreallocation(
+								&fPreallocation); }
+
 
 
 protected:
@@ -138,6 +142,8 @@ private:
 			status_t	_ShrinkDataStream(Transaction& transaction,
 							off_t size);
 	
+			fsblock_t	_AllocationGoal() const;
+
 			uint64		_NumBlocks();
 			status_t	_SetNumBlocks(uint64 numBlocks);
 
@@ -153,6 +159,7 @@ private:
 				// Inodes have a variable size, but the important
 				// information is always the same size (except in ext4)
 			status_t	fInitStatus;
+			Preallocation fPreallocation;
 
 			mutable recursive_lock fSmallDataLock;
 };
@@ -12,6 +12,7 @@
 
 #include <errno.h>
 #include <new>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +21,7 @@
 #include <fs_volume.h>
 
 #include <util/AutoLock.h>
+#include <util/crc32c.h>
 
 #include "CachedBlock.h"
 #include "CRCTable.h"
@@ -210,6 +212,15 @@ ext2_super_block::IsValid()
 			|| ReservedGDTBlocks() > (1UL << BlockShift()) / 4) {
 		return false;
 	}
+
+	if ((ReadOnlyFeatures() & EXT2_READ_ONLY_FEATURE_METADATA_CSUM) != 0) {
+		// the checksum covers everything before itself
+		if (checksum_type != EXT2_CHECKSUM_TYPE_CRC32C
+			|| Checksum() != crc32c((uint32)~0, this,
+				offsetof(ext2_super_block, checksum))) {
+			return false;
+		}
+	}
 	
 	return true;
 }
@@ -261,6 +272,16 @@ Volume::HasExtendedAttributes() const
 }
 
 
+uint32
+Volume::GroupsPerFlex() const
+{
+	if (!HasFlexGroupsFeature() || fSuperBlock.groups_per_flex_shift >= 31)
+		return 1;
+
+	return 1UL << fSuperBlock.groups_per_flex_shift;
+}
+
+
 const char*
 Volume::Name() const
 {
@@ -818,7 +839,8 @@ Volume::FreeInode(Transaction& transaction, ino_t id, bool isDirectory)
 
 status_t
 Volume::AllocateBlocks(Transaction& transaction, uint32 minimum, uint32 maximum,
-	uint32& blockGroup, fsblock_t& start, uint32& length)
+	uint32& blockGroup, fsblock_t& start, uint32& length,
+	Preallocation* preallocation)
 {
 	TRACE("Volume::AllocateBlocks()\n");
 	if (IsReadOnly())
@@ -827,7 +849,7 @@ Volume::AllocateBlocks(Transaction& transaction, uint32 minimum, uint32 maximum,
 	TRACE("Volume::AllocateBlocks(): Calling the block allocator\n");
 
 	status_t status = fBlockAllocator->AllocateBlocks(transaction, minimum,
-		maximum, blockGroup, start, length);
+		maximum, blockGroup, start, length, preallocation);
 	if (status != B_OK)
 		return status;
 
@@ -861,6 +883,14 @@ Volume::FreeBlocks(Transaction& transaction, fsblock_t start, uint32 length)
 }
 
 
+void
+Volume::ReleasePreallocation(Preallocation* preallocation)
+{
+	if (fBlockAllocator != NULL)
+		fBlockAllocator->ReleasePreallocation(preallocation);
+}
+
+
 status_t
 Volume::LoadSuperBlock()
 {
@@ -96,6 +96,11 @@ public:
 									!= 0; }
 			uint8				DefaultHashVersion() const
 								{ return fSuperBlock.default_hash_version; }
+			bool				HasFlexGroupsFeature() const
+								{ return (fSuperBlock.IncompatibleFeatures()
+									& EXT2_INCOMPATIBLE_FEATURE_FLEX_GROUP)
+									!= 0; }
+			uint32				GroupsPerFlex() const;
 			bool				HugeFiles() const
 								{ return (fSuperBlock.ReadOnlyFeatures()
 									& EXT2_READ_ONLY_FEATURE_HUGE_FILE) != 0; }
@@ -115,9 +120,12 @@ public:
 			status_t			AllocateBlocks(Transaction& transaction,
 									uint32 minimum, uint32 maximum,
 									uint32& blockGroup, fsblock_t& start,
-									uint32& length);
+									uint32& length,
+									Preallocation* preallocation = NULL);
 			status_t			FreeBlocks(Transaction& transaction,
 									fsblock_t start, uint32 length);
+			void				ReleasePreallocation(
+									Preallocation* preallocation);
 
 			status_t			LoadSuperBlock();
 			status_t			WriteSuperBlock(Transaction& transaction);
@@ -85,9 +85,10 @@ struct ext2_super_block {
 	uint64	mmp_block;
 	uint32	raid_stripe_width;
 	uint8	groups_per_flex_shift;
-	uint8	_reserved3;
+	uint8	checksum_type;
 	uint16	_reserved4;
-	uint32	_reserved5[162];
+	uint32	_reserved5[161];
+	uint32	checksum;
 
 	uint16 Magic() const { return B_LENDIAN_TO_HOST_INT16(magic); }
 	uint16 State() const { return B_LENDIAN_TO_HOST_INT16(state); }
@@ -126,6 +127,8 @@ struct ext2_super_block {
 		{ return B_LENDIAN_TO_HOST_INT32(incompatible_features); }
 	uint16 ReservedGDTBlocks() const
 		{ return B_LENDIAN_TO_HOST_INT16(reserved_gdt_blocks); }
+	uint32 Checksum() const
+		{ return B_LENDIAN_TO_HOST_INT32(checksum); }
 	ino_t  JournalInode() const
 		{ return B_LENDIAN_TO_HOST_INT32(journal_inode); }
 	ino_t  LastOrphan() const
@@ -177,6 +180,7 @@ struct ext2_super_block {
 #define EXT2_READ_ONLY_FEATURE_GDT_CSUM			0x0010
 #define EXT2_READ_ONLY_FEATURE_DIR_NLINK		0x0020
 #define EXT2_READ_ONLY_FEATURE_EXTRA_ISIZE		0x0040
+#define EXT2_READ_ONLY_FEATURE_METADATA_CSUM	0x0400
 
 // incompatible features
 #define EXT2_INCOMPATIBLE_FEATURE_COMPRESSION	0x0001
@@ -189,6 +193,9 @@ struct ext2_super_block {
 #define EXT2_INCOMPATIBLE_FEATURE_MMP			0x0100
 #define EXT2_INCOMPATIBLE_FEATURE_FLEX_GROUP	0x0200
 
+// checksum types
+#define EXT2_CHECKSUM_TYPE_CRC32C				0x01
+
 // states
 #define EXT2_STATE_VALID						0x01
 #define	EXT2_STATE_INVALID						0x02
@@ -384,7 +391,8 @@ struct ext2_extent_entry {
 	void SetLogicalBlock(uint32 block) {
 		logical_block = B_HOST_TO_LENDIAN_INT32(block); }
 	void SetLength(uint16 _length) {
-		length = B_HOST_TO_LENDIAN_INT16(_length) & 0x7fff; }
+		length = B_HOST_TO_LENDIAN_INT16(_length == 0x8000
+			? 0x8000 : _length & 0x7fff); }
 	void SetPhysicalBlock(uint64 block) {
 		physical_block = B_HOST_TO_LENDIAN_INT32(block & 0xffffffff);
 		physical_block_high = B_HOST_TO_LENDIAN_INT16((block >> 32) & 0xffff); }
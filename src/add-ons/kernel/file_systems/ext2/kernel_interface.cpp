@@ -1252,6 +1252,9 @@ ext2_free_cookie(fs_volume* _volume, fs_vnode* _node, void* _cookie)
 	if ((cookie->open_mode & O_NOCACHE) != 0)
 		inode->EnableFileCache();
 
+	if ((cookie->open_mode & O_RWMASK) != O_RDONLY)
+		inode->ReleasePreallocation();
+
 	delete cookie;
 	return B_OK;
 }
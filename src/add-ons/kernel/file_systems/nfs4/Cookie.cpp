@@ -155,7 +155,9 @@ OpenStateCookie::OpenStateCookie(FileSystem* fileSystem)
 OpenFileCookie::OpenFileCookie(FileSystem* fileSystem)
 	:
 	OpenStateCookie(fileSystem),
-	fLocks(NULL)
+	fLocks(NULL),
+	fLastReadEnd(0),
+	fReadAheadEnd(0)
 {
 }
 
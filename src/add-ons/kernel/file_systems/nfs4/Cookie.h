@@ -84,6 +84,10 @@ struct OpenStateCookie : public Cookie {
 struct OpenFileCookie : public OpenStateCookie {
 			LockInfo*		fLocks;
 
+			// sequential access detection for read-ahead
+			off_t			fLastReadEnd;
+			off_t			fReadAheadEnd;
+
 			void			AddLock(LockInfo* lock);
 			void			RemoveLock(LockInfo* lock, LockInfo* prev);
 
@@ -218,7 +218,9 @@ DirectoryCache::_LoadSnapshot(bool trash)
 	if (oldSnapshot != NULL)
 		oldSnapshot->AcquireReference();
 
-	if (trash)
+	// Loading the snapshot of a directory adds all its entries to the name
+	// cache, the ones that are already there would be duplicated.
+	if (trash || !fAttrDir)
 		Trash();
 
 	DirectoryCacheSnapshot* newSnapshot;
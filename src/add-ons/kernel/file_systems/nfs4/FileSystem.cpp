@@ -40,6 +40,9 @@ FileSystem::FileSystem(const MountConfiguration& configuration)
 	mutex_init(&fOpenLock, NULL);
 	mutex_init(&fDelegationLock, NULL);
 	mutex_init(&fCreateFileLock, NULL);
+	mutex_init(&fStatisticsLock, NULL);
+
+	memset(fRPCStatistics, 0, sizeof(fRPCStatistics));
 }
 
 
@@ -56,6 +59,7 @@ FileSystem::~FileSystem()
 	mutex_destroy(&fOpenLock);
 	mutex_destroy(&fOpenOwnerLock);
 	mutex_destroy(&fCreateFileLock);
+	mutex_destroy(&fStatisticsLock);
 
 	if (fPath != NULL) {
 		for (uint32 i = 0; fPath[i] != NULL; i++)
@@ -264,8 +268,12 @@ FileSystem::GetInode(ino_t id, Inode** _inode)
 	if (result != B_OK)
 		return result;
 
+	// attributes returned by READDIR or LOOKUP save a GETATTR here
+	PrefetchedAttrs attrs;
+	bool prefetched = fInoIdMap.TakeAttrs(id, &attrs);
+
 	Inode* inode;
-	result = Inode::CreateInode(this, fi, &inode);
+	result = Inode::CreateInode(this, fi, &inode, prefetched ? &attrs : NULL);
 	if (result != B_OK)
 		return result;
 
@@ -474,3 +482,44 @@ FileSystem::_ParsePath(RequestBuilder& req, uint32& count, const char* _path)
 	return B_OK;
 }
 
+
+void
+FileSystem::RecordRPC(uint32 type, bigtime_t latency, size_t sent,
+	size_t received, bool success)
+{
+	ASSERT(type < NFS4_RPC_TYPE_COUNT);
+
+	MutexLocker _(fStatisticsLock);
+	nfs4_rpc_type_statistics& statistics = fRPCStatistics[type];
+	statistics.calls++;
+	if (!success)
+		statistics.errors++;
+	statistics.bytes_sent += sent;
+	statistics.bytes_received += received;
+	statistics.total_latency += latency;
+	statistics.max_latency = max_c(statistics.max_latency, latency);
+}
+
+
+void
+FileSystem::GetRPCStatistics(nfs4_rpc_statistics* statistics)
+{
+	ASSERT(statistics != NULL);
+
+	MutexLocker locker(fStatisticsLock);
+	memcpy(statistics->types, fRPCStatistics, sizeof(fRPCStatistics));
+	locker.Unlock();
+
+	statistics->read_size = fRoot->ReadSize();
+	statistics->write_size = fRoot->WriteSize();
+	statistics->max_requests_in_flight = fConfiguration.fMaxRequestsInFlight;
+}
+
+
+void
+FileSystem::ResetRPCStatistics()
+{
+	MutexLocker _(fStatisticsLock);
+	memset(fRPCStatistics, 0, sizeof(fRPCStatistics));
+}
+
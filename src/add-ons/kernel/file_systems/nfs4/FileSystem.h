@@ -13,6 +13,7 @@
 #include "InodeIdMap.h"
 #include "NFS4Defs.h"
 #include "NFS4Server.h"
+#include "nfs4_ioctl.h"
 
 
 class Inode;
@@ -27,6 +28,10 @@ struct MountConfiguration {
 	bool		fCacheMetadata;
 
 	bigtime_t	fDirectoryCacheTime;
+
+	uint32		fReadSize;
+	uint32		fWriteSize;
+	uint32		fMaxRequestsInFlight;
 };
 
 class FileSystem : public DoublyLinkedListLinkImpl<FileSystem> {
@@ -78,6 +83,13 @@ public:
 	inline	const MountConfiguration&	GetConfiguration();
 
 	inline	mutex&				CreateFileLock();
+
+			void				RecordRPC(uint32 type, bigtime_t latency,
+									size_t sent, size_t received,
+									bool success);
+			void				GetRPCStatistics(
+									nfs4_rpc_statistics* statistics);
+			void				ResetRPCStatistics();
 private:
 								FileSystem(const MountConfiguration& config);
 
@@ -115,6 +127,9 @@ private:
 			InodeIdMap			fInoIdMap;
 
 			MountConfiguration	fConfiguration;
+
+			mutex				fStatisticsLock;
+			nfs4_rpc_type_statistics	fRPCStatistics[NFS4_RPC_TYPE_COUNT];
 };
 
 
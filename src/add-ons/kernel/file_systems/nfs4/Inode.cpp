@@ -43,7 +43,8 @@ Inode::Inode()
 
 
 status_t
-Inode::CreateInode(FileSystem* fs, const FileInfo& fi, Inode** _inode)
+Inode::CreateInode(FileSystem* fs, const FileInfo& fi, Inode** _inode,
+	const PrefetchedAttrs* attrs)
 {
 	ASSERT(fs != NULL);
 	ASSERT(_inode != NULL);
@@ -60,72 +61,85 @@ Inode::CreateInode(FileSystem* fs, const FileInfo& fi, Inode** _inode)
 	inode->fInfo = fi;
 	inode->fFileSystem = fs;
 
-	uint32 attempt = 0;
 	uint64 size;
-	do {
-		RPC::Server* serv = fs->Server();
-		Request request(serv, fs);
-		RequestBuilder& req = request.Builder();
+	if (attrs != NULL) {
+		// the file system ID has been checked when the attributes were
+		// prefetched
+		ASSERT(fi.fFileId != 0);
+		inode->fType = attrs->fType;
+		inode->fChange = attrs->fChange;
+		size = attrs->fStat.st_size;
+	} else {
+		uint32 attempt = 0;
+		do {
+			RPC::Server* serv = fs->Server();
+			Request request(serv, fs);
+			RequestBuilder& req = request.Builder();
 
-		req.PutFH(inode->fInfo.fHandle);
+			req.PutFH(inode->fInfo.fHandle);
 
-		Attribute attr[] = { FATTR4_TYPE, FATTR4_CHANGE, FATTR4_SIZE,
-			FATTR4_FSID, FATTR4_FILEID };
-		req.GetAttr(attr, sizeof(attr) / sizeof(Attribute));
+			Attribute attr[] = { FATTR4_TYPE, FATTR4_CHANGE, FATTR4_SIZE,
+				FATTR4_FSID, FATTR4_FILEID };
+			req.GetAttr(attr, sizeof(attr) / sizeof(Attribute));
 
-		status_t result = request.Send();
-		if (result != B_OK)
-			return result;
+			status_t result = request.Send();
+			if (result != B_OK)
+				return result;
 
-		ReplyInterpreter& reply = request.Reply();
+			ReplyInterpreter& reply = request.Reply();
 
-		if (inode->HandleErrors(attempt, reply.NFS4Error(), serv))
-			continue;
+			if (inode->HandleErrors(attempt, reply.NFS4Error(), serv))
+				continue;
 
-		reply.PutFH();
+			reply.PutFH();
 
-		AttrValue* values;
-		uint32 count;
-		result = reply.GetAttr(&values, &count);
-		if (result != B_OK)
-			return result;
+			AttrValue* values;
+			uint32 count;
+			result = reply.GetAttr(&values, &count);
+			if (result != B_OK)
+				return result;
 
-		if (fi.fFileId == 0) {
-			if (count < 5 || values[4].fAttribute != FATTR4_FILEID)
-				inode->fInfo.fFileId = fs->AllocFileId();
-			else
-				inode->fInfo.fFileId = values[4].fData.fValue64;
-		} else
-			inode->fInfo.fFileId = fi.fFileId;
+			if (fi.fFileId == 0) {
+				if (count < 5 || values[4].fAttribute != FATTR4_FILEID)
+					inode->fInfo.fFileId = fs->AllocFileId();
+				else
+					inode->fInfo.fFileId = values[4].fData.fValue64;
+			} else
+				inode->fInfo.fFileId = fi.fFileId;
 
-		// FATTR4_TYPE is mandatory
-		inode->fType = values[0].fData.fValue32;
+			// FATTR4_TYPE is mandatory
+			inode->fType = values[0].fData.fValue32;
 
-		if (inode->fType == NF4DIR)
-			inode->fCache = new DirectoryCache(inode);
-		inode->fAttrCache = new DirectoryCache(inode, true);
+			// FATTR4_CHANGE is mandatory
+			inode->fChange = values[1].fData.fValue64;
 
-		// FATTR4_CHANGE is mandatory
-		inode->fChange = values[1].fData.fValue64;
+			// FATTR4_SIZE is mandatory
+			size = values[2].fData.fValue64;
 
-		// FATTR4_SIZE is mandatory
-		size = values[2].fData.fValue64;
-		inode->fMaxFileSize = size;
+			// FATTR4_FSID is mandatory
+			FileSystemId* fsid
+				= reinterpret_cast<FileSystemId*>(values[3].fData.fPointer);
+			if (*fsid != fs->FsId()) {
+				delete[] values;
+				return B_ENTRY_NOT_FOUND;
+			}
 
-		// FATTR4_FSID is mandatory
-		FileSystemId* fsid
-			= reinterpret_cast<FileSystemId*>(values[3].fData.fPointer);
-		if (*fsid != fs->FsId()) {
 			delete[] values;
-			return B_ENTRY_NOT_FOUND;
-		}
 
-		delete[] values;
+			break;
+		} while (true);
+	}
+
+	if (inode->fType == NF4DIR)
+		inode->fCache = new DirectoryCache(inode);
+	inode->fAttrCache = new DirectoryCache(inode, true);
+
+	inode->fMaxFileSize = size;
 
-		*_inode = inode;
+	if (attrs != NULL && fs->GetConfiguration().fCacheMetadata)
+		inode->fMetaCache.SetStat(attrs->fStat);
 
-		break;
-	} while (true);
+	*_inode = inode;
 
 	if (inode->fType == NF4REG)
 		inode->fFileCache = file_cache_create(fs->DevId(), inode->ID(), size);
@@ -136,6 +150,10 @@ Inode::CreateInode(FileSystem* fs, const FileInfo& fi, Inode** _inode)
 
 Inode::~Inode()
 {
+	// Prefetched attributes that haven't been used yet may predate changes
+	// made through this inode.
+	fFileSystem->InoIdMap()->RemoveAttrs(ID());
+
 	if (fDelegation != NULL)
 		RecallDelegation();
 
@@ -195,19 +213,33 @@ Inode::LookUp(const char* name, ino_t* id)
 	if (fType != NF4DIR)
 		return B_NOT_A_DIRECTORY;
 
+	// Get all attributes at once, they will be needed when the Inode of the
+	// file is created.
+	AttrValue* values = NULL;
+	uint32 count = 0;
+	AttrValue** prefetch = NULL;
+	if (fFileSystem->GetConfiguration().fCacheMetadata)
+		prefetch = &values;
+
 	uint64 change;
 	uint64 fileID;
 	FileHandle handle;
-	status_t result = NFS4Inode::LookUp(name, &change, &fileID, &handle);
+	status_t result = NFS4Inode::LookUp(name, &change, &fileID, &handle,
+		false, prefetch, &count);
 	if (result != B_OK)
 		return result;
 
+	ArrayDeleter<AttrValue> valuesDeleter(values);
+
 	*id = FileIdToInoT(fileID);
 
 	result = ChildAdded(name, fileID, handle);
 	if (result != B_OK)
 		return result;
 
+	if (values != NULL)
+		PrefetchAttrs(*id, values, count);
+
 	fCache->Lock();
 	if (!fCache->Valid()) {
 		fCache->Reset();
@@ -518,76 +550,112 @@ Inode::GetStat(struct stat* st, OpenAttrCookie* attr)
 		delete[] values;
 		return B_BAD_VALUE;
 	}
-	st->st_size = values[0].fData.fValue64;
 
-	uint32 next = 1;
-	st->st_mode = Type();
-	if (count >= next && values[next].fAttribute == FATTR4_MODE) {
-		st->st_mode |= values[next].fData.fValue32;
-		next++;
-	} else
+	AttrsToStat(values, count, Type(), st);
+	delete[] values;
+
+	return B_OK;
+}
+
+
+void
+Inode::AttrsToStat(const AttrValue* values, uint32 count, mode_t type,
+	struct stat* st)
+{
+	ASSERT(values != NULL);
+	ASSERT(st != NULL);
+
+	const AttrValue* value = FindAttrValue(values, count, FATTR4_SIZE);
+	st->st_size = value != NULL ? value->fData.fValue64 : 0;
+
+	st->st_mode = type;
+	value = FindAttrValue(values, count, FATTR4_MODE);
+	if (value != NULL)
+		st->st_mode |= value->fData.fValue32;
+	else
 		st->st_mode = 777;
 
-	if (count >= next && values[next].fAttribute == FATTR4_NUMLINKS) {
-		st->st_nlink = values[next].fData.fValue32;
-		next++;
-	} else
-		st->st_nlink = 1;
+	value = FindAttrValue(values, count, FATTR4_NUMLINKS);
+	st->st_nlink = value != NULL ? value->fData.fValue32 : 1;
 
-	if (count >= next && values[next].fAttribute == FATTR4_OWNER) {
-		char* owner = reinterpret_cast<char*>(values[next].fData.fPointer);
+	value = FindAttrValue(values, count, FATTR4_OWNER);
+	if (value != NULL) {
+		char* owner = reinterpret_cast<char*>(value->fData.fPointer);
 		if (owner != NULL && isdigit(owner[0]))
 			st->st_uid = atoi(owner);
 		else
 			st->st_uid = gIdMapper->GetUserId(owner);
-		next++;
 	} else
 		st->st_uid = 0;
 
-	if (count >= next && values[next].fAttribute == FATTR4_OWNER_GROUP) {
-		char* group = reinterpret_cast<char*>(values[next].fData.fPointer);
+	value = FindAttrValue(values, count, FATTR4_OWNER_GROUP);
+	if (value != NULL) {
+		char* group = reinterpret_cast<char*>(value->fData.fPointer);
 		if (group != NULL && isdigit(group[0]))
 			st->st_gid = atoi(group);
 		else
 			st->st_gid = gIdMapper->GetGroupId(group);
-		next++;
 	} else
 		st->st_gid = 0;
 
-	if (count >= next && values[next].fAttribute == FATTR4_TIME_ACCESS) {
-		memcpy(&st->st_atim, values[next].fData.fPointer,
-			sizeof(timespec));
-		next++;
-	} else
+	value = FindAttrValue(values, count, FATTR4_TIME_ACCESS);
+	if (value != NULL)
+		memcpy(&st->st_atim, value->fData.fPointer, sizeof(timespec));
+	else
 		memset(&st->st_atim, 0, sizeof(timespec));
 
-	if (count >= next && values[next].fAttribute == FATTR4_TIME_CREATE) {
-		memcpy(&st->st_crtim, values[next].fData.fPointer,
-			sizeof(timespec));
-		next++;
-	} else
+	value = FindAttrValue(values, count, FATTR4_TIME_CREATE);
+	if (value != NULL)
+		memcpy(&st->st_crtim, value->fData.fPointer, sizeof(timespec));
+	else
 		memset(&st->st_crtim, 0, sizeof(timespec));
 
-	if (count >= next && values[next].fAttribute == FATTR4_TIME_METADATA) {
-		memcpy(&st->st_ctim, values[next].fData.fPointer,
-			sizeof(timespec));
-		next++;
-	} else
+	value = FindAttrValue(values, count, FATTR4_TIME_METADATA);
+	if (value != NULL)
+		memcpy(&st->st_ctim, value->fData.fPointer, sizeof(timespec));
+	else
 		memset(&st->st_ctim, 0, sizeof(timespec));
 
-	if (count >= next && values[next].fAttribute == FATTR4_TIME_MODIFY) {
-		memcpy(&st->st_mtim, values[next].fData.fPointer,
-			sizeof(timespec));
-		next++;
-	} else
+	value = FindAttrValue(values, count, FATTR4_TIME_MODIFY);
+	if (value != NULL)
+		memcpy(&st->st_mtim, value->fData.fPointer, sizeof(timespec));
+	else
 		memset(&st->st_mtim, 0, sizeof(timespec));
-	delete[] values;
 
 	st->st_blksize = fFileSystem->Root()->IOSize();
 	st->st_blocks = st->st_size / st->st_blksize;
 	st->st_blocks += st->st_size % st->st_blksize == 0 ? 0 : 1;
+}
 
-	return B_OK;
+
+/*!	Remembers the attributes of a child that came with READDIR or LOOKUP, so
+	that creating its Inode and the first stat don't need a round trip.
+*/
+void
+Inode::PrefetchAttrs(ino_t id, const AttrValue* values, uint32 count)
+{
+	ASSERT(values != NULL);
+
+	if (!fFileSystem->GetConfiguration().fCacheMetadata)
+		return;
+
+	const AttrValue* type = FindAttrValue(values, count, FATTR4_TYPE);
+	const AttrValue* change = FindAttrValue(values, count, FATTR4_CHANGE);
+	if (type == NULL || change == NULL
+		|| FindAttrValue(values, count, FATTR4_SIZE) == NULL
+		|| type->fData.fValue32 >= sizeof(sNFSFileTypeToHaiku)
+			/ sizeof(sNFSFileTypeToHaiku[0])) {
+		return;
+	}
+
+	PrefetchedAttrs attrs;
+	attrs.fType = type->fData.fValue32;
+	attrs.fChange = change->fData.fValue64;
+	AttrsToStat(values, count, sNFSFileTypeToHaiku[attrs.fType],
+		&attrs.fStat);
+	attrs.fExpire = time(NULL) + MetadataCache::kExpirationTime;
+
+	fFileSystem->InoIdMap()->AddAttrs(id, attrs);
 }
 
 
@@ -10,6 +10,7 @@
 
 
 #include "DirectoryCache.h"
+#include "InodeIdMap.h"
 #include "MetadataCache.h"
 #include "NFS4Inode.h"
 #include "OpenState.h"
@@ -20,7 +21,8 @@ class Delegation;
 class Inode : public NFS4Inode {
 public:
 	static			status_t	CreateInode(FileSystem* fs, const FileInfo& fi,
-									Inode** inode);
+									Inode** inode,
+									const PrefetchedAttrs* attrs = NULL);
 	virtual						~Inode();
 
 	inline			ino_t		ID() const;
@@ -90,6 +92,12 @@ public:
 									void* buffer, size_t* length, bool* eof);
 					status_t	WriteDirect(OpenStateCookie* cookie, off_t pos,
 									const void* buffer, size_t* _length);
+					status_t	ReadDirect(OpenStateCookie* cookie, off_t pos,
+									const iovec* vecs, uint32 count,
+									size_t* length, bool* eof);
+					status_t	WriteDirect(OpenStateCookie* cookie, off_t pos,
+									const iovec* vecs, uint32 count,
+									size_t* _length);
 
 					status_t	CreateDir(const char* name, int mode,
 									ino_t* id);
@@ -139,9 +147,20 @@ protected:
 
 					status_t	GetStat(struct stat* st,
 									OpenAttrCookie* attr = NULL);
+					void		AttrsToStat(const AttrValue* values,
+									uint32 count, mode_t type,
+									struct stat* st);
+					void		PrefetchAttrs(ino_t id,
+									const AttrValue* values, uint32 count);
+					void		PrimeChild(const char* name, uint64 fileID,
+									const FileHandle& handle,
+									const AttrValue* values, uint32 count);
 
 					char*		AttrToFileName(const char* path);
 
+					void		ReadAhead(OpenFileCookie* cookie, off_t pos,
+									size_t length);
+
 	static inline	status_t	CheckLockType(short ltype, uint32 mode);
 
 private:
@@ -248,22 +248,48 @@ Inode::GetDirSnapshot(DirectoryCacheSnapshot** _snapshot,
 
 		uint32 i;
 		for (i = 0; i < count; i++) {
+			const AttrValue* values = dirents[i].fAttrs;
+			uint32 attrCount = dirents[i].fAttrCount;
+
+			// Entries whose attributes couldn't be obtained are still
+			// listed, their details are retrieved on lookup.
+			const AttrValue* error = FindAttrValue(values, attrCount,
+				FATTR4_RDATTR_ERROR);
+			bool valid = error == NULL || error->fData.fValue32 == NFS4_OK;
 
 			// FATTR4_FSID is mandatory
-			void* data = dirents[i].fAttrs[0].fData.fPointer;
-			FileSystemId* fsid = reinterpret_cast<FileSystemId*>(data);
-			if (*fsid != fFileSystem->FsId())
+			const AttrValue* fsidValue = FindAttrValue(values, attrCount,
+				FATTR4_FSID);
+			if (valid && fsidValue == NULL)
 				continue;
+			if (fsidValue != NULL) {
+				void* data = fsidValue->fData.fPointer;
+				FileSystemId* fsid = reinterpret_cast<FileSystemId*>(data);
+				if (*fsid != fFileSystem->FsId())
+					continue;
+			}
 
 			if (strstr(dirents[i].fName, "-haiku-attrs") != NULL)
 				continue;
 
 			ino_t id;
 			if (!attribute) {
-				if (dirents[i].fAttrCount == 2)
-					id = FileIdToInoT(dirents[i].fAttrs[1].fData.fValue64);
+				const AttrValue* fileID = FindAttrValue(values, attrCount,
+					FATTR4_FILEID);
+				if (fileID != NULL)
+					id = FileIdToInoT(fileID->fData.fValue64);
 				else
 					id = FileIdToInoT(fFileSystem->AllocFileId());
+
+				const AttrValue* handle = FindAttrValue(values, attrCount,
+					FATTR4_FILEHANDLE);
+				if (valid && fileID != NULL && handle != NULL
+					&& handle->fData.fPointer != NULL) {
+					PrimeChild(dirents[i].fName, fileID->fData.fValue64,
+						*reinterpret_cast<FileHandle*>(
+							handle->fData.fPointer),
+						values, attrCount);
+				}
 			} else
 				id = 0;
 	
@@ -300,6 +326,28 @@ Inode::GetDirSnapshot(DirectoryCacheSnapshot** _snapshot,
 }
 
 
+/*!	Makes a directory entry returned by READDIR known as if it had been
+	looked up, so that neither LOOKUP nor GETATTR are needed when the entry
+	is accessed afterwards, e.g. by "ls -l". Must be called with fCache
+	locked.
+*/
+void
+Inode::PrimeChild(const char* name, uint64 fileID, const FileHandle& handle,
+	const AttrValue* values, uint32 count)
+{
+	FileInfo fi;
+	fi.fFileId = fileID;
+	fi.fHandle = handle;
+
+	ino_t id = FileIdToInoT(fileID);
+	if (fFileSystem->InoIdMap()->AddName(fi, fInfo.fNames, name, id) != B_OK)
+		return;
+
+	PrefetchAttrs(id, values, count);
+	fCache->AddEntry(name, id);
+}
+
+
 status_t
 Inode::ReadDir(void* _buffer, uint32 size, uint32* _count,
 	OpenDirCookie* cookie)
@@ -59,6 +59,7 @@ status_t
 InodeIdMap::RemoveEntry(ino_t id)
 {
 	MutexLocker _(fLock);
+	fAttrs.Remove(id);
 	return fMap.Remove(id);
 }
 
@@ -79,3 +80,61 @@ InodeIdMap::GetFileInfo(FileInfo* fileInfo, ino_t id)
 	return B_OK;
 }
 
+
+status_t
+InodeIdMap::AddAttrs(ino_t id, const PrefetchedAttrs& attrs)
+{
+	MutexLocker _(fLock);
+	fAttrs.Remove(id);
+
+	if (fAttrs.Count() >= kMaxPrefetchedAttrs) {
+		_RemoveExpiredAttrs();
+		if (fAttrs.Count() >= kMaxPrefetchedAttrs)
+			return B_NO_MEMORY;
+	}
+
+	return fAttrs.Insert(id, attrs);
+}
+
+
+/*!	Returns the attributes prefetched for the given file and forgets them,
+	they are only used once to initialize the file's Inode. Expired
+	attributes are not returned.
+*/
+bool
+InodeIdMap::TakeAttrs(ino_t id, PrefetchedAttrs* attrs)
+{
+	ASSERT(attrs != NULL);
+
+	MutexLocker _(fLock);
+	AVLTreeMap<ino_t, PrefetchedAttrs>::Iterator iterator = fAttrs.Find(id);
+	if (!iterator.HasCurrent())
+		return false;
+
+	*attrs = iterator.Current();
+	iterator.Remove();
+
+	return attrs->fExpire > time(NULL);
+}
+
+
+void
+InodeIdMap::RemoveAttrs(ino_t id)
+{
+	MutexLocker _(fLock);
+	fAttrs.Remove(id);
+}
+
+
+void
+InodeIdMap::_RemoveExpiredAttrs()
+{
+	time_t now = time(NULL);
+
+	AVLTreeMap<ino_t, PrefetchedAttrs>::Iterator iterator
+		= fAttrs.GetIterator();
+	while (PrefetchedAttrs* attrs = iterator.NextValuePointer()) {
+		if (attrs->fExpire <= now)
+			iterator.Remove();
+	}
+}
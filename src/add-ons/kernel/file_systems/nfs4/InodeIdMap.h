@@ -9,6 +9,9 @@
 #define INODEIDMAP_H
 
 
+#include <sys/stat.h>
+#include <time.h>
+
 #include <lock.h>
 #include <SupportDefs.h>
 #include <util/AutoLock.h>
@@ -17,6 +20,15 @@
 #include "FileInfo.h"
 
 
+// Attributes of a file that were returned by READDIR or LOOKUP, before the
+// file's Inode has been created.
+struct PrefetchedAttrs {
+			uint32							fType;
+			uint64							fChange;
+			struct stat						fStat;
+			time_t							fExpire;
+};
+
 class InodeIdMap {
 public:
 	inline									InodeIdMap();
@@ -32,8 +44,19 @@ public:
 			status_t						GetFileInfo(FileInfo* fileInfo,
 												ino_t id);
 
+			status_t						AddAttrs(ino_t id,
+												const PrefetchedAttrs& attrs);
+			bool							TakeAttrs(ino_t id,
+												PrefetchedAttrs* attrs);
+			void							RemoveAttrs(ino_t id);
+
+	static	const uint32					kMaxPrefetchedAttrs = 4096;
+
 private:
+			void							_RemoveExpiredAttrs();
+
 			AVLTreeMap<ino_t, FileInfo>		fMap;
+			AVLTreeMap<ino_t, PrefetchedAttrs>	fAttrs;
 			mutex							fLock;
 
 };
@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include <AutoDeleter.h>
+#include <file_cache.h>
 #include <fs_cache.h>
 #include <NodeMonitor.h>
 
@@ -20,6 +21,9 @@
 #include "RootInode.h"
 
 
+static const uint64 kMaxReadAhead = 2 * 1024 * 1024;
+
+
 status_t
 Inode::CreateState(const char* name, int mode, int perms, OpenState* state,
 	OpenDelegationData* delegationData) {
@@ -308,36 +312,24 @@ status_t
 Inode::ReadDirect(OpenStateCookie* cookie, off_t pos, void* buffer,
 	size_t* _length, bool* eof)
 {
-	ASSERT(cookie != NULL || fOpenState != NULL);
 	ASSERT(buffer != NULL);
-	ASSERT(_length != NULL);
-	ASSERT(eof != NULL);
 
-	*eof = false;
-	uint32 size = 0;
+	iovec vec = { buffer, *_length };
+	return ReadDirect(cookie, pos, &vec, 1, _length, eof);
+}
 
-	uint32 ioSize = fFileSystem->Root()->IOSize();
-	*_length = min_c(ioSize, *_length);
 
-	status_t result;
-	OpenState* state = cookie != NULL ? cookie->fOpenState : fOpenState;
-	while (size < *_length && !*eof) {
-		uint32 len = *_length - size;
-		result = ReadFile(cookie, state, pos + size, &len,
-			reinterpret_cast<char*>(buffer) + size, eof);
-		if (result != B_OK) {
-			if (size == 0)
-				return result;
-			else
-				break;
-		}
-
-		size += len;
-	}
-
-	*_length = size;
+status_t
+Inode::ReadDirect(OpenStateCookie* cookie, off_t pos, const iovec* vecs,
+	uint32 count, size_t* _length, bool* eof)
+{
+	ASSERT(cookie != NULL || fOpenState != NULL);
+	ASSERT(vecs != NULL);
+	ASSERT(_length != NULL);
+	ASSERT(eof != NULL);
 
-	return B_OK;
+	OpenState* state = cookie != NULL ? cookie->fOpenState : fOpenState;
+	return ReadFile(cookie, state, pos, vecs, count, _length, eof);
 }
 
 
@@ -351,23 +343,65 @@ Inode::Read(OpenFileCookie* cookie, off_t pos, void* buffer, size_t* _length)
 	bool eof = false;
 	if ((cookie->fMode & O_NOCACHE) != 0)
 		return ReadDirect(cookie, pos, buffer, _length, &eof);
-	return file_cache_read(fFileCache, cookie, pos, buffer, _length);
+
+	status_t result = file_cache_read(fFileCache, cookie, pos, buffer,
+		_length);
+	if (result == B_OK && *_length > 0)
+		ReadAhead(cookie, pos, *_length);
+	return result;
+}
+
+
+/*!	Prefetches the data following a sequential read into the file cache.
+	The window is large enough to keep as many read requests in flight as
+	the mount allows, and the next window is requested as soon as the reader
+	has passed the middle of the current one, so that the reader doesn't have
+	to wait for the network while it is reading sequentially.
+*/
+void
+Inode::ReadAhead(OpenFileCookie* cookie, off_t pos, size_t length)
+{
+	bool sequential = pos == cookie->fLastReadEnd;
+	cookie->fLastReadEnd = pos + length;
+	if (!sequential) {
+		cookie->fReadAheadEnd = cookie->fLastReadEnd;
+		return;
+	}
+
+	uint64 window = min_c(kMaxReadAhead,
+		(uint64)fFileSystem->GetConfiguration().fMaxRequestsInFlight
+			* fFileSystem->Root()->ReadSize());
+	if (cookie->fReadAheadEnd - cookie->fLastReadEnd > (off_t)window / 2)
+		return;
+
+	off_t start = max_c(cookie->fReadAheadEnd, cookie->fLastReadEnd);
+	if ((uint64)start >= fMaxFileSize)
+		return;
+
+	size_t size = min_c(window, fMaxFileSize - start);
+	cache_prefetch(fFileSystem->DevId(), ID(), start, size);
+	cookie->fReadAheadEnd = start + size;
 }
 
 
 status_t
-Inode::WriteDirect(OpenStateCookie* cookie, off_t pos, const void* _buffer,
+Inode::WriteDirect(OpenStateCookie* cookie, off_t pos, const void* buffer,
 	size_t* _length)
 {
-	ASSERT(cookie != NULL || fOpenState != NULL);
-	ASSERT(_buffer != NULL);
-	ASSERT(_length != NULL);
+	ASSERT(buffer != NULL);
+
+	iovec vec = { const_cast<void*>(buffer), *_length };
+	return WriteDirect(cookie, pos, &vec, 1, _length);
+}
 
-	uint32 size = 0;
-	const char* buffer = reinterpret_cast<const char*>(_buffer);
 
-	uint32 ioSize = fFileSystem->Root()->IOSize();
-	*_length = min_c(ioSize, *_length);
+status_t
+Inode::WriteDirect(OpenStateCookie* cookie, off_t pos, const iovec* vecs,
+	uint32 count, size_t* _length)
+{
+	ASSERT(cookie != NULL || fOpenState != NULL);
+	ASSERT(vecs != NULL);
+	ASSERT(_length != NULL);
 
 	bool attribute = false;
 	OpenState* state = fOpenState;
@@ -381,23 +415,12 @@ Inode::WriteDirect(OpenStateCookie* cookie, off_t pos, const void* _buffer,
 		fWriteDirty = true;
 	}
 
-	while (size < *_length) {
-		uint32 len = *_length - size;
-		status_t result = WriteFile(cookie, state, pos + size, &len,
-			buffer + size, attribute);
-		if (result != B_OK) {
-			if (size == 0)
-				return result;
-			else
-				break;
-		}
-
-		size += len;
-	}
-
-	*_length = size;
+	status_t result = WriteFile(cookie, state, pos, vecs, count, _length,
+		attribute);
+	if (result != B_OK)
+		return result;
 
-	fMetaCache.GrowFile(size + pos);
+	fMetaCache.GrowFile(*_length + pos);
 	fFileSystem->Root()->MakeInfoInvalid();
 
 	return B_OK;
@@ -7,12 +7,35 @@
  */
 
 
+#include <string.h>
+
 #include <AutoDeleter.h>
 
 #include "IdMap.h"
 #include "Inode.h"
 #include "NFS4Inode.h"
 #include "Request.h"
+#include "RootInode.h"
+
+
+// Everything needed to create an Inode and to fill in its stat, requested
+// together with LOOKUP and READDIR so that no separate GETATTR is needed.
+static Attribute sPrefetchAttrs[] = { FATTR4_TYPE, FATTR4_CHANGE,
+	FATTR4_SIZE, FATTR4_FSID, FATTR4_FILEID, FATTR4_MODE, FATTR4_NUMLINKS,
+	FATTR4_OWNER, FATTR4_OWNER_GROUP, FATTR4_TIME_ACCESS, FATTR4_TIME_CREATE,
+	FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY };
+
+// READDIR has no GETFH, so the file handles are requested as attributes.
+// READDIR fails as a whole if attributes of a single entry can't be
+// obtained, unless FATTR4_RDATTR_ERROR is requested, too. GETATTR must not
+// request it, though.
+static Attribute sReadDirAttrs[] = { FATTR4_TYPE, FATTR4_CHANGE,
+	FATTR4_SIZE, FATTR4_FSID, FATTR4_RDATTR_ERROR, FATTR4_FILEHANDLE,
+	FATTR4_FILEID, FATTR4_MODE, FATTR4_NUMLINKS, FATTR4_OWNER,
+	FATTR4_OWNER_GROUP, FATTR4_TIME_ACCESS, FATTR4_TIME_CREATE,
+	FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY };
+
+static const uint32 kMaxReadDirSize = 256 * 1024;
 
 
 status_t
@@ -69,6 +92,7 @@ NFS4Inode::CommitWrites()
 		Request request(serv, fFileSystem);
 		RequestBuilder& req = request.Builder();
 
+		request.SetType(NFS4_RPC_COMMIT);
 		req.PutFH(fInfo.fHandle);
 		req.Commit(0, 0);
 
@@ -119,7 +143,7 @@ NFS4Inode::Access(uint32* allowed)
 
 status_t
 NFS4Inode::LookUp(const char* name, uint64* change, uint64* fileID,
-	FileHandle* handle, bool parent)
+	FileHandle* handle, bool parent, AttrValue** attrs, uint32* attrCount)
 {
 	ASSERT(name != NULL);
 
@@ -145,8 +169,13 @@ NFS4Inode::LookUp(const char* name, uint64* change, uint64* fileID,
 		if (handle != NULL)
 			req.GetFH();
 
-		Attribute attr[] = { FATTR4_FSID, FATTR4_FILEID };
-		req.GetAttr(attr, sizeof(attr) / sizeof(Attribute));
+		if (attrs != NULL) {
+			req.GetAttr(sPrefetchAttrs,
+				sizeof(sPrefetchAttrs) / sizeof(Attribute));
+		} else {
+			Attribute attr[] = { FATTR4_FSID, FATTR4_FILEID };
+			req.GetAttr(attr, sizeof(attr) / sizeof(Attribute));
+		}
 
 		status_t result = request.Send();
 		if (result != B_OK)
@@ -184,22 +213,30 @@ NFS4Inode::LookUp(const char* name, uint64* change, uint64* fileID,
 		if (result != B_OK)
 			return result;
 
+		ArrayDeleter<AttrValue> valuesDeleter(values);
+
 		// FATTR4_FSID is mandatory
+		const AttrValue* fsidValue = FindAttrValue(values, count, FATTR4_FSID);
+		if (fsidValue == NULL)
+			return B_BAD_VALUE;
 		FileSystemId* fsid
-			= reinterpret_cast<FileSystemId*>(values[0].fData.fPointer);
-		if (*fsid != fFileSystem->FsId()) {
-			delete[] values;
+			= reinterpret_cast<FileSystemId*>(fsidValue->fData.fPointer);
+		if (*fsid != fFileSystem->FsId())
 			return B_ENTRY_NOT_FOUND;
-		}
 
 		if (fileID != NULL) {
-			if (count < 2 || values[1].fAttribute != FATTR4_FILEID)
+			const AttrValue* value = FindAttrValue(values, count,
+				FATTR4_FILEID);
+			if (value == NULL)
 				*fileID = fFileSystem->AllocFileId();
 			else
-				*fileID = values[1].fData.fValue64;
+				*fileID = value->fData.fValue64;
 		}
 
-		delete[] values;
+		if (attrs != NULL) {
+			*attrs = valuesDeleter.Detach();
+			*attrCount = count;
+		}
 
 		return B_OK;
 	} while (true);
@@ -716,79 +753,331 @@ NFS4Inode::OpenAttr(OpenState* state, const char* name, int mode,
 }
 
 
+/*!	Copies \a size bytes of \a data to the given I/O vectors, starting
+	\a offset bytes into them.
+*/
+static void
+copy_to_vecs(const iovec* vecs, uint32 count, size_t offset, const void* data,
+	size_t size)
+{
+	const uint8* source = reinterpret_cast<const uint8*>(data);
+	for (uint32 i = 0; i < count && size > 0; i++) {
+		if (offset >= vecs[i].iov_len) {
+			offset -= vecs[i].iov_len;
+			continue;
+		}
+
+		size_t length = min_c(vecs[i].iov_len - offset, size);
+		memcpy(reinterpret_cast<uint8*>(vecs[i].iov_base) + offset, source,
+			length);
+		source += length;
+		size -= length;
+		offset = 0;
+	}
+}
+
+
 status_t
 NFS4Inode::ReadFile(OpenStateCookie* cookie, OpenState* state, uint64 position,
-	uint32* length, void* buffer, bool* eof)
+	const iovec* vecs, uint32 count, size_t* length, bool* eof)
 {
 	ASSERT(state != NULL);
 	ASSERT(length != NULL);
-	ASSERT(buffer != NULL);
+	ASSERT(vecs != NULL);
 	ASSERT(eof != NULL);
 
-	uint32 attempt = 0;
-	do {
-		RPC::Server* serv = fFileSystem->Server();
-		Request request(serv, fFileSystem);
-		RequestBuilder& req = request.Builder();
+	*eof = false;
+	return _PipelineIO(cookie, state, position, vecs, count, length, false,
+		false, eof);
+}
 
-		req.PutFH(state->fInfo.fHandle);
-		req.Read(state->fStateID, state->fStateSeq, position, *length);
 
-		status_t result = request.Send(cookie);
-		if (result != B_OK)
-			return result;
+status_t
+NFS4Inode::WriteFile(OpenStateCookie* cookie, OpenState* state, uint64 position,
+	const iovec* vecs, uint32 count, size_t* length, bool commit)
+{
+	ASSERT(state != NULL);
+	ASSERT(length != NULL);
+	ASSERT(vecs != NULL);
 
-		ReplyInterpreter& reply = request.Reply();
+	bool eof = false;
+	return _PipelineIO(cookie, state, position, vecs, count, length, true,
+		commit, &eof);
+}
+
+
+/*!	Splits the I/O into requests of the negotiated read or write size and
+	keeps several of them in flight at the same time, so that the throughput
+	isn't limited by the round trip time of a single request. The requests
+	are completed in order. If the server returns an error or transfers less
+	than requested, the rest of that request is done synchronously.
+	On error, the number of bytes transferred until then is returned in
+	\a length and the error is only returned, if nothing was transferred.
+*/
+status_t
+NFS4Inode::_PipelineIO(OpenStateCookie* cookie, OpenState* state,
+	uint64 position, const iovec* vecs, uint32 count, size_t* _length,
+	bool write, bool commit, bool* eof)
+{
+	uint32 ioSize = write ? fFileSystem->Root()->WriteSize()
+		: fFileSystem->Root()->ReadSize();
+	uint32 maxInFlight = fFileSystem->GetConfiguration().fMaxRequestsInFlight;
+
+	size_t length = *_length;
+	maxInFlight = min_c(maxInFlight, (length + ioSize - 1) / ioSize);
+	if (maxInFlight == 0) {
+		*_length = 0;
+		return B_OK;
+	}
+
+	IOSegment* segments = new(std::nothrow) IOSegment[maxInFlight];
+	if (segments == NULL)
+		return B_NO_MEMORY;
+	ArrayDeleter<IOSegment> segmentsDeleter(segments);
+
+	status_t result = B_OK;
+	size_t sent = 0;
+	size_t done = 0;
+	uint32 first = 0;
+	uint32 inFlight = 0;
+
+	while (true) {
+		while (result == B_OK && !*eof && inFlight < maxInFlight
+			&& sent < length) {
+			IOSegment& segment = segments[(first + inFlight) % maxInFlight];
+			segment.fOffset = sent;
+			segment.fLength = min_c(ioSize, length - sent);
+
+			status_t status = _SendIO(segment, cookie, state, position, vecs,
+				count, write, commit);
+			if (status != B_OK) {
+				// try again, once the requests in flight are done
+				if (inFlight == 0)
+					result = status;
+				break;
+			}
+
+			sent += segment.fLength;
+			inFlight++;
+		}
+
+		if (inFlight == 0)
+			break;
 
-		if (HandleErrors(attempt, reply.NFS4Error(), serv, cookie, state))
+		IOSegment& segment = segments[first];
+		first = (first + 1) % maxInFlight;
+		inFlight--;
+
+		if (result != B_OK || *eof) {
+			// the data isn't needed anymore
+			segment.fRequest->Wait();
+			delete segment.fRequest;
 			continue;
+		}
+
+		ASSERT(segment.fOffset == done);
+
+		size_t segmentDone = 0;
+		result = _FinishIO(segment, cookie, state, position, vecs, count,
+			write, commit, &segmentDone, eof);
+		done += segmentDone;
+		if (result == B_OK && segmentDone < segment.fLength && !*eof)
+			result = B_IO_ERROR;
+	}
+
+	*_length = done;
+	return done > 0 ? B_OK : result;
+}
+
+
+status_t
+NFS4Inode::_SendIO(IOSegment& segment, OpenStateCookie* cookie,
+	OpenState* state, uint64 position, const iovec* vecs, uint32 count,
+	bool write, bool commit)
+{
+	Request* request = new(std::nothrow) Request(fFileSystem->Server(),
+		fFileSystem);
+	if (request == NULL)
+		return B_NO_MEMORY;
+
+	RequestBuilder& req = request->Builder();
+	req.PutFH(state->fInfo.fHandle);
+	if (write) {
+		request->SetType(NFS4_RPC_WRITE);
+		req.Write(state->fStateID, state->fStateSeq, vecs, count,
+			segment.fOffset, position + segment.fOffset, segment.fLength,
+			commit);
+	} else {
+		request->SetType(NFS4_RPC_READ);
+		req.Read(state->fStateID, state->fStateSeq,
+			position + segment.fOffset, segment.fLength);
+	}
+
+	status_t result = request->SendAsync(cookie);
+	if (result != B_OK) {
+		delete request;
+		return result;
+	}
+
+	segment.fRequest = request;
+	return B_OK;
+}
 
+
+status_t
+NFS4Inode::_FinishIO(IOSegment& segment, OpenStateCookie* cookie,
+	OpenState* state, uint64 position, const iovec* vecs, uint32 count,
+	bool write, bool commit, size_t* _done, bool* eof)
+{
+	ObjectDeleter<Request> requestDeleter(segment.fRequest);
+
+	status_t result = segment.fRequest->Wait();
+	if (result != B_OK)
+		return result;
+
+	uint32 size = 0;
+	ReplyInterpreter& reply = segment.fRequest->Reply();
+	if (reply.NFS4Error() == NFS4_OK) {
 		reply.PutFH();
-		result = reply.Read(buffer, length, eof);
-		if (result != B_OK)
-			return result;
 
+		if (write) {
+			if (reply.Write(&size) != B_OK || size > segment.fLength)
+				size = 0;
+		} else {
+			const void* data;
+			size = segment.fLength;
+			if (reply.Read(&data, &size, eof) == B_OK) {
+				copy_to_vecs(vecs, count, segment.fOffset, data, size);
+				// make sure we don't stall on a server sending nothing
+				if (size == 0)
+					*eof = true;
+			} else {
+				size = 0;
+				*eof = false;
+			}
+		}
+	}
+
+	*_done = size;
+	if (size == segment.fLength || *eof)
 		return B_OK;
-	} while (true);
+
+	// Errors are handled (and the request retried, if appropriate) by the
+	// synchronous path. The same goes for short transfers.
+	size_t offset = segment.fOffset + size;
+	size_t length = segment.fLength - size;
+	if (write) {
+		result = _WriteFileSync(cookie, state, position + offset, vecs, count,
+			offset, &length, commit);
+	} else {
+		result = _ReadFileSync(cookie, state, position + offset, vecs, count,
+			offset, &length, eof);
+	}
+
+	*_done += length;
+	return result;
 }
 
 
 status_t
-NFS4Inode::WriteFile(OpenStateCookie* cookie, OpenState* state, uint64 position,
-	uint32* length, const void* buffer, bool commit)
+NFS4Inode::_ReadFileSync(OpenStateCookie* cookie, OpenState* state,
+	uint64 position, const iovec* vecs, uint32 count, size_t vecOffset,
+	size_t* _length, bool* eof)
 {
-	ASSERT(state != NULL);
-	ASSERT(length != NULL);
-	ASSERT(buffer != NULL);
+	size_t length = *_length;
+	size_t done = 0;
+	status_t result = B_OK;
+
+	while (done < length && !*eof && result == B_OK) {
+		uint32 attempt = 0;
+		do {
+			RPC::Server* serv = fFileSystem->Server();
+			Request request(serv, fFileSystem);
+			request.SetType(NFS4_RPC_READ);
+			RequestBuilder& req = request.Builder();
+
+			uint32 size = min_c(length - done,
+				fFileSystem->Root()->ReadSize());
+			req.PutFH(state->fInfo.fHandle);
+			req.Read(state->fStateID, state->fStateSeq, position + done,
+				size);
 
-	uint32 attempt = 0;
-	do {
-		RPC::Server* serv = fFileSystem->Server();
-		Request request(serv, fFileSystem);
-		RequestBuilder& req = request.Builder();
+			result = request.Send(cookie);
+			if (result != B_OK)
+				break;
 
-		req.PutFH(state->fInfo.fHandle);
+			ReplyInterpreter& reply = request.Reply();
 
-		req.Write(state->fStateID, state->fStateSeq, buffer, position, *length,
-			commit);
+			if (HandleErrors(attempt, reply.NFS4Error(), serv, cookie, state))
+				continue;
 
-		status_t result = request.Send(cookie);
-		if (result != B_OK)
-			return result;
+			reply.PutFH();
 
-		ReplyInterpreter& reply = request.Reply();
+			const void* data;
+			result = reply.Read(&data, &size, eof);
+			if (result != B_OK)
+				break;
 
-		if (HandleErrors(attempt, reply.NFS4Error(), serv, cookie, state))
-			continue;
+			copy_to_vecs(vecs, count, vecOffset + done, data, size);
+			done += size;
+			if (size == 0)
+				*eof = true;
+			break;
+		} while (true);
+	}
 
-		reply.PutFH();
+	*_length = done;
+	return done > 0 ? B_OK : result;
+}
 
-		result = reply.Write(length);
-		if (result != B_OK)
-			return result;
 
-		return B_OK;
-	} while (true);
+status_t
+NFS4Inode::_WriteFileSync(OpenStateCookie* cookie, OpenState* state,
+	uint64 position, const iovec* vecs, uint32 count, size_t vecOffset,
+	size_t* _length, bool commit)
+{
+	size_t length = *_length;
+	size_t done = 0;
+	status_t result = B_OK;
+
+	while (done < length && result == B_OK) {
+		uint32 attempt = 0;
+		do {
+			RPC::Server* serv = fFileSystem->Server();
+			Request request(serv, fFileSystem);
+			request.SetType(NFS4_RPC_WRITE);
+			RequestBuilder& req = request.Builder();
+
+			uint32 size = min_c(length - done,
+				fFileSystem->Root()->WriteSize());
+			req.PutFH(state->fInfo.fHandle);
+			req.Write(state->fStateID, state->fStateSeq, vecs, count,
+				vecOffset + done, position + done, size, commit);
+
+			result = request.Send(cookie);
+			if (result != B_OK)
+				break;
+
+			ReplyInterpreter& reply = request.Reply();
+
+			if (HandleErrors(attempt, reply.NFS4Error(), serv, cookie, state))
+				continue;
+
+			reply.PutFH();
+
+			result = reply.Write(&size);
+			if (result != B_OK)
+				break;
+
+			if (size == 0)
+				result = B_IO_ERROR;
+			done += size;
+			break;
+		} while (true);
+	}
+
+	*_length = done;
+	return done > 0 ? B_OK : result;
 }
 
 
@@ -977,9 +1266,20 @@ NFS4Inode::ReadDirOnce(DirEntry** dirents, uint32* count, OpenDirCookie* cookie,
 		if (*change == 0)
 			req.GetAttr(dirAttr, sizeof(dirAttr) / sizeof(Attribute));
 
-		Attribute attr[] = { FATTR4_FSID, FATTR4_FILEID };
-		req.ReadDir(*dirCookie, *dirCookieVerf, attr,
-			sizeof(attr) / sizeof(Attribute));
+		// The replies are as large as reads, but directory entries are
+		// decoded in memory all at once, so don't go too far.
+		uint32 maxCount = min_c(fFileSystem->Root()->ReadSize(),
+			kMaxReadDirSize);
+		uint32 dirCount = maxCount / 4;
+
+		if (attribute) {
+			Attribute attr[] = { FATTR4_FSID, FATTR4_FILEID };
+			req.ReadDir(*dirCookie, *dirCookieVerf, dirCount, maxCount, attr,
+				sizeof(attr) / sizeof(Attribute));
+		} else {
+			req.ReadDir(*dirCookie, *dirCookieVerf, dirCount, maxCount,
+				sReadDirAttrs, sizeof(sReadDirAttrs) / sizeof(Attribute));
+		}
 
 		req.GetAttr(dirAttr, sizeof(dirAttr) / sizeof(Attribute));
 
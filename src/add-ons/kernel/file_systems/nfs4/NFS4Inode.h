@@ -20,6 +20,8 @@
 #include "ReplyInterpreter.h"
 
 
+class Request;
+
 class NFS4Inode : public NFS4Object {
 public:
 			status_t	GetChangeInfo(uint64* change, bool attrDir = false);
@@ -31,7 +33,8 @@ protected:
 			status_t	CommitWrites();
 
 			status_t	LookUp(const char* name, uint64* change, uint64* fileID,
-							FileHandle* handle, bool parent = false);
+							FileHandle* handle, bool parent = false,
+							AttrValue** attrs = NULL, uint32* attrCount = NULL);
 
 			status_t	Link(Inode* dir, const char* name,
 							ChangeInfo* changeInfo);
@@ -57,11 +60,11 @@ protected:
 							OpenDelegationData* delegation, bool create);
 
 			status_t	ReadFile(OpenStateCookie* cookie, OpenState* state,
-							uint64 position, uint32* length, void* buffer,
-							bool* eof);
+							uint64 position, const iovec* vecs, uint32 count,
+							size_t* length, bool* eof);
 			status_t	WriteFile(OpenStateCookie* cookie, OpenState* state,
-							uint64 position, uint32* length,
-							const void* buffer, bool commit = false);
+							uint64 position, const iovec* vecs, uint32 count,
+							size_t* length, bool commit = false);
 
 			status_t	CreateObject(const char* name, const char* path,
 							int mode, FileType type, ChangeInfo* changeInfo,
@@ -82,6 +85,36 @@ protected:
 			status_t	AcquireLock(OpenFileCookie* cookie, LockInfo* lockInfo,
 							bool wait);
 			status_t	ReleaseLock(OpenFileCookie* cookie, LockInfo* lockInfo);
+
+private:
+			struct IOSegment {
+				Request*	fRequest;
+				size_t		fOffset;
+				uint32		fLength;
+			};
+
+			status_t	_PipelineIO(OpenStateCookie* cookie, OpenState* state,
+							uint64 position, const iovec* vecs, uint32 count,
+							size_t* length, bool write, bool commit,
+							bool* eof);
+			status_t	_SendIO(IOSegment& segment, OpenStateCookie* cookie,
+							OpenState* state, uint64 position,
+							const iovec* vecs, uint32 count, bool write,
+							bool commit);
+			status_t	_FinishIO(IOSegment& segment,
+							OpenStateCookie* cookie, OpenState* state,
+							uint64 position, const iovec* vecs, uint32 count,
+							bool write, bool commit, size_t* _done,
+							bool* eof);
+
+			status_t	_ReadFileSync(OpenStateCookie* cookie,
+							OpenState* state, uint64 position,
+							const iovec* vecs, uint32 count, size_t vecOffset,
+							size_t* length, bool* eof);
+			status_t	_WriteFileSync(OpenStateCookie* cookie,
+							OpenState* state, uint64 position,
+							const iovec* vecs, uint32 count, size_t vecOffset,
+							size_t* length, bool commit);
 };
 
 
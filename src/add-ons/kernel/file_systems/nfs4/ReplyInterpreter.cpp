@@ -369,15 +369,20 @@ ReplyInterpreter::OpenConfirm(uint32* stateSeq)
 
 
 status_t
-ReplyInterpreter::Read(void* buffer, uint32* size, bool* eof)
+ReplyInterpreter::Read(const void** data, uint32* size, bool* eof)
 {
 	status_t res = _OperationError(OpRead);
 	if (res != B_OK)
 		return res;
 
+	// The data is left in the reply's buffer, so that it can be copied
+	// directly to its final destination. On input *size is the number of
+	// bytes requested, the server must not send more than that.
+	uint32 requested = *size;
 	*eof = fReply->Stream().GetBoolean();
-	const void* ptr = fReply->Stream().GetOpaque(size);
-	memcpy(buffer, ptr, *size);
+	*data = fReply->Stream().GetOpaque(size);
+	if (*size > requested)
+		return B_BAD_DATA;
 
 	return fReply->Stream().IsEOF() ? B_BAD_VALUE : B_OK;
 }
@@ -652,6 +657,32 @@ ReplyInterpreter::_DecodeAttrs(XDR::ReadStream& str, AttrValue** attrs,
 		current++;
 	}
 
+	if (sIsAttrSet(FATTR4_RDATTR_ERROR, bitmap, bcount)) {
+		values[current].fAttribute = FATTR4_RDATTR_ERROR;
+		values[current].fData.fValue32 = stream.GetUInt();
+		current++;
+	}
+
+	if (sIsAttrSet(FATTR4_FILEHANDLE, bitmap, bcount)) {
+		values[current].fAttribute = FATTR4_FILEHANDLE;
+		values[current].fFreePointer = true;
+
+		uint32 size;
+		const void* ptr = stream.GetOpaque(&size);
+
+		FileHandle* handle
+			= reinterpret_cast<FileHandle*>(malloc(sizeof(FileHandle)));
+		if (handle != NULL) {
+			handle->fSize = min_c(size, NFS4_FHSIZE);
+			if (ptr != NULL)
+				memcpy(handle->fData, ptr, handle->fSize);
+			else
+				handle->fSize = 0;
+		}
+		values[current].fData.fPointer = handle;
+		current++;
+	}
+
 	if (sIsAttrSet(FATTR4_FILEID, bitmap, bcount)) {
 		values[current].fAttribute = FATTR4_FILEID;
 		values[current].fData.fValue64 = stream.GetUHyper();
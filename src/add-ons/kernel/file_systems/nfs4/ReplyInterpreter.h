@@ -48,6 +48,18 @@ struct AttrValue {
 	} fData;
 };
 
+// Returns the value of the given attribute, or NULL if the server didn't
+// send it.
+inline const AttrValue*
+FindAttrValue(const AttrValue* values, uint32 count, uint32 attribute)
+{
+	for (uint32 i = 0; i < count; i++) {
+		if (values[i].fAttribute == attribute)
+			return &values[i];
+	}
+	return NULL;
+}
+
 struct DirEntry {
 	const char*			fName;
 	AttrValue*			fAttrs;
@@ -90,7 +102,7 @@ public:
 			status_t	OpenConfirm(uint32* stateSeq);
 	inline	status_t	PutFH();
 	inline	status_t	PutRootFH();
-			status_t	Read(void* buffer, uint32* size, bool* eof);
+			status_t	Read(const void** data, uint32* size, bool* eof);
 			status_t	ReadDir(uint64* cookie, uint64* cookieVerf,
 							DirEntry** dirents, uint32* count, bool* eof);
 			status_t	ReadLink(void* buffer, uint32* size, uint32 maxSize);
@@ -16,137 +16,194 @@
 status_t
 Request::Send(Cookie* cookie)
 {
-	switch (fServer->ID().fProtocol) {
-		case IPPROTO_UDP:	return _SendUDP(cookie);
-		case IPPROTO_TCP:	return _SendTCP(cookie);
-	}
+	status_t result = SendAsync(cookie);
+	if (result != B_OK)
+		return result;
 
-	return B_BAD_VALUE;
+	return Wait();
 }
 
 
+/*!	Sends the call without waiting for the reply. Each successful call must be
+	followed by Wait(), which also takes care of retransmissions.
+*/
 status_t
-Request::_SendUDP(Cookie* cookie)
+Request::SendAsync(Cookie* cookie)
 {
-	RPC::Reply* rpl = NULL;
-	RPC::Request* rpc;
+	ASSERT(fCall == NULL);
+
+	fCookie = cookie;
+	fCallReply = NULL;
+	fReplySize = 0;
+	fAttempts = 0;
+	fStartTime = system_time();
+
+	fRequestTimeout = sSecToBigTime(60);
+	fRetryLimit = 0;
+	fHard = true;
+
+	if (fFileSystem != NULL) {
+		fRequestTimeout = fFileSystem->GetConfiguration().fRequestTimeout;
+		fRetryLimit = fFileSystem->GetConfiguration().fRetryLimit;
+		fHard = fFileSystem->GetConfiguration().fHard;
+	}
 
-	status_t result = fServer->SendCallAsync(fBuilder.Request(), &rpl, &rpc);
+	status_t result = _SendCall();
 	if (result != B_OK)
-		return result;
+		_RecordStatistics(false);
+	return result;
+}
 
-	if (cookie != NULL)
-		cookie->RegisterRequest(rpc);
 
-	int requestTimeout = sSecToBigTime(60);
-	int retryLimit = 0;
-	bool hard = true;
+status_t
+Request::Wait()
+{
+	ASSERT(fCall != NULL);
 
-	if (fFileSystem != NULL) {
-		requestTimeout = fFileSystem->GetConfiguration().fRequestTimeout;
-		retryLimit = fFileSystem->GetConfiguration().fRetryLimit;
-		hard = fFileSystem->GetConfiguration().fHard;
+	status_t result;
+	switch (fServer->ID().fProtocol) {
+		case IPPROTO_UDP:
+			result = _WaitUDP();
+			break;
+		case IPPROTO_TCP:
+			result = _WaitTCP();
+			break;
+		default:
+			_AbortCall();
+			result = B_BAD_VALUE;
 	}
 
-	result = fServer->WaitCall(rpc, requestTimeout);
+	_RecordStatistics(result == B_OK);
+	return result;
+}
+
+
+status_t
+Request::_SendCall()
+{
+	bool stream = fServer->ID().fProtocol == IPPROTO_TCP;
+
+	status_t result;
+	do {
+		result = fServer->SendCallAsync(fBuilder.Request(), &fCallReply,
+			&fCall);
+		if (result == B_OK || result == B_NO_MEMORY || !stream)
+			break;
+
+		fServer->Repair();
+	} while (_CanRetry());
+
 	if (result != B_OK) {
-		int attempts = 1;
-		while (result != B_OK && (hard || attempts++ < retryLimit)) {
-			result = fServer->ResendCallAsync(fBuilder.Request(), rpc);
-			if (result != B_OK) {
-				if (cookie != NULL)
-					cookie->UnregisterRequest(rpc);
-				delete rpc;
-				return result;
-			}
-
-			result = fServer->WaitCall(rpc, requestTimeout);
-		}
+		fCall = NULL;
+		return result;
+	}
+
+	if (fCookie != NULL)
+		fCookie->RegisterRequest(fCall);
 
+	return B_OK;
+}
+
+
+status_t
+Request::_WaitUDP()
+{
+	status_t result = fServer->WaitCall(fCall, fRequestTimeout);
+
+	fAttempts = 1;
+	while (result != B_OK && _CanRetry()) {
+		result = fServer->ResendCallAsync(fBuilder.Request(), fCall);
 		if (result != B_OK) {
-			if (cookie != NULL)
-				cookie->UnregisterRequest(rpc);
-			fServer->CancelCall(rpc);
-			delete rpc;
+			if (fCookie != NULL)
+				fCookie->UnregisterRequest(fCall);
+			delete fCall;
+			fCall = NULL;
 			return result;
 		}
-	}
 
-	if (cookie != NULL)
-		cookie->UnregisterRequest(rpc);
+		result = fServer->WaitCall(fCall, fRequestTimeout);
+	}
 
-	if (rpc->fError != B_OK) {
-		delete rpl;
-		result = rpc->fError;
-		delete rpc;
+	if (result != B_OK) {
+		_AbortCall();
 		return result;
-	} else {
-		fReply.SetTo(rpl);
-		delete rpc;
-		return B_OK;
 	}
+
+	return _FinishCall();
 }
 
 
 status_t
-Request::_SendTCP(Cookie* cookie)
+Request::_WaitTCP()
 {
-	RPC::Reply* rpl = NULL;
-	RPC::Request* rpc;
+	status_t result = fServer->WaitCall(fCall, fRequestTimeout);
+	while (result != B_OK) {
+		_AbortCall();
+		fServer->Repair();
 
-	status_t result;
-	int attempts = 0;
+		if (!_CanRetry())
+			return result;
 
-	int requestTimeout = sSecToBigTime(60);
-	int retryLimit = 0;
-	bool hard = true;
+		result = _SendCall();
+		if (result != B_OK)
+			return result;
 
-	if (fFileSystem != NULL) {
-		requestTimeout = fFileSystem->GetConfiguration().fRequestTimeout;
-		retryLimit = fFileSystem->GetConfiguration().fRetryLimit;
-		hard = fFileSystem->GetConfiguration().fHard;
+		result = fServer->WaitCall(fCall, fRequestTimeout);
 	}
 
-	do {
-		result = fServer->SendCallAsync(fBuilder.Request(), &rpl, &rpc);
-		if (result == B_NO_MEMORY)
-			return result;
-		else if (result != B_OK) {
-			fServer->Repair();
-			continue;
-		}
+	return _FinishCall();
+}
 
-		if (cookie != NULL)
-			cookie->RegisterRequest(rpc);
 
-		result = fServer->WaitCall(rpc, requestTimeout);
-		if (result != B_OK) {
-			if (cookie != NULL)
-				cookie->UnregisterRequest(rpc);
+status_t
+Request::_FinishCall()
+{
+	if (fCookie != NULL)
+		fCookie->UnregisterRequest(fCall);
 
-			fServer->CancelCall(rpc);
-			delete rpc;
+	status_t result = fCall->fError;
+	if (result != B_OK)
+		delete fCallReply;
+	else {
+		fReplySize = fCallReply->Stream().Size();
+		fReply.SetTo(fCallReply);
+	}
 
-			fServer->Repair();	
-		}
-	} while (result != B_OK && (hard || attempts++ < retryLimit));
+	delete fCall;
+	fCall = NULL;
+	fCallReply = NULL;
+	return result;
+}
 
-	if (result != B_OK)
-		return result;
 
-	if (cookie != NULL)
-		cookie->UnregisterRequest(rpc);
+void
+Request::_AbortCall()
+{
+	if (fCookie != NULL)
+		fCookie->UnregisterRequest(fCall);
 
-	if (rpc->fError != B_OK) {
-		delete rpl;
-		result = rpc->fError;
-		delete rpc;
-		return result;
-	} 
+	fServer->CancelCall(fCall);
+	delete fCall;
+	fCall = NULL;
+}
 
-	fReply.SetTo(rpl);
-	delete rpc;
-	return B_OK;
+
+inline bool
+Request::_CanRetry()
+{
+	return fHard || fAttempts++ < fRetryLimit;
+}
+
+
+void
+Request::_RecordStatistics(bool success)
+{
+	if (fFileSystem == NULL)
+		return;
+
+	fFileSystem->RecordRPC(fType, system_time() - fStartTime,
+		fBuilder.Request() != NULL ? fBuilder.Request()->Stream().Size() : 0,
+		fReplySize, success);
 }
 
 
@@ -9,6 +9,7 @@
 #define REQUEST_H
 
 
+#include "nfs4_ioctl.h"
 #include "ReplyInterpreter.h"
 #include "RequestBuilder.h"
 #include "RPCServer.h"
@@ -25,18 +26,44 @@ public:
 	inline	RequestBuilder&		Builder();
 	inline	ReplyInterpreter&	Reply();
 
+	inline	void				SetType(uint32 type);
+
 			status_t			Send(Cookie* cookie = NULL);
 			void				Reset();
 
+			// Send() split in two, so that several requests can be in
+			// flight at the same time.
+			status_t			SendAsync(Cookie* cookie = NULL);
+			status_t			Wait();
+
 private:
-			status_t			_SendUDP(Cookie* cookie);
-			status_t			_SendTCP(Cookie* cookie);
+			status_t			_SendCall();
+			status_t			_WaitUDP();
+			status_t			_WaitTCP();
+			status_t			_FinishCall();
+			void				_AbortCall();
+	inline	bool				_CanRetry();
+
+			void				_RecordStatistics(bool success);
 
 			RPC::Server*		fServer;
 			FileSystem*			fFileSystem;
 
 			RequestBuilder		fBuilder;
 			ReplyInterpreter	fReply;
+
+			uint32				fType;
+
+			Cookie*				fCookie;
+			RPC::Request*		fCall;
+			RPC::Reply*			fCallReply;
+			size_t				fReplySize;
+
+			bigtime_t			fStartTime;
+			bigtime_t			fRequestTimeout;
+			int					fRetryLimit;
+			int					fAttempts;
+			bool				fHard;
 };
 
 
@@ -44,7 +71,10 @@ inline
 Request::Request(RPC::Server* server, FileSystem* fileSystem)
 	:
 	fServer(server),
-	fFileSystem(fileSystem)
+	fFileSystem(fileSystem),
+	fType(NFS4_RPC_OTHER),
+	fCall(NULL),
+	fCallReply(NULL)
 {
 	ASSERT(server != NULL);
 }
@@ -64,5 +94,13 @@ Request::Reply()
 }
 
 
-#endif	// REQUEST_H
+/*!	Sets the statistics category (NFS4_RPC_*) the request is accounted to.
+*/
+inline void
+Request::SetType(uint32 type)
+{
+	fType = type;
+}
 
+
+#endif	// REQUEST_H
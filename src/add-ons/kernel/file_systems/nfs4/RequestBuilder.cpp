@@ -518,8 +518,8 @@ RequestBuilder::Read(const uint32* id, uint32 stateSeq, uint64 pos, uint32 len)
 
 
 status_t
-RequestBuilder::ReadDir(uint64 cookie, uint64 cookieVerf, Attribute* attrs,
-	uint32 attrCount)
+RequestBuilder::ReadDir(uint64 cookie, uint64 cookieVerf, uint32 dirCount,
+	uint32 maxCount, Attribute* attrs, uint32 attrCount)
 {
 	if (fProcedure != ProcCompound)
 		return B_BAD_VALUE;
@@ -530,9 +530,8 @@ RequestBuilder::ReadDir(uint64 cookie, uint64 cookieVerf, Attribute* attrs,
 	fRequest->Stream().AddUHyper(cookie);
 	fRequest->Stream().AddUHyper(cookieVerf);
 
-	// consider predicting this values basing on count or buffer size
-	fRequest->Stream().AddUInt(0x2000);
-	fRequest->Stream().AddUInt(0x8000);
+	fRequest->Stream().AddUInt(dirCount);
+	fRequest->Stream().AddUInt(maxCount);
 	_AttrBitmap(fRequest->Stream(), attrs, attrCount);
 
 	fOpCount++;
@@ -763,8 +762,8 @@ RequestBuilder::Verify(AttrValue* attr, uint32 count)
 
 
 status_t
-RequestBuilder::Write(const uint32* id, uint32 stateSeq, const void* buffer,
-	uint64 pos, uint32 len, bool stable)
+RequestBuilder::Write(const uint32* id, uint32 stateSeq, const iovec* vecs,
+	uint32 count, size_t vecOffset, uint64 pos, uint32 len, bool stable)
 {
 	if (fProcedure != ProcCompound)
 		return B_BAD_VALUE;
@@ -778,7 +777,7 @@ RequestBuilder::Write(const uint32* id, uint32 stateSeq, const void* buffer,
 	fRequest->Stream().AddUInt(id[2]);
 	fRequest->Stream().AddUHyper(pos);
 	fRequest->Stream().AddInt(stable ? FILE_SYNC4 : UNSTABLE4);
-	fRequest->Stream().AddOpaque(buffer, len);
+	fRequest->Stream().AddOpaque(vecs, count, vecOffset, len);
 
 	fOpCount++;
 
@@ -64,6 +64,7 @@ public:
 			status_t				Read(const uint32* id, uint32 stateSeq,
 										uint64 pos, uint32 len);
 			status_t				ReadDir(uint64 cookie, uint64 cookieVerf,
+										uint32 dirCount, uint32 maxCount,
 										Attribute* attrs, uint32 attrCount);
 			status_t				ReadLink();
 			status_t				Remove(const char* file);
@@ -76,7 +77,8 @@ public:
 			status_t				SetClientIDConfirm(uint64 id, uint64 ver);
 			status_t				Verify(AttrValue* attr, uint32 count);
 			status_t				Write(const uint32* id, uint32 stateSeq,
-										const void* buffer, uint64 pos,
+										const iovec* vecs, uint32 count,
+										size_t vecOffset, uint64 pos,
 										uint32 len, bool stable = false);
 			status_t				ReleaseLockOwner(OpenState* state,
 										LockOwner* owner);
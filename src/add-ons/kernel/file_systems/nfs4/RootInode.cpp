@@ -19,7 +19,9 @@ RootInode::RootInode()
 	:
 	fInfoCacheExpire(0),
 	fName(NULL),
-	fIOSize(0)
+	fIOSize(0),
+	fReadSize(0),
+	fWriteSize(0)
 {
 	mutex_init(&fInfoCacheLock, NULL);
 }
@@ -97,21 +99,23 @@ RootInode::_UpdateInfo(bool force)
 			next++;
 		}
 
-		uint64 ioSize = LONGLONG_MAX;
+		uint64 maxRead = LONGLONG_MAX;
 		if (count >= next && values[next].fAttribute == FATTR4_MAXREAD) {
-			ioSize = min_c(ioSize, values[next].fData.fValue64);
+			maxRead = values[next].fData.fValue64;
 			next++;
 		}
 
+		uint64 maxWrite = LONGLONG_MAX;
 		if (count >= next && values[next].fAttribute == FATTR4_MAXWRITE) {
-			ioSize = min_c(ioSize, values[next].fData.fValue64);
+			maxWrite = values[next].fData.fValue64;
 			next++;
 		}
 
-		if (ioSize == LONGLONG_MAX)
-			ioSize = 32768;
-		if (ioSize == 0)
-			ioSize = 4096;
+		const MountConfiguration& config = fFileSystem->GetConfiguration();
+		fReadSize = _LimitIOSize(maxRead, config.fReadSize);
+		fWriteSize = _LimitIOSize(maxWrite, config.fWriteSize);
+
+		uint32 ioSize = min_c(fReadSize, fWriteSize);
 		fInfoCache.io_size = ioSize;
 		fInfoCache.block_size = ioSize;
 		fIOSize = ioSize;
@@ -146,6 +150,29 @@ RootInode::_UpdateInfo(bool force)
 }
 
 
+/*!	Returns the size of a single READ or WRITE request: what the server
+	supports, but not more than the user asked for. A UDP datagram cannot
+	carry more than 64 kB, so the size is limited further in that case.
+*/
+uint32
+RootInode::_LimitIOSize(uint64 serverSize, uint32 configuredSize)
+{
+	if (serverSize == LONGLONG_MAX)
+		serverSize = 32768;
+	if (serverSize == 0)
+		serverSize = 4096;
+
+	uint64 size = min_c(serverSize, configuredSize);
+	if (fFileSystem->Server()->ID().fProtocol == IPPROTO_UDP)
+		size = min_c(size, 32768);
+
+	// keep whole pages together, the file cache reads and writes those
+	if (size > B_PAGE_SIZE)
+		size = size / B_PAGE_SIZE * B_PAGE_SIZE;
+	return size;
+}
+
+
 bool
 RootInode::ProbeMigration()
 {
@@ -26,6 +26,8 @@ public:
 	inline	void				MakeInfoInvalid();
 
 	inline	uint32				IOSize();
+	inline	uint32				ReadSize();
+	inline	uint32				WriteSize();
 
 			bool				ProbeMigration();
 			status_t			GetLocations(AttrValue** attr);
@@ -38,8 +40,12 @@ private:
 			const char*			fName;
 
 			uint32				fIOSize;
+			uint32				fReadSize;
+			uint32				fWriteSize;
 
 			status_t			_UpdateInfo(bool force = false);
+			uint32				_LimitIOSize(uint64 serverSize,
+									uint32 configuredSize);
 
 };
 
@@ -60,6 +66,28 @@ RootInode::IOSize()
 }
 
 
+inline uint32
+RootInode::ReadSize()
+{
+	if (fReadSize == 0)
+		_UpdateInfo(true);
+
+	// if the server couldn't be asked, keep the I/O going in small requests
+	return fReadSize != 0 ? fReadSize : B_PAGE_SIZE;
+}
+
+
+inline uint32
+RootInode::WriteSize()
+{
+	if (fWriteSize == 0)
+		_UpdateInfo(true);
+
+	// see ReadSize()
+	return fWriteSize != 0 ? fWriteSize : B_PAGE_SIZE;
+}
+
+
 inline void
 RootInode::SetName(const char* name)
 {
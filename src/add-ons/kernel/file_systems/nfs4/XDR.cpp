@@ -293,6 +293,41 @@ WriteStream::AddOpaque(const void* ptr, uint32 size)
 }
 
 
+/*!	Adds \a size bytes starting at \a offset of the data described by the
+	I/O vectors, so that the caller doesn't have to gather them first.
+*/
+status_t
+WriteStream::AddOpaque(const iovec* vecs, uint32 count, size_t offset,
+	uint32 size)
+{
+	uint32 real_size = _RealSize(size);
+	status_t err = _CheckResize(real_size + sizeof(uint32));
+	if (err != B_OK)
+		return err;
+
+	AddUInt(size);
+	uint8* buffer = reinterpret_cast<uint8*>(fBuffer + fPosition);
+	memset(buffer, 0, real_size);
+
+	uint32 copied = 0;
+	for (uint32 i = 0; i < count && copied < size; i++) {
+		if (offset >= vecs[i].iov_len) {
+			offset -= vecs[i].iov_len;
+			continue;
+		}
+
+		size_t length = min_c(vecs[i].iov_len - offset, size - copied);
+		memcpy(buffer + copied,
+			reinterpret_cast<uint8*>(vecs[i].iov_base) + offset, length);
+		copied += length;
+		offset = 0;
+	}
+	fPosition += real_size / sizeof(int32);
+
+	return copied == size ? B_OK : B_BAD_VALUE;
+}
+
+
 status_t
 WriteStream::AddOpaque(const WriteStream& stream)
 {
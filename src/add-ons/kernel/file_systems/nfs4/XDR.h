@@ -9,6 +9,8 @@
 #define XDR_H
 
 
+#include <sys/uio.h>
+
 #include <SupportDefs.h>
 
 
@@ -81,6 +83,8 @@ public:
 			status_t		AddString(const char* str, uint32 maxlen = 0);
 
 			status_t		AddOpaque(const void* ptr, uint32 size);
+			status_t		AddOpaque(const iovec* vecs, uint32 count,
+								size_t offset, uint32 size);
 			status_t		AddOpaque(const WriteStream& stream);
 
 			status_t		Append(const WriteStream& stream);
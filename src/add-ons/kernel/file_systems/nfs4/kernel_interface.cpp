@@ -8,6 +8,7 @@
 
 
 #include <stdio.h>
+#include <string.h>
 
 #include <AutoDeleter.h>
 #include <fs_cache.h>
@@ -49,6 +50,10 @@ extern fs_volume_ops gNFSv4VolumeOps;
 extern fs_vnode_ops gNFSv4VnodeOps;
 
 
+static const uint32 kDefaultMaxIOSize = 1024 * 1024;
+static const uint32 kDefaultRequestsInFlight = 8;
+
+
 RPC::ServerManager* gRPCServerManager;
 
 
@@ -73,6 +78,12 @@ CreateNFS4Server(RPC::Server* serv)
 //	proto=X		- user transport protocol X (default: tcp)
 //	dirtime=X	- attempt revalidate directory cache not more often than each X
 //				  seconds
+//	rsize=X		- read at most X bytes per request (default: 1 MB, the server
+//				  may support less)
+//	wsize=X		- write at most X bytes per request (default: 1 MB, the server
+//				  may support less)
+//	inflight=X	- allow X read or write requests of a single I/O operation to
+//				  be in flight at the same time (default: 8)
 static status_t
 ParseArguments(const char* _args, AddressResolver** address, char** _server,
 	char** _path, MountConfiguration* conf)
@@ -116,6 +127,9 @@ ParseArguments(const char* _args, AddressResolver** address, char** _server,
 	conf->fEmulateNamedAttrs = false;
 	conf->fCacheMetadata = true;
 	conf->fDirectoryCacheTime = sSecToBigTime(5);
+	conf->fReadSize = kDefaultMaxIOSize;
+	conf->fWriteSize = kDefaultMaxIOSize;
+	conf->fMaxRequestsInFlight = kDefaultRequestsInFlight;
 
 	char* optionsEnd = NULL;
 	if (options != NULL)
@@ -145,6 +159,15 @@ ParseArguments(const char* _args, AddressResolver** address, char** _server,
 		} else if (strncmp(options, "dirtime=", 8) == 0) {
 			options += strlen("dirtime=");
 			conf->fDirectoryCacheTime = sSecToBigTime(atoi(options));
+		} else if (strncmp(options, "rsize=", 6) == 0) {
+			options += strlen("rsize=");
+			conf->fReadSize = max_c(atoi(options), B_PAGE_SIZE);
+		} else if (strncmp(options, "wsize=", 6) == 0) {
+			options += strlen("wsize=");
+			conf->fWriteSize = max_c(atoi(options), B_PAGE_SIZE);
+		} else if (strncmp(options, "inflight=", 9) == 0) {
+			options += strlen("inflight=");
+			conf->fMaxRequestsInFlight = max_c(atoi(options), 1);
 		}
 
 		options = optionsEnd;
@@ -376,25 +399,17 @@ nfs4_read_pages(fs_volume* _volume, fs_vnode* vnode, void* _cookie, off_t pos,
 
 	OpenFileCookie* cookie = reinterpret_cast<OpenFileCookie*>(_cookie);
 
-	status_t result;
 	size_t totalRead = 0;
-	bool eof = false;
-	for (size_t i = 0; i < count && !eof; i++) {
-		size_t bytesLeft = vecs[i].iov_len;
-		char* buffer = reinterpret_cast<char*>(vecs[i].iov_base);
-
-		do {
-			size_t bytesRead = bytesLeft;
-			result = inode->ReadDirect(cookie, pos, buffer, &bytesRead, &eof);
-			if (result != B_OK)
-				return result;
+	for (size_t i = 0; i < count; i++)
+		totalRead += vecs[i].iov_len;
 
-			totalRead += bytesRead;
-			pos += bytesRead;
-			buffer += bytesRead;
-			bytesLeft -= bytesRead;
-		} while (bytesLeft > 0 && !eof);
-	}
+	// The whole request is handed over at once, so that it can be split into
+	// several RPCs that are in flight at the same time.
+	bool eof = false;
+	status_t result = inode->ReadDirect(cookie, pos, vecs, count, &totalRead,
+		&eof);
+	if (result != B_OK)
+		return result;
 
 	*_numBytes = totalRead;
 
@@ -420,26 +435,22 @@ nfs4_write_pages(fs_volume* _volume, fs_vnode* vnode, void* _cookie, off_t pos,
 
 	OpenFileCookie* cookie = reinterpret_cast<OpenFileCookie*>(_cookie);
 
-	status_t result;
-	for (size_t i = 0; i < count; i++) {
-		uint64 bytesLeft = vecs[i].iov_len;
-		if (pos + bytesLeft > inode->MaxFileSize())
-			bytesLeft = inode->MaxFileSize() - pos;
-
-		char* buffer = reinterpret_cast<char*>(vecs[i].iov_base);
+	uint64 length = 0;
+	for (size_t i = 0; i < count; i++)
+		length += vecs[i].iov_len;
 
-		do {
-			size_t bytesWritten = bytesLeft;
-
-			result = inode->WriteDirect(cookie, pos, buffer, &bytesWritten);
-			if (result != B_OK)
-				return result;
+	if (pos >= inode->MaxFileSize())
+		return B_OK;
+	if (pos + length > inode->MaxFileSize())
+		length = inode->MaxFileSize() - pos;
 
-			bytesLeft -= bytesWritten;
-			pos += bytesWritten;
-			buffer += bytesWritten;
-		} while (bytesLeft > 0);
-	}
+	size_t bytesWritten = length;
+	status_t result = inode->WriteDirect(cookie, pos, vecs, count,
+		&bytesWritten);
+	if (result != B_OK)
+		return result;
+	if (bytesWritten < length)
+		return B_IO_ERROR;
 
 	return B_OK;
 }
@@ -481,6 +492,40 @@ nfs4_get_file_map(fs_volume* volume, fs_vnode* vnode, off_t _offset,
 }
 
 
+static status_t
+nfs4_ioctl(fs_volume* volume, fs_vnode* vnode, void* _cookie, uint32 op,
+	void* buffer, size_t length)
+{
+	FileSystem* fs = reinterpret_cast<FileSystem*>(volume->private_volume);
+	TRACE("volume = %p, vnode = %" B_PRIi64 ", cookie = %p, op = %" B_PRIu32,
+		volume, reinterpret_cast<VnodeToInode*>(vnode->private_node)->ID(),
+		_cookie, op);
+
+	switch (op) {
+		case NFS4_IOCTL_GET_RPC_STATISTICS:
+		{
+			if (buffer == NULL || length < sizeof(nfs4_rpc_statistics))
+				return B_BAD_VALUE;
+
+			nfs4_rpc_statistics statistics;
+			fs->GetRPCStatistics(&statistics);
+
+			if (IS_USER_ADDRESS(buffer))
+				return user_memcpy(buffer, &statistics, sizeof(statistics));
+
+			memcpy(buffer, &statistics, sizeof(statistics));
+			return B_OK;
+		}
+
+		case NFS4_IOCTL_RESET_RPC_STATISTICS:
+			fs->ResetRPCStatistics();
+			return B_OK;
+	}
+
+	return B_DEV_INVALID_IOCTL;
+}
+
+
 static status_t
 nfs4_set_flags(fs_volume* volume, fs_vnode* vnode, void* _cookie, int flags)
 {
@@ -1465,7 +1510,7 @@ fs_vnode_ops gNFSv4VnodeOps = {
 
 	nfs4_get_file_map,
 
-	NULL,	// ioctl()
+	nfs4_ioctl,
 	nfs4_set_flags,
 	NULL,	// fs_select()
 	NULL,	// fs_deselect()
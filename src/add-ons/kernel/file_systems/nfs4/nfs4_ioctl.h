@@ -0,0 +1,48 @@
+/*
+ * Copyright 2026 Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef NFS4_IOCTL_H
+#define NFS4_IOCTL_H
+
+
+#include <Drivers.h>
+
+
+#define NFS4_IOCTL_BASE		(B_DEVICE_OP_CODES_END + 10201)
+
+enum {
+	NFS4_IOCTL_GET_RPC_STATISTICS	= NFS4_IOCTL_BASE,
+		// nfs4_rpc_statistics*
+	NFS4_IOCTL_RESET_RPC_STATISTICS
+};
+
+
+enum {
+	NFS4_RPC_READ	= 0,
+	NFS4_RPC_WRITE,
+	NFS4_RPC_COMMIT,
+	NFS4_RPC_OTHER,
+
+	NFS4_RPC_TYPE_COUNT
+};
+
+struct nfs4_rpc_type_statistics {
+	uint64		calls;
+	uint64		errors;
+	uint64		bytes_sent;
+	uint64		bytes_received;
+	bigtime_t	total_latency;
+	bigtime_t	max_latency;
+};
+
+// per mount
+struct nfs4_rpc_statistics {
+	nfs4_rpc_type_statistics	types[NFS4_RPC_TYPE_COUNT];
+	uint32						read_size;
+	uint32						write_size;
+	uint32						max_requests_in_flight;
+};
+
+
+#endif	// NFS4_IOCTL_H
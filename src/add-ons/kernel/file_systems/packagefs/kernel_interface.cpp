@@ -20,6 +20,7 @@
 #include "AttributeCookie.h"
 #include "AttributeDirectoryCookie.h"
 #include "DebugSupport.h"
+#include "DecompressedChunkCache.h"
 #include "Directory.h"
 #include "GlobalFactory.h"
 #include "Query.h"
@@ -142,10 +143,16 @@ packagefs_lookup(fs_volume* fsVolume, fs_vnode* fsDir, const char* entryName,
 		return volume->GetVNode(*_vnid, node);
 	}
 
+	// make sure the directory's children have been added
+	Directory* directory = dynamic_cast<Directory*>(dir);
+	status_t error = volume->PopulateDirectory(directory);
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
 	// resolve normal entries -- look up the node
 	NodeReadLocker dirLocker(dir);
 	String entryNameString;
-	Node* node = dynamic_cast<Directory*>(dir)->FindChild(StringKey(entryName));
+	Node* node = directory->FindChild(StringKey(entryName));
 	if (node == NULL)
 		return B_ENTRY_NOT_FOUND;
 	BReference<Node> nodeReference(node);
@@ -515,7 +522,6 @@ packagefs_open_dir(fs_volume* fsVolume, fs_vnode* fsNode, void** _cookie)
 
 	FUNCTION("volume: %p, node: %p (%" B_PRId64 ")\n", volume, node,
 		node->ID());
-	TOUCH(volume);
 
 	if (!S_ISDIR(node->Mode()))
 		return B_NOT_A_DIRECTORY;
@@ -526,6 +532,11 @@ packagefs_open_dir(fs_volume* fsVolume, fs_vnode* fsNode, void** _cookie)
 	if (error != B_OK)
 		return error;
 
+	// make sure the directory's children have been added
+	error = volume->PopulateDirectory(dir);
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
 	// create a cookie
 	NodeWriteLocker dirLocker(dir);
 	DirectoryCookie* cookie = new(std::nothrow) DirectoryCookie(dir);
@@ -949,6 +960,11 @@ packagefs_read_index_stat(fs_volume* fsVolume, const char* name,
 	if (index == NULL)
 		return B_ENTRY_NOT_FOUND;
 
+	// the index only knows the nodes that have been added to the tree
+	status_t error = volume->PopulateAllDirectories();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
 	VolumeReadLocker volumeReadLocker(volume);
 
 	memset(stat, 0, sizeof(*stat));
@@ -976,10 +992,15 @@ packagefs_open_query(fs_volume* fsVolume, const char* queryString, uint32 flags,
 		B_PRId32 ", token: %" B_PRIu32 "\n", volume, queryString, flags, port,
 		token);
 
+	// the indices only know the nodes that have been added to the tree
+	status_t error = volume->PopulateAllDirectories();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
 	VolumeWriteLocker volumeWriteLocker(volume);
 
 	Query* query;
-	status_t error = Query::Create(volume, queryString, flags, port, token,
+	error = Query::Create(volume, queryString, flags, port, token,
 		query);
 	if (error != B_OK)
 		return error;
@@ -1085,9 +1106,20 @@ packagefs_std_ops(int32 op, ...)
 				return error;
 			}
 
+			error = DecompressedChunkCache::CreateDefault();
+			if (error != B_OK) {
+				ERROR("Failed to init DecompressedChunkCache\n");
+				GlobalFactory::DeleteDefault();
+				StringConstants::Cleanup();
+				StringPool::Cleanup();
+				exit_debugging();
+				return error;
+			}
+
 			error = PackageFSRoot::GlobalInit();
 			if (error != B_OK) {
 				ERROR("Failed to init PackageFSRoot\n");
+				DecompressedChunkCache::DeleteDefault();
 				GlobalFactory::DeleteDefault();
 				StringConstants::Cleanup();
 				StringPool::Cleanup();
@@ -1102,6 +1134,7 @@ packagefs_std_ops(int32 op, ...)
 		{
 			PRINT("package_std_ops(): B_MODULE_UNINIT\n");
 			PackageFSRoot::GlobalUninit();
+			DecompressedChunkCache::DeleteDefault();
 			GlobalFactory::DeleteDefault();
 			StringConstants::Cleanup();
 			StringPool::Cleanup();
@@ -45,6 +45,9 @@ public:
 	inline	Node*				FirstChild() const;
 	inline	Node*				NextChild(Node* node) const;
 
+	inline	bool				HasPendingChildren() const;
+	inline	void				SetChildrenPending(bool pending);
+
 			void				AddDirectoryIterator(
 									DirectoryIterator* iterator);
 			void				RemoveDirectoryIterator(
@@ -71,4 +74,21 @@ Directory::NextChild(Node* node) const
 }
 
 
+bool
+Directory::HasPendingChildren() const
+{
+	return (fFlags & NODE_FLAG_CHILDREN_PENDING) != 0;
+}
+
+
+void
+Directory::SetChildrenPending(bool pending)
+{
+	if (pending)
+		fFlags |= NODE_FLAG_CHILDREN_PENDING;
+	else
+		fFlags &= ~(uint32)NODE_FLAG_CHILDREN_PENDING;
+}
+
+
 #endif	// DIRECTORY_H
@@ -31,6 +31,9 @@ enum {
 	NODE_FLAG_KNOWN_TO_VFS		= 0x01,
 	NODE_FLAG_VFS_INIT_ERROR	= 0x02,
 		// used by subclasses
+	NODE_FLAG_CHILDREN_PENDING	= 0x04
+		// directories only: the children of the package directories haven't
+		// been added yet
 };
 
 
@@ -39,6 +39,9 @@ public:
 
 	virtual	void				PrepareForRemoval();
 
+			const PackageDirectoryList& PackageDirectories() const
+									{ return fPackageDirectories; }
+
 	virtual	status_t			OpenAttributeDirectory(
 									AttributeDirectoryCookie*& _cookie);
 	virtual	status_t			OpenAttribute(const StringKey& name,
@@ -6,6 +6,8 @@
 
 #include "CachedDataReader.h"
 
+#include <stdlib.h>
+
 #include <algorithm>
 
 #include <DataIO.h>
@@ -15,6 +17,7 @@
 #include <vm/vm_page.h>
 
 #include "DebugSupport.h"
+#include "DecompressedChunkCache.h"
 
 
 using BPackageKit::BHPKG::BBufferDataReader;
@@ -82,7 +85,10 @@ CachedDataReader::CachedDataReader()
 	:
 	fReader(NULL),
 	fCache(NULL),
-	fCacheLineLockers()
+	fCacheLineLockers(),
+	fDeviceID(-1),
+	fNodeID(-1),
+	fUseChunkCache(false)
 {
 	mutex_init(&fLock, "packagefs cached reader");
 }
@@ -90,6 +96,9 @@ CachedDataReader::CachedDataReader()
 
 CachedDataReader::~CachedDataReader()
 {
+	if (fUseChunkCache)
+		DecompressedChunkCache::Default()->RemovePackage(fDeviceID, fNodeID);
+
 	if (fCache != NULL) {
 		fCache->Lock();
 		fCache->ReleaseRefAndUnlock();
@@ -99,10 +108,19 @@ CachedDataReader::~CachedDataReader()
 }
 
 
+/*!	If \a deviceID and \a nodeID are given, the data of cache lines read from
+	\a reader are additionally kept in the global DecompressedChunkCache, so
+	that they don't need to be decompressed again when the pages have been
+	discarded.
+*/
 status_t
-CachedDataReader::Init(BAbstractBufferedDataReader* reader, off_t size)
+CachedDataReader::Init(BAbstractBufferedDataReader* reader, off_t size,
+	dev_t deviceID, ino_t nodeID)
 {
 	fReader = reader;
+	fDeviceID = deviceID;
+	fNodeID = nodeID;
+	fUseChunkCache = nodeID >= 0 && DecompressedChunkCache::Default() != NULL;
 
 	status_t error = fCacheLineLockers.Init();
 	if (error != B_OK)
@@ -227,8 +245,7 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 			_DiscardPages(pages, firstMissing - firstPageOffset, missingPages);
 
 			// fall back to uncached transfer
-			return fReader->ReadDataToOutput(requestOffset, requestLength,
-				output);
+			return _ReadFromReader(requestOffset, requestLength, output);
 		}
 
 		// Allocate the missing pages and remove the already existing pages in
@@ -275,8 +292,7 @@ CachedDataReader::_ReadCacheLine(off_t lineOffset, size_t lineSize,
 			_DiscardPages(pages, firstMissing - firstPageOffset, missingPages);
 
 			// Try again using an uncached transfer
-			return fReader->ReadDataToOutput(requestOffset, requestLength,
-				output);
+			return _ReadFromReader(requestOffset, requestLength, output);
 		}
 	}
 
@@ -411,7 +427,50 @@ CachedDataReader::_ReadIntoPages(vm_page** pages, size_t firstPage,
 			fCache->virtual_end)
 		- firstPageOffset;
 
-	return fReader->ReadDataToOutput(firstPageOffset, requestLength, &output);
+	return _ReadFromReader(firstPageOffset, requestLength, &output);
+}
+
+
+/*!	Reads data from within a single cache line from the underlying reader.
+	If enabled, the data are taken from the DecompressedChunkCache, or the
+	complete cache line is read and added to it.
+*/
+status_t
+CachedDataReader::_ReadFromReader(off_t offset, size_t size, BDataIO* output)
+{
+	if (!fUseChunkCache)
+		return fReader->ReadDataToOutput(offset, size, output);
+
+	DecompressedChunkCache* chunkCache = DecompressedChunkCache::Default();
+
+	// The cache lines match the package file heap's chunks, so this is in
+	// effect a cache of decompressed chunks.
+	uint32 lineIndex = uint32(offset / kCacheLineSize);
+	off_t lineOffset = (off_t)lineIndex * kCacheLineSize;
+
+	status_t error = chunkCache->Read(fDeviceID, fNodeID, lineIndex,
+		offset - lineOffset, size, output);
+	if (error != B_ENTRY_NOT_FOUND)
+		return error;
+
+	size_t lineSize = std::min((off_t)kCacheLineSize,
+		fCache->virtual_end - lineOffset);
+	void* buffer = malloc(lineSize);
+	if (buffer == NULL)
+		return fReader->ReadDataToOutput(offset, size, output);
+
+	error = fReader->ReadData(lineOffset, buffer, lineSize);
+	if (error == B_OK) {
+		error = output->WriteExactly((uint8*)buffer + (offset - lineOffset),
+			size);
+	}
+	if (error != B_OK) {
+		free(buffer);
+		return error;
+	}
+
+	chunkCache->Insert(fDeviceID, fNodeID, lineIndex, buffer, lineSize);
+	return B_OK;
 }
 
 
@@ -24,7 +24,8 @@ public:
 	virtual						~CachedDataReader();
 
 			status_t			Init(BAbstractBufferedDataReader* reader,
-									off_t size);
+									off_t size, dev_t deviceID = -1,
+									ino_t nodeID = -1);
 
 	virtual	status_t			ReadDataToOutput(off_t offset, size_t size,
 									BDataIO* output);
@@ -129,6 +130,8 @@ private:
 									size_t requestLength, BDataIO* output);
 			status_t			_ReadIntoPages(vm_page** pages,
 									size_t firstPage, size_t pageCount);
+			status_t			_ReadFromReader(off_t offset, size_t size,
+									BDataIO* output);
 
 			void				_LockCacheLine(CacheLineLocker* lineLocker);
 			void				_UnlockCacheLine(CacheLineLocker* lineLocker);
@@ -143,6 +146,9 @@ private:
 			BAbstractBufferedDataReader* fReader;
 			VMCache*			fCache;
 			LockerTable			fCacheLineLockers;
+			dev_t				fDeviceID;
+			ino_t				fNodeID;
+			bool				fUseChunkCache;
 };
 
 
@@ -0,0 +1,641 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "ContentSnapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <zlib.h>
+
+#include <AutoDeleter.h>
+#include <package/hpkg/PackageEntry.h>
+#include <package/hpkg/PackageEntryAttribute.h>
+
+#include "DebugSupport.h"
+
+
+using BPackageKit::BHPKG::B_HPKG_MAX_INLINE_DATA_SIZE;
+
+
+static const uint32 kSnapshotMagic = 'PkSn';
+static const uint32 kSnapshotVersion = 1;
+
+// sanity limit for the snapshot file size
+static const off_t kMaxSnapshotSize = 128 * 1024 * 1024;
+
+static const size_t kInitialRecorderCapacity = 64 * 1024;
+
+// recorded item types
+enum {
+	RECORDED_ENTRY				= 1,
+	RECORDED_ENTRY_ATTRIBUTE	= 2,
+	RECORDED_ENTRY_DONE			= 3
+};
+
+
+// The snapshot file is a cache for the machine that wrote it, so everything
+// is stored in host byte order. A file written with a different byte order
+// is rejected because of the magic.
+struct packagefs_snapshot_header {
+	uint32	magic;
+	uint32	version;
+	uint32	package_count;
+	uint32	checksum;			// CRC32 of everything following the header
+	uint64	size;				// including the header
+};
+
+struct packagefs_snapshot_package {
+	int64	node_id;
+	int64	file_size;
+	int64	modified_time;		// in nanoseconds
+	uint32	content_size;
+	uint16	file_name_length;	// including the terminating null
+	uint16	reserved;
+	// followed by the file name and the recorded content
+};
+
+
+static int64
+timespec_to_nsecs(const timespec& time)
+{
+	return (int64)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+// #pragma mark - SnapshotReader
+
+
+namespace {
+
+struct SnapshotReader {
+	SnapshotReader(const uint8* data, size_t size)
+		:
+		fData(data),
+		fEnd(data + size)
+	{
+	}
+
+	bool AtEnd() const
+	{
+		return fData == fEnd;
+	}
+
+	bool Read(void* buffer, size_t size)
+	{
+		if ((size_t)(fEnd - fData) < size)
+			return false;
+
+		memcpy(buffer, fData, size);
+		fData += size;
+		return true;
+	}
+
+	template<typename Type>
+	bool Read(Type& value)
+	{
+		return Read(&value, sizeof(value));
+	}
+
+	bool Skip(size_t size, const uint8*& _data)
+	{
+		if ((size_t)(fEnd - fData) < size)
+			return false;
+
+		_data = fData;
+		fData += size;
+		return true;
+	}
+
+	bool ReadString(const char*& _string)
+	{
+		uint16 length;
+		if (!Read(length) || (size_t)(fEnd - fData) < (size_t)length + 1
+			|| fData[length] != '\0') {
+			return false;
+		}
+
+		_string = (const char*)fData;
+		fData += length + 1;
+		return true;
+	}
+
+	bool ReadPackageData(BPackageData& data)
+	{
+		uint8 isInline;
+		if (!Read(isInline))
+			return false;
+
+		if (isInline != 0) {
+			uint8 size;
+			if (!Read(size) || size > B_HPKG_MAX_INLINE_DATA_SIZE
+				|| (size_t)(fEnd - fData) < size) {
+				return false;
+			}
+
+			data.SetData(size, fData);
+			fData += size;
+			return true;
+		}
+
+		uint64 size;
+		uint64 offset;
+		if (!Read(size) || !Read(offset))
+			return false;
+
+		data.SetData(size, offset);
+		return true;
+	}
+
+private:
+	const uint8*	fData;
+	const uint8*	fEnd;
+};
+
+}	// unnamed namespace
+
+
+// #pragma mark - ContentRecorder
+
+
+ContentRecorder::ContentRecorder()
+	:
+	fData(NULL),
+	fSize(0),
+	fCapacity(0),
+	fError(B_OK)
+{
+}
+
+
+ContentRecorder::~ContentRecorder()
+{
+	free(fData);
+}
+
+
+void
+ContentRecorder::AddEntry(BPackageEntry* entry)
+{
+	uint8 type = RECORDED_ENTRY;
+	uint32 mode = entry->Mode();
+	uint32 modifiedTime = entry->ModifiedTime().tv_sec;
+	uint32 modifiedTimeNanos = entry->ModifiedTime().tv_nsec;
+
+	_Add(&type, sizeof(type));
+	_Add(&mode, sizeof(mode));
+	_Add(&modifiedTime, sizeof(modifiedTime));
+	_Add(&modifiedTimeNanos, sizeof(modifiedTimeNanos));
+	_AddString(entry->Name());
+
+	if (S_ISLNK(mode))
+		_AddString(entry->SymlinkPath());
+	else if (S_ISREG(mode))
+		_AddPackageData(entry->Data());
+}
+
+
+void
+ContentRecorder::AddEntryAttribute(BPackageEntryAttribute* attribute)
+{
+	uint8 type = RECORDED_ENTRY_ATTRIBUTE;
+	uint32 attributeType = attribute->Type();
+
+	_Add(&type, sizeof(type));
+	_AddString(attribute->Name());
+	_Add(&attributeType, sizeof(attributeType));
+	_AddPackageData(attribute->Data());
+}
+
+
+void
+ContentRecorder::EntryDone()
+{
+	uint8 type = RECORDED_ENTRY_DONE;
+	_Add(&type, sizeof(type));
+}
+
+
+void
+ContentRecorder::_AddString(const char* string)
+{
+	if (string == NULL)
+		string = "";
+
+	size_t length = strlen(string);
+	if (length > 0xffff) {
+		fError = B_NAME_TOO_LONG;
+		return;
+	}
+
+	uint16 length16 = length;
+	_Add(&length16, sizeof(length16));
+	_Add(string, length + 1);
+}
+
+
+void
+ContentRecorder::_AddPackageData(BPackageData& data)
+{
+	uint8 isInline = data.IsEncodedInline() ? 1 : 0;
+	_Add(&isInline, sizeof(isInline));
+
+	if (isInline != 0) {
+		uint8 size = data.Size();
+		_Add(&size, sizeof(size));
+		_Add(data.InlineData(), size);
+		return;
+	}
+
+	uint64 size = data.Size();
+	uint64 offset = data.Offset();
+	_Add(&size, sizeof(size));
+	_Add(&offset, sizeof(offset));
+}
+
+
+void
+ContentRecorder::_Add(const void* data, size_t size)
+{
+	if (fError != B_OK)
+		return;
+
+	if (fSize + size > fCapacity) {
+		size_t capacity = fCapacity > 0 ? fCapacity : kInitialRecorderCapacity;
+		while (fSize + size > capacity)
+			capacity *= 2;
+
+		uint8* newData = (uint8*)realloc(fData, capacity);
+		if (newData == NULL) {
+			fError = B_NO_MEMORY;
+			return;
+		}
+
+		fData = newData;
+		fCapacity = capacity;
+	}
+
+	memcpy(fData + fSize, data, size);
+	fSize += size;
+}
+
+
+// #pragma mark - ContentSnapshot
+
+
+struct ContentSnapshot::PackageRecord {
+	const char*		fileName;
+	ino_t			nodeID;
+	off_t			fileSize;
+	int64			modifiedTime;
+	const uint8*	content;
+	size_t			contentSize;
+};
+
+
+struct ContentSnapshot::ReplayEntry : BPackageEntry {
+	ReplayEntry(ReplayEntry* parent, const char* name)
+		:
+		BPackageEntry(parent, name),
+		parent(parent)
+	{
+	}
+
+	ReplayEntry*	parent;
+};
+
+
+ContentSnapshot::ContentSnapshot()
+	:
+	fData(NULL),
+	fPackages(NULL),
+	fPackageCount(0)
+{
+}
+
+
+ContentSnapshot::~ContentSnapshot()
+{
+	delete[] fPackages;
+	free(fData);
+}
+
+
+/*!	Reads the snapshot file and checks its integrity. If anything is wrong
+	with it, the snapshot remains empty and an error is returned.
+*/
+status_t
+ContentSnapshot::Load(int directoryFD, const char* path)
+{
+	int fd = openat(directoryFD, path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+	FileDescriptorCloser fdCloser(fd);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		RETURN_ERROR(errno);
+
+	if (st.st_size < (off_t)sizeof(packagefs_snapshot_header)
+		|| st.st_size > kMaxSnapshotSize) {
+		RETURN_ERROR(B_BAD_DATA);
+	}
+
+	// read the whole file at once
+	uint8* data = (uint8*)malloc(st.st_size);
+	if (data == NULL)
+		RETURN_ERROR(B_NO_MEMORY);
+	MemoryDeleter dataDeleter(data);
+
+	ssize_t bytesRead = read(fd, data, st.st_size);
+	if (bytesRead < 0)
+		RETURN_ERROR(errno);
+	if (bytesRead != st.st_size)
+		RETURN_ERROR(B_BAD_DATA);
+
+	// check the header
+	packagefs_snapshot_header header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion
+		|| header.size != (uint64)st.st_size) {
+		RETURN_ERROR(B_BAD_DATA);
+	}
+
+	const uint8* contentStart = data + sizeof(header);
+	size_t contentSize = st.st_size - sizeof(header);
+	if (crc32(0, contentStart, contentSize) != header.checksum)
+		RETURN_ERROR(B_BAD_DATA);
+
+	// index the packages
+	PackageRecord* packages
+		= new(std::nothrow) PackageRecord[header.package_count];
+	if (packages == NULL)
+		RETURN_ERROR(B_NO_MEMORY);
+	ArrayDeleter<PackageRecord> packagesDeleter(packages);
+
+	SnapshotReader reader(contentStart, contentSize);
+	for (uint32 i = 0; i < header.package_count; i++) {
+		packagefs_snapshot_package package;
+		const char* fileName;
+		const uint8* content;
+		if (!reader.Read(package) || !reader.ReadString(fileName)
+			|| strlen(fileName) + 1 != package.file_name_length
+			|| !reader.Skip(package.content_size, content)) {
+			RETURN_ERROR(B_BAD_DATA);
+		}
+
+		PackageRecord& record = packages[i];
+		record.fileName = fileName;
+		record.nodeID = package.node_id;
+		record.fileSize = package.file_size;
+		record.modifiedTime = package.modified_time;
+		record.content = content;
+		record.contentSize = package.content_size;
+	}
+
+	if (!reader.AtEnd())
+		RETURN_ERROR(B_BAD_DATA);
+
+	fData = (uint8*)dataDeleter.Detach();
+	fPackages = packagesDeleter.Detach();
+	fPackageCount = header.package_count;
+	return B_OK;
+}
+
+
+/*!	Returns the recorded content of the given package, if the snapshot
+	contains it and the package file hasn't changed since.
+*/
+bool
+ContentSnapshot::FindPackage(const Package* package, const uint8*& _content,
+	size_t& _contentSize) const
+{
+	for (int32 i = 0; i < fPackageCount; i++) {
+		const PackageRecord& record = fPackages[i];
+		if (record.nodeID != package->NodeID()
+			|| record.fileSize != package->FileSize()
+			|| record.modifiedTime
+				!= timespec_to_nsecs(package->ModifiedTime())
+			|| strcmp(record.fileName, package->FileName()) != 0) {
+			continue;
+		}
+
+		_content = record.content;
+		_contentSize = record.contentSize;
+		return true;
+	}
+
+	return false;
+}
+
+
+/*!	Writes a snapshot containing the recorded content of the given packages.
+	A package's content is taken from its ContentRecorder or, if it has been
+	replayed, from \a previous. Packages for which neither is available are
+	left out.
+*/
+/*static*/ status_t
+ContentSnapshot::Write(int directoryFD, const char* path,
+	const PackageFileNameHashTable& packages, const ContentSnapshot* previous)
+{
+	int fd = openat(directoryFD, path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return errno;
+	FileDescriptorCloser fdCloser(fd);
+
+	// Write the header last. Until then the file is invalid anyway, so a
+	// snapshot that hasn't been written completely is never used.
+	packagefs_snapshot_header header;
+	memset(&header, 0, sizeof(header));
+	off_t offset = sizeof(header);
+	uint32 checksum = crc32(0, NULL, 0);
+
+	for (PackageFileNameHashTable::Iterator it = packages.GetIterator();
+			Package* package = it.Next();) {
+		const uint8* content = NULL;
+		size_t contentSize = 0;
+		if (const ContentRecorder* recorder = package->Recorder()) {
+			if (recorder->InitCheck() == B_OK) {
+				content = recorder->Data();
+				contentSize = recorder->Size();
+			}
+		} else if (previous != NULL)
+			previous->FindPackage(package, content, contentSize);
+
+		if (content == NULL || contentSize > 0xffffffff)
+			continue;
+
+		const char* fileName = package->FileName();
+		packagefs_snapshot_package record;
+		memset(&record, 0, sizeof(record));
+		record.node_id = package->NodeID();
+		record.file_size = package->FileSize();
+		record.modified_time = timespec_to_nsecs(package->ModifiedTime());
+		record.content_size = contentSize;
+		record.file_name_length = strlen(fileName) + 1;
+		uint16 nameLength = record.file_name_length - 1;
+
+		const struct {
+			const void*	data;
+			size_t		size;
+		} parts[] = {
+			{ &record, sizeof(record) },
+			{ &nameLength, sizeof(nameLength) },
+			{ fileName, record.file_name_length },
+			{ content, contentSize }
+		};
+
+		for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+			ssize_t written = pwrite(fd, parts[i].data, parts[i].size, offset);
+			if (written < 0)
+				RETURN_ERROR(errno);
+			if ((size_t)written != parts[i].size)
+				RETURN_ERROR(B_DEVICE_FULL);
+
+			checksum = crc32(checksum, (const Bytef*)parts[i].data,
+				parts[i].size);
+			offset += written;
+		}
+
+		header.package_count++;
+	}
+
+	header.magic = kSnapshotMagic;
+	header.version = kSnapshotVersion;
+	header.checksum = checksum;
+	header.size = offset;
+
+	ssize_t written = pwrite(fd, &header, sizeof(header), 0);
+	if (written < 0)
+		RETURN_ERROR(errno);
+	if (written != (ssize_t)sizeof(header))
+		RETURN_ERROR(B_DEVICE_FULL);
+
+	return B_OK;
+}
+
+
+/*!	Feeds recorded content to the given handler, the same way the package
+	reader does when parsing the TOC.
+*/
+/*static*/ status_t
+ContentSnapshot::Replay(const uint8* content, size_t size,
+	BPackageContentHandler* handler)
+{
+	SnapshotReader reader(content, size);
+	ReplayEntry* entry = NULL;
+	status_t error = B_OK;
+
+	while (error == B_OK && !reader.AtEnd()) {
+		uint8 type;
+		reader.Read(type);
+
+		switch (type) {
+			case RECORDED_ENTRY:
+			{
+				uint32 mode;
+				uint32 modifiedTime;
+				uint32 modifiedTimeNanos;
+				const char* name;
+				if (!reader.Read(mode) || !reader.Read(modifiedTime)
+					|| !reader.Read(modifiedTimeNanos)
+					|| !reader.ReadString(name)) {
+					error = B_BAD_DATA;
+					break;
+				}
+
+				ReplayEntry* child = new(std::nothrow) ReplayEntry(entry, name);
+				if (child == NULL) {
+					error = B_NO_MEMORY;
+					break;
+				}
+				entry = child;
+
+				entry->SetType(mode);
+				entry->SetPermissions(mode);
+				entry->SetModifiedTime(modifiedTime);
+				entry->SetModifiedTimeNanos(modifiedTimeNanos);
+
+				if (S_ISLNK(mode)) {
+					const char* symlinkPath;
+					if (!reader.ReadString(symlinkPath)) {
+						error = B_BAD_DATA;
+						break;
+					}
+					entry->SetSymlinkPath(symlinkPath);
+				} else if (S_ISREG(mode)) {
+					if (!reader.ReadPackageData(entry->Data())) {
+						error = B_BAD_DATA;
+						break;
+					}
+				}
+
+				error = handler->HandleEntry(entry);
+				break;
+			}
+
+			case RECORDED_ENTRY_ATTRIBUTE:
+			{
+				const char* name;
+				uint32 attributeType;
+				if (entry == NULL || !reader.ReadString(name)
+					|| !reader.Read(attributeType)) {
+					error = B_BAD_DATA;
+					break;
+				}
+
+				BPackageEntryAttribute attribute(name);
+				attribute.SetType(attributeType);
+				if (!reader.ReadPackageData(attribute.Data())) {
+					error = B_BAD_DATA;
+					break;
+				}
+
+				error = handler->HandleEntryAttribute(entry, &attribute);
+				break;
+			}
+
+			case RECORDED_ENTRY_DONE:
+			{
+				if (entry == NULL) {
+					error = B_BAD_DATA;
+					break;
+				}
+
+				error = handler->HandleEntryDone(entry);
+
+				ReplayEntry* parent = entry->parent;
+				delete entry;
+				entry = parent;
+				break;
+			}
+
+			default:
+				error = B_BAD_DATA;
+				break;
+		}
+	}
+
+	if (error == B_OK && entry != NULL)
+		error = B_BAD_DATA;
+
+	if (error != B_OK)
+		handler->HandleErrorOccurred();
+
+	while (entry != NULL) {
+		ReplayEntry* parent = entry->parent;
+		delete entry;
+		entry = parent;
+	}
+
+	return error;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef CONTENT_SNAPSHOT_H
+#define CONTENT_SNAPSHOT_H
+
+
+#include <package/hpkg/PackageContentHandler.h>
+
+#include <Referenceable.h>
+
+#include "Package.h"
+
+
+using BPackageKit::BHPKG::BPackageContentHandler;
+using BPackageKit::BHPKG::BPackageData;
+using BPackageKit::BHPKG::BPackageEntry;
+using BPackageKit::BHPKG::BPackageEntryAttribute;
+
+
+/*!	Records the entries and entry attributes a package's TOC consists of in
+	a compact form that can be replayed to a BPackageContentHandler later.
+	Only what packagefs uses is recorded. The recording happens before any
+	package settings are applied, so a replay yields the same nodes as
+	parsing the TOC, even if the settings have changed in the meantime.
+*/
+class ContentRecorder {
+public:
+								ContentRecorder();
+								~ContentRecorder();
+
+			void				AddEntry(BPackageEntry* entry);
+			void				AddEntryAttribute(
+									BPackageEntryAttribute* attribute);
+			void				EntryDone();
+
+			status_t			InitCheck() const	{ return fError; }
+			const uint8*		Data() const		{ return fData; }
+			size_t				Size() const		{ return fSize; }
+
+private:
+			void				_AddString(const char* string);
+			void				_AddPackageData(BPackageData& data);
+			void				_Add(const void* data, size_t size);
+
+private:
+			uint8*				fData;
+			size_t				fSize;
+			size_t				fCapacity;
+			status_t			fError;
+};
+
+
+/*!	A snapshot of the recorded content of a volume's packages. It is stored
+	in the administrative directory and read in one go at mount time. When
+	a package's file is unchanged (same node ID, size, and modification
+	time), its recorded content is replayed instead of reading and
+	decompressing the package's TOC.
+*/
+class ContentSnapshot : public BReferenceable {
+public:
+								ContentSnapshot();
+	virtual						~ContentSnapshot();
+
+			status_t			Load(int directoryFD, const char* path);
+
+			int32				CountPackages() const
+									{ return fPackageCount; }
+			bool				FindPackage(const Package* package,
+									const uint8*& _content,
+									size_t& _contentSize) const;
+
+	static	status_t			Write(int directoryFD, const char* path,
+									const PackageFileNameHashTable& packages,
+									const ContentSnapshot* previous);
+	static	status_t			Replay(const uint8* content, size_t size,
+									BPackageContentHandler* handler);
+
+private:
+			struct PackageRecord;
+			struct ReplayEntry;
+
+private:
+			uint8*				fData;
+			PackageRecord*		fPackages;
+			int32				fPackageCount;
+};
+
+
+#endif	// CONTENT_SNAPSHOT_H
@@ -0,0 +1,354 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "DecompressedChunkCache.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+
+#include <DataIO.h>
+
+#include <debug.h>
+#include <low_resource_manager.h>
+#include <util/AutoLock.h>
+#include <vm/vm_page.h>
+
+#include "DebugSupport.h"
+
+
+static const size_t kMinCacheSize = 4 * 1024 * 1024;
+static const size_t kMaxCacheSize = 64 * 1024 * 1024;
+static const uint32 kPhysicalMemoryShift = 6;
+	// use 1/64 of the physical memory, within the limits above
+
+static const char* const kDumpCommandName = "packagefs_chunk_cache";
+
+
+/*static*/ DecompressedChunkCache* DecompressedChunkCache::sDefaultInstance
+	= NULL;
+
+
+DecompressedChunkCache::DecompressedChunkCache()
+	:
+	fEntries(),
+	fProbationList(),
+	fProtectedList(),
+	fSize(0),
+	fProtectedSize(0),
+	fMaxSize(0),
+	fHits(0),
+	fMisses(0),
+	fEvictions(0)
+{
+	mutex_init(&fLock, "packagefs chunk cache");
+}
+
+
+DecompressedChunkCache::~DecompressedChunkCache()
+{
+	unregister_low_resource_handler(&_LowMemoryHandler, this);
+	remove_debugger_command((char*)kDumpCommandName, &_DumpCommand);
+
+	mutex_lock(&fLock);
+	_Trim(0);
+	mutex_destroy(&fLock);
+}
+
+
+/*static*/ status_t
+DecompressedChunkCache::CreateDefault()
+{
+	if (sDefaultInstance != NULL)
+		return B_OK;
+
+	DecompressedChunkCache* cache = new(std::nothrow) DecompressedChunkCache;
+	if (cache == NULL)
+		return B_NO_MEMORY;
+
+	status_t error = cache->_Init();
+	if (error != B_OK) {
+		delete cache;
+		return error;
+	}
+
+	sDefaultInstance = cache;
+	return B_OK;
+}
+
+
+/*static*/ void
+DecompressedChunkCache::DeleteDefault()
+{
+	delete sDefaultInstance;
+	sDefaultInstance = NULL;
+}
+
+
+/*static*/ DecompressedChunkCache*
+DecompressedChunkCache::Default()
+{
+	return sDefaultInstance;
+}
+
+
+status_t
+DecompressedChunkCache::Read(dev_t device, ino_t node, uint32 chunkIndex,
+	size_t offset, size_t size, BDataIO* output)
+{
+	Key key = { device, node, chunkIndex };
+
+	MutexLocker locker(fLock);
+
+	Entry* entry = fEntries.Lookup(key);
+	if (entry == NULL || offset > entry->size || size > entry->size - offset) {
+		fMisses++;
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	fHits++;
+	_Touch(entry);
+	entry->referenceCount++;
+
+	// don't hold the lock while copying, the output might be in userland
+	locker.Unlock();
+
+	status_t error = output->WriteExactly((uint8*)entry->data + offset, size);
+
+	locker.Lock();
+	_ReleaseEntry(entry);
+
+	return error;
+}
+
+
+void
+DecompressedChunkCache::Insert(dev_t device, ino_t node, uint32 chunkIndex,
+	void* data, size_t size)
+{
+	// don't add to the memory pressure
+	if (size > fMaxSize
+		|| low_resource_state(B_KERNEL_RESOURCE_PAGES
+			| B_KERNEL_RESOURCE_MEMORY) >= B_LOW_RESOURCE_WARNING) {
+		free(data);
+		return;
+	}
+
+	Entry* entry = new(std::nothrow) Entry;
+	if (entry == NULL) {
+		free(data);
+		return;
+	}
+
+	entry->key.device = device;
+	entry->key.node = node;
+	entry->key.chunkIndex = chunkIndex;
+	entry->data = data;
+	entry->size = size;
+	entry->referenceCount = 0;
+	entry->isProtected = false;
+	entry->removed = false;
+
+	MutexLocker locker(fLock);
+
+	// someone else might have been quicker
+	if (fEntries.Lookup(entry->key) != NULL) {
+		locker.Unlock();
+		free(data);
+		delete entry;
+		return;
+	}
+
+	_Trim(fMaxSize - size);
+
+	if (fEntries.Insert(entry) != B_OK) {
+		locker.Unlock();
+		free(data);
+		delete entry;
+		return;
+	}
+
+	fProbationList.Add(entry, false);
+	fSize += size;
+}
+
+
+/*!	Removes all chunks of the given package file. Must be called when the
+	package file is no longer used, since its node ID might be reused.
+*/
+void
+DecompressedChunkCache::RemovePackage(dev_t device, ino_t node)
+{
+	MutexLocker locker(fLock);
+
+	EntryTable::Iterator it = fEntries.GetIterator();
+	while (Entry* entry = it.Next()) {
+		if (entry->key.device == device && entry->key.node == node)
+			_Remove(entry);
+	}
+}
+
+
+status_t
+DecompressedChunkCache::_Init()
+{
+	status_t error = fEntries.Init();
+	if (error != B_OK)
+		return error;
+
+	fMaxSize = std::max(kMinCacheSize, std::min(kMaxCacheSize,
+		(size_t)(vm_page_num_pages() * B_PAGE_SIZE) >> kPhysicalMemoryShift));
+
+	error = register_low_resource_handler(&_LowMemoryHandler, this,
+		B_KERNEL_RESOURCE_PAGES | B_KERNEL_RESOURCE_MEMORY, 0);
+	if (error != B_OK)
+		return error;
+
+	add_debugger_command_etc(kDumpCommandName, &_DumpCommand,
+		"Print the packagefs decompressed chunk cache statistics",
+		"\n"
+		"Prints the size and hit/miss statistics of the packagefs cache of\n"
+		"decompressed package heap chunks.\n", 0);
+
+	return B_OK;
+}
+
+
+/*!	Marks the entry as recently used. A hit in the probationary segment
+	promotes the entry to the protected segment, which may in turn push the
+	least recently used protected entries back to the probationary segment.
+	The caller must hold the lock.
+*/
+void
+DecompressedChunkCache::_Touch(Entry* entry)
+{
+	if (entry->isProtected) {
+		fProtectedList.Remove(entry);
+		fProtectedList.Add(entry, false);
+		return;
+	}
+
+	fProbationList.Remove(entry);
+	fProtectedList.Add(entry, false);
+	entry->isProtected = true;
+	fProtectedSize += entry->size;
+
+	// the protected segment gets at most three quarters of the cache
+	while (fProtectedSize > fMaxSize / 4 * 3) {
+		Entry* demoted = fProtectedList.RemoveTail();
+		demoted->isProtected = false;
+		fProtectedSize -= demoted->size;
+		fProbationList.Add(demoted, false);
+	}
+}
+
+
+/*!	Removes the entry from the cache. It is deleted right away, unless
+	someone is still reading its data. The caller must hold the lock.
+*/
+void
+DecompressedChunkCache::_Remove(Entry* entry)
+{
+	fEntries.RemoveUnchecked(entry);
+
+	if (entry->isProtected) {
+		fProtectedList.Remove(entry);
+		fProtectedSize -= entry->size;
+	} else
+		fProbationList.Remove(entry);
+
+	fSize -= entry->size;
+	entry->removed = true;
+
+	if (entry->referenceCount == 0) {
+		free(entry->data);
+		delete entry;
+	}
+}
+
+
+void
+DecompressedChunkCache::_ReleaseEntry(Entry* entry)
+{
+	if (--entry->referenceCount == 0 && entry->removed) {
+		free(entry->data);
+		delete entry;
+	}
+}
+
+
+/*!	Evicts least recently used entries, the probationary ones first, until
+	the cache size doesn't exceed \a targetSize anymore.
+	The caller must hold the lock.
+*/
+void
+DecompressedChunkCache::_Trim(size_t targetSize)
+{
+	while (fSize > targetSize) {
+		Entry* entry = fProbationList.Tail();
+		if (entry == NULL)
+			entry = fProtectedList.Tail();
+
+		_Remove(entry);
+		fEvictions++;
+	}
+}
+
+
+/*static*/ void
+DecompressedChunkCache::_LowMemoryHandler(void* data, uint32 resources,
+	int32 level)
+{
+	DecompressedChunkCache* cache = (DecompressedChunkCache*)data;
+
+	MutexLocker locker(cache->fLock);
+
+	size_t toFree;
+	switch (level) {
+		case B_NO_LOW_RESOURCE:
+			return;
+		case B_LOW_RESOURCE_NOTE:
+			toFree = cache->fSize / 8;
+			break;
+		case B_LOW_RESOURCE_WARNING:
+			toFree = cache->fSize / 4;
+			break;
+		case B_LOW_RESOURCE_CRITICAL:
+		default:
+			toFree = cache->fSize / 2;
+			break;
+	}
+
+	PRINT("DecompressedChunkCache: low memory level %" B_PRId32 ", freeing %"
+		B_PRIuSIZE " bytes\n", level, toFree);
+
+	cache->_Trim(cache->fSize - toFree);
+}
+
+
+/*static*/ int
+DecompressedChunkCache::_DumpCommand(int argc, char** argv)
+{
+	DecompressedChunkCache* cache = sDefaultInstance;
+	if (cache == NULL)
+		return 0;
+
+	uint64 lookups = cache->fHits + cache->fMisses;
+
+	kprintf("packagefs decompressed chunk cache %p\n", cache);
+	kprintf("  size:       %" B_PRIuSIZE " / %" B_PRIuSIZE " bytes\n",
+		cache->fSize, cache->fMaxSize);
+	kprintf("  protected:  %" B_PRIuSIZE " bytes\n", cache->fProtectedSize);
+	kprintf("  chunks:     %" B_PRIu32 "\n",
+		(uint32)cache->fEntries.CountElements());
+	kprintf("  hits:       %" B_PRIu64 " (%" B_PRIu64 "%%)\n", cache->fHits,
+		lookups > 0 ? cache->fHits * 100 / lookups : 0);
+	kprintf("  misses:     %" B_PRIu64 "\n", cache->fMisses);
+	kprintf("  evictions:  %" B_PRIu64 "\n", cache->fEvictions);
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+#ifndef DECOMPRESSED_CHUNK_CACHE_H
+#define DECOMPRESSED_CHUNK_CACHE_H
+
+
+#include <lock.h>
+#include <util/DoublyLinkedList.h>
+#include <util/OpenHashTable.h>
+
+
+class BDataIO;
+
+
+/*!	A global cache of decompressed package file heap chunks, shared by all
+	packagefs volumes. Chunks are identified by the package file's device and
+	node ID and the chunk's index.
+
+	The cache is a segmented LRU: new chunks enter the probationary segment
+	and are moved to the protected segment when hit again, so a scan through
+	many chunks that are read only once doesn't push the frequently used ones
+	out. The total size is bounded and shrunk further under memory pressure.
+*/
+class DecompressedChunkCache {
+private:
+								DecompressedChunkCache();
+								~DecompressedChunkCache();
+
+public:
+	static	status_t			CreateDefault();
+	static	void				DeleteDefault();
+	static	DecompressedChunkCache* Default();
+
+			status_t			Read(dev_t device, ino_t node,
+									uint32 chunkIndex, size_t offset,
+									size_t size, BDataIO* output);
+									// B_ENTRY_NOT_FOUND, if not cached
+			void				Insert(dev_t device, ino_t node,
+									uint32 chunkIndex, void* data,
+									size_t size);
+									// takes over the malloc()ed data
+			void				RemovePackage(dev_t device, ino_t node);
+
+private:
+			struct Key {
+				dev_t	device;
+				ino_t	node;
+				uint32	chunkIndex;
+			};
+
+			struct Entry : DoublyLinkedListLinkImpl<Entry> {
+				Key		key;
+				void*	data;
+				size_t	size;
+				int32	referenceCount;
+				bool	isProtected;
+				bool	removed;
+				Entry*	hashNext;
+			};
+
+			struct EntryHashDefinition {
+				typedef Key		KeyType;
+				typedef	Entry	ValueType;
+
+				size_t HashKey(const Key& key) const
+				{
+					return (size_t)key.node ^ ((size_t)key.device << 16)
+						^ ((size_t)key.chunkIndex * 0x9e3779b1);
+				}
+
+				size_t Hash(const Entry* value) const
+				{
+					return HashKey(value->key);
+				}
+
+				bool Compare(const Key& key, const Entry* value) const
+				{
+					return value->key.chunkIndex == key.chunkIndex
+						&& value->key.node == key.node
+						&& value->key.device == key.device;
+				}
+
+				Entry*& GetLink(Entry* value) const
+				{
+					return value->hashNext;
+				}
+			};
+
+			typedef BOpenHashTable<EntryHashDefinition> EntryTable;
+			typedef DoublyLinkedList<Entry> EntryList;
+
+private:
+			status_t			_Init();
+
+			void				_Touch(Entry* entry);
+			void				_Remove(Entry* entry);
+			void				_ReleaseEntry(Entry* entry);
+			void				_Trim(size_t targetSize);
+
+	static	void				_LowMemoryHandler(void* data,
+									uint32 resources, int32 level);
+	static	int					_DumpCommand(int argc, char** argv);
+
+private:
+	static	DecompressedChunkCache* sDefaultInstance;
+
+			mutex				fLock;
+			EntryTable			fEntries;
+			EntryList			fProbationList;
+			EntryList			fProtectedList;
+			size_t				fSize;
+			size_t				fProtectedSize;
+			size_t				fMaxSize;
+			uint64				fHits;
+			uint64				fMisses;
+			uint64				fEvictions;
+};
+
+
+#endif	// DECOMPRESSED_CHUNK_CACHE_H
@@ -27,6 +27,7 @@
 #include <util/AutoLock.h>
 
 #include "CachedDataReader.h"
+#include "ContentSnapshot.h"
 #include "DebugSupport.h"
 #include "GlobalFactory.h"
 #include "PackageDirectory.h"
@@ -95,10 +96,12 @@ private:
 
 
 struct Package::LoaderContentHandler : BPackageContentHandler {
-	LoaderContentHandler(Package* package, const PackageSettings& settings)
+	LoaderContentHandler(Package* package, const PackageSettings& settings,
+		ContentRecorder* recorder = NULL)
 		:
 		fPackage(package),
 		fSettings(settings),
+		fRecorder(recorder),
 		fSettingsItem(NULL),
 		fLastSettingsEntry(NULL),
 		fLastSettingsEntryEntry(NULL),
@@ -108,11 +111,20 @@ struct Package::LoaderContentHandler : BPackageContentHandler {
 
 	status_t Init()
 	{
+		// When only the TOC is parsed, the package name is already known.
+		if (!fPackage->Name().IsEmpty())
+			fSettingsItem = fSettings.PackageItemFor(fPackage->Name());
+
 		return B_OK;
 	}
 
 	virtual status_t HandleEntry(BPackageEntry* entry)
 	{
+		// record the unfiltered content, so the package settings can still
+		// be applied when it is replayed
+		if (fRecorder != NULL)
+			fRecorder->AddEntry(entry);
+
 		if (fErrorOccurred
 			|| (fLastSettingsEntry != NULL
 				&& fLastSettingsEntry->IsBlackListed())) {
@@ -196,6 +208,9 @@ struct Package::LoaderContentHandler : BPackageContentHandler {
 	virtual status_t HandleEntryAttribute(BPackageEntry* entry,
 		BPackageEntryAttribute* attribute)
 	{
+		if (fRecorder != NULL)
+			fRecorder->AddEntryAttribute(attribute);
+
 		if (fErrorOccurred
 			|| (fLastSettingsEntry != NULL
 				&& fLastSettingsEntry->IsBlackListed())) {
@@ -222,6 +237,9 @@ struct Package::LoaderContentHandler : BPackageContentHandler {
 
 	virtual status_t HandleEntryDone(BPackageEntry* entry)
 	{
+		if (fRecorder != NULL)
+			fRecorder->EntryDone();
+
 		if (entry == fLastSettingsEntryEntry) {
 			fLastSettingsEntryEntry = entry->Parent();
 			fLastSettingsEntry = fLastSettingsEntry->Parent();
@@ -370,6 +388,7 @@ struct Package::LoaderContentHandler : BPackageContentHandler {
 private:
 	Package*					fPackage;
 	const PackageSettings&		fSettings;
+	ContentRecorder*			fRecorder;
 	const PackageSettingsItem*	fSettingsItem;
 	PackageSettingsItem::Entry*	fLastSettingsEntry;
 	const BPackageEntry*		fLastSettingsEntryEntry;
@@ -701,7 +720,8 @@ public:
 		delete fHeapReader;
 	}
 
-	status_t Init(const PackageFileHeapReader* heapReader, int fd)
+	status_t Init(const PackageFileHeapReader* heapReader, int fd,
+		dev_t deviceID, ino_t nodeID)
 	{
 		fHeapReader = heapReader->Clone();
 		if (fHeapReader == NULL)
@@ -712,8 +732,15 @@ public:
 		fHeapReader->SetErrorOutput(this);
 		fHeapReader->SetFile(this);
 
+		// Only a compressed heap's chunks are worth keeping in the global
+		// decompressed chunk cache.
+		if (fHeapReader->CompressedHeapSize()
+				== (off_t)fHeapReader->UncompressedHeapSize()) {
+			nodeID = -1;
+		}
+
 		status_t error = CachedDataReader::Init(fHeapReader,
-			fHeapReader->UncompressedHeapSize());
+			fHeapReader->UncompressedHeapSize(), deviceID, nodeID);
 		if (error != B_OK)
 			return error;
 
@@ -749,11 +776,14 @@ private:
 
 
 struct Package::CachingPackageReader : public PackageReaderImpl {
-	CachingPackageReader(BErrorOutput* errorOutput)
+	CachingPackageReader(BErrorOutput* errorOutput, dev_t deviceID,
+		ino_t nodeID)
 		:
 		PackageReaderImpl(errorOutput),
 		fCachedHeapReader(NULL),
-		fFD(-1)
+		fFD(-1),
+		fDeviceID(deviceID),
+		fNodeID(nodeID)
 	{
 	}
 
@@ -775,7 +805,8 @@ struct Package::CachingPackageReader : public PackageReaderImpl {
 		if (fCachedHeapReader == NULL)
 			RETURN_ERROR(B_NO_MEMORY);
 
-		status_t error = fCachedHeapReader->Init(rawHeapReader, fFD);
+		status_t error = fCachedHeapReader->Init(rawHeapReader, fFD,
+			fDeviceID, fNodeID);
 		if (error != B_OK)
 			RETURN_ERROR(error);
 
@@ -800,6 +831,8 @@ struct Package::CachingPackageReader : public PackageReaderImpl {
 private:
 	HeapReaderV2*	fCachedHeapReader;
 	int				fFD;
+	dev_t			fDeviceID;
+	ino_t			fNodeID;
 };
 
 
@@ -807,7 +840,7 @@ private:
 
 
 Package::Package(::Volume* volume, PackagesDirectory* directory, dev_t deviceID,
-	ino_t nodeID)
+	ino_t nodeID, off_t fileSize, const timespec& modifiedTime)
 	:
 	fVolume(volume),
 	fPackagesDirectory(directory),
@@ -822,9 +855,14 @@ Package::Package(::Volume* volume, PackagesDirectory* directory, dev_t deviceID,
 	fOpenCount(0),
 	fHeapReader(NULL),
 	fNodeID(nodeID),
-	fDeviceID(deviceID)
+	fDeviceID(deviceID),
+	fFileSize(fileSize),
+	fModifiedTime(modifiedTime),
+	fContentRecorder(NULL),
+	fContentLoaded(false)
 {
 	mutex_init(&fLock, "packagefs package");
+	mutex_init(&fContentLock, "packagefs package content");
 
 	fPackagesDirectory->AcquireReference();
 }
@@ -833,9 +871,9 @@ Package::Package(::Volume* volume, PackagesDirectory* directory, dev_t deviceID,
 Package::~Package()
 {
 	delete fHeapReader;
+	delete fContentRecorder;
 
-	while (PackageNode* node = fNodes.RemoveHead())
-		node->ReleaseReference();
+	_DeleteNodes();
 
 	while (Resolvable* resolvable = fResolvables.RemoveHead())
 		delete resolvable;
@@ -847,6 +885,7 @@ Package::~Package()
 
 	fPackagesDirectory->ReleaseReference();
 
+	mutex_destroy(&fContentLock);
 	mutex_destroy(&fLock);
 }
 
@@ -861,6 +900,11 @@ Package::Init(const char* fileName)
 }
 
 
+/*!	Loads the package attributes, i.e. everything needed to resolve the
+	package's dependencies. For the current package file format the TOC is
+	left alone; it is read by LoadContent() once the package's node tree is
+	actually needed.
+*/
 status_t
 Package::Load(const PackageSettings& settings)
 {
@@ -875,6 +919,67 @@ Package::Load(const PackageSettings& settings)
 }
 
 
+/*!	Loads the package's node tree, unless that has already happened. May be
+	called without holding any volume lock.
+	If a \a snapshot is given and it contains the package's content, the
+	content is replayed from it. Otherwise the TOC is parsed and, if a
+	\a snapshot is given, recorded, so that it can be added to the next
+	snapshot (cf. Recorder()).
+*/
+status_t
+Package::LoadContent(const PackageSettings& settings,
+	ContentSnapshot* snapshot)
+{
+	MutexLocker contentLocker(fContentLock);
+	if (fContentLoaded)
+		return B_OK;
+
+	ContentRecorder* recorder = NULL;
+	if (snapshot != NULL) {
+		const uint8* content;
+		size_t contentSize;
+		if (snapshot->FindPackage(this, content, contentSize)) {
+			if (_ReplayContent(settings, content, contentSize) == B_OK) {
+				fContentLoaded = true;
+				return B_OK;
+			}
+
+			WARN("Package::LoadContent(): failed to replay content of "
+				"package \"%s\" from snapshot\n", fFileName.Data());
+			_DeleteNodes();
+		}
+
+		// Recording is merely an optimization for the next time, so we don't
+		// fail, if we can't do it.
+		recorder = new(std::nothrow) ContentRecorder;
+	}
+	ObjectDeleter<ContentRecorder> recorderDeleter(recorder);
+
+	status_t error = _LoadContent(settings, recorder);
+	if (error != B_OK) {
+		// drop the nodes created before the error occurred
+		_DeleteNodes();
+		return error;
+	}
+
+	fContentRecorder = recorderDeleter.Detach();
+	fContentLoaded = true;
+	return B_OK;
+}
+
+
+/*!	Deletes the recording of the package's content made by LoadContent(),
+	once it has been written to a snapshot or is not needed anymore.
+*/
+void
+Package::DeleteContentRecorder()
+{
+	MutexLocker contentLocker(fContentLock);
+	delete fContentRecorder;
+	fContentRecorder = NULL;
+}
+
+
 void
 Package::SetName(const String& name)
 {
@@ -1019,17 +1124,18 @@ Package::_Load(const PackageSettings& settings)
 
 	// try current package file format version
 	{
-		CachingPackageReader packageReader(&errorOutput);
+		CachingPackageReader packageReader(&errorOutput, fDeviceID,
+			fNodeID);
 		status_t error = packageReader.Init(fd, false,
 			BHPKG::B_HPKG_READER_DONT_PRINT_VERSION_MISMATCH_MESSAGE);
 		if (error == B_OK) {
-			// parse content
+			// parse the package attributes -- the TOC is parsed on demand
 			LoaderContentHandler handler(this, settings);
 			error = handler.Init();
 			if (error != B_OK)
 				RETURN_ERROR(error);
 
-			error = packageReader.ParseContent(&handler);
+			error = packageReader.ParsePackageAttributes(&handler);
 			if (error != B_OK)
 				RETURN_ERROR(error);
 
@@ -1063,10 +1169,66 @@ Package::_Load(const PackageSettings& settings)
 	if (fHeapReader == NULL)
 		RETURN_ERROR(B_NO_MEMORY);
 
+	// The version 1 reader can't parse the sections separately, so the
+	// content has been loaded as well.
+	fContentLoaded = true;
+
+	return B_OK;
+}
+
+
+status_t
+Package::_LoadContent(const PackageSettings& settings,
+	ContentRecorder* recorder)
+{
+	// open package file
+	int fd = Open();
+	if (fd < 0)
+		RETURN_ERROR(fd);
+	PackageCloser packageCloser(this);
+
+	// Only the TOC is needed, so the raw heap reader the package reader
+	// creates by default will do.
+	LoaderErrorOutput errorOutput(this);
+	PackageReaderImpl packageReader(&errorOutput);
+	status_t error = packageReader.Init(fd, false, 0);
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	LoaderContentHandler handler(this, settings, recorder);
+	error = handler.Init();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	error = packageReader.ParseTOC(&handler);
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
 	return B_OK;
 }
 
 
+status_t
+Package::_ReplayContent(const PackageSettings& settings, const uint8* content,
+	size_t contentSize)
+{
+	LoaderContentHandler handler(this, settings);
+	status_t error = handler.Init();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	return ContentSnapshot::Replay(content, contentSize, &handler);
+}
+
+
+void
+Package::_DeleteNodes()
+{
+	while (PackageNode* node = fNodes.RemoveHead())
+		node->ReleaseReference();
+}
+
+
 bool
 Package::_InitVersionedName()
 {
@@ -27,6 +27,8 @@ using BPackageKit::BPackageArchitecture;
 using BPackageKit::BHPKG::BAbstractBufferedDataReader;
 
 
+class ContentRecorder;
+class ContentSnapshot;
 class PackageLinkDirectory;
 class PackagesDirectory;
 class PackageSettings;
@@ -39,11 +41,18 @@ class Package : public BReferenceable,
 public:
 								Package(::Volume* volume,
 									PackagesDirectory* directory,
-									dev_t deviceID, ino_t nodeID);
+									dev_t deviceID, ino_t nodeID,
+									off_t fileSize,
+									const timespec& modifiedTime);
 								~Package();
 
 			status_t			Init(const char* fileName);
 			status_t			Load(const PackageSettings& settings);
+			status_t			LoadContent(
+									const PackageSettings& settings,
+									ContentSnapshot* snapshot = NULL);
+			bool				IsContentLoaded() const
+									{ return fContentLoaded; }
 
 			::Volume*			Volume() const		{ return fVolume; }
 			const String&		FileName() const	{ return fFileName; }
@@ -58,6 +67,10 @@ public:
 									{ return fDeviceID; }
 			ino_t				NodeID() const
 									{ return fNodeID; }
+			off_t				FileSize() const
+									{ return fFileSize; }
+			const timespec&		ModifiedTime() const
+									{ return fModifiedTime; }
 			PackagesDirectory*	Directory() const
 									{ return fPackagesDirectory; }
 
@@ -95,6 +108,10 @@ public:
 			status_t			CreateDataReader(const PackageData& data,
 									BAbstractBufferedDataReader*& _reader);
 
+			const ContentRecorder* Recorder() const
+									{ return fContentRecorder; }
+			void				DeleteContentRecorder();
+
 			const PackageNodeList& Nodes() const	{ return fNodes; }
 			const ResolvableList& Resolvables() const
 									{ return fResolvables; }
@@ -112,10 +129,18 @@ private:
 
 private:
 			status_t			_Load(const PackageSettings& settings);
+			status_t			_LoadContent(
+									const PackageSettings& settings,
+									ContentRecorder* recorder);
+			status_t			_ReplayContent(
+									const PackageSettings& settings,
+									const uint8* content, size_t contentSize);
+			void				_DeleteNodes();
 			bool				_InitVersionedName();
 
 private:
 			mutex				fLock;
+			mutex				fContentLock;
 			::Volume*			fVolume;
 			PackagesDirectory*	fPackagesDirectory;
 			String				fFileName;
@@ -131,9 +156,13 @@ private:
 			Package*			fFileNameHashTableNext;
 			ino_t				fNodeID;
 			dev_t				fDeviceID;
+			off_t				fFileSize;
+			timespec			fModifiedTime;
 			PackageNodeList		fNodes;
 			ResolvableList		fResolvables;
 			DependencyList		fDependencies;
+			ContentRecorder*	fContentRecorder;
+			bool				fContentLoaded;
 };
 
 
@@ -27,6 +27,7 @@
 #include <vfs.h>
 
 #include "AttributeIndex.h"
+#include "ContentSnapshot.h"
 #include "DebugSupport.h"
 #include "kernel_interface.h"
 #include "LastModifiedIndex.h"
@@ -68,6 +69,8 @@ static const char* const kActivationFileName
 static const char* const kActivationFilePath
 	= PACKAGES_DIRECTORY_ADMIN_DIRECTORY "/"
 		PACKAGES_DIRECTORY_ACTIVATION_FILE;
+static const char* const kContentSnapshotPath
+	= PACKAGES_DIRECTORY_ADMIN_DIRECTORY "/packagefs-snapshot";
 
 
 // #pragma mark - ShineThroughDirectory
@@ -171,7 +174,9 @@ Volume::Volume(fs_volume* fsVolume)
 	fPackagesDirectories(),
 	fPackagesDirectoriesByNodeRef(),
 	fPackageSettings(),
-	fNextNodeID(kRootDirectoryID + 1)
+	fContentSnapshot(NULL),
+	fNextNodeID(kRootDirectoryID + 1),
+	fPopulateLazily(true)
 {
 	rw_lock_init(&fLock, "packagefs volume");
 }
@@ -221,6 +226,9 @@ Volume::~Volume()
 	while (PackagesDirectory* directory = fPackagesDirectories.RemoveHead())
 		directory->ReleaseReference();
 
+	if (fContentSnapshot != NULL)
+		fContentSnapshot->ReleaseReference();
+
 	rw_lock_destroy(&fLock);
 }
 
@@ -327,6 +335,8 @@ Volume::Mount(const char* parameterString)
 			NULL, NULL);
 		packagesState = get_driver_parameter(parameterHandle, "state", NULL,
 			NULL);
+		fPopulateLazily = get_driver_boolean_parameter(parameterHandle,
+			"lazy", true, true);
 	}
 
 	CObjectDeleter<void, status_t> parameterHandleDeleter(parameterHandle,
@@ -406,6 +416,11 @@ Volume::Mount(const char* parameterString)
 	fRootDirectory->AcquireReference();
 		// one reference for the table
 
+	// Unless requested otherwise, the packages' content is added to the node
+	// tree only when a directory is accessed for the first time.
+	if (fPopulateLazily)
+		fRootDirectory->SetChildrenPending(true);
+
 	// register with packagefs root
 	error = ::PackageFSRoot::RegisterVolume(this);
 	if (error != B_OK)
@@ -422,6 +437,18 @@ Volume::Mount(const char* parameterString)
 	if (error != B_OK)
 		RETURN_ERROR(error);
 
+	// Read the snapshot of the packages' content written the last time. It is
+	// used for the initial packages only and dropped once their content has
+	// been loaded, so a missing or broken snapshot is nothing to worry about.
+	fContentSnapshot = new(std::nothrow) ContentSnapshot;
+	if (fContentSnapshot == NULL)
+		RETURN_ERROR(B_NO_MEMORY);
+
+	error = fContentSnapshot->Load(fPackagesDirectory->DirectoryFD(),
+		kContentSnapshotPath);
+	if (error != B_OK && error != B_ENTRY_NOT_FOUND)
+		INFORM("Failed to read content snapshot: %s\n", strerror(error));
+
 	// add initial packages
 	error = _AddInitialPackages();
 	if (error != B_OK)
@@ -564,6 +591,93 @@ Volume::IOCtl(Node* node, uint32 operation, void* buffer, size_t size)
 }
 
 
+/*!	Adds the children of the given directory's package directories to the
+	directory, if that hasn't happened yet. For the root directory this also
+	loads the content of all packages not loaded yet.
+*/
+status_t
+Volume::PopulateDirectory(Directory* directory)
+{
+	if (!directory->HasPendingChildren())
+		return B_OK;
+
+	if (directory == fRootDirectory)
+		_LoadPendingPackageContents();
+
+	VolumeWriteLocker systemVolumeLocker(_SystemVolumeIfNotSelf());
+	VolumeWriteLocker volumeLocker(this);
+
+	if (directory == fRootDirectory)
+		return _PopulateRootDirectory();
+
+	UnpackingDirectory* unpackingDirectory
+		= dynamic_cast<UnpackingDirectory*>(directory);
+	if (unpackingDirectory == NULL)
+		return B_OK;
+
+	return _PopulateDirectory(unpackingDirectory);
+}
+
+
+/*!	Populates all directories and disables lazy population for the future.
+	Needed when the indices must be complete, i.e. for queries.
+*/
+status_t
+Volume::PopulateAllDirectories()
+{
+	if (!fPopulateLazily)
+		return B_OK;
+
+	_LoadPendingPackageContents();
+
+	VolumeWriteLocker systemVolumeLocker(_SystemVolumeIfNotSelf());
+	VolumeWriteLocker volumeLocker(this);
+
+	if (!fPopulateLazily)
+		return B_OK;
+
+	status_t error = _PopulateRootDirectory();
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	// Iterate through the tree in pre-order and populate every directory
+	// before visiting its children. Newly created directories are still
+	// created with pending children, but since they are added to directories
+	// we haven't visited yet, we will get to them.
+	Node* node = fRootDirectory->FirstChild();
+	while (node != NULL) {
+		if (UnpackingDirectory* directory
+				= dynamic_cast<UnpackingDirectory*>(node)) {
+			error = _PopulateDirectory(directory);
+			if (error != B_OK)
+				RETURN_ERROR(error);
+
+			if (directory->FirstChild() != NULL) {
+				node = directory->FirstChild();
+				continue;
+			}
+		}
+
+		// continue with the next available (ancestors's) sibling
+		while (node != fRootDirectory) {
+			Node* sibling = node->Parent()->NextChild(node);
+			if (sibling != NULL) {
+				node = sibling;
+				break;
+			}
+
+			node = node->Parent();
+		}
+
+		if (node == fRootDirectory)
+			break;
+	}
+
+	fPopulateLazily = false;
+	return B_OK;
+}
+
+
 void
 Volume::AddNodeListener(NodeListener* listener, Node* node)
 {
@@ -803,6 +917,10 @@ Volume::_AddInitialPackages()
 		}
 	}
 
+	// If the packages' content has been added right away, it is complete now.
+	if (!fRootDirectory->HasPendingChildren())
+		_WriteContentSnapshot();
+
 	return B_OK;
 }
 
@@ -981,6 +1099,41 @@ Volume::_FindPackage(const char* fileName) const
 
 status_t
 Volume::_AddPackageContent(Package* package, bool notify)
+{
+	status_t error = fPackageFSRoot->AddPackage(package);
+	if (error != B_OK)
+		RETURN_ERROR(error);
+
+	// As long as the root directory hasn't been populated, no one has seen any
+	// package content yet, so adding the package's nodes can wait, too.
+	if (fRootDirectory->HasPendingChildren())
+		return B_OK;
+
+	error = package->LoadContent(fPackageSettings, fContentSnapshot);
+	if (error == B_OK)
+		error = _AddPackageContentRootNodes(package, notify);
+	if (error != B_OK) {
+		fPackageFSRoot->RemovePackage(package);
+		RETURN_ERROR(error);
+	}
+
+	return B_OK;
+}
+
+
+void
+Volume::_RemovePackageContent(Package* package, PackageNode* endNode,
+	bool notify)
+{
+	if (!fRootDirectory->HasPendingChildren())
+		_RemovePackageContentRootNodes(package, endNode, notify);
+
+	fPackageFSRoot->RemovePackage(package);
+}
+
+
+status_t
+Volume::_AddPackageContentRootNodes(Package* package, bool notify)
 {
 	// Open the package. We don't need the FD here, but this is an optimization.
 	// The attribute indices may want to read the package nodes' attributes and
@@ -992,10 +1145,6 @@ Volume::_AddPackageContent(Package* package, bool notify)
 		RETURN_ERROR(fd);
 	PackageCloser packageCloser(package);
 
-	status_t error = fPackageFSRoot->AddPackage(package);
-	if (error != B_OK)
-		RETURN_ERROR(error);
-
 	for (PackageNodeList::Iterator it = package->Nodes().GetIterator();
 			PackageNode* node = it.Next();) {
 		// skip over ".PackageInfo" file, it isn't part of the package content
@@ -1003,9 +1152,9 @@ Volume::_AddPackageContent(Package* package, bool notify)
 				BPackageKit::BHPKG::B_HPKG_PACKAGE_INFO_FILE_NAME) == 0) {
 			continue;
 		}
-		error = _AddPackageContentRootNode(package, node, notify);
+		status_t error = _AddPackageContentRootNode(package, node, notify);
 		if (error != B_OK) {
-			_RemovePackageContent(package, node, notify);
+			_RemovePackageContentRootNodes(package, node, notify);
 			RETURN_ERROR(error);
 		}
 	}
@@ -1015,7 +1164,7 @@ Volume::_AddPackageContent(Package* package, bool notify)
 
 
 void
-Volume::_RemovePackageContent(Package* package, PackageNode* endNode,
+Volume::_RemovePackageContentRootNodes(Package* package, PackageNode* endNode,
 	bool notify)
 {
 	PackageNode* node = package->Nodes().Head();
@@ -1033,8 +1182,6 @@ Volume::_RemovePackageContent(Package* package, PackageNode* endNode,
 
 		node = nextNode;
 	}
-
-	fPackageFSRoot->RemovePackage(package);;
 }
 
 
@@ -1069,12 +1216,15 @@ Volume::_AddPackageContentRootNode(Package* package,
 			RETURN_ERROR(error);
 		}
 
-		// recurse into directory, unless we're supposed to skip the node
+		// recurse into directory, unless we're supposed to skip the node or
+		// the directory's children will be added when it is populated
 		if (node != NULL) {
 			if (PackageDirectory* packageDirectory
 					= dynamic_cast<PackageDirectory*>(packageNode)) {
-				if (packageDirectory->FirstChild() != NULL) {
-					directory = dynamic_cast<Directory*>(node);
+				Directory* childDirectory = dynamic_cast<Directory*>(node);
+				if (packageDirectory->FirstChild() != NULL
+					&& !childDirectory->HasPendingChildren()) {
+					directory = childDirectory;
 					packageNode = packageDirectory->FirstChild();
 					directory->WriteLock();
 					continue;
@@ -1127,8 +1277,10 @@ Volume::_RemovePackageContentRootNode(Package* package,
 		if (PackageDirectory* packageDirectory
 				= dynamic_cast<PackageDirectory*>(packageNode)) {
 			if (packageDirectory->FirstChild() != NULL) {
-				if (Directory* childDirectory = dynamic_cast<Directory*>(
-						directory->FindChild(packageNode->Name()))) {
+				Directory* childDirectory = dynamic_cast<Directory*>(
+					directory->FindChild(packageNode->Name()));
+				if (childDirectory != NULL
+					&& !childDirectory->HasPendingChildren()) {
 					directory = childDirectory;
 					packageNode = packageDirectory->FirstChild();
 					directory->WriteLock();
@@ -1394,6 +1546,11 @@ Volume::_CreateUnpackingNode(mode_t mode, Directory* parent, const String& name,
 	if (error != B_OK)
 		RETURN_ERROR(error);
 
+	if (fPopulateLazily && S_ISDIR(mode)) {
+		static_cast<UnpackingDirectory*>(unpackingNode)
+			->SetChildrenPending(true);
+	}
+
 	parent->AddChild(node);
 
 	fNodes.Insert(node);
@@ -1480,7 +1637,7 @@ Volume::_LoadPackage(PackagesDirectory* packagesDirectory, const char* name,
 
 	// create a package
 	Package* package = new(std::nothrow) Package(this, packagesDirectory,
-		st.st_dev, st.st_ino);
+		st.st_dev, st.st_ino, st.st_size, st.st_mtim);
 	if (package == NULL)
 		RETURN_ERROR(B_NO_MEMORY);
 	BReference<Package> packageReference(package, true);
@@ -1498,6 +1655,183 @@ Volume::_LoadPackage(PackagesDirectory* packagesDirectory, const char* name,
 }
 
 
+/*!	Loads the content of all packages that haven't been loaded yet. The
+	volume must not be locked, since reading the TOCs may take a while. Errors
+	are ignored here; the content is loaded again (and errors are handled) with
+	the volume locked.
+*/
+void
+Volume::_LoadPendingPackageContents()
+{
+	BReference<Package>* packages;
+	uint32 packageCount = 0;
+	BReference<ContentSnapshot> snapshotReference;
+	{
+		VolumeReadLocker volumeLocker(this);
+		if (!fRootDirectory->HasPendingChildren())
+			return;
+
+		snapshotReference.SetTo(fContentSnapshot);
+
+		packages = new(std::nothrow) BReference<Package>[
+			fPackages.CountElements()];
+		if (packages == NULL)
+			return;
+
+		for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+				Package* package = it.Next();) {
+			if (!package->IsContentLoaded())
+				packages[packageCount++].SetTo(package);
+		}
+	}
+	ArrayDeleter<BReference<Package> > packagesDeleter(packages);
+
+	for (uint32 i = 0; i < packageCount; i++)
+		packages[i]->LoadContent(fPackageSettings, snapshotReference.Get());
+}
+
+
+/*!	Adds the root nodes of all packages to the root directory. Packages whose
+	content cannot be loaded remain active (their resolvables are still
+	registered), but don't contribute any nodes.
+	The volume must be write-locked.
+*/
+status_t
+Volume::_PopulateRootDirectory()
+{
+	NodeWriteLocker rootDirectoryLocker(fRootDirectory);
+	if (!fRootDirectory->HasPendingChildren())
+		return B_OK;
+
+	fRootDirectory->SetChildrenPending(false);
+
+	for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+		Package* package = it.Next();) {
+		status_t error = package->LoadContent(fPackageSettings,
+			fContentSnapshot);
+		if (error != B_OK) {
+			ERROR("Failed to load content of package \"%s\": %s\n",
+				package->FileName().Data(), strerror(error));
+			continue;
+		}
+
+		error = _AddPackageContentRootNodes(package, false);
+		if (error != B_OK) {
+			for (it.Rewind(); Package* addedPackage = it.Next();) {
+				if (addedPackage == package)
+					break;
+				_RemovePackageContentRootNodes(addedPackage, NULL, false);
+			}
+
+			fRootDirectory->SetChildrenPending(true);
+			RETURN_ERROR(error);
+		}
+	}
+
+	_WriteContentSnapshot();
+
+	return B_OK;
+}
+
+
+/*!	Adds the children of the directory's package directories to the
+	directory. Subdirectories are created with pending children, so only a
+	single level of the tree is added.
+	The volume must be write-locked.
+*/
+status_t
+Volume::_PopulateDirectory(UnpackingDirectory* directory)
+{
+	NodeWriteLocker directoryLocker(directory);
+	if (!directory->HasPendingChildren())
+		return B_OK;
+
+	directory->SetChildrenPending(false);
+
+	const PackageDirectoryList& packageDirectories
+		= directory->PackageDirectories();
+	for (PackageDirectoryList::ConstIterator it
+			= packageDirectories.GetIterator();
+		PackageDirectory* packageDirectory = it.Next();) {
+		for (PackageNode* packageNode = packageDirectory->FirstChild();
+				packageNode != NULL;
+				packageNode = packageDirectory->NextChild(packageNode)) {
+			Node* node;
+			status_t error = _AddPackageNode(directory, packageNode, false,
+				node);
+			if (error == B_OK)
+				continue;
+
+			// remove the package nodes added so far
+			for (it.Rewind(); PackageDirectory* addedDirectory = it.Next();) {
+				for (PackageNode* addedNode = addedDirectory->FirstChild();
+						addedNode != NULL && addedNode != packageNode;
+						addedNode = addedDirectory->NextChild(addedNode)) {
+					_RemovePackageNode(directory, addedNode,
+						directory->FindChild(addedNode->Name()), false);
+				}
+
+				if (addedDirectory == packageDirectory)
+					break;
+			}
+
+			directory->SetChildrenPending(true);
+			RETURN_ERROR(error);
+		}
+	}
+
+	return B_OK;
+}
+
+
+/*!	Writes a new content snapshot, if the current one doesn't match the
+	initial packages anymore, and drops the current one together with the
+	packages' recordings. Called once the content of the initial packages has
+	been loaded.
+	The volume must be write-locked.
+*/
+void
+Volume::_WriteContentSnapshot()
+{
+	if (fContentSnapshot == NULL)
+		return;
+
+	// The snapshot is up to date, if no package had to be recorded and all
+	// packages in the snapshot are still active.
+	bool upToDate = true;
+	int32 snapshotPackageCount = 0;
+	for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+		Package* package = it.Next();) {
+		if (package->Recorder() != NULL) {
+			upToDate = false;
+			break;
+		}
+
+		const uint8* content;
+		size_t contentSize;
+		if (fContentSnapshot->FindPackage(package, content, contentSize))
+			snapshotPackageCount++;
+	}
+
+	if (!upToDate
+		|| snapshotPackageCount != fContentSnapshot->CountPackages()) {
+		status_t error = ContentSnapshot::Write(
+			fPackagesDirectory->DirectoryFD(), kContentSnapshotPath, fPackages,
+			fContentSnapshot);
+		if (error != B_OK)
+			INFORM("Failed to write content snapshot: %s\n", strerror(error));
+	}
+
+	for (PackageFileNameHashTable::Iterator it = fPackages.GetIterator();
+		Package* package = it.Next();) {
+		package->DeleteContentRecorder();
+	}
+
+	fContentSnapshot->ReleaseReference();
+	fContentSnapshot = NULL;
+}
+
+
 status_t
 Volume::_ChangeActivation(ActivationChangeRequest& request)
 {
@@ -1585,6 +1919,17 @@ INFORM("Volume::_ChangeActivation(): %" B_PRId32 " new packages, %" B_PRId32 " o
 		}
 
 		newPackageReferences[newPackageIndex++].SetTo(package, true);
+
+		// If the root directory has already been populated, the package's
+		// content is needed right away. Load it before locking the volume.
+		if (!fRootDirectory->HasPendingChildren()) {
+			error = package->LoadContent(fPackageSettings);
+			if (error != B_OK) {
+				ERROR("Volume::_ChangeActivation(): failed to load content of "
+					"package \"%s\"\n", item->name);
+				RETURN_ERROR(error);
+			}
+		}
 	}
 
 	// apply the changes
@@ -26,9 +26,11 @@
 #include "Query.h"
 
 
+class ContentSnapshot;
 class Directory;
 class PackageFSRoot;
 class PackagesDirectory;
+class UnpackingDirectory;
 class UnpackingNode;
 
 typedef IndexHashTable::Iterator IndexDirIterator;
@@ -73,6 +75,10 @@ public:
 			status_t			IOCtl(Node* node, uint32 operation,
 									void* buffer, size_t size);
 
+			// lazy population -- volume must not be locked
+			status_t			PopulateDirectory(Directory* directory);
+			status_t			PopulateAllDirectories();
+
 			// node listeners -- volume must be write-locked
 			void				AddNodeListener(NodeListener* listener,
 									Node* node);
@@ -131,6 +137,12 @@ private:
 			void				_RemovePackageContent(Package* package,
 									PackageNode* endNode, bool notify);
 
+			status_t			_AddPackageContentRootNodes(Package* package,
+									bool notify);
+			void				_RemovePackageContentRootNodes(
+									Package* package, PackageNode* endNode,
+									bool notify);
+
 			status_t			_AddPackageContentRootNode(Package* package,
 									PackageNode* node, bool notify);
 			void				_RemovePackageContentRootNode(Package* package,
@@ -156,6 +168,12 @@ private:
 									PackagesDirectory* packagesDirectory,
 									const char* name, Package*& _package);
 
+			void				_LoadPendingPackageContents();
+			status_t			_PopulateRootDirectory();
+			status_t			_PopulateDirectory(
+									UnpackingDirectory* directory);
+			void				_WriteContentSnapshot();
+
 			status_t			_ChangeActivation(
 									ActivationChangeRequest& request);
 
@@ -189,6 +207,7 @@ private:
 			PackagesDirectoryList fPackagesDirectories;
 			PackagesDirectoryHashTable fPackagesDirectoriesByNodeRef;
 			PackageSettings		fPackageSettings;
+			ContentSnapshot*	fContentSnapshot;
 
 			struct {
 				dev_t			deviceID;
@@ -202,6 +221,7 @@ private:
 			IndexHashTable		fIndices;
 
 			ino_t				fNextNodeID;
+			bool				fPopulateLazily;
 };
 
 
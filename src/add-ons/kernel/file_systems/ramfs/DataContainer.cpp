@@ -1,25 +1,42 @@
 // DataContainer.cpp
 
+#include <stdlib.h>
+#include <string.h>
+
+#if !USER
+#	include <KernelExport.h>
+#	include <kernel.h>
+#	include <util/AutoLock.h>
+#	include <vm/vm.h>
+#	include <vm/vm_page.h>
+#	include <vm/VMCache.h>
+
+#	include "IORequest.h"
+#endif
+
 #include "AllocationInfo.h"
-#include "Attribute.h"	// for debugging only
-#include "Block.h"
 #include "DataContainer.h"
 #include "Debug.h"
 #include "Misc.h"
-#include "Node.h"		// for debugging only
-#include "Volume.h"
 
 // constructor
 DataContainer::DataContainer(Volume *volume)
 	: fVolume(volume),
-	  fSize(0)
+	  fSize(0),
+	  fCache(NULL),
+	  fBuffer(NULL)
 {
 }
 
 // destructor
 DataContainer::~DataContainer()
 {
-	Resize(0);
+#if !USER
+	// If the file is still mapped, the areas keep the cache alive.
+	if (fCache)
+		fCache->ReleaseRef();
+#endif
+	free(fBuffer);
 }
 
 // InitCheck
@@ -58,37 +75,14 @@ DataContainer::ReadAt(off_t offset, void *_buffer, size_t size,
 		// read not more than we have to offer
 		offset = min(offset, fSize);
 		size = min(size, size_t(fSize - offset));
-		// iterate through the blocks, reading as long as there's something
-		// left to read
-		size_t blockSize = fVolume->GetBlockSize();
 		*bytesRead = 0;
-		while (size > 0) {
-			size_t inBlockOffset = offset % blockSize;
-			size_t toRead = min(size, size_t(blockSize - inBlockOffset));
-			void *blockData = _GetBlockDataAt(offset / blockSize,
-											  inBlockOffset, toRead);
-D(
-if (!blockData) {
-	Node *node = NULL;
-	if (Attribute *attribute = dynamic_cast<Attribute*>(this)) {
-		FATAL(("attribute `%s' of\n", attribute->GetName()));
-		node = attribute->GetNode();
-	} else {
-		node = dynamic_cast<Node*>(this);
-	}
-	if (node)
-//		FATAL(("node `%s'\n", node->GetName()));
-		FATAL(("container size: %Ld, offset: %Ld, buffer size: %lu\n",
-		   fSize, offset, size));
-		return B_ERROR;
-}
-);
-			memcpy(buffer, blockData, toRead);
-			buffer += toRead;
-			size -= toRead;
-			offset += toRead;
-			*bytesRead += toRead;
-		}
+#if !USER
+		if (_IsCacheMode())
+			return _DoCacheIO(offset, buffer, size, bytesRead, false);
+#endif
+		if (size > 0)
+			memcpy(buffer, fBuffer + offset, size);
+		*bytesRead = size;
 	}
 	return error;
 }
@@ -98,40 +92,28 @@ status_t
 DataContainer::WriteAt(off_t offset, const void *_buffer, size_t size,
 					   size_t *bytesWritten)
 {
-//PRINT(("DataContainer::WriteAt(%Ld, %p, %lu, %p), fSize: %Ld\n", offset, _buffer, size, bytesWritten, fSize));
 	const uint8 *buffer = (const uint8*)_buffer;
 	status_t error = (buffer && offset >= 0 && bytesWritten
 					  ? B_OK : B_BAD_VALUE);
-	// resize the container, if necessary
+	// resize the container, if necessary -- a gap between the old end and
+	// the offset reads as zeros
 	if (error == B_OK) {
 		off_t newSize = offset + size;
-		off_t oldSize = fSize;
-		if (newSize > fSize) {
+		if (newSize > fSize)
 			error = Resize(newSize);
-			// pad with zero, if necessary
-			if (error == B_OK && offset > oldSize)
-				_ClearArea(offset, oldSize - offset);
-		}
 	}
 	if (error == B_OK) {
-		// iterate through the blocks, writing as long as there's something
-		// left to write
-		size_t blockSize = fVolume->GetBlockSize();
 		*bytesWritten = 0;
-		while (size > 0) {
-			size_t inBlockOffset = offset % blockSize;
-			size_t toWrite = min(size, size_t(blockSize - inBlockOffset));
-			void *blockData = _GetBlockDataAt(offset / blockSize,
-											  inBlockOffset, toWrite);
-D(if (!blockData) return B_ERROR;);
-			memcpy(blockData, buffer, toWrite);
-			buffer += toWrite;
-			size -= toWrite;
-			offset += toWrite;
-			*bytesWritten += toWrite;
+#if !USER
+		if (_IsCacheMode()) {
+			return _DoCacheIO(offset, const_cast<uint8*>(buffer), size,
+				bytesWritten, true);
 		}
+#endif
+		if (size > 0)
+			memcpy(fBuffer + offset, buffer, size);
+		*bytesWritten = size;
 	}
-//PRINT(("DataContainer::WriteAt() done: %lx, fSize: %Ld\n", error, fSize));
 	return error;
 }
 
@@ -140,12 +122,12 @@ void
 DataContainer::GetFirstDataBlock(const uint8 **data, size_t *length)
 {
 	if (data && length) {
-		if (_IsBlockMode()) {
-			BlockReference *block = _GetBlockList()->ItemAt(0);
-			*data = (const uint8*)block->GetData();
-			*length = min(fSize, fVolume->GetBlockSize());
+		// only available in buffer mode, which is all attributes need
+		if (_IsCacheMode()) {
+			*data = NULL;
+			*length = 0;
 		} else {
-			*data = fSmallBuffer;
+			*data = fBuffer;
 			*length = fSize;
 		}
 	}
@@ -155,263 +137,250 @@ DataContainer::GetFirstDataBlock(const uint8 **data, size_t *length)
 void
 DataContainer::GetAllocationInfo(AllocationInfo &info)
 {
-	if (_IsBlockMode()) {
-		BlockList *blocks = _GetBlockList();
-		info.AddListAllocation(blocks->GetCapacity(), sizeof(BlockReference*));
-		int32 blockCount = blocks->CountItems();
-		for (int32 i = 0; i < blockCount; i++)
-			info.AddBlockAllocation(blocks->ItemAt(i)->GetBlock()->GetSize());
-	} else {
-		// ...
+#if !USER
+	if (_IsCacheMode()) {
+		info.AddBlockAllocation((size_t)fCache->page_count * B_PAGE_SIZE);
+		return;
 	}
+#endif
+	if (fSize > 0)
+		info.AddBlockAllocation(fSize);
 }
 
-// _RequiresBlockMode
-inline
-bool
-DataContainer::_RequiresBlockMode(size_t size)
+// _SwitchToCacheMode
+status_t
+DataContainer::_SwitchToCacheMode()
 {
-	return (size > kSmallDataContainerSize);
+#if USER
+	// there is no VM cache in userland -- keep using the buffer
+	return B_OK;
+#else
+	if (_IsCacheMode())
+		return B_OK;
+	// we don't copy any data; the container must still be empty
+	if (fSize > 0)
+		return B_BAD_VALUE;
+
+	VMCache *cache;
+	status_t error = VMCacheFactory::CreateAnonymousCache(cache, false, 0, 0,
+		true, VM_PRIORITY_USER);
+	if (error != B_OK)
+		return error;
+
+	cache->temporary = 1;
+	cache->virtual_end = 0;
+	fCache = cache;
+	return B_OK;
+#endif
 }
 
-// _IsBlockMode
+// _IsCacheMode
 inline
 bool
-DataContainer::_IsBlockMode() const
+DataContainer::_IsCacheMode() const
 {
-	return (fSize > kSmallDataContainerSize);
+	return (fCache != NULL);
 }
 
 // _Resize
 status_t
 DataContainer::_Resize(off_t newSize)
 {
-//PRINT(("DataContainer::_Resize(%Ld), fSize: %Ld\n", newSize, fSize));
 	status_t error = B_OK;
-	if (newSize != fSize) {
-		size_t blockSize = fVolume->GetBlockSize();
-		int32 blockCount = _CountBlocks();
-		int32 newBlockCount = (newSize + blockSize - 1) / blockSize;
-		if (newBlockCount == blockCount) {
-			// only the last block needs to be resized
-			if (_IsBlockMode() && _RequiresBlockMode(newSize)) {
-				// keep block mode
-				error = _ResizeLastBlock((newSize - 1) % blockSize + 1);
-			} else if (!_IsBlockMode() && !_RequiresBlockMode(newSize)) {
-				// keep small buffer mode
-				fSize = newSize;
-			} else if (fSize < newSize) {
-				// switch to block mode
-				_SwitchToBlockMode(newSize);
-			} else {
-				// switch to small buffer mode
-				_SwitchToSmallBufferMode(newSize);
-			}
-		} else if (newBlockCount < blockCount) {
-			// shrink
-			if (_IsBlockMode()) {
-				// remove the last blocks
-				BlockList *blocks = _GetBlockList();
-				for (int32 i = blockCount - 1; i >= newBlockCount; i--) {
-					BlockReference *block = blocks->ItemAt(i);
-					blocks->RemoveItem(i);
-					fVolume->FreeBlock(block);
-					fSize = (fSize - 1) / blockSize * blockSize;
-				}
-				// resize the last block to the correct size, respectively
-				// switch to small buffer mode
-				if (_RequiresBlockMode(newSize))
-					error = _ResizeLastBlock((newSize - 1) % blockSize + 1);
-				else
-					_SwitchToSmallBufferMode(newSize);
-			} else {
-				// small buffer mode: just set the new size
-				fSize = newSize;
-			}
-		} else {
-			// grow
-			if (_RequiresBlockMode(newSize)) {
-				// resize the first block to the correct size, respectively
-				// switch to block mode
-				if (_IsBlockMode())
-					error = _ResizeLastBlock(blockSize);
-				else {
-					error = _SwitchToBlockMode(min((size_t)newSize,
-												   blockSize));
-				}
-				// add new blocks
-				BlockList *blocks = _GetBlockList();
-				while (error == B_OK && fSize < newSize) {
-					size_t newBlockSize = min(size_t(newSize - fSize),
-											  blockSize);
-					BlockReference *block = NULL;
-					error = fVolume->AllocateBlock(newBlockSize, &block);
-					if (error == B_OK) {
-						if (blocks->AddItem(block))
-							fSize += newBlockSize;
-						else {
-							SET_ERROR(error, B_NO_MEMORY);
-							fVolume->FreeBlock(block);
-						}
-					}
-				}
-			} else {
-				// no need to switch to block mode: just set the new size
-				fSize = newSize;
-			}
+#if !USER
+	if (_IsCacheMode()) {
+		// Clear the rest of the last page first. Otherwise growing the
+		// container again would make stale data visible, which may also have
+		// been written via a mapping beyond the end of the data.
+		_ClearPageTail(min(newSize, fSize));
+
+		AutoLocker<VMCache> locker(fCache);
+
+		// The pages have to be accounted for (in the swap space, or in
+		// memory) before they can be used; that's also what allows them to
+		// be swapped out at all.
+		if (newSize > fSize
+			&& fCache->Commit(PAGE_ALIGN(newSize), VM_PRIORITY_USER) != B_OK) {
+			return B_DEVICE_FULL;
 		}
+
+		error = fCache->Resize(newSize, VM_PRIORITY_USER);
+		if (error == B_OK)
+			fSize = newSize;
+
+		// shrink the commitment again, if the cache did not grow after all
+		fCache->Commit(PAGE_ALIGN(fSize), VM_PRIORITY_USER);
+		return error;
 	}
-//PRINT(("DataContainer::_Resize() done: %lx, fSize: %Ld\n", error, fSize));
+#endif
+	if (newSize == 0) {
+		free(fBuffer);
+		fBuffer = NULL;
+		fSize = 0;
+	} else if ((off_t)(size_t)newSize != newSize) {
+		SET_ERROR(error, B_NO_MEMORY);
+	} else if (uint8 *buffer = (uint8*)realloc(fBuffer, newSize)) {
+		if (newSize > fSize)
+			memset(buffer + fSize, 0, newSize - fSize);
+		fBuffer = buffer;
+		fSize = newSize;
+	} else
+		SET_ERROR(error, B_NO_MEMORY);
 	return error;
 }
 
-// _GetBlockList
-inline
-DataContainer::BlockList *
-DataContainer::_GetBlockList()
-{
-	return (BlockList*)fBlocks;
-}
+#if !USER
 
-// _GetBlockList
-inline
-const DataContainer::BlockList *
-DataContainer::_GetBlockList() const
+// _DoCacheIO
+status_t
+DataContainer::_DoCacheIO(off_t offset, uint8 *buffer, size_t size,
+						  size_t *bytesProcessed, bool isWrite)
 {
-	return (BlockList*)fBlocks;
-}
+	bool userBuffer = IS_USER_ADDRESS(buffer);
+	*bytesProcessed = 0;
+	while (size > 0) {
+		size_t inPageOffset = offset % B_PAGE_SIZE;
+		size_t toProcess = min(size, size_t(B_PAGE_SIZE - inPageOffset));
 
-// _CountBlocks
-inline
-int32
-DataContainer::_CountBlocks() const
-{
-	if (_IsBlockMode())
-		return _GetBlockList()->CountItems();
-	else if (fSize == 0)	// small buffer mode, empty buffer
-		return 0;
-	return 1;	// small buffer mode, non-empty buffer
-}
+		vm_page *page = NULL;
+		status_t error = _GetPage(offset - inPageOffset, isWrite, &page);
+		if (error != B_OK)
+			return error;
 
-// _GetBlockDataAt
-inline
-void *
-DataContainer::_GetBlockDataAt(int32 index, size_t offset, size_t DARG(size))
-{
-	if (_IsBlockMode()) {
-		BlockReference *block = _GetBlockList()->ItemAt(index);
-D(if (!fVolume->CheckBlock(block, offset + size)) return NULL;);
-		return block->GetDataAt(offset);
-	} else {
-D(
-if (offset + size > kSmallDataContainerSize) {
-	FATAL(("DataContainer: Data access exceeds small buffer.\n"));
-	PANIC("DataContainer: Data access exceeds small buffer.");
-	return NULL;
-}
-);
-		return fSmallBuffer + offset;
-	}
-}
+		if (page) {
+			phys_addr_t address
+				= (phys_addr_t)page->physical_page_number * B_PAGE_SIZE
+					+ inPageOffset;
+			if (isWrite) {
+				error = vm_memcpy_to_physical(address, buffer, toProcess,
+					userBuffer);
+			} else {
+				error = vm_memcpy_from_physical(buffer, address, toProcess,
+					userBuffer);
+			}
+			_PutPage(page, isWrite && error == B_OK);
+		} else {
+			// a page that has never been written reads as zeros
+			if (userBuffer)
+				error = user_memset(buffer, 0, toProcess);
+			else
+				memset(buffer, 0, toProcess);
+		}
+		if (error != B_OK)
+			return error;
 
-// _ClearArea
-void
-DataContainer::_ClearArea(off_t offset, off_t size)
-{
-	// constrain the area to the data area
-	offset = min(offset, fSize);
-	size = min(size, fSize - offset);
-	// iterate through the blocks, clearing as long as there's something
-	// left to clear
-	size_t blockSize = fVolume->GetBlockSize();
-	while (size > 0) {
-		size_t inBlockOffset = offset % blockSize;
-		size_t toClear = min(size_t(size), blockSize - inBlockOffset);
-		void *blockData = _GetBlockDataAt(offset / blockSize, inBlockOffset,
-										  toClear);
-D(if (!blockData) return;);
-		memset(blockData, 0, toClear);
-		size -= toClear;
-		offset += toClear;
+		buffer += toProcess;
+		size -= toProcess;
+		offset += toProcess;
+		*bytesProcessed += toProcess;
 	}
+	return B_OK;
 }
 
-// _ResizeLastBlock
+// _GetPage
+//
+// Returns the page at the given (page aligned) offset marked busy, so that it
+// stays where it is while the cache is unlocked. The caller must return it
+// via _PutPage(). Swapped out pages are read back in. If the page doesn't
+// exist, a cleared one is inserted, if \a create is \c true, otherwise
+// \c NULL is returned.
 status_t
-DataContainer::_ResizeLastBlock(size_t newSize)
+DataContainer::_GetPage(off_t offset, bool create, vm_page **_page)
 {
-//PRINT(("DataContainer::_ResizeLastBlock(%lu), fSize: %Ld\n", newSize, fSize));
-	int32 blockCount = _CountBlocks();
-	status_t error = (fSize > 0 && blockCount > 0 && newSize > 0
-					  ? B_OK : B_BAD_VALUE);
-D(
-if (!_IsBlockMode()) {
-	FATAL(("Call of _ResizeLastBlock() in small buffer mode.\n"));
-	PANIC("Call of _ResizeLastBlock() in small buffer mode.");
-	return B_ERROR;
-}
-);
-	if (error == B_OK) {
-		size_t blockSize = fVolume->GetBlockSize();
-		size_t oldSize = (fSize - 1) % blockSize + 1;
-		if (newSize != oldSize) {
-			BlockList *blocks = _GetBlockList();
-			BlockReference *block = blocks->ItemAt(blockCount - 1);
-			BlockReference *newBlock = fVolume->ResizeBlock(block, newSize);
-			if (newBlock) {
-				if (newBlock != block)
-					blocks->ReplaceItem(blockCount - 1, newBlock);
-				fSize += off_t(newSize) - oldSize;
-			} else
-				SET_ERROR(error, B_NO_MEMORY);
+	AutoLocker<VMCache> locker(fCache);
+	while (true) {
+		vm_page *page = fCache->LookupPage(offset);
+		if (page) {
+			if (page->busy) {
+				fCache->WaitForPageEvents(page, PAGE_EVENT_NOT_BUSY, true);
+				continue;
+			}
+			DEBUG_PAGE_ACCESS_START(page);
+			page->busy = true;
+			*_page = page;
+			return B_OK;
+		}
+
+		bool swappedOut = fCache->HasPage(offset);
+		if (!swappedOut && !create) {
+			*_page = NULL;
+			return B_OK;
+		}
+
+		// reserve a page -- this may wait, so the cache must not be locked
+		locker.Unlock();
+		vm_page_reservation reservation;
+		vm_page_reserve_pages(&reservation, 1, VM_PRIORITY_USER);
+		locker.Lock();
+
+		if (fCache->LookupPage(offset)
+			|| fCache->HasPage(offset) != swappedOut) {
+			// someone else was faster
+			vm_page_unreserve_pages(&reservation);
+			continue;
 		}
+
+		page = vm_page_allocate_page(&reservation, PAGE_STATE_ACTIVE
+			| VM_PAGE_ALLOC_BUSY | (swappedOut ? 0 : VM_PAGE_ALLOC_CLEAR));
+		vm_page_unreserve_pages(&reservation);
+		fCache->InsertPage(page, offset);
+
+		if (swappedOut) {
+			// read the page back in
+			fCache->AcquireRefLocked();
+			locker.Unlock();
+
+			generic_io_vec vec;
+			vec.base = (phys_addr_t)page->physical_page_number * B_PAGE_SIZE;
+			generic_size_t bytesRead = vec.length = B_PAGE_SIZE;
+			status_t error = fCache->Read(offset, &vec, 1,
+				B_PHYSICAL_IO_REQUEST, &bytesRead);
+
+			locker.Lock();
+			fCache->ReleaseRefLocked();
+
+			if (error != B_OK) {
+				fCache->NotifyPageEvents(page, PAGE_EVENT_NOT_BUSY);
+				fCache->RemovePage(page);
+				vm_page_set_state(page, PAGE_STATE_FREE);
+				return error;
+			}
+		}
+
+		*_page = page;
+		return B_OK;
 	}
-//PRINT(("DataContainer::_ResizeLastBlock() done: %lx, fSize: %Ld\n", error, fSize));
-	return error;
 }
 
-// _SwitchToBlockMode
-status_t
-DataContainer::_SwitchToBlockMode(size_t newBlockSize)
+// _PutPage
+void
+DataContainer::_PutPage(vm_page *page, bool modified)
 {
-	// allocate a new block
-	BlockReference *block = NULL;
-	status_t error = fVolume->AllocateBlock(newBlockSize, &block);
-	if (error == B_OK) {
-		// copy the data from the small buffer into the block
-		if (fSize > 0)
-			memcpy(block->GetData(), fSmallBuffer, fSize);
-		// construct the block list and add the block
-		new (fBlocks) BlockList(10);
-		BlockList *blocks = _GetBlockList();
-		if (blocks->AddItem(block)) {
-			fSize = newBlockSize;
-		} else {
-			// error: destroy the block list and free the block
-			SET_ERROR(error, B_NO_MEMORY);
-			blocks->~BlockList();
-			if (fSize > 0)
-				memcpy(fSmallBuffer, block->GetData(), fSize);
-			fVolume->FreeBlock(block);
-		}
-	}
-	return error;
+	AutoLocker<VMCache> locker(fCache);
+	// Pages of temporary caches that aren't marked modified are considered
+	// to be freeable by the page daemon.
+	if (modified)
+		page->modified = true;
+	fCache->MarkPageUnbusy(page);
+	DEBUG_PAGE_ACCESS_END(page);
 }
 
-// _SwitchToSmallBufferMode
+// _ClearPageTail
 void
-DataContainer::_SwitchToSmallBufferMode(size_t newSize)
+DataContainer::_ClearPageTail(off_t offset)
 {
-	// remove the first (and only) block
-	BlockList *blocks = _GetBlockList();
-	BlockReference *block = blocks->ItemAt(0);
-	blocks->RemoveItem(0L);
-	// destroy the block list and copy the data into the small buffer
-	blocks->~BlockList();
-	if (newSize > 0)
-		memcpy(fSmallBuffer, block->GetData(), newSize);
-	// free the block and set the new size
-	fVolume->FreeBlock(block);
-	fSize = newSize;
+	size_t inPageOffset = offset % B_PAGE_SIZE;
+	if (inPageOffset == 0)
+		return;
+
+	vm_page *page = NULL;
+	if (_GetPage(offset - inPageOffset, false, &page) != B_OK || !page)
+		return;
+
+	vm_memset_physical(
+		(phys_addr_t)page->physical_page_number * B_PAGE_SIZE + inPageOffset,
+		0, B_PAGE_SIZE - inPageOffset);
+	_PutPage(page, true);
 }
 
+#endif	// !USER
@@ -1,6 +1,7 @@
 // File.cpp
 
 #include "AllocationInfo.h"
+#include "Debug.h"
 #include "File.h"
 #include "SizeIndex.h"
 #include "Volume.h"
@@ -10,6 +11,8 @@ File::File(Volume *volume)
 	: Node(volume, NODE_TYPE_FILE),
 	  DataContainer(volume)
 {
+	// keep the data in a VM cache, so the file can be mapped directly
+	_SwitchToCacheMode();
 }
 
 // destructor
@@ -17,6 +20,18 @@ File::~File()
 {
 }
 
+// InitCheck
+status_t
+File::InitCheck() const
+{
+	status_t error = Node::InitCheck();
+#if !USER
+	if (error == B_OK && !GetCache())
+		SET_ERROR(error, B_NO_MEMORY);
+#endif
+	return error;
+}
+
 // ReadAt
 status_t
 File::ReadAt(off_t offset, void *buffer, size_t size, size_t *bytesRead)
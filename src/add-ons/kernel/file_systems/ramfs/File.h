@@ -11,6 +11,8 @@ public:
 	File(Volume *volume);
 	virtual ~File();
 
+	virtual status_t InitCheck() const;
+
 	Volume *GetVolume() const	{ return Node::GetVolume(); }
 
 	virtual status_t ReadAt(off_t offset, void *buffer, size_t size,
@@ -26,8 +26,6 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "Block.h"
-#include "BlockAllocator.h"
 #include "Debug.h"
 #include "Directory.h"
 #include "Entry.h"
@@ -43,11 +41,6 @@
 #include "TwoKeyAVLTree.h"
 #include "Volume.h"
 
-// default block size
-static const off_t kDefaultBlockSize = 4096;
-
-static const size_t kDefaultAreaSize = kDefaultBlockSize * 128;
-
 // default volume name
 static const char *kDefaultVolumeName = "RAM FS";
 
@@ -148,9 +141,6 @@ Volume::Volume(fs_volume* volume)
 	fAnyNodeListeners(),
 	fEntryListeners(NULL),
 	fAnyEntryListeners(),
-	fBlockAllocator(NULL),
-	fBlockSize(kDefaultBlockSize),
-	fAllocatedBlocks(0),
 	fAccessTime(0),
 	fMounted(false)
 {
@@ -180,14 +170,6 @@ Volume::Mount(uint32 flags)
 
 	status_t error = B_OK;
 	fID = id;
-	// create a block allocator
-	if (error == B_OK) {
-		fBlockAllocator = new(nothrow) BlockAllocator(kDefaultAreaSize);
-		if (fBlockAllocator)
-			error = fBlockAllocator->InitCheck();
-		else
-			SET_ERROR(error, B_NO_MEMORY);
-	}
 	// create the listener trees
 	if (error == B_OK) {
 		fNodeListeners = new(nothrow) NodeListenerTree;
@@ -286,11 +268,6 @@ Volume::Unmount()
 		delete fNodeTable;
 		fNodeTable = NULL;
 	}
-	// delete the block allocator
-	if (fBlockAllocator) {
-		delete fBlockAllocator;
-		fBlockAllocator = NULL;
-	}
 	fID = 0;
 	return B_OK;
 }
@@ -299,29 +276,28 @@ Volume::Unmount()
 off_t
 Volume::GetBlockSize() const
 {
-	return fBlockSize;
+	return B_PAGE_SIZE;
 }
 
 // CountBlocks
 off_t
 Volume::CountBlocks() const
 {
-	size_t bytes = 0;
+	// file data live in swappable VM caches -- we can use all memory
 	system_info sysInfo;
-	if (get_system_info(&sysInfo) == B_OK) {
-		int32 freePages = sysInfo.max_pages - sysInfo.used_pages;
-		bytes = (uint32)freePages * B_PAGE_SIZE
-				+ fBlockAllocator->GetAvailableBytes();
-	}
-	return bytes / kDefaultBlockSize;
+	if (get_system_info(&sysInfo) != B_OK)
+		return 0;
+	return sysInfo.max_pages;
 }
 
 // CountFreeBlocks
 off_t
 Volume::CountFreeBlocks() const
 {
-	// TODO:...
-	return CountBlocks() - fBlockAllocator->GetUsedBytes() / kDefaultBlockSize;
+	system_info sysInfo;
+	if (get_system_info(&sysInfo) != B_OK)
+		return 0;
+	return sysInfo.max_pages - sysInfo.used_pages;
 }
 
 // SetName
@@ -786,54 +762,6 @@ Volume::UpdateLiveQueries(Entry *entry, Node* node, const char *attribute,
 	}
 }
 
-// AllocateBlock
-status_t
-Volume::AllocateBlock(size_t size, BlockReference **block)
-{
-	status_t error = (size > 0 && size <= fBlockSize && block
-					  ? B_OK : B_BAD_VALUE);
-	if (error == B_OK) {
-		*block = fBlockAllocator->AllocateBlock(size);
-		if (*block)
-			fAllocatedBlocks++;
-		else
-			SET_ERROR(error, B_NO_MEMORY);
-	}
-	return error;
-}
-
-// FreeBlock
-void
-Volume::FreeBlock(BlockReference *block)
-{
-	if (block) {
-		fBlockAllocator->FreeBlock(block);
-		fAllocatedBlocks--;
-	}
-}
-
-// ResizeBlock
-BlockReference *
-Volume::ResizeBlock(BlockReference *block, size_t size)
-{
-	BlockReference *newBlock = NULL;
-	if (size <= fBlockSize && block) {
-		if (size == 0) {
-			fBlockAllocator->FreeBlock(block);
-			fAllocatedBlocks--;
-		} else
-			newBlock = fBlockAllocator->ResizeBlock(block, size);
-	}
-	return newBlock;
-}
-
-// CheckBlock
-bool
-Volume::CheckBlock(BlockReference *block, size_t size)
-{
-	return fBlockAllocator->CheckBlock(block, size);
-}
-
 // GetAllocationInfo
 void
 Volume::GetAllocationInfo(AllocationInfo &info)
@@ -849,9 +777,6 @@ Volume::GetAllocationInfo(AllocationInfo &info)
 	fRootDirectory->GetAllocationInfo(info);
 	// name
 	info.AddStringAllocation(fName.GetLength());
-	// block allocator
-	info.AddOtherAllocation(sizeof(BlockAllocator));
-	fBlockAllocator->GetAllocationInfo(info);
 }
 
 // ReadLock
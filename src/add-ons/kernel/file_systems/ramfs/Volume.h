@@ -34,9 +34,6 @@
 #include "String.h"
 
 class AllocationInfo;
-class Block;
-class BlockAllocator;
-class BlockReference;
 class Directory;
 class DirectoryEntryTable;
 class Entry;
@@ -159,11 +156,7 @@ public:
 
 	ino_t NextNodeID() { return fNextNodeID++; }
 
-	status_t AllocateBlock(size_t size, BlockReference **block);
-	void FreeBlock(BlockReference *block);
-	BlockReference *ResizeBlock(BlockReference *block, size_t size);
 	// debugging only
-	bool CheckBlock(BlockReference *block, size_t size = 0);
 	void GetAllocationInfo(AllocationInfo &info);
 
 	bigtime_t GetAccessTime() const	{ return fAccessTime; }
@@ -199,9 +192,6 @@ private:
 	EntryListenerTree		*fEntryListeners;
 	EntryListenerList		fAnyEntryListeners;
 	QueryList				fQueries;
-	BlockAllocator			*fBlockAllocator;
-	off_t					fBlockSize;
-	off_t					fAllocatedBlocks;
 	bigtime_t				fAccessTime;
 	bool					fMounted;
 };
@@ -42,6 +42,10 @@
 
 #include <AutoDeleter.h>
 
+#if !USER
+#	include <vfs.h>
+#endif
+
 #include "AllocationInfo.h"
 #include "AttributeIndex.h"
 #include "AttributeIterator.h"
@@ -74,6 +78,24 @@ notify_if_stat_changed(Volume *volume, Node *node)
 	}
 }
 
+// attach_file_cache
+//
+// Makes the VM cache holding the file's data the vnode's cache, so that the
+// VFS maps it directly instead of creating a vnode cache on top of our
+// read/write hooks.
+static void
+attach_file_cache(Volume *volume, Node *node)
+{
+#if !USER
+	File *file = dynamic_cast<File*>(node);
+	if (!file || !file->GetCache())
+		return;
+	struct vnode *vnode;
+	if (vfs_lookup_vnode(volume->GetID(), node->GetID(), &vnode) == B_OK)
+		vfs_set_vnode_cache(vnode, file->GetCache());
+#endif
+}
+
 
 // #pragma mark - FS
 
@@ -848,6 +870,8 @@ ramfs_create(fs_volume* _volume, fs_vnode* _dir, const char *name, int openMode,
 				delete cookie;
 		}
 		NodeMTimeUpdater mTimeUpdater2(node);
+		if (error == B_OK)
+			attach_file_cache(volume, node);
 		// notify listeners
 		if (error == B_OK)
 			notify_entry_created(volume->GetID(), dir->GetID(), name, *vnid);
@@ -889,6 +913,8 @@ ramfs_open(fs_volume* _volume, fs_vnode* _node, int openMode, void** _cookie)
 		if (error == B_OK && (openMode & O_TRUNC))
 			error = node->SetSize(0);
 		NodeMTimeUpdater mTimeUpdater(node);
+		if (error == B_OK)
+			attach_file_cache(volume, node);
 		// set result / cleanup on failure
 		if (error == B_OK)
 			*_cookie = cookie;
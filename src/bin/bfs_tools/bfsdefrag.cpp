@@ -0,0 +1,145 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+//!	Defragments a mounted BFS volume
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bfs_control.h"
+
+
+extern const char* __progname;
+static const char* kProgramName = __progname;
+
+
+static void
+usage(int status)
+{
+	fprintf(stderr, "Usage: %s [-fdv] [-r <rate>] <path on volume>\n"
+		"Moves fragmented files and directories of a mounted BFS volume into\n"
+		"contiguous space while the volume stays in use.\n\n"
+		"  -f, --files          only defragment files\n"
+		"  -d, --directories    only defragment directories\n"
+		"  -r, --rate <KB/s>    limit the rate at which data is moved\n"
+		"  -v, --verbose        print every node that is relocated\n",
+		kProgramName);
+	exit(status);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	const struct option kLongOptions[] = {
+		{ "files", 0, NULL, 'f' },
+		{ "directories", 0, NULL, 'd' },
+		{ "rate", 1, NULL, 'r' },
+		{ "verbose", 0, NULL, 'v' },
+		{ "help", 0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	uint32 flags = 0;
+	uint32 rate = 0;
+	bool verbose = false;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "fdr:vh", kLongOptions, NULL)) != -1) {
+		switch (c) {
+			case 'f':
+				flags |= BFS_DEFRAGMENT_FILES;
+				break;
+			case 'd':
+				flags |= BFS_DEFRAGMENT_DIRECTORIES;
+				break;
+			case 'r':
+				rate = strtoul(optarg, NULL, 0);
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			case 'h':
+				usage(0);
+				break;
+			default:
+				usage(1);
+				break;
+		}
+	}
+
+	if (optind + 1 != argc)
+		usage(1);
+
+	if (flags == 0)
+		flags = BFS_DEFRAGMENT_FILES | BFS_DEFRAGMENT_DIRECTORIES;
+
+	int fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: could not open \"%s\": %s\n", kProgramName,
+			argv[optind], strerror(errno));
+		return 1;
+	}
+
+	struct defrag_control control;
+	memset(&control, 0, sizeof(control));
+	control.magic = BFS_IOCTL_DEFRAG_MAGIC;
+	control.flags = flags;
+	control.max_rate = rate;
+
+	if (ioctl(fd, BFS_IOCTL_START_DEFRAGMENTING, &control,
+			sizeof(control)) != 0) {
+		fprintf(stderr, "%s: could not start defragmenting: %s\n",
+			kProgramName, strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	uint64 counter = 0;
+	while (ioctl(fd, BFS_IOCTL_DEFRAGMENT_NEXT_NODE, &control,
+			sizeof(control)) == 0) {
+		if (!verbose && ++counter % 50 == 0) {
+			printf("%9" B_PRIu64 " nodes processed\x1b[1A\n",
+				control.stats.nodes);
+		}
+
+		if (!verbose || control.fragments == 0)
+			continue;
+
+		if (control.status == B_OK
+			&& control.new_fragments != control.fragments) {
+			printf("%s (inode = %" B_PRIdINO "): %" B_PRIu32 " -> %"
+				B_PRIu32 " fragments\n", control.name, control.inode,
+				control.fragments, control.new_fragments);
+		} else if (control.status != B_OK) {
+			printf("%s (inode = %" B_PRIdINO "): skipped, %s\n",
+				control.name, control.inode, strerror(control.status));
+		}
+	}
+
+	if (ioctl(fd, BFS_IOCTL_STOP_DEFRAGMENTING, &control,
+			sizeof(control)) != 0) {
+		fprintf(stderr, "%s: could not stop defragmenting: %s\n",
+			kProgramName, strerror(errno));
+	}
+
+	close(fd);
+
+	printf("        %" B_PRIu64 " nodes checked,\n"
+		"\t%" B_PRIu64 " fragmented,\n"
+		"\t%" B_PRIu64 " relocated,\n"
+		"\t%" B_PRIu64 " blocks moved.\n",
+		control.stats.nodes, control.stats.fragmented_nodes,
+		control.stats.relocated_nodes, control.stats.moved_blocks);
+
+	return 0;
+}
@@ -30,6 +30,7 @@ static struct option const kLongOptions[] = {
 	{"volume", required_argument, 0, 'd'},
 	{"type", required_argument, 0, 't'},
 	{"copy-from", required_argument, 0, 'f'},
+	{"trigrams", no_argument, 0, 'g'},
 	{"verbose", no_argument, 0, 'v'},
 	{"help", no_argument, 0, 'h'},
 	{NULL}
@@ -88,6 +89,8 @@ usage(int status)
 		"\t\t\t\"llong\", \"string\", \"float\", or \"double\".\n"
 		"\t\t\tDefaults to \"string\".\n"
 		"      --copy-from\tpath to volume to copy the indexes from.\n"
+		"  -g, --trigrams\tcreate a trigram index for the string attribute, which\n"
+		"\t\t\tspeeds up substring and case-insensitive queries.\n"
 		"  -v, --verbose\t\tprint information about the index being created\n",
 		kProgramName);
 
@@ -102,10 +105,11 @@ main(int argc, char **argv)
 	int indexType = B_STRING_TYPE;
 	char *indexName = NULL;
 	bool verbose = false;
+	uint32 flags = 0;
 	dev_t device = -1, copyFromDevice = -1;
 
 	int c;
-	while ((c = getopt_long(argc, argv, "d:ht:v", kLongOptions, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "d:ght:v", kLongOptions, NULL)) != -1) {
 		switch (c) {
 			case 0:
 				break;
@@ -125,6 +129,9 @@ main(int argc, char **argv)
 					return -1;
 				}
 				break;
+			case 'g':
+				flags |= B_TRIGRAM_INDEX;
+				break;
 			case 'h':
 				usage(0);
 				break;
@@ -181,11 +188,12 @@ main(int argc, char **argv)
 		volume.GetRootDirectory(&dir);
 		BPath path(&dir, NULL);
 
-		printf("Creating index \"%s\" of type %s on volume mounted at %s.\n",
-			indexName, indexTypeName, path.Path());
+		printf("Creating %sindex \"%s\" of type %s on volume mounted at %s.\n",
+			(flags & B_TRIGRAM_INDEX) != 0 ? "trigram " : "", indexName,
+			indexTypeName, path.Path());
 	}
 
-	if (fs_create_index(device, indexName, indexType, 0) != 0)
+	if (fs_create_index(device, indexName, indexType, flags) != 0)
 		fprintf(stderr, "%s: Could not create index: %s\n", kProgramName, strerror(errno));
 
 	return 0;
@@ -72,6 +72,7 @@ static const char* kUsage =
 	"                 to redirect a \"make install\". Only allowed with -b.\n"
 	"    -q         - Be quiet (don't show any output except for errors).\n"
 	"    -v         - Be verbose (show more info about created package).\n"
+	"    -z         - Use Zstandard instead of zlib compression.\n"
 	"\n"
 	"  dump [ <options> ] <package>\n"
 	"    Dumps the TOC section of package file <package>. For debugging only.\n"
@@ -120,6 +121,7 @@ static const char* kUsage =
 	"                 Defaults to 9.\n"
 	"    -q         - Be quiet (don't show any output except for errors).\n"
 	"    -v         - Be verbose (show more info about created package).\n"
+	"    -z         - Use Zstandard instead of zlib compression.\n"
 	"\n"
 	"Common Options:\n"
 	"  -h, --help   - Print this usage info.\n"
@@ -6,6 +6,9 @@
 
 #include <package/hpkg/PackageFileHeapWriter.h>
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <new>
 
@@ -24,6 +27,9 @@
 // minimum length of data we require before trying to compress them
 static const size_t kCompressionSizeThreshold = 64;
 
+// maximum number of threads compressing chunks in parallel
+static const int32 kMaxCompressionThreads = 32;
+
 
 namespace BPackageKit {
 
@@ -194,6 +200,203 @@ private:
 };
 
 
+struct PackageFileHeapWriter::CompressionJob {
+	void*		uncompressedData;
+	void*		compressedData;
+	size_t		uncompressedSize;
+	size_t		compressedSize;
+	status_t	error;
+	bool		done;
+};
+
+
+/*!	Compresses complete chunks on a number of worker threads.
+	Chunks are submitted in heap order and retired (i.e. written) in the same
+	order, so the resulting heap is identical to the one written sequentially.
+	Only the writer's thread submits and retires jobs.
+*/
+struct PackageFileHeapWriter::CompressionPool {
+	CompressionPool(const PackageFileHeapWriter* writer)
+		:
+		fWriter(writer),
+		fThreads(NULL),
+		fThreadCount(0),
+		fJobs(NULL),
+		fJobCount(0),
+		fSubmitted(0),
+		fStarted(0),
+		fRetired(0),
+		fQuit(false),
+		fInitialized(false)
+	{
+	}
+
+	~CompressionPool()
+	{
+		if (fInitialized) {
+			pthread_mutex_lock(&fLock);
+			fQuit = true;
+			pthread_cond_broadcast(&fJobAvailable);
+			pthread_mutex_unlock(&fLock);
+
+			for (int32 i = 0; i < fThreadCount; i++)
+				pthread_join(fThreads[i], NULL);
+
+			pthread_cond_destroy(&fJobDone);
+			pthread_cond_destroy(&fJobAvailable);
+			pthread_mutex_destroy(&fLock);
+		}
+
+		if (fJobs != NULL) {
+			for (int32 i = 0; i < fJobCount; i++) {
+				free(fJobs[i].uncompressedData);
+				free(fJobs[i].compressedData);
+			}
+			delete[] fJobs;
+		}
+
+		delete[] fThreads;
+	}
+
+	status_t Init(int32 threadCount)
+	{
+		// Allow for some jobs in flight beyond one per thread, so the threads
+		// can keep working while the oldest chunk is being written.
+		fJobCount = threadCount * 2;
+		fJobs = new(std::nothrow) CompressionJob[fJobCount]();
+		fThreads = new(std::nothrow) pthread_t[threadCount];
+		if (fJobs == NULL || fThreads == NULL)
+			return B_NO_MEMORY;
+
+		for (int32 i = 0; i < fJobCount; i++) {
+			fJobs[i].uncompressedData = malloc(kChunkSize);
+			fJobs[i].compressedData = malloc(kChunkSize);
+			if (fJobs[i].uncompressedData == NULL
+				|| fJobs[i].compressedData == NULL) {
+				return B_NO_MEMORY;
+			}
+		}
+
+		pthread_mutex_init(&fLock, NULL);
+		pthread_cond_init(&fJobAvailable, NULL);
+		pthread_cond_init(&fJobDone, NULL);
+		fInitialized = true;
+
+		for (; fThreadCount < threadCount; fThreadCount++) {
+			if (pthread_create(&fThreads[fThreadCount], NULL, &_WorkerThread,
+					this) != 0) {
+				break;
+			}
+		}
+
+		return fThreadCount > 0 ? B_OK : B_NO_MORE_THREADS;
+	}
+
+	int32 JobCount() const
+	{
+		return fJobCount;
+	}
+
+	int32 QueuedJobs() const
+	{
+		return int32(fSubmitted - fRetired);
+	}
+
+	/*!	Hands the chunk data over to the pool. \a buffer is replaced by a
+		buffer of the same size that the caller owns from then on.
+		There must be room for another job.
+	*/
+	void Submit(void*& buffer, size_t size)
+	{
+		CompressionJob& job = fJobs[fSubmitted % fJobCount];
+		std::swap(buffer, job.uncompressedData);
+		job.uncompressedSize = size;
+		job.compressedSize = 0;
+		job.error = B_OK;
+		job.done = false;
+
+		pthread_mutex_lock(&fLock);
+		fSubmitted++;
+		pthread_cond_signal(&fJobAvailable);
+		pthread_mutex_unlock(&fLock);
+	}
+
+	/*!	Returns the oldest job, if it is done or \a wait is \c true, waiting
+		for it to be done in the latter case. Returns \c NULL, if there are no
+		jobs or the oldest one isn't done yet and \a wait is \c false.
+	*/
+	CompressionJob* OldestJob(bool wait)
+	{
+		if (fRetired == fSubmitted)
+			return NULL;
+
+		CompressionJob& job = fJobs[fRetired % fJobCount];
+
+		pthread_mutex_lock(&fLock);
+		while (!job.done && wait)
+			pthread_cond_wait(&fJobDone, &fLock);
+		bool done = job.done;
+		pthread_mutex_unlock(&fLock);
+
+		return done ? &job : NULL;
+	}
+
+	void RetireOldestJob()
+	{
+		fRetired++;
+	}
+
+private:
+	static void* _WorkerThread(void* data)
+	{
+		((CompressionPool*)data)->_Work();
+		return NULL;
+	}
+
+	void _Work()
+	{
+		pthread_mutex_lock(&fLock);
+
+		while (true) {
+			while (!fQuit && fStarted == fSubmitted)
+				pthread_cond_wait(&fJobAvailable, &fLock);
+			if (fQuit)
+				break;
+
+			CompressionJob& job = fJobs[fStarted++ % fJobCount];
+			pthread_mutex_unlock(&fLock);
+
+			job.error = fWriter->_CompressChunk(job.uncompressedData,
+				job.uncompressedSize, job.compressedData, job.compressedSize);
+
+			pthread_mutex_lock(&fLock);
+			job.done = true;
+			pthread_cond_broadcast(&fJobDone);
+		}
+
+		pthread_mutex_unlock(&fLock);
+	}
+
+private:
+	const PackageFileHeapWriter* fWriter;
+
+	pthread_t*				fThreads;
+	int32					fThreadCount;
+
+	CompressionJob*			fJobs;
+	int32					fJobCount;
+	uint64					fSubmitted;
+	uint64					fStarted;
+	uint64					fRetired;
+
+	pthread_mutex_t			fLock;
+	pthread_cond_t			fJobAvailable;
+	pthread_cond_t			fJobDone;
+	bool					fQuit;
+	bool					fInitialized;
+};
+
+
 PackageFileHeapWriter::PackageFileHeapWriter(BErrorOutput* errorOutput,
 	BPositionIO* file, off_t heapOffset,
 	CompressionAlgorithmOwner* compressionAlgorithm,
@@ -205,7 +408,8 @@ PackageFileHeapWriter::PackageFileHeapWriter(BErrorOutput* errorOutput,
 	fCompressedDataBuffer(NULL),
 	fPendingDataSize(0),
 	fOffsets(),
-	fCompressionAlgorithm(compressionAlgorithm)
+	fCompressionAlgorithm(compressionAlgorithm),
+	fCompressionPool(NULL)
 {
 	if (fCompressionAlgorithm != NULL)
 		fCompressionAlgorithm->AcquireReference();
@@ -229,6 +433,23 @@ PackageFileHeapWriter::Init()
 	fCompressedDataBuffer = malloc(kChunkSize);
 	if (fPendingDataBuffer == NULL || fCompressedDataBuffer == NULL)
 		throw std::bad_alloc();
+
+	// If we compress and there's more than one CPU, compress complete chunks
+	// in parallel. Failing that isn't fatal, we just compress sequentially.
+	if (fCompressionAlgorithm == NULL)
+		return;
+
+	long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpuCount < 2)
+		return;
+
+	fCompressionPool = new(std::nothrow) CompressionPool(this);
+	if (fCompressionPool == NULL
+		|| fCompressionPool->Init(
+			std::min((int32)cpuCount, kMaxCompressionThreads)) != B_OK) {
+		delete fCompressionPool;
+		fCompressionPool = NULL;
+	}
 }
 
 
@@ -306,8 +527,7 @@ void
 PackageFileHeapWriter::RemoveDataRanges(
 	const ::BPrivate::RangeArray<uint64>& ranges)
 {
-	ssize_t rangeCount = ranges.CountRanges();
-	if (rangeCount == 0)
+	if (ranges.CountRanges() == 0)
 		return;
 
 	if (fUncompressedHeapSize == 0) {
@@ -317,7 +537,34 @@ PackageFileHeapWriter::RemoveDataRanges(
 
 	// Before we begin flush any pending data, so we don't need any special
 	// handling and also can use the pending data buffer.
-	_FlushPendingData();
+	status_t error = _FlushPendingData();
+	if (error == B_OK)
+		error = _WriteQueuedChunks(0);
+	if (error != B_OK)
+		throw error;
+
+	// The removal interleaves copying compressed chunks with adding data and
+	// relies on the compressed heap size being current, so it has to write
+	// all chunks sequentially.
+	CompressionPool* compressionPool = fCompressionPool;
+	fCompressionPool = NULL;
+
+	try {
+		_RemoveDataRanges(ranges);
+	} catch (...) {
+		fCompressionPool = compressionPool;
+		throw;
+	}
+
+	fCompressionPool = compressionPool;
+}
+
+
+void
+PackageFileHeapWriter::_RemoveDataRanges(
+	const ::BPrivate::RangeArray<uint64>& ranges)
+{
+	ssize_t rangeCount = ranges.CountRanges();
 
 	// We potentially have to recompress all data from the first affected chunk
 	// to the end (minus the removed ranges, of course). As a basic algorithm we
@@ -438,6 +685,8 @@ PackageFileHeapWriter::Finish()
 {
 	// flush pending data, if any
 	status_t error = _FlushPendingData();
+	if (error == B_OK)
+		error = _WriteQueuedChunks(0);
 	if (error != B_OK)
 		return error;
 
@@ -488,6 +737,13 @@ PackageFileHeapWriter::ReadAndDecompressChunk(size_t chunkIndex,
 		return B_OK;
 	}
 
+	// the chunk might still be queued for compression
+	if ((size_t)fOffsets.Count() <= chunkIndex) {
+		status_t error = _WriteQueuedChunks(0);
+		if (error != B_OK)
+			return error;
+	}
+
 	uint64 offset = fOffsets[chunkIndex];
 	size_t compressedSize = chunkIndex + 1 == (size_t)fOffsets.Count()
 		? fCompressedHeapSize - offset
@@ -501,6 +757,9 @@ PackageFileHeapWriter::ReadAndDecompressChunk(size_t chunkIndex,
 void
 PackageFileHeapWriter::_Uninit()
 {
+	delete fCompressionPool;
+	fCompressionPool = NULL;
+
 	free(fPendingDataBuffer);
 	free(fCompressedDataBuffer);
 	fPendingDataBuffer = NULL;
@@ -514,7 +773,25 @@ PackageFileHeapWriter::_FlushPendingData()
 	if (fPendingDataSize == 0)
 		return B_OK;
 
-	status_t error = _WriteChunk(fPendingDataBuffer, fPendingDataSize, true);
+	// Complete chunks are compressed in parallel, if possible.
+	if (fCompressionPool != NULL && fPendingDataSize == kChunkSize) {
+		status_t error = _WriteQueuedChunks(fCompressionPool->JobCount() - 1);
+		if (error != B_OK)
+			return error;
+
+		fCompressionPool->Submit(fPendingDataBuffer, fPendingDataSize);
+		fPendingDataSize = 0;
+
+		// write whatever is done already
+		return _WriteQueuedChunks(fCompressionPool->JobCount());
+	}
+
+	// A partial chunk has to be written after all queued ones.
+	status_t error = _WriteQueuedChunks(0);
+	if (error != B_OK)
+		return error;
+
+	error = _WriteChunk(fPendingDataBuffer, fPendingDataSize, true);
 	if (error == B_OK)
 		fPendingDataSize = 0;
 
@@ -522,30 +799,22 @@ PackageFileHeapWriter::_FlushPendingData()
 }
 
 
+/*!	Writes the chunks compressed by the compression pool in order, until no
+	more than \a maxQueued chunks remain queued. Chunks that are done already
+	are written in any case.
+*/
 status_t
-PackageFileHeapWriter::_WriteChunk(const void* data, size_t size,
-	bool mayCompress)
+PackageFileHeapWriter::_WriteQueuedChunks(int32 maxQueued)
 {
-	// add offset
-	if (!fOffsets.Add(fCompressedHeapSize)) {
-		fErrorOutput->PrintError("Out of memory!\n");
-		return B_NO_MEMORY;
-	}
-
-	// Try to use compression only for data large enough.
-	bool compress = mayCompress && size >= (off_t)kCompressionSizeThreshold;
-	if (compress) {
-		status_t error = _WriteDataCompressed(data, size);
-		if (error != B_OK) {
-			if (error != B_BUFFER_OVERFLOW)
-				return error;
-			compress = false;
-		}
-	}
+	if (fCompressionPool == NULL)
+		return B_OK;
 
-	// Write uncompressed, if necessary.
-	if (!compress) {
-		status_t error = _WriteDataUncompressed(data, size);
+	while (CompressionJob* job = fCompressionPool->OldestJob(
+			fCompressionPool->QueuedJobs() > maxQueued)) {
+		status_t error = _WriteChunkData(job->uncompressedData,
+			job->uncompressedSize, job->compressedData, job->compressedSize,
+			job->error);
+		fCompressionPool->RetireOldestJob();
 		if (error != B_OK)
 			return error;
 	}
@@ -555,28 +824,67 @@ PackageFileHeapWriter::_WriteChunk(const void* data, size_t size,
 
 
 status_t
-PackageFileHeapWriter::_WriteDataCompressed(const void* data, size_t size)
+PackageFileHeapWriter::_WriteChunk(const void* data, size_t size,
+	bool mayCompress)
 {
-	if (fCompressionAlgorithm == NULL)
+	size_t compressedSize = 0;
+	status_t compressionError = mayCompress
+		? _CompressChunk(data, size, fCompressedDataBuffer, compressedSize)
+		: B_BUFFER_OVERFLOW;
+
+	return _WriteChunkData(data, size, fCompressedDataBuffer, compressedSize,
+		compressionError);
+}
+
+
+/*!	Compresses the given chunk data. Returns \c B_BUFFER_OVERFLOW, if the data
+	shall be stored uncompressed. May be invoked by the compression pool's
+	threads concurrently.
+*/
+status_t
+PackageFileHeapWriter::_CompressChunk(const void* data, size_t size,
+	void* compressedDataBuffer, size_t& _compressedSize) const
+{
+	// Try to use compression only for data large enough.
+	if (fCompressionAlgorithm == NULL || size < kCompressionSizeThreshold)
 		return B_BUFFER_OVERFLOW;
 
-	size_t compressedSize;
 	status_t error = fCompressionAlgorithm->algorithm->CompressBuffer(data,
-		size, fCompressedDataBuffer, size, compressedSize,
+		size, compressedDataBuffer, size, _compressedSize,
 		fCompressionAlgorithm->parameters);
-	if (error != B_OK) {
-		if (error != B_BUFFER_OVERFLOW) {
-			fErrorOutput->PrintError("Failed to compress chunk data: %s\n",
-				strerror(error));
-		}
+	if (error != B_OK)
 		return error;
-	}
 
 	// only use compressed data when we've actually saved space
-	if (compressedSize == size)
+	if (_compressedSize == size)
 		return B_BUFFER_OVERFLOW;
 
-	return _WriteDataUncompressed(fCompressedDataBuffer, compressedSize);
+	return B_OK;
+}
+
+
+status_t
+PackageFileHeapWriter::_WriteChunkData(const void* data, size_t size,
+	const void* compressedData, size_t compressedSize,
+	status_t compressionError)
+{
+	if (compressionError != B_OK && compressionError != B_BUFFER_OVERFLOW) {
+		fErrorOutput->PrintError("Failed to compress chunk data: %s\n",
+			strerror(compressionError));
+		return compressionError;
+	}
+
+	// add offset
+	if (!fOffsets.Add(fCompressedHeapSize)) {
+		fErrorOutput->PrintError("Out of memory!\n");
+		return B_NO_MEMORY;
+	}
+
+	// write compressed data, if compression paid off, uncompressed otherwise
+	if (compressionError == B_OK)
+		return _WriteDataUncompressed(compressedData, compressedSize);
+
+	return _WriteDataUncompressed(data, size);
 }
 
 
@@ -0,0 +1,494 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <ZstdCompressionAlgorithm.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#ifdef ZSTD_ENABLED
+#	include <zstd.h>
+#	include <zstd_errors.h>
+#endif
+
+#include <DataIO.h>
+
+
+// build compression support only for userland
+#if defined(ZSTD_ENABLED) && !defined(_KERNEL_MODE) && !defined(_BOOT_MODE)
+#	define B_ZSTD_COMPRESSION_SUPPORT 1
+#endif
+
+
+static const size_t kMinBufferSize		= 1024;
+static const size_t kMaxBufferSize		= 1024 * 1024;
+static const size_t kDefaultBufferSize	= 4 * 1024;
+
+
+static size_t
+sanitize_buffer_size(size_t size)
+{
+	if (size < kMinBufferSize)
+		return kMinBufferSize;
+	return std::min(size, kMaxBufferSize);
+}
+
+
+// #pragma mark - BZstdCompressionParameters
+
+
+BZstdCompressionParameters::BZstdCompressionParameters(
+	int compressionLevel)
+	:
+	BCompressionParameters(),
+	fCompressionLevel(compressionLevel),
+	fBufferSize(kDefaultBufferSize)
+{
+}
+
+
+BZstdCompressionParameters::~BZstdCompressionParameters()
+{
+}
+
+
+int32
+BZstdCompressionParameters::CompressionLevel() const
+{
+	return fCompressionLevel;
+}
+
+
+void
+BZstdCompressionParameters::SetCompressionLevel(int32 level)
+{
+	fCompressionLevel = level;
+}
+
+
+size_t
+BZstdCompressionParameters::BufferSize() const
+{
+	return fBufferSize;
+}
+
+
+void
+BZstdCompressionParameters::SetBufferSize(size_t size)
+{
+	fBufferSize = sanitize_buffer_size(size);
+}
+
+
+// #pragma mark - BZstdDecompressionParameters
+
+
+BZstdDecompressionParameters::BZstdDecompressionParameters()
+	:
+	BDecompressionParameters(),
+	fBufferSize(kDefaultBufferSize)
+{
+}
+
+
+BZstdDecompressionParameters::~BZstdDecompressionParameters()
+{
+}
+
+
+size_t
+BZstdDecompressionParameters::BufferSize() const
+{
+	return fBufferSize;
+}
+
+
+void
+BZstdDecompressionParameters::SetBufferSize(size_t size)
+{
+	fBufferSize = sanitize_buffer_size(size);
+}
+
+
+// #pragma mark - CompressionStrategy
+
+
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+
+
+struct BZstdCompressionAlgorithm::CompressionStrategy {
+	typedef BZstdCompressionParameters Parameters;
+	typedef ZSTD_CCtx Context;
+
+	static const bool kNeedsFinalFlush = true;
+
+	static size_t Init(ZSTD_CCtx*& context,
+		const BZstdCompressionParameters* parameters)
+	{
+		int32 compressionLevel = B_ZSTD_COMPRESSION_DEFAULT;
+		if (parameters != NULL)
+			compressionLevel = parameters->CompressionLevel();
+
+		context = ZSTD_createCCtx();
+		if (context == NULL)
+			return (size_t)-ZSTD_error_memory_allocation;
+
+		return ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel,
+			compressionLevel);
+	}
+
+	static void Uninit(ZSTD_CCtx* context)
+	{
+		ZSTD_freeCCtx(context);
+	}
+
+	static size_t Process(ZSTD_CCtx* context, ZSTD_outBuffer& output,
+		ZSTD_inBuffer& input, bool flush)
+	{
+		return ZSTD_compressStream2(context, &output, &input,
+			flush ? ZSTD_e_end : ZSTD_e_continue);
+	}
+};
+
+
+#endif	// B_ZSTD_COMPRESSION_SUPPORT
+
+
+// #pragma mark - DecompressionStrategy
+
+
+#ifdef ZSTD_ENABLED
+
+
+struct BZstdCompressionAlgorithm::DecompressionStrategy {
+	typedef BZstdDecompressionParameters Parameters;
+	typedef ZSTD_DCtx Context;
+
+	static const bool kNeedsFinalFlush = false;
+
+	static size_t Init(ZSTD_DCtx*& context,
+		const BZstdDecompressionParameters* /*parameters*/)
+	{
+		context = ZSTD_createDCtx();
+		if (context == NULL)
+			return (size_t)-ZSTD_error_memory_allocation;
+		return 0;
+	}
+
+	static void Uninit(ZSTD_DCtx* context)
+	{
+		ZSTD_freeDCtx(context);
+	}
+
+	static size_t Process(ZSTD_DCtx* context, ZSTD_outBuffer& output,
+		ZSTD_inBuffer& input, bool /*flush*/)
+	{
+		return ZSTD_decompressStream(context, &output, &input);
+	}
+};
+
+
+// #pragma mark - Stream
+
+
+template<typename BaseClass, typename Strategy>
+struct BZstdCompressionAlgorithm::Stream : BaseClass {
+	Stream(BDataIO* io)
+		:
+		BaseClass(io),
+		fContext(NULL)
+	{
+	}
+
+	~Stream()
+	{
+		if (fContext != NULL) {
+			if (Strategy::kNeedsFinalFlush)
+				this->Flush();
+			Strategy::Uninit(fContext);
+		}
+	}
+
+	status_t Init(const typename Strategy::Parameters* parameters)
+	{
+		status_t error = this->BaseClass::Init(
+			parameters != NULL ? parameters->BufferSize() : kDefaultBufferSize);
+		if (error != B_OK)
+			return error;
+
+		size_t zstdError = Strategy::Init(fContext, parameters);
+		if (ZSTD_isError(zstdError)) {
+			if (fContext != NULL) {
+				Strategy::Uninit(fContext);
+				fContext = NULL;
+			}
+			return _TranslateZstdError(zstdError);
+		}
+
+		return B_OK;
+	}
+
+	virtual status_t ProcessData(const void* input, size_t inputSize,
+		void* output, size_t outputSize, size_t& bytesConsumed,
+		size_t& bytesProduced)
+	{
+		return _ProcessData(input, inputSize, output, outputSize,
+			bytesConsumed, bytesProduced, false);
+	}
+
+	virtual status_t FlushPendingData(void* output, size_t outputSize,
+		size_t& bytesProduced)
+	{
+		size_t bytesConsumed;
+		return _ProcessData(NULL, 0, output, outputSize,
+			bytesConsumed, bytesProduced, true);
+	}
+
+	template<typename BaseParameters>
+	static status_t Create(BDataIO* io, BaseParameters* _parameters,
+		BDataIO*& _stream)
+	{
+		const typename Strategy::Parameters* parameters
+#ifdef _BOOT_MODE
+			= static_cast<const typename Strategy::Parameters*>(_parameters);
+#else
+			= dynamic_cast<const typename Strategy::Parameters*>(_parameters);
+#endif
+		Stream* stream = new(std::nothrow) Stream(io);
+		if (stream == NULL)
+			return B_NO_MEMORY;
+
+		status_t error = stream->Init(parameters);
+		if (error != B_OK) {
+			delete stream;
+			return error;
+		}
+
+		_stream = stream;
+		return B_OK;
+	}
+
+private:
+	status_t _ProcessData(const void* input, size_t inputSize,
+		void* output, size_t outputSize, size_t& bytesConsumed,
+		size_t& bytesProduced, bool flush)
+	{
+		ZSTD_inBuffer inBuffer = { input, inputSize, 0 };
+		ZSTD_outBuffer outBuffer = { output, outputSize, 0 };
+
+		size_t zstdError = Strategy::Process(fContext, outBuffer, inBuffer,
+			flush);
+		if (ZSTD_isError(zstdError))
+			return _TranslateZstdError(zstdError);
+
+		bytesConsumed = inBuffer.pos;
+		bytesProduced = outBuffer.pos;
+		return B_OK;
+	}
+
+private:
+	typename Strategy::Context*	fContext;
+};
+
+
+#endif	// ZSTD_ENABLED
+
+
+// #pragma mark - BZstdCompressionAlgorithm
+
+
+BZstdCompressionAlgorithm::BZstdCompressionAlgorithm()
+	:
+	BCompressionAlgorithm(),
+	fDecompressionContext(NULL)
+{
+}
+
+
+BZstdCompressionAlgorithm::~BZstdCompressionAlgorithm()
+{
+#ifdef ZSTD_ENABLED
+	ZSTD_freeDCtx((ZSTD_DCtx*)fDecompressionContext);
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::CreateCompressingInputStream(BDataIO* input,
+	const BCompressionParameters* parameters, BDataIO*& _stream)
+{
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	return Stream<BAbstractInputStream, CompressionStrategy>::Create(
+		input, parameters, _stream);
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::CreateCompressingOutputStream(BDataIO* output,
+	const BCompressionParameters* parameters, BDataIO*& _stream)
+{
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	return Stream<BAbstractOutputStream, CompressionStrategy>::Create(
+		output, parameters, _stream);
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::CreateDecompressingInputStream(BDataIO* input,
+	const BDecompressionParameters* parameters, BDataIO*& _stream)
+{
+#ifdef ZSTD_ENABLED
+	return Stream<BAbstractInputStream, DecompressionStrategy>::Create(
+		input, parameters, _stream);
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::CreateDecompressingOutputStream(BDataIO* output,
+	const BDecompressionParameters* parameters, BDataIO*& _stream)
+{
+#ifdef ZSTD_ENABLED
+	return Stream<BAbstractOutputStream, DecompressionStrategy>::Create(
+		output, parameters, _stream);
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::CompressBuffer(const void* input,
+	size_t inputSize, void* output, size_t outputSize, size_t& _compressedSize,
+	const BCompressionParameters* parameters)
+{
+#ifdef B_ZSTD_COMPRESSION_SUPPORT
+	const BZstdCompressionParameters* zstdParameters
+		= dynamic_cast<const BZstdCompressionParameters*>(parameters);
+	int compressionLevel = zstdParameters != NULL
+		? zstdParameters->CompressionLevel()
+		: B_ZSTD_COMPRESSION_DEFAULT;
+
+	size_t zstdError = ZSTD_compress(output, outputSize, input, inputSize,
+		compressionLevel);
+	if (ZSTD_isError(zstdError))
+		return _TranslateZstdError(zstdError);
+
+	_compressedSize = zstdError;
+	return B_OK;
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+status_t
+BZstdCompressionAlgorithm::DecompressBuffer(const void* input,
+	size_t inputSize, void* output, size_t outputSize,
+	size_t& _uncompressedSize, const BDecompressionParameters* parameters)
+{
+#ifdef ZSTD_ENABLED
+	ZSTD_DCtx* context = (ZSTD_DCtx*)_GetDecompressionContext();
+	if (context == NULL)
+		return B_NO_MEMORY;
+
+	size_t zstdError = ZSTD_decompressDCtx(context, output, outputSize, input,
+		inputSize);
+	_PutDecompressionContext(context);
+	if (ZSTD_isError(zstdError))
+		return _TranslateZstdError(zstdError);
+
+	_uncompressedSize = zstdError;
+	return B_OK;
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
+
+
+/*!	Returns the cached decompression context, or a new one if it is in use
+	by another thread. The reader calls DecompressBuffer() once per chunk,
+	so this saves zstd from setting up its tables every time.
+*/
+void*
+BZstdCompressionAlgorithm::_GetDecompressionContext()
+{
+#ifdef ZSTD_ENABLED
+#if LONG_MAX == INT_MAX
+	void* context = (void*)atomic_get_and_set((int32*)&fDecompressionContext,
+		0);
+#else
+	void* context = (void*)atomic_get_and_set64(
+		(int64*)&fDecompressionContext, 0);
+#endif
+	if (context != NULL)
+		return context;
+
+	return ZSTD_createDCtx();
+#else
+	return NULL;
+#endif
+}
+
+
+void
+BZstdCompressionAlgorithm::_PutDecompressionContext(void* context)
+{
+#ifdef ZSTD_ENABLED
+#if LONG_MAX == INT_MAX
+	void* previous = (void*)atomic_test_and_set(
+		(int32*)&fDecompressionContext, (int32)context, 0);
+#else
+	void* previous = (void*)atomic_test_and_set64(
+		(int64*)&fDecompressionContext, (int64)context, 0);
+#endif
+	if (previous != NULL) {
+		// another thread has already returned its context
+		ZSTD_freeDCtx((ZSTD_DCtx*)context);
+	}
+#endif
+}
+
+
+/*static*/ status_t
+BZstdCompressionAlgorithm::_TranslateZstdError(size_t error)
+{
+#ifdef ZSTD_ENABLED
+	switch (ZSTD_getErrorCode(error)) {
+		case ZSTD_error_no_error:
+			return B_OK;
+		case ZSTD_error_corruption_detected:
+		case ZSTD_error_checksum_wrong:
+		case ZSTD_error_prefix_unknown:
+		case ZSTD_error_frameParameter_unsupported:
+			return B_BAD_DATA;
+		case ZSTD_error_memory_allocation:
+			return B_NO_MEMORY;
+		case ZSTD_error_dstSize_tooSmall:
+			return B_BUFFER_OVERFLOW;
+		case ZSTD_error_parameter_unsupported:
+		case ZSTD_error_parameter_outOfBound:
+		case ZSTD_error_init_missing:
+			return B_BAD_VALUE;
+		default:
+			return B_ERROR;
+	}
+#else
+	return B_NOT_SUPPORTED;
+#endif
+}
@@ -194,6 +194,36 @@ Stream::ReadLink(char* buffer, size_t bufferSize)
 }
 
 
+/*!	Small files may keep their data in the small_data section of the inode,
+	which is not kept in memory.
+*/
+status_t
+Stream::ReadInlineData(off_t pos, uint8* buffer, size_t* _length)
+{
+	CachedBlock cached(fVolume);
+	bfs_inode* node = (bfs_inode*)cached.SetTo(inode_num);
+	if (node == NULL) {
+		*_length = 0;
+		return B_IO_ERROR;
+	}
+
+	const small_data* item = node->SmallDataStart();
+	for (; !item->IsLast(node); item = item->Next()) {
+		if (item->NameSize() == INLINE_DATA_NAME_LENGTH
+			&& *item->Name() == INLINE_DATA_NAME)
+			break;
+	}
+
+	if (item->IsLast(node) || pos + *_length > item->DataSize()) {
+		*_length = 0;
+		return B_BAD_DATA;
+	}
+
+	memcpy(buffer, item->Data() + pos, *_length);
+	return B_OK;
+}
+
+
 status_t
 Stream::FindBlockRun(off_t pos, block_run& run, off_t& offset)
 {
@@ -309,6 +339,11 @@ Stream::ReadAt(off_t pos, uint8* buffer, size_t* _length)
 	if (pos + (off_t)length > data.Size())
 		length = data.Size() - pos;
 
+	if ((Flags() & INODE_INLINE_DATA) != 0) {
+		*_length = length;
+		return ReadInlineData(pos, buffer, _length);
+	}
+
 	block_run run;
 	off_t offset;
 	if (FindBlockRun(pos, run, offset) < B_OK) {
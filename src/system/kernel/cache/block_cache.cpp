@@ -7,6 +7,7 @@
 #include <block_cache.h>
 
 #include <unistd.h>
+#include <sys/uio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -48,6 +49,8 @@
 
 static const bigtime_t kTransactionIdleTime = 2000000LL;
 	// a transaction is considered idle after 2 seconds of inactivity
+static const size_t kMaxPrefetchBlocks = 32;
+	// maximum number of blocks a single block_cache_prefetch() call reads in
 
 
 namespace {
@@ -113,6 +116,15 @@ typedef DoublyLinkedList<cached_block,
 	DoublyLinkedListMemberGetLink<cached_block,
 		&cached_block::link> > block_list;
 
+struct block_prefetch : DoublyLinkedListLinkImpl<block_prefetch> {
+	block_cache*	cache;
+	off_t			block_number;
+	size_t			num_blocks;
+	cached_block*	blocks[kMaxPrefetchBlocks];
+};
+
+typedef DoublyLinkedList<block_prefetch> PrefetchList;
+
 struct cache_notification : DoublyLinkedListLinkImpl<cache_notification> {
 	int32			transaction_id;
 	int32			events_pending;
@@ -152,6 +164,21 @@ struct BlockHash {
 typedef BOpenHashTable<BlockHash> BlockTable;
 
 
+static const uint32 kBlockHashShardBits = 4;
+static const uint32 kBlockHashShardCount = 1 << kBlockHashShardBits;
+
+/*!	The block hash is split into shards that each have their own lock in
+	addition to the cache lock. Inserting or removing blocks requires both
+	locks, so the cache lock alone is sufficient to look up blocks. A shard's
+	read lock alone allows get_cached_block_fast() and put_cached_block_fast()
+	to look up blocks and change their reference count without the cache lock.
+*/
+struct BlockHashShard {
+	rw_lock			lock;
+	BlockTable		table;
+};
+
+
 struct TransactionHash {
 	typedef int32				KeyType;
 	typedef	cache_transaction	ValueType;
@@ -170,7 +197,7 @@ typedef BOpenHashTable<TransactionHash> TransactionTable;
 
 
 struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
-	BlockTable*		hash;
+	BlockHashShard	hash_shards[kBlockHashShardCount];
 	mutex			lock;
 	int				fd;
 	off_t			max_blocks;
@@ -209,9 +236,22 @@ struct block_cache : DoublyLinkedListLinkImpl<block_cache> {
 	cached_block*	NewBlock(off_t blockNumber);
 	void			FreeBlockParentData(cached_block* block);
 
+	BlockHashShard&	ShardFor(off_t blockNumber)
+	{
+		// The tables already use the lower bits of the block number, so we
+		// pick the shard by the upper bits of a multiplicative hash.
+		uint64 hash = (uint64)blockNumber * 0x9e3779b97f4a7c15ULL;
+		return hash_shards[hash >> (64 - kBlockHashShardBits)];
+	}
+
+	cached_block*	LookupBlock(off_t blockNumber)
+		{ return ShardFor(blockNumber).table.Lookup(blockNumber); }
+	void			InsertBlock(cached_block* block);
+
 	void			RemoveUnusedBlocks(int32 count, int32 minSecondsOld = 0);
 	void			RemoveBlock(cached_block* block);
 	void			DiscardBlock(cached_block* block);
+	bool			UnlinkUnusedBlock(cached_block* block);
 
 private:
 	static void		_LowMemoryHandler(void* data, uint32 resources,
@@ -219,6 +259,40 @@ private:
 	cached_block*	_GetUnusedBlock();
 };
 
+
+/*!	Iterates over all blocks of a cache. The cache must be locked. */
+class BlockIterator {
+public:
+	BlockIterator(block_cache* cache)
+		:
+		fCache(cache),
+		fShard(0),
+		fIterator(&cache->hash_shards[0].table)
+	{
+	}
+
+	bool HasNext()
+	{
+		while (!fIterator.HasNext()) {
+			if (++fShard >= kBlockHashShardCount)
+				return false;
+			fIterator = BlockTable::Iterator(
+				&fCache->hash_shards[fShard].table);
+		}
+		return true;
+	}
+
+	cached_block* Next()
+	{
+		return HasNext() ? fIterator.Next() : NULL;
+	}
+
+private:
+	block_cache*		fCache;
+	uint32				fShard;
+	BlockTable::Iterator fIterator;
+};
+
 struct cache_listener;
 typedef DoublyLinkedListLink<cache_listener> listener_link;
 
@@ -739,6 +813,10 @@ static sem_id sEventSemaphore;
 static mutex sNotificationsLock
 	= MUTEX_INITIALIZER("block cache notifications");
 static thread_id sNotifierWriterThread;
+static mutex sPrefetchLock = MUTEX_INITIALIZER("block cache prefetch");
+static ConditionVariable sPrefetchCondition;
+static PrefetchList sPrefetchQueue;
+static thread_id sPrefetcherThread = -1;
 static DoublyLinkedListLink<block_cache> sMarkCache;
 	// TODO: this only works if the link is the first entry of block_cache
 static object_cache* sBlockCache;
@@ -1356,7 +1434,6 @@ BlockWriter::_CompareBlocks(const void* _blockA, const void* _blockB)
 block_cache::block_cache(int _fd, off_t numBlocks, size_t blockSize,
 		bool readOnly)
 	:
-	hash(NULL),
 	fd(_fd),
 	max_blocks(numBlocks),
 	block_size(blockSize),
@@ -1381,7 +1458,9 @@ block_cache::~block_cache()
 	unregister_low_resource_handler(&_LowMemoryHandler, this);
 
 	delete transaction_hash;
-	delete hash;
+
+	for (uint32 i = 0; i < kBlockHashShardCount; i++)
+		rw_lock_destroy(&hash_shards[i].lock);
 
 	delete_object_cache(buffer_cache);
 
@@ -1402,9 +1481,11 @@ block_cache::Init()
 	if (buffer_cache == NULL)
 		return B_NO_MEMORY;
 
-	hash = new BlockTable();
-	if (hash == NULL || hash->Init(1024) != B_OK)
-		return B_NO_MEMORY;
+	for (uint32 i = 0; i < kBlockHashShardCount; i++) {
+		rw_lock_init(&hash_shards[i].lock, "block cache hash");
+		if (hash_shards[i].table.Init(1024 / kBlockHashShardCount) != B_OK)
+			return B_NO_MEMORY;
+	}
 
 	transaction_hash = new(std::nothrow) TransactionTable();
 	if (transaction_hash == NULL || transaction_hash->Init(16) != B_OK)
@@ -1523,6 +1604,17 @@ block_cache::FreeBlockParentData(cached_block* block)
 }
 
 
+/*!	Adds \a block to the hash. The cache must be locked. */
+void
+block_cache::InsertBlock(cached_block* block)
+{
+	BlockHashShard& shard = ShardFor(block->block_number);
+	WriteLocker _(shard.lock);
+
+	shard.table.Insert(block);
+}
+
+
 void
 block_cache::RemoveUnusedBlocks(int32 count, int32 minSecondsOld)
 {
@@ -1530,6 +1622,11 @@ block_cache::RemoveUnusedBlocks(int32 count, int32 minSecondsOld)
 
 	for (block_list::Iterator iterator = unused_blocks.GetIterator();
 			cached_block* block = iterator.Next();) {
+		if (atomic_get(&block->ref_count) > 0) {
+			// Acquired by get_cached_block_fast(): its position is stale
+			// until it is moved to the end of the list when put
+			continue;
+		}
 		if (minSecondsOld >= block->LastAccess()) {
 			// The list is sorted by last access
 			break;
@@ -1542,17 +1639,24 @@ block_cache::RemoveUnusedBlocks(int32 count, int32 minSecondsOld)
 			block->block_number, block->last_accessed));
 
 		// this can only happen if no transactions are used
-		if (block->is_dirty && !block->discard) {
+		if (block->is_dirty && !block->discard
+			&& atomic_get(&block->ref_count) == 0) {
 			if (block->busy_writing)
 				continue;
 
 			BlockWriter::WriteBlock(this, block);
+			if (!block->unused) {
+				// it has been acquired while the cache was unlocked
+				continue;
+			}
 		}
 
 		// remove block from lists
-		iterator.Remove();
-		unused_block_count--;
-		RemoveBlock(block);
+		if (!UnlinkUnusedBlock(block)) {
+			// it's in use again
+			continue;
+		}
+		FreeBlock(block);
 
 		if (--count <= 0)
 			break;
@@ -1560,10 +1664,23 @@ block_cache::RemoveUnusedBlocks(int32 count, int32 minSecondsOld)
 }
 
 
+/*!	Removes \a block from the hash, and frees it. The block must not be
+	referenced, nor in the unused list, so that get_cached_block_fast() cannot
+	acquire a reference to it. The cache must be locked.
+*/
 void
 block_cache::RemoveBlock(cached_block* block)
 {
-	hash->Remove(block);
+	ASSERT(!block->unused);
+
+	BlockHashShard& shard = ShardFor(block->block_number);
+	WriteLocker shardLocker(shard.lock);
+
+	ASSERT(block->ref_count == 0);
+	shard.table.Remove(block);
+
+	shardLocker.Unlock();
+
 	FreeBlock(block);
 }
 
@@ -1589,6 +1706,31 @@ block_cache::DiscardBlock(cached_block* block)
 }
 
 
+/*!	Removes the unused \a block from the unused list, and, unless it has been
+	referenced via get_cached_block_fast() in the meantime, from the hash.
+	Returns \c true if the block was removed from the hash, and can therefore
+	be freed or reused. The cache must be locked.
+*/
+bool
+block_cache::UnlinkUnusedBlock(cached_block* block)
+{
+	ASSERT(block->unused);
+
+	BlockHashShard& shard = ShardFor(block->block_number);
+	WriteLocker _(shard.lock);
+
+	unused_blocks.Remove(block);
+	unused_block_count--;
+	block->unused = false;
+
+	if (block->ref_count > 0)
+		return false;
+
+	shard.table.Remove(block);
+	return true;
+}
+
+
 void
 block_cache::_LowMemoryHandler(void* data, uint32 resources, int32 level)
 {
@@ -1646,16 +1788,22 @@ block_cache::_GetUnusedBlock()
 			cached_block* block = iterator.Next();) {
 		TB(Flush(this, block, true));
 		// this can only happen if no transactions are used
-		if (block->is_dirty && !block->busy_writing && !block->discard)
+		if (block->is_dirty && !block->busy_writing && !block->discard
+			&& atomic_get(&block->ref_count) == 0) {
 			BlockWriter::WriteBlock(this, block);
+			if (!block->unused) {
+				// it has been acquired while the cache was unlocked
+				continue;
+			}
+		}
 
 		// remove block from lists
-		iterator.Remove();
-		unused_block_count--;
-		hash->Remove(block);
+		if (!UnlinkUnusedBlock(block)) {
+			// it's in use again
+			continue;
+		}
 
 		ASSERT(block->original_data == NULL && block->parent_data == NULL);
-		block->unused = false;
 
 		// TODO: see if compare data is handled correctly here!
 #if BLOCK_CACHE_DEBUG_CHANGED
@@ -1803,21 +1951,26 @@ put_cached_block(block_cache* cache, cached_block* block)
 #endif
 	TB(Put(cache, block));
 
-	if (block->ref_count < 1) {
+	if (atomic_get(&block->ref_count) < 1) {
 		panic("Invalid ref_count for block %p, cache %p\n", block, cache);
 		return;
 	}
 
-	if (--block->ref_count == 0
+	if (atomic_add(&block->ref_count, -1) == 1
 		&& block->transaction == NULL && block->previous_transaction == NULL) {
 		// This block is not used anymore, and not part of any transaction
 		block->is_writing = false;
 
 		if (block->discard) {
 			cache->RemoveBlock(block);
+		} else if (block->unused) {
+			// The block has been acquired by get_cached_block_fast(), and
+			// was left in the list of unused blocks; move it to its end, as
+			// it's the most recently used one now.
+			cache->unused_blocks.Remove(block);
+			cache->unused_blocks.Add(block);
 		} else {
 			// put this block in the list of unused blocks
-			ASSERT(!block->unused);
 			block->unused = true;
 
 			ASSERT(block->original_data == NULL && block->parent_data == NULL);
@@ -1836,7 +1989,7 @@ put_cached_block(block_cache* cache, off_t blockNumber)
 			blockNumber, cache->max_blocks - 1);
 	}
 
-	cached_block* block = cache->hash->Lookup(blockNumber);
+	cached_block* block = cache->LookupBlock(blockNumber);
 	if (block != NULL)
 		put_cached_block(cache, block);
 	else {
@@ -1869,7 +2022,7 @@ get_cached_block(block_cache* cache, off_t blockNumber, bool* _allocated,
 	}
 
 retry:
-	cached_block* block = cache->hash->Lookup(blockNumber);
+	cached_block* block = cache->LookupBlock(blockNumber);
 	*_allocated = false;
 
 	if (block == NULL) {
@@ -1878,7 +2031,7 @@ retry:
 		if (block == NULL)
 			return NULL;
 
-		cache->hash->Insert(block);
+		cache->InsertBlock(block);
 		*_allocated = true;
 	} else if (block->busy_reading) {
 		// The block is currently busy_reading - wait and try again later
@@ -1917,13 +2070,88 @@ retry:
 		mark_block_unbusy_reading(cache, block);
 	}
 
-	block->ref_count++;
+	atomic_add(&block->ref_count, 1);
 	block->last_accessed = system_time() / 1000000L;
 
 	return block;
 }
 
 
+#if !BLOCK_CACHE_DEBUG_CHANGED
+
+/*!	Tries to acquire a reference to the already cached block \a blockNumber
+	without locking the cache.
+	This only works for blocks that are either referenced already, or are in
+	the list of unused blocks. In the latter case, the block is left in that
+	list; put_cached_block() and anyone reclaiming unused blocks cope with
+	that.
+	Returns \c NULL if the block has to be retrieved via get_cached_block().
+*/
+static cached_block*
+get_cached_block_fast(block_cache* cache, off_t blockNumber)
+{
+	BlockHashShard& shard = cache->ShardFor(blockNumber);
+	ReadLocker shardLocker(shard.lock);
+
+	cached_block* block = shard.table.Lookup(blockNumber);
+	if (block == NULL)
+		return NULL;
+
+	int32 refCount = atomic_get(&block->ref_count);
+	while (true) {
+		// Unreferenced blocks that aren't in the unused list are still being
+		// read in, or are about to be removed.
+		if (refCount == 0 && (!block->unused || block->discard))
+			return NULL;
+
+		int32 previous = atomic_test_and_set(&block->ref_count, refCount + 1,
+			refCount);
+		if (previous == refCount)
+			break;
+
+		refCount = previous;
+	}
+
+	block->last_accessed = system_time() / 1000000L;
+	return block;
+}
+
+
+/*!	Tries to release a reference to \a blockNumber without locking the cache.
+	This only works as long as it isn't the last reference: the last one has
+	to move the block to the end of the unused list (or put it there), which
+	keeps that list sorted by last access.
+	Returns \c false if the reference has to be released via
+	put_cached_block().
+*/
+static bool
+put_cached_block_fast(block_cache* cache, off_t blockNumber)
+{
+	BlockHashShard& shard = cache->ShardFor(blockNumber);
+	ReadLocker shardLocker(shard.lock);
+
+	cached_block* block = shard.table.Lookup(blockNumber);
+	if (block == NULL)
+		return false;
+
+	int32 refCount = atomic_get(&block->ref_count);
+	while (refCount > 1) {
+		int32 previous = atomic_test_and_set(&block->ref_count, refCount - 1,
+			refCount);
+		if (previous == refCount) {
+			TB(Put(cache, block));
+			return true;
+		}
+
+		refCount = previous;
+	}
+
+	return false;
+}
+
+#endif	// !BLOCK_CACHE_DEBUG_CHANGED
+
+
 /*!	Returns the writable block data for the requested blockNumber.
 	If \a cleared is true, the block is not read from disk; an empty block
 	is returned.
@@ -2192,7 +2420,7 @@ dump_cache(int argc, char** argv)
 	off_t blockNumber = -1;
 	if (i + 1 < argc) {
 		blockNumber = parse_expression(argv[i + 1]);
-		cached_block* block = cache->hash->Lookup(blockNumber);
+		cached_block* block = cache->LookupBlock(blockNumber);
 		if (block != NULL)
 			dump_block_long(block);
 		else
@@ -2252,7 +2480,7 @@ dump_cache(int argc, char** argv)
 	uint32 count = 0;
 	uint32 dirty = 0;
 	uint32 discarded = 0;
-	BlockTable::Iterator iterator(cache->hash);
+	BlockIterator iterator(cache);
 	while (iterator.HasNext()) {
 		cached_block* block = iterator.Next();
 		if (showBlocks)
@@ -2543,7 +2771,7 @@ block_notifier_and_writer(void* /*data*/)
 			if (cache->num_dirty_blocks) {
 				// This cache is not using transactions, we'll scan the blocks
 				// directly
-				BlockTable::Iterator iterator(cache->hash);
+				BlockIterator iterator(cache);
 
 				while (iterator.HasNext()) {
 					cached_block* block = iterator.Next();
@@ -2592,6 +2820,76 @@ block_notifier_and_writer(void* /*data*/)
 }
 
 
+/*!	Reads in the blocks of \a prefetch, which are all marked busy reading,
+	and moves them into the list of unused blocks. Blocks that could not be
+	read are removed from the cache again.
+*/
+static void
+read_prefetched_blocks(block_prefetch* prefetch)
+{
+	block_cache* cache = prefetch->cache;
+	size_t blockSize = cache->block_size;
+
+	iovec vecs[kMaxPrefetchBlocks];
+	for (size_t i = 0; i < prefetch->num_blocks; i++) {
+		vecs[i].iov_base = prefetch->blocks[i]->current_data;
+		vecs[i].iov_len = blockSize;
+	}
+
+	ssize_t bytesRead = readv_pos(cache->fd,
+		prefetch->block_number * blockSize, vecs, prefetch->num_blocks);
+
+	MutexLocker locker(&cache->lock);
+
+	for (size_t i = 0; i < prefetch->num_blocks; i++) {
+		cached_block* block = prefetch->blocks[i];
+		mark_block_unbusy_reading(cache, block);
+
+		if (bytesRead < (ssize_t)((i + 1) * blockSize)) {
+			TB(Error(cache, block->block_number, "prefetch failed",
+				bytesRead));
+			cache->RemoveBlock(block);
+			continue;
+		}
+
+		TB(Read(cache, block));
+
+		block->unused = true;
+		cache->unused_blocks.Add(block);
+		cache->unused_block_count++;
+	}
+}
+
+
+/*!	This thread reads in the blocks that have been queued by
+	block_cache_prefetch().
+*/
+static status_t
+block_prefetcher(void* /*data*/)
+{
+	while (true) {
+		MutexLocker locker(sPrefetchLock);
+
+		block_prefetch* prefetch = sPrefetchQueue.RemoveHead();
+		if (prefetch == NULL) {
+			ConditionVariableEntry entry;
+			sPrefetchCondition.Add(&entry);
+			locker.Unlock();
+
+			entry.Wait();
+			continue;
+		}
+
+		locker.Unlock();
+
+		read_prefetched_blocks(prefetch);
+		delete prefetch;
+	}
+
+	return B_OK;
+}
+
+
 /*!	Notify function for wait_for_notifications(). */
 static void
 notify_sync(int32 transactionID, int32 event, void* _cache)
@@ -2671,6 +2969,14 @@ block_cache_init(void)
 	if (sNotifierWriterThread >= B_OK)
 		resume_thread(sNotifierWriterThread);
 
+	new (&sPrefetchQueue) PrefetchList;
+	sPrefetchCondition.Init(&sPrefetchQueue, "block cache prefetch");
+
+	sPrefetcherThread = spawn_kernel_thread(&block_prefetcher,
+		"block prefetcher", B_NORMAL_PRIORITY, NULL);
+	if (sPrefetcherThread >= B_OK)
+		resume_thread(sPrefetcherThread);
+
 #if DEBUG_BLOCK_CACHE
 	add_debugger_command_etc("block_caches", &dump_caches,
 		"dumps all block caches", "\n", 0);
@@ -3324,11 +3630,13 @@ block_cache_delete(void* _cache, bool allowWrites)
 
 	// free all blocks
 
-	cached_block* block = cache->hash->Clear(true);
-	while (block != NULL) {
-		cached_block* next = block->next;
-		cache->FreeBlock(block);
-		block = next;
+	for (uint32 i = 0; i < kBlockHashShardCount; i++) {
+		cached_block* block = cache->hash_shards[i].table.Clear(true);
+		while (block != NULL) {
+			cached_block* next = block->next;
+			cache->FreeBlock(block);
+			block = next;
+		}
 	}
 
 	// free all transactions (they will all be aborted)
@@ -3375,7 +3683,7 @@ block_cache_sync(void* _cache)
 	MutexLocker locker(&cache->lock);
 
 	BlockWriter writer(cache);
-	BlockTable::Iterator iterator(cache->hash);
+	BlockIterator iterator(cache);
 
 	while (iterator.HasNext()) {
 		cached_block* block = iterator.Next();
@@ -3413,7 +3721,7 @@ block_cache_sync_etc(void* _cache, off_t blockNumber, size_t numBlocks)
 	BlockWriter writer(cache);
 
 	for (; numBlocks > 0; numBlocks--, blockNumber++) {
-		cached_block* block = cache->hash->Lookup(blockNumber);
+		cached_block* block = cache->LookupBlock(blockNumber);
 		if (block == NULL)
 			continue;
 
@@ -3447,7 +3755,7 @@ block_cache_discard(void* _cache, off_t blockNumber, size_t numBlocks)
 	BlockWriter writer(cache);
 
 	for (size_t i = 0; i < numBlocks; i++, blockNumber++) {
-		cached_block* block = cache->hash->Lookup(blockNumber);
+		cached_block* block = cache->LookupBlock(blockNumber);
 		if (block != NULL && block->previous_transaction != NULL)
 			writer.Add(block);
 	}
@@ -3459,16 +3767,14 @@ block_cache_discard(void* _cache, off_t blockNumber, size_t numBlocks)
 		// reset blockNumber to its original value
 
 	for (size_t i = 0; i < numBlocks; i++, blockNumber++) {
-		cached_block* block = cache->hash->Lookup(blockNumber);
+		cached_block* block = cache->LookupBlock(blockNumber);
 		if (block == NULL)
 			continue;
 
 		ASSERT(block->previous_transaction == NULL);
 
-		if (block->unused) {
-			cache->unused_blocks.Remove(block);
-			cache->unused_block_count--;
-			cache->RemoveBlock(block);
+		if (block->unused && cache->UnlinkUnusedBlock(block)) {
+			cache->FreeBlock(block);
 		} else {
 			if (block->transaction != NULL && block->parent_data != NULL
 				&& block->parent_data != block->current_data) {
@@ -3551,6 +3857,16 @@ const void*
 block_cache_get_etc(void* _cache, off_t blockNumber, off_t base, off_t length)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	// try to get along without locking the cache first
+	cached_block* fastBlock = get_cached_block_fast(cache, blockNumber);
+	if (fastBlock != NULL) {
+		TB(Get(cache, fastBlock));
+		return fastBlock->current_data;
+	}
+#endif
+
 	MutexLocker locker(&cache->lock);
 	bool allocated;
 
@@ -3577,6 +3893,93 @@ block_cache_get(void* _cache, off_t blockNumber)
 }
 
 
+/*!	Asynchronously reads in up to \a _numBlocks consecutive blocks starting
+	at \a blockNumber, so that a later block_cache_get() for them won't have
+	to wait for the disk, or at least not as long.
+	Prefetching stops at the first block that is already cached, or if the
+	system is low on memory. On return, \a _numBlocks is set to the number
+	of blocks that are actually being read in; this may be zero.
+	The blocks are not referenced by this call; if memory gets tight, they
+	may be removed from the cache again before they are used.
+*/
+status_t
+block_cache_prefetch(void* _cache, off_t blockNumber, size_t* _numBlocks)
+{
+	block_cache* cache = (block_cache*)_cache;
+	size_t numBlocks = *_numBlocks;
+	*_numBlocks = 0;
+
+	if (blockNumber < 0 || blockNumber >= cache->max_blocks)
+		return B_BAD_VALUE;
+
+	if (sPrefetcherThread < B_OK)
+		return B_NOT_SUPPORTED;
+
+	numBlocks = min_c(numBlocks, kMaxPrefetchBlocks);
+	if ((off_t)numBlocks > cache->max_blocks - blockNumber)
+		numBlocks = cache->max_blocks - blockNumber;
+
+	if (numBlocks == 0 || low_resource_state(B_KERNEL_RESOURCE_PAGES
+			| B_KERNEL_RESOURCE_MEMORY | B_KERNEL_RESOURCE_ADDRESS_SPACE)
+				!= B_NO_LOW_RESOURCE) {
+		return B_OK;
+	}
+
+	{
+		// Callers tend to prefetch the same blocks over and over again, so
+		// avoid locking the cache if the first one is already there
+		BlockHashShard& shard = cache->ShardFor(blockNumber);
+		ReadLocker shardLocker(shard.lock);
+		if (shard.table.Lookup(blockNumber) != NULL)
+			return B_OK;
+	}
+
+	block_prefetch* prefetch = new(std::nothrow) block_prefetch;
+	if (prefetch == NULL)
+		return B_NO_MEMORY;
+
+	prefetch->cache = cache;
+	prefetch->block_number = blockNumber;
+	prefetch->num_blocks = 0;
+
+	MutexLocker locker(&cache->lock);
+
+	for (size_t i = 0; i < numBlocks; i++) {
+		if (cache->LookupBlock(blockNumber + i) != NULL)
+			break;
+
+		cached_block* block = cache->NewBlock(blockNumber + i);
+		if (block == NULL)
+			break;
+
+		if (cache->LookupBlock(blockNumber + i) != NULL) {
+			// NewBlock() may have unlocked the cache to write back a block
+			cache->FreeBlock(block);
+			break;
+		}
+
+		cache->InsertBlock(block);
+		mark_block_busy_reading(cache, block);
+		prefetch->blocks[prefetch->num_blocks++] = block;
+	}
+
+	locker.Unlock();
+
+	if (prefetch->num_blocks == 0) {
+		delete prefetch;
+		return B_OK;
+	}
+
+	*_numBlocks = prefetch->num_blocks;
+
+	MutexLocker prefetchLocker(sPrefetchLock);
+	sPrefetchQueue.Add(prefetch);
+	sPrefetchCondition.NotifyOne();
+
+	return B_OK;
+}
+
+
 /*!	Changes the internal status of a writable block to \a dirty. This can be
 	helpful in case you realize you don't need to change that block anymore
 	for whatever reason.
@@ -3591,7 +3994,7 @@ block_cache_set_dirty(void* _cache, off_t blockNumber, bool dirty,
 	block_cache* cache = (block_cache*)_cache;
 	MutexLocker locker(&cache->lock);
 
-	cached_block* block = cache->hash->Lookup(blockNumber);
+	cached_block* block = cache->LookupBlock(blockNumber);
 	if (block == NULL)
 		return B_BAD_VALUE;
 	if (block->is_dirty == dirty) {
@@ -3611,6 +4014,12 @@ void
 block_cache_put(void* _cache, off_t blockNumber)
 {
 	block_cache* cache = (block_cache*)_cache;
+
+#if !BLOCK_CACHE_DEBUG_CHANGED
+	if (put_cached_block_fast(cache, blockNumber))
+		return;
+#endif
+
 	MutexLocker locker(&cache->lock);
 
 	put_cached_block(cache, blockNumber);
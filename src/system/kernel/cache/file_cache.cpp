@@ -40,6 +40,7 @@
 #define MAX_FILE_IO_VECS	32
 
 #define BYPASS_IO_SIZE		65536
+#define MAX_DIRECT_IO_RETRIES	4
 #define LAST_ACCESSES		3
 
 struct file_cache_ref {
@@ -886,6 +887,183 @@ cache_io(void* _cacheRef, void* cookie, off_t offset, addr_t buffer,
 }
 
 
+/*!	Makes the cache coherent with a direct transfer of the given range: all
+	modified pages in it are written back, and if \a doWrite is \c true, all
+	of its pages are removed from the cache, too.
+	Returns \c B_BUSY if pages of the range are mapped, or keep being
+	modified while they are written back, in which case the transfer must go
+	through the cache.
+	The cache must be locked; the lock is released temporarily while pages
+	are being written back.
+*/
+static status_t
+prepare_direct_io(file_cache_ref* ref, off_t offset, size_t size,
+	bool doWrite)
+{
+	VMCache* cache = ref->cache;
+	uint32 firstPage = offset >> PAGE_SHIFT;
+	uint32 endPage = (offset + size + B_PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	for (int32 tries = 0;; tries++) {
+		if (tries >= MAX_DIRECT_IO_RETRIES)
+			return B_BUSY;
+
+		status_t status = vm_page_write_modified_page_range(cache, firstPage,
+			endPage);
+		if (status != B_OK)
+			return status;
+
+		bool restart = false;
+		for (VMCachePagesTree::Iterator it
+					= cache->pages.GetIterator(firstPage, true, true);
+				vm_page* page = it.Next();) {
+			if (page->cache_offset >= endPage)
+				break;
+
+			if (page->busy) {
+				// wait for page to become unbusy, and start over; this does
+				// not count as a retry, as we've been blocked meanwhile
+				cache->WaitForPageEvents(page, PAGE_EVENT_NOT_BUSY, true);
+				restart = true;
+				tries--;
+				break;
+			}
+
+			if (page->State() == PAGE_STATE_MODIFIED) {
+				// it has been written to again in the mean time
+				restart = true;
+				continue;
+			}
+
+			if (!doWrite)
+				continue;
+
+			// We can't remove mapped pages.
+			if (page->IsMapped())
+				return B_BUSY;
+
+			DEBUG_PAGE_ACCESS_START(page);
+			cache->RemovePage(page);
+			vm_page_free(cache, page);
+		}
+
+		if (!restart)
+			return B_OK;
+	}
+}
+
+
+/*!	Copies the data that has just been written directly to the file from
+	\a buffer into all pages of that range that are still in the cache, as
+	prepare_direct_io() could not remove them.
+	The cache must be locked; the lock is released temporarily while the
+	data is being copied.
+*/
+static void
+update_cached_pages(file_cache_ref* ref, off_t offset, addr_t buffer,
+	size_t size)
+{
+	VMCache* cache = ref->cache;
+	off_t end = offset + size;
+
+	for (off_t pageOffset = offset; pageOffset < end;) {
+		vm_page* page = cache->LookupPage(pageOffset);
+		if (page == NULL) {
+			pageOffset += B_PAGE_SIZE;
+			continue;
+		}
+
+		if (page->busy) {
+			// wait for page to become unbusy, and look it up again
+			cache->WaitForPageEvents(page, PAGE_EVENT_NOT_BUSY, true);
+			continue;
+		}
+
+		size_t bytes = min_c(end - pageOffset, (off_t)B_PAGE_SIZE);
+
+		page->busy = true;
+		cache->Unlock();
+
+		vm_memcpy_to_physical(page->physical_page_number * B_PAGE_SIZE,
+			(void*)(buffer + (pageOffset - offset)), bytes,
+			IS_USER_ADDRESS(buffer));
+
+		cache->Lock();
+		cache->MarkPageUnbusy(page);
+
+		pageOffset += B_PAGE_SIZE;
+	}
+}
+
+
+/*!	Transfers the data directly between the file and \a buffer, bypassing
+	the cache, if the request is suitably aligned, and the range is not
+	mapped. Returns \c false if it could not do that, in which case the
+	caller has to go through the cache instead.
+*/
+static bool
+direct_io(file_cache_ref* ref, void* cookie, off_t offset, addr_t buffer,
+	size_t* _size, bool doWrite, status_t* _status)
+{
+	VMCache* cache = ref->cache;
+	AutoLocker<VMCache> locker(cache);
+
+	off_t fileSize = cache->virtual_end;
+	if (offset >= fileSize || offset < 0) {
+		*_size = 0;
+		*_status = B_OK;
+		return true;
+	}
+
+	size_t size = *_size;
+	if ((off_t)(offset + size) > fileSize)
+		size = fileSize - offset;
+
+	// Only whole pages may be transferred, except for the last one of the
+	// file, or else we would tear pages that are still in the cache.
+	if ((offset & (B_PAGE_SIZE - 1)) != 0 || (buffer & (B_PAGE_SIZE - 1)) != 0
+		|| ((size & (B_PAGE_SIZE - 1)) != 0
+			&& (off_t)(offset + size) != fileSize)
+		|| size == 0) {
+		return false;
+	}
+
+	status_t status = prepare_direct_io(ref, offset, size, doWrite);
+	if (status == B_BUSY)
+		return false;
+	if (status != B_OK) {
+		*_status = status;
+		return true;
+	}
+
+	locker.Unlock();
+
+	generic_io_vec vec;
+	vec.base = buffer;
+	generic_size_t bytes = vec.length = size;
+
+	if (doWrite) {
+		status = vfs_write_pages(ref->vnode, cookie, offset, &vec, 1, 0,
+			&bytes);
+
+		// Someone might have read the range into the cache while the write
+		// was in progress; make sure those pages don't survive it, or at
+		// least contain what has just been written.
+		locker.Lock();
+		if (prepare_direct_io(ref, offset, bytes, true) == B_BUSY)
+			update_cached_pages(ref, offset, buffer, bytes);
+		locker.Unlock();
+	} else {
+		status = vfs_read_pages(ref->vnode, cookie, offset, &vec, 1, 0,
+			&bytes);
+	}
+
+	*_size = bytes;
+	*_status = status;
+	return true;
+}
+
+
 static status_t
 file_cache_control(const char* subsystem, uint32 function, void* buffer,
 	size_t bufferSize)
@@ -949,6 +1127,12 @@ cache_prefetch_vnode(struct vnode* vnode, off_t offset, size_t size)
 	if (vfs_get_vnode_cache(vnode, &cache, false) != B_OK)
 		return;
 
+	if (cache->type != CACHE_TYPE_VNODE) {
+		// the file system maintains the cache itself
+		cache->ReleaseRef();
+		return;
+	}
+
 	file_cache_ref* ref = ((VMVnodeCache*)cache)->FileCacheRef();
 	off_t fileSize = cache->virtual_end;
 
@@ -1045,7 +1229,7 @@ cache_node_opened(struct vnode* vnode, int32 fdType, VMCache* cache,
 		return;
 
 	off_t size = -1;
-	if (cache != NULL) {
+	if (cache != NULL && cache->type == CACHE_TYPE_VNODE) {
 		file_cache_ref* ref = ((VMVnodeCache*)cache)->FileCacheRef();
 		if (ref != NULL)
 			size = cache->virtual_end;
@@ -1351,3 +1535,51 @@ file_cache_write(void* _cacheRef, void* cookie, off_t offset,
 
 	return status;
 }
+
+
+/*!	Like file_cache_read(), but reads the data directly from the file into
+	\a buffer, without adding it to the cache, if \a offset and \a buffer
+	are page aligned, and the request consists of whole pages (only the last
+	page of the file may be partial). Any modified cached data in the range
+	is written back first.
+	Requests that don't meet these requirements are served by the cache.
+*/
+extern "C" status_t
+file_cache_read_direct(void* _cacheRef, void* cookie, off_t offset,
+	void* buffer, size_t* _size)
+{
+	file_cache_ref* ref = (file_cache_ref*)_cacheRef;
+
+	TRACE(("file_cache_read_direct(ref = %p, offset = %Ld, buffer = %p, "
+		"size = %lu)\n", ref, offset, buffer, *_size));
+
+	status_t status;
+	if (direct_io(ref, cookie, offset, (addr_t)buffer, _size, false, &status))
+		return status;
+
+	return file_cache_read(_cacheRef, cookie, offset, buffer, _size);
+}
+
+
+/*!	Like file_cache_write(), but writes the data directly from \a buffer to
+	the file under the same conditions as file_cache_read_direct(). The
+	cached pages of the range are dropped, so that later reads through the
+	cache will see the new data.
+*/
+extern "C" status_t
+file_cache_write_direct(void* _cacheRef, void* cookie, off_t offset,
+	const void* buffer, size_t* _size)
+{
+	file_cache_ref* ref = (file_cache_ref*)_cacheRef;
+
+	TRACE(("file_cache_write_direct(ref = %p, offset = %Ld, buffer = %p, "
+		"size = %lu)\n", ref, offset, buffer, *_size));
+
+	status_t status;
+	if (buffer != NULL && direct_io(ref, cookie, offset,
+			(addr_t)const_cast<void*>(buffer), _size, true, &status)) {
+		return status;
+	}
+
+	return file_cache_write(_cacheRef, cookie, offset, buffer, _size);
+}
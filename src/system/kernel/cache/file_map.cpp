@@ -11,6 +11,7 @@
 #ifdef FS_SHELL
 #	include "vfs.h"
 #	include "fssh_api_wrapper.h"
+#	include "SplayTree.h"
 
 using namespace FSShell;
 #else
@@ -22,8 +23,10 @@ using namespace FSShell;
 #	include <condition_variable.h>
 #	include <file_cache.h>
 #	include <generic_syscall.h>
+#	include <low_resource_manager.h>
 #	include <util/AutoLock.h>
 #	include <util/DoublyLinkedList.h>
+#	include <util/SplayTree.h>
 #	include <vfs.h>
 #	include <vm/vm.h>
 #	include <vm/vm_page.h>
@@ -40,28 +43,70 @@ using namespace FSShell;
 #	define TRACE(x...) ;
 #endif
 
-// TODO: use a sparse array - eventually, the unused BlockMap would be something
-//	to reuse for this. We could also have an upperbound of memory consumption
-//	for the whole map.
-// TODO: it would be nice if we could free a file map in low memory situations.
+// TODO: We could also have an upper bound of memory consumption for the
+//	whole map.
 
 
-#define CACHED_FILE_EXTENTS	2
-	// must be smaller than MAX_FILE_IO_VECS
-	// TODO: find out how much of these are typically used
+#define MAX_CHUNK_EXTENTS	64
+	// extents per chunk; larger chunks need fewer tree nodes, smaller ones
+	// allow for finer grained eviction
 
 struct file_extent {
 	off_t			offset;
 	file_io_vec		disk;
 };
 
-struct file_extent_array {
-	file_extent*	array;
-	size_t			max_count;
+/*!	A chunk of consecutive file extents that covers the file range from
+	\c offset to \c end without any holes. The map is filled lazily, so there
+	might be gaps between chunks; they are retrieved from the file system when
+	needed. Chunks are also the unit in which the map is freed when memory
+	gets low.
+*/
+struct file_extent_chunk {
+	SplayTreeLink<file_extent_chunk> tree_link;
+	file_extent_chunk* tree_next;
+	off_t			offset;
+	off_t			end;
+	int32			last_used;
+	uint16			count;
+	uint16			max_count;
+	file_extent		extents[0];
+
+	file_extent* Last() { return &extents[count - 1]; }
 };
 
+struct FileExtentChunkTreeDefinition {
+	typedef off_t				KeyType;
+	typedef file_extent_chunk	NodeType;
+
+	static const off_t& GetKey(const file_extent_chunk* node)
+	{
+		return node->offset;
+	}
+
+	static SplayTreeLink<file_extent_chunk>* GetLink(file_extent_chunk* node)
+	{
+		return &node->tree_link;
+	}
+
+	static int Compare(const off_t& key, const file_extent_chunk* node)
+	{
+		if (key < node->offset)
+			return -1;
+		return key == node->offset ? 0 : 1;
+	}
+
+	static file_extent_chunk** GetListLink(file_extent_chunk* node)
+	{
+		return &node->tree_next;
+	}
+};
+
+typedef IteratableSplayTree<FileExtentChunkTreeDefinition> FileExtentChunkTree;
+
+
 class FileMap
-#if DEBUG_FILE_MAP
+#ifndef FS_SHELL
 	: public DoublyLinkedListLinkImpl<FileMap>
 #endif
 {
@@ -79,32 +124,41 @@ public:
 			file_extent*	ExtentAt(uint32 index);
 
 			size_t			Count() const { return fCount; }
+			size_t			ChunkCount() const { return fChunkCount; }
+			off_t			CachedSize() const { return fCachedSize; }
 			struct vnode*	Vnode() const { return fVnode; }
 			off_t			Size() const { return fSize; }
 
 			status_t		SetMode(uint32 mode);
 
+			void			Evict(int32 minSecondsOld);
+
 private:
-			file_extent*	_FindExtent(off_t offset, uint32* _index);
-			status_t		_MakeSpace(size_t count);
-			status_t		_Add(file_io_vec* vecs, size_t vecCount,
-								off_t& lastOffset);
+			file_extent_chunk* _FindChunk(off_t offset);
+			file_extent*	_FindExtent(file_extent_chunk* chunk, off_t offset,
+								uint32* _index);
+			file_extent_chunk* _AllocateChunk(off_t offset);
+			file_extent_chunk* _GrowChunk(file_extent_chunk* chunk);
+			void			_FreeChunk(file_extent_chunk* chunk);
+			void			_TruncateChunk(file_extent_chunk* chunk,
+								off_t offset);
+			status_t		_Add(off_t offset, file_io_vec* vecs,
+								size_t vecCount, off_t limit, off_t& end);
 			status_t		_Cache(off_t offset, off_t size);
-			void			_InvalidateAfter(off_t offset);
+			void			_Invalidate(off_t offset, off_t end);
 			void			_Free();
 
-	union {
-		file_extent	fDirect[CACHED_FILE_EXTENTS];
-		file_extent_array fIndirect;
-	};
+	FileExtentChunkTree	fChunks;
 	mutex			fLock;
 	size_t			fCount;
+	size_t			fChunkCount;
+	off_t			fCachedSize;
 	struct vnode*	fVnode;
 	off_t			fSize;
 	bool			fCacheAll;
 };
 
-#if DEBUG_FILE_MAP
+#ifndef FS_SHELL
 typedef DoublyLinkedList<FileMap> FileMapList;
 
 static FileMapList sList;
@@ -112,16 +166,25 @@ static mutex sLock;
 #endif
 
 
+static inline int32
+current_seconds()
+{
+	return system_time() / 1000000L;
+}
+
+
 FileMap::FileMap(struct vnode* vnode, off_t size)
 	:
 	fCount(0),
+	fChunkCount(0),
+	fCachedSize(0),
 	fVnode(vnode),
 	fSize(size),
 	fCacheAll(false)
 {
 	mutex_init(&fLock, "file map");
 
-#if DEBUG_FILE_MAP
+#ifndef FS_SHELL
 	MutexLocker _(sLock);
 	sList.Add(this);
 #endif
@@ -130,38 +193,60 @@ FileMap::FileMap(struct vnode* vnode, off_t size)
 
 FileMap::~FileMap()
 {
+#ifndef FS_SHELL
+	{
+		// Remove us from the list first, so that the low resource handler
+		// cannot get to us anymore
+		MutexLocker _(sLock);
+		sList.Remove(this);
+	}
+#endif
+
 	_Free();
 	mutex_destroy(&fLock);
-
-#if DEBUG_FILE_MAP
-	MutexLocker _(sLock);
-	sList.Remove(this);
-#endif
 }
 
 
+/*!	Returns the extent with the given \a index counted from the start of the
+	cached part of the map. This walks all chunks, and is only meant for
+	debugging purposes.
+*/
 file_extent*
 FileMap::ExtentAt(uint32 index)
 {
-	if (index >= fCount)
-		return NULL;
+	FileExtentChunkTree::Iterator iterator = fChunks.GetIterator();
+	while (file_extent_chunk* chunk = iterator.Next()) {
+		if (index < chunk->count)
+			return &chunk->extents[index];
+
+		index -= chunk->count;
+	}
+
+	return NULL;
+}
 
-	if (fCount > CACHED_FILE_EXTENTS)
-		return &fIndirect.array[index];
 
-	return &fDirect[index];
+/*!	Returns the chunk that contains \a offset, if any. */
+file_extent_chunk*
+FileMap::_FindChunk(off_t offset)
+{
+	file_extent_chunk* chunk = fChunks.FindClosest(offset, false, true);
+	if (chunk == NULL || offset >= chunk->end)
+		return NULL;
+
+	return chunk;
 }
 
 
 file_extent*
-FileMap::_FindExtent(off_t offset, uint32 *_index)
+FileMap::_FindExtent(file_extent_chunk* chunk, off_t offset, uint32* _index)
 {
 	int32 left = 0;
-	int32 right = fCount - 1;
+	int32 right = chunk->count - 1;
 
 	while (left <= right) {
 		int32 index = (left + right) / 2;
-		file_extent* extent = ExtentAt(index);
+		file_extent* extent = &chunk->extents[index];
 
 		if (extent->offset > offset) {
 			// search in left part
@@ -182,127 +267,185 @@ FileMap::_FindExtent(off_t offset, uint32 *_index)
 }
 
 
-status_t
-FileMap::_MakeSpace(size_t count)
+/*!	Creates a new empty chunk starting at \a offset, and adds it to the tree.
+*/
+file_extent_chunk*
+FileMap::_AllocateChunk(off_t offset)
 {
-	if (count <= CACHED_FILE_EXTENTS) {
-		// just use the reserved area in the file_cache_ref structure
-		if (fCount > CACHED_FILE_EXTENTS) {
-			// the new size is smaller than the minimal array size
-			file_extent *array = fIndirect.array;
-			memcpy(fDirect, array, sizeof(file_extent) * count);
-			free(array);
-		}
-	} else {
-		// resize array if needed
-		file_extent* oldArray = NULL;
-		size_t maxCount = CACHED_FILE_EXTENTS;
-		if (fCount > CACHED_FILE_EXTENTS) {
-			oldArray = fIndirect.array;
-			maxCount = fIndirect.max_count;
-		}
+	// Start small, most files only have a single extent
+	const uint16 maxCount = 2;
 
-		if (count > maxCount) {
-			// allocate new array
-			while (maxCount < count) {
-				if (maxCount < 32768)
-					maxCount <<= 1;
-				else
-					maxCount += 32768;
-			}
+	file_extent_chunk* chunk = (file_extent_chunk*)malloc(
+		sizeof(file_extent_chunk) + maxCount * sizeof(file_extent));
+	if (chunk == NULL)
+		return NULL;
 
-			file_extent* newArray = (file_extent *)realloc(oldArray,
-				maxCount * sizeof(file_extent));
-			if (newArray == NULL)
-				return B_NO_MEMORY;
+	chunk->offset = offset;
+	chunk->end = offset;
+	chunk->last_used = current_seconds();
+	chunk->count = 0;
+	chunk->max_count = maxCount;
 
-			if (fCount > 0 && fCount <= CACHED_FILE_EXTENTS)
-				memcpy(newArray, fDirect, sizeof(file_extent) * fCount);
+	fChunks.Insert(chunk);
+	fChunkCount++;
+	return chunk;
+}
 
-			fIndirect.array = newArray;
-			fIndirect.max_count = maxCount;
-		}
+
+/*!	Makes room for more extents in the full \a chunk. Returns the resized
+	chunk, or \c NULL if the chunk cannot grow any further, or there is not
+	enough memory; the chunk stays valid in this case.
+*/
+file_extent_chunk*
+FileMap::_GrowChunk(file_extent_chunk* chunk)
+{
+	if (chunk->max_count >= MAX_CHUNK_EXTENTS)
+		return NULL;
+
+	uint16 maxCount = min_c(chunk->max_count * 2, MAX_CHUNK_EXTENTS);
+
+	// the chunk might move, so we have to take it out of the tree first
+	fChunks.Remove(chunk);
+
+	file_extent_chunk* newChunk = (file_extent_chunk*)realloc(chunk,
+		sizeof(file_extent_chunk) + maxCount * sizeof(file_extent));
+	if (newChunk == NULL) {
+		fChunks.Insert(chunk);
+		return NULL;
 	}
 
-	fCount = count;
-	return B_OK;
+	newChunk->max_count = maxCount;
+	fChunks.Insert(newChunk);
+	return newChunk;
 }
 
 
-status_t
-FileMap::_Add(file_io_vec* vecs, size_t vecCount, off_t& lastOffset)
+void
+FileMap::_FreeChunk(file_extent_chunk* chunk)
 {
-	TRACE("FileMap@%p::Add(vecCount = %ld)\n", this, vecCount);
+	fChunks.Remove(chunk);
 
-	uint32 start = fCount;
-	off_t offset = 0;
+	fCount -= chunk->count;
+	fCachedSize -= chunk->end - chunk->offset;
+	fChunkCount--;
 
-	status_t status = _MakeSpace(fCount + vecCount);
-	if (status != B_OK)
-		return status;
+	free(chunk);
+}
 
-	file_extent* lastExtent = NULL;
-	if (start != 0) {
-		lastExtent = ExtentAt(start - 1);
-		offset = lastExtent->offset + lastExtent->disk.length;
-	}
 
-	for (uint32 i = 0; i < vecCount; i++) {
-		if (lastExtent != NULL) {
-			if (lastExtent->disk.offset + lastExtent->disk.length
-					== vecs[i].offset
-				|| (lastExtent->disk.offset == -1 && vecs[i].offset == -1)) {
+/*!	Removes everything from \a offset on from the \a chunk. \a offset must be
+	within the chunk, but not its start.
+*/
+void
+FileMap::_TruncateChunk(file_extent_chunk* chunk, off_t offset)
+{
+	uint32 index;
+	file_extent* extent = _FindExtent(chunk, offset, &index);
+	if (extent == NULL)
+		return;
+
+	uint32 count = index + 1;
+	if (extent->offset == offset)
+		count = index;
+	else
+		extent->disk.length = offset - extent->offset;
+
+	fCount -= chunk->count - count;
+	fCachedSize -= chunk->end - offset;
+
+	chunk->count = count;
+	chunk->end = offset;
+}
+
+
+/*!	Adds the \a vecs that map the file from \a offset on. Nothing beyond
+	\a limit is added, unless \a limit is negative. \a end is set to the file
+	offset after the last added extent.
+*/
+status_t
+FileMap::_Add(off_t offset, file_io_vec* vecs, size_t vecCount, off_t limit,
+	off_t& end)
+{
+	TRACE("FileMap@%p::Add(offset = %lld, vecCount = %ld)\n", this, offset,
+		vecCount);
 
-				lastExtent->disk.length += vecs[i].length;
-				offset += vecs[i].length;
+	// continue the chunk that ends where we start, if any
+	file_extent_chunk* chunk = fChunks.FindClosest(offset, false, false);
+	if (chunk != NULL && chunk->end != offset)
+		chunk = NULL;
 
-				_MakeSpace(fCount - 1);
-				if (fCount == CACHED_FILE_EXTENTS) {
-					// We moved the indirect array into the direct one, making
-					// lastExtent a stale pointer, re-get it.
-					lastExtent = ExtentAt(start - 1);
-				}
+	for (uint32 i = 0; i < vecCount; i++) {
+		if (limit >= 0 && offset >= limit)
+			break;
+
+		file_io_vec vec = vecs[i];
+		if (limit >= 0 && vec.length > limit - offset)
+			vec.length = limit - offset;
+		if (vec.length <= 0)
+			continue;
 
+		if (chunk != NULL) {
+			file_extent* lastExtent = chunk->Last();
+			if (lastExtent->disk.offset + lastExtent->disk.length == vec.offset
+				|| (lastExtent->disk.offset == -1 && vec.offset == -1)) {
+				// just extend the last extent
+				lastExtent->disk.length += vec.length;
+				chunk->end += vec.length;
+				fCachedSize += vec.length;
+				offset += vec.length;
 				continue;
 			}
+
+			if (chunk->count == chunk->max_count) {
+				file_extent_chunk* grownChunk = _GrowChunk(chunk);
+				if (grownChunk == NULL && chunk->max_count < MAX_CHUNK_EXTENTS)
+					return B_NO_MEMORY;
+
+				chunk = grownChunk;
+			}
 		}
 
-		file_extent* extent = ExtentAt(start++);
+		if (chunk == NULL) {
+			chunk = _AllocateChunk(offset);
+			if (chunk == NULL)
+				return B_NO_MEMORY;
+		}
+
+		file_extent* extent = &chunk->extents[chunk->count++];
 		extent->offset = offset;
-		extent->disk = vecs[i];
+		extent->disk = vec;
 
-		offset += extent->disk.length;
-		lastExtent = extent;
+		chunk->end += vec.length;
+		fCachedSize += vec.length;
+		fCount++;
+		offset += vec.length;
 	}
 
-#ifdef TRACE_FILE_MAP
-	for (uint32 i = 0; i < fCount; i++) {
-		file_extent* extent = ExtentAt(i);
-		TRACE("[%ld] extent offset %Ld, disk offset %Ld, length %Ld\n",
-			i, extent->offset, extent->disk.offset, extent->disk.length);
-	}
-#endif
-
-	lastOffset = offset;
+	end = offset;
 	return B_OK;
 }
 
 
+/*!	Removes all extents in the range from \a offset to \a end from the map.
+	If \a end is negative, everything after \a offset is removed.
+	Chunks that are only partially in the range are removed completely if the
+	range covers their start; that doesn't hurt, as they will be retrieved
+	again when needed.
+*/
 void
-FileMap::_InvalidateAfter(off_t offset)
+FileMap::_Invalidate(off_t offset, off_t end)
 {
-	uint32 index;
-	file_extent* extent = _FindExtent(offset, &index);
-	if (extent != NULL) {
-		uint32 resizeTo = index + 1;
-
-		if (extent->offset + extent->disk.length > offset) {
-			extent->disk.length = offset - extent->offset;
-			if (extent->disk.length == 0)
-				resizeTo = index;
-		}
+	file_extent_chunk* chunk = fChunks.FindClosest(offset, false, true);
+	if (chunk != NULL && chunk->offset < offset && chunk->end > offset) {
+		_TruncateChunk(chunk, offset);
+		chunk = chunk->tree_next;
+	} else
+		chunk = fChunks.FindClosest(offset, true, true);
 
-		_MakeSpace(resizeTo);
+	while (chunk != NULL && (end < 0 || chunk->offset < end)) {
+		file_extent_chunk* next = chunk->tree_next;
+		_FreeChunk(chunk);
+		chunk = next;
 	}
 }
 
@@ -314,13 +457,16 @@ FileMap::Invalidate(off_t offset, off_t size)
 {
 	MutexLocker _(fLock);
 
-	// TODO: honour size, we currently always remove everything after "offset"
-	if (offset == 0) {
+	if (offset == 0 && size >= fSize) {
 		_Free();
 		return;
 	}
 
-	_InvalidateAfter(offset);
+	off_t end = offset + size;
+	if (size < 0 || end < offset)
+		end = -1;
+
+	_Invalidate(offset, end);
 }
 
 
@@ -330,7 +476,7 @@ FileMap::SetSize(off_t size)
 	MutexLocker _(fLock);
 
 	if (size < fSize)
-		_InvalidateAfter(size);
+		_Invalidate(size, -1);
 
 	fSize = size;
 }
@@ -339,42 +485,83 @@ FileMap::SetSize(off_t size)
 void
 FileMap::_Free()
 {
-	if (fCount > CACHED_FILE_EXTENTS)
-		free(fIndirect.array);
+	while (file_extent_chunk* chunk = fChunks.FindMin())
+		_FreeChunk(chunk);
+}
+
+
+/*!	Frees all chunks that haven't been used for \a minSecondsOld seconds.
+	Maps in FILE_MAP_CACHE_ALL mode are left alone, as they are not allowed
+	to retrieve extents on demand.
+	Since this is called by the low resource handler, it will not wait for
+	the map to become available.
+*/
+void
+FileMap::Evict(int32 minSecondsOld)
+{
+	if (mutex_trylock(&fLock) != B_OK)
+		return;
+
+	if (!fCacheAll) {
+		int32 now = current_seconds();
+
+		FileExtentChunkTree::Iterator iterator = fChunks.GetIterator();
+		while (file_extent_chunk* chunk = iterator.Next()) {
+			if (now - chunk->last_used >= minSecondsOld)
+				_FreeChunk(chunk);
+		}
+	}
 
-	fCount = 0;
+	mutex_unlock(&fLock);
 }
 
 
+/*!	Makes sure the extents for the range from \a offset to \a offset + \a size
+	are in the map, retrieving only those parts that are missing.
+*/
 status_t
 FileMap::_Cache(off_t offset, off_t size)
 {
-	file_extent* lastExtent = NULL;
-	if (fCount > 0)
-		lastExtent = ExtentAt(fCount - 1);
-
-	off_t mapEnd = 0;
-	if (lastExtent != NULL)
-		mapEnd = lastExtent->offset + lastExtent->disk.length;
-
 	off_t end = offset + size;
 
-	if (fCacheAll && mapEnd < end)
-		return B_ERROR;
-
-	status_t status = B_OK;
 	file_io_vec vecs[8];
 	const size_t kMaxVecs = 8;
 
-	while (status == B_OK && mapEnd < end) {
-		// We don't have the requested extents yet, retrieve them
+	while (offset < end) {
+		file_extent_chunk* chunk = _FindChunk(offset);
+		if (chunk != NULL) {
+			offset = chunk->end;
+			continue;
+		}
+
+		if (fCacheAll)
+			return B_ERROR;
+
+		// We don't have the requested extents yet, retrieve them up to the
+		// next chunk we already have
+		file_extent_chunk* next = fChunks.FindClosest(offset, true, false);
+		size_t length = ~(size_t)0;
+		if (next != NULL && (uint64)(next->offset - offset) < length)
+			length = next->offset - offset;
+
 		size_t vecCount = kMaxVecs;
-		status = vfs_get_file_map(Vnode(), mapEnd, ~0UL, vecs, &vecCount);
-		if (status == B_OK || status == B_BUFFER_OVERFLOW)
-			status = _Add(vecs, vecCount, mapEnd);
+		status_t status = vfs_get_file_map(Vnode(), offset, length, vecs,
+			&vecCount);
+		if (status != B_OK && status != B_BUFFER_OVERFLOW)
+			return status;
+		if (vecCount == 0)
+			return B_ERROR;
+
+		off_t previousOffset = offset;
+		status = _Add(offset, vecs, vecCount,
+			next != NULL ? next->offset : -1, offset);
+		if (status != B_OK)
+			return status;
+		if (offset == previousOffset)
+			return B_ERROR;
 	}
 
-	return status;
+	return B_OK;
 }
 
 
@@ -438,8 +625,12 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	// We now have cached the map of this file as far as we need it, now
 	// we need to translate it for the requested access.
 
+	int32 now = current_seconds();
+
+	file_extent_chunk* chunk = _FindChunk(offset);
 	uint32 index;
-	file_extent* fileExtent = _FindExtent(offset, &index);
+	file_extent* fileExtent = _FindExtent(chunk, offset, &index);
+	chunk->last_used = now;
 
 	offset -= fileExtent->offset;
 	if (fileExtent->disk.offset != -1)
@@ -460,7 +651,21 @@ FileMap::Translate(off_t offset, size_t size, file_io_vec* vecs, size_t* _count,
 	uint32 vecIndex = 1;
 
 	while (true) {
-		fileExtent++;
+		if (++index >= chunk->count) {
+			// continue with the next chunk, which _Cache() made sure follows
+			// this one without a gap
+			off_t chunkEnd = chunk->end;
+			chunk = chunk->tree_next;
+			if (chunk == NULL || chunk->offset != chunkEnd) {
+				panic("FileMap %p: no extent for offset %" B_PRIdOFF "!\n",
+					this, chunkEnd);
+				return B_ERROR;
+			}
+
+			chunk->last_used = now;
+			index = 0;
+		}
+		fileExtent = &chunk->extents[index];
 
 		vecs[vecIndex++] = fileExtent->disk;
 
@@ -507,7 +712,9 @@ dump_file_map(int argc, char** argv)
 
 	kprintf("FileMap %p\n", map);
 	kprintf("  size    %" B_PRIdOFF "\n", map->Size());
+	kprintf("  cached  %" B_PRIdOFF "\n", map->CachedSize());
 	kprintf("  count   %lu\n", map->Count());
+	kprintf("  chunks  %lu\n", map->ChunkCount());
 
 	if (!printExtents)
 		return 0;
@@ -551,10 +758,7 @@ dump_file_map_stats(int argc, char** argv)
 			continue;
 
 		if (map->Count() != 0) {
-			file_extent* extent = map->ExtentAt(map->Count() - 1);
-			if (extent != NULL)
-				mapSize += extent->offset + extent->disk.length;
-
+			mapSize += map->CachedSize();
 			extents += map->Count();
 		} else
 			emptyCount++;
@@ -578,9 +782,45 @@ dump_file_map_stats(int argc, char** argv)
 //	#pragma mark - private kernel API
 
 
+#ifndef FS_SHELL
+static void
+file_map_low_resource_handler(void* /*data*/, uint32 resources, int32 level)
+{
+	int32 minSecondsOld;
+	switch (level) {
+		case B_LOW_RESOURCE_NOTE:
+			minSecondsOld = 60;
+			break;
+		case B_LOW_RESOURCE_WARNING:
+			minSecondsOld = 10;
+			break;
+		case B_LOW_RESOURCE_CRITICAL:
+			minSecondsOld = 0;
+			break;
+		default:
+			return;
+	}
+
+	MutexLocker _(sLock);
+
+	FileMapList::Iterator iterator = sList.GetIterator();
+	while (FileMap* map = iterator.Next())
+		map->Evict(minSecondsOld);
+}
+#endif	// !FS_SHELL
+
+
 extern "C" status_t
 file_map_init(void)
 {
+#ifndef FS_SHELL
+	mutex_init(&sLock, "file map list");
+	new(&sList) FileMapList;
+
+	register_low_resource_handler(&file_map_low_resource_handler, NULL,
+		B_KERNEL_RESOURCE_MEMORY, 0);
+#endif
+
 #if DEBUG_FILE_MAP
 	add_debugger_command_etc("file_map", &dump_file_map,
 		"Dumps the specified file map.",
@@ -589,8 +829,6 @@ file_map_init(void)
 		"  <file-map>  - pointer to the file map.\n", 0);
 	add_debugger_command("file_map_stats", &dump_file_map_stats,
 		"Dumps some file map statistics.");
-
-	mutex_init(&sLock, "file map list");
 #endif
 	return B_OK;
 }
@@ -0,0 +1,785 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	I/O rings: batched, asynchronous submission of I/O operations through
+	queues in an area shared between a team and the kernel.
+
+	Submitted operations are executed by kernel threads that belong to the
+	ring's team, so that they resolve FDs in the team's I/O context and can
+	access the team's buffers directly. The number of operations in flight is
+	bounded by the size of the completion queue, so the completion queue can
+	never overflow; submissions the ring has no room for simply stay in the
+	submission queue until completions have been consumed.
+*/
+
+
+#include <fs/io_ring.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include <OS.h>
+#include <Referenceable.h>
+#include <Select.h>
+
+#include <condition_variable.h>
+#include <fs/fd.h>
+#include <fs/select_sync_pool.h>
+#include <io_ring_defs.h>
+#include <kernel.h>
+#include <lock.h>
+#include <team.h>
+#include <thread.h>
+#include <util/AutoLock.h>
+#include <util/DoublyLinkedList.h>
+#include <vfs.h>
+#include <vm/vm.h>
+#include <wait_for_objects.h>
+
+
+//#define TRACE_IO_RING
+#ifdef TRACE_IO_RING
+#	define TRACE(x...) dprintf("io_ring: " x)
+#else
+#	define TRACE(x...) do {} while (false)
+#endif
+
+
+static const bigtime_t kDefaultPollIdleTime = 2000;
+static const size_t kHeaderSize = 64;
+
+
+struct IORingRequest : DoublyLinkedListLinkImpl<IORingRequest> {
+	io_ring_submission	submission;
+};
+
+typedef DoublyLinkedList<IORingRequest> IORingRequestList;
+
+
+class IORing : public BReferenceable {
+public:
+								IORing(team_id team);
+	virtual						~IORing();
+
+			status_t			Init(const io_ring_params& params);
+			status_t			StartThreads();
+
+			team_id				Team() const	{ return fTeam; }
+			area_id				UserArea() const { return fUserArea; }
+			void*				UserAddress() const { return fUserAddress; }
+			size_t				AreaSize() const { return fAreaSize; }
+
+			ssize_t				Enter(uint32 toSubmit, uint32 minComplete,
+									uint32 flags, bigtime_t timeout);
+			void				Close();
+
+			status_t			Select(uint8 event, selectsync* sync);
+			status_t			Deselect(uint8 event, selectsync* sync);
+
+private:
+			uint32				_PendingCompletions() const;
+			uint32				_FreeRequestSlots() const;
+			uint32				_Submit(uint32 count);
+			void				_Complete(IORingRequest* request,
+									int64 result);
+			int64				_Execute(const io_ring_submission& submission);
+
+	static	status_t			_WorkerThreadEntry(void* data);
+			void				_WorkerLoop();
+	static	status_t			_PollThreadEntry(void* data);
+			void				_PollLoop();
+
+private:
+			mutex				fLock;
+			team_id				fTeam;
+			area_id				fKernelArea;
+			area_id				fUserArea;
+			void*				fUserAddress;
+			size_t				fAreaSize;
+			io_ring_header*		fHeader;
+			io_ring_submission*	fSubmissions;
+			io_ring_completion*	fCompletions;
+			uint32				fSubmissionMask;
+			uint32				fCompletionMask;
+			uint32				fSubmissionHead;
+			uint32				fCompletionTail;
+			IORingRequest*		fRequests;
+			IORingRequestList	fFreeRequests;
+			IORingRequestList	fPendingRequests;
+			uint32				fInFlight;
+			uint32				fFlags;
+			uint32				fWorkerCount;
+			bigtime_t			fPollIdleTime;
+			bool				fPollThreadWaitingForSlots;
+			bool				fClosed;
+			ConditionVariable	fWorkCondition;
+			ConditionVariable	fCompletionCondition;
+			ConditionVariable	fPollCondition;
+			select_sync_pool*	fSelectPool;
+};
+
+
+static inline bool
+is_power_of_two(uint32 value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+
+IORing::IORing(team_id team)
+	:
+	fTeam(team),
+	fKernelArea(-1),
+	fUserArea(-1),
+	fUserAddress(NULL),
+	fAreaSize(0),
+	fHeader(NULL),
+	fSubmissions(NULL),
+	fCompletions(NULL),
+	fSubmissionMask(0),
+	fCompletionMask(0),
+	fSubmissionHead(0),
+	fCompletionTail(0),
+	fRequests(NULL),
+	fInFlight(0),
+	fFlags(0),
+	fWorkerCount(0),
+	fPollIdleTime(0),
+	fPollThreadWaitingForSlots(false),
+	fClosed(false),
+	fSelectPool(NULL)
+{
+	mutex_init(&fLock, "io ring");
+	fWorkCondition.Init(this, "io ring work");
+	fCompletionCondition.Init(this, "io ring completion");
+	fPollCondition.Init(this, "io ring poll");
+}
+
+
+IORing::~IORing()
+{
+	TRACE("%p: delete\n", this);
+
+	if (fSelectPool != NULL)
+		delete_select_sync_pool(fSelectPool);
+
+	// The team might already be gone, taking the area with it.
+	if (fUserArea >= 0)
+		vm_delete_area(fTeam, fUserArea, true);
+	if (fKernelArea >= 0)
+		delete_area(fKernelArea);
+
+	delete[] fRequests;
+	mutex_destroy(&fLock);
+}
+
+
+status_t
+IORing::Init(const io_ring_params& params)
+{
+	uint32 submissionEntries = params.submission_entries;
+	uint32 completionEntries = params.completion_entries != 0
+		? params.completion_entries : 2 * submissionEntries;
+
+	if (!is_power_of_two(submissionEntries)
+		|| submissionEntries > IO_RING_MAX_ENTRIES
+		|| !is_power_of_two(completionEntries)
+		|| completionEntries < submissionEntries
+		|| completionEntries > 2 * IO_RING_MAX_ENTRIES
+		|| (params.flags & ~(uint32)IO_RING_SETUP_SQ_POLL) != 0
+		|| params.worker_count > IO_RING_MAX_WORKERS) {
+		return B_BAD_VALUE;
+	}
+
+	fFlags = params.flags;
+	fWorkerCount = params.worker_count != 0
+		? params.worker_count : IO_RING_DEFAULT_WORKERS;
+	fPollIdleTime = params.poll_idle_time > 0
+		? params.poll_idle_time : kDefaultPollIdleTime;
+	fSubmissionMask = submissionEntries - 1;
+	fCompletionMask = completionEntries - 1;
+
+	// Every operation in flight is guaranteed a slot in the completion queue.
+	fRequests = new(std::nothrow) IORingRequest[completionEntries];
+	if (fRequests == NULL)
+		return B_NO_MEMORY;
+	for (uint32 i = 0; i < completionEntries; i++)
+		fFreeRequests.Add(&fRequests[i]);
+
+	// create the ring area and map it into the team as well
+	size_t submissionOffset = kHeaderSize;
+	size_t completionOffset = submissionOffset
+		+ submissionEntries * sizeof(io_ring_submission);
+	fAreaSize = PAGE_ALIGN(completionOffset
+		+ completionEntries * sizeof(io_ring_completion));
+
+	void* address;
+	fKernelArea = create_area("io ring", &address, B_ANY_KERNEL_ADDRESS,
+		fAreaSize, B_FULL_LOCK, B_KERNEL_READ_AREA | B_KERNEL_WRITE_AREA);
+	if (fKernelArea < 0)
+		return fKernelArea;
+
+	memset(address, 0, fAreaSize);
+
+	fHeader = (io_ring_header*)address;
+	fSubmissions = (io_ring_submission*)((uint8*)address + submissionOffset);
+	fCompletions = (io_ring_completion*)((uint8*)address + completionOffset);
+
+	fHeader->submission_mask = fSubmissionMask;
+	fHeader->submission_entries = submissionEntries;
+	fHeader->completion_mask = fCompletionMask;
+	fHeader->completion_entries = completionEntries;
+	fHeader->submission_offset = submissionOffset;
+	fHeader->completion_offset = completionOffset;
+
+	fUserArea = vm_clone_area(fTeam, "io ring", &fUserAddress,
+		B_RANDOMIZED_ANY_ADDRESS,
+		B_READ_AREA | B_WRITE_AREA | B_KERNEL_AREA, REGION_NO_PRIVATE_MAP,
+		fKernelArea, true);
+	if (fUserArea < 0)
+		return fUserArea;
+
+	TRACE("%p: init: %" B_PRIu32 "/%" B_PRIu32 " entries, %" B_PRIu32
+		" workers, user address %p\n", this, submissionEntries,
+		completionEntries, fWorkerCount, fUserAddress);
+
+	return B_OK;
+}
+
+
+/*!	Spawns the worker threads and, if requested, the submission queue polling
+	thread. Each thread holds a reference to the ring.
+*/
+status_t
+IORing::StartThreads()
+{
+	char name[B_OS_NAME_LENGTH];
+
+	for (uint32 i = 0; i < fWorkerCount; i++) {
+		snprintf(name, sizeof(name), "io ring worker %" B_PRIu32, i);
+		thread_id thread = spawn_kernel_thread_etc(&_WorkerThreadEntry, name,
+			B_NORMAL_PRIORITY, this, fTeam);
+		if (thread < 0)
+			return thread;
+
+		AcquireReference();
+		resume_thread(thread);
+	}
+
+	if ((fFlags & IO_RING_SETUP_SQ_POLL) != 0) {
+		thread_id thread = spawn_kernel_thread_etc(&_PollThreadEntry,
+			"io ring poller", B_NORMAL_PRIORITY, this, fTeam);
+		if (thread < 0)
+			return thread;
+
+		AcquireReference();
+		resume_thread(thread);
+	}
+
+	return B_OK;
+}
+
+
+ssize_t
+IORing::Enter(uint32 toSubmit, uint32 minComplete, uint32 flags,
+	bigtime_t timeout)
+{
+	MutexLocker locker(fLock);
+
+	if (fClosed)
+		return B_FILE_ERROR;
+
+	ssize_t submitted = 0;
+	if ((fFlags & IO_RING_SETUP_SQ_POLL) != 0) {
+		// the polling thread does the submitting
+		if ((flags & IO_RING_ENTER_SQ_WAKEUP) != 0)
+			fPollCondition.NotifyAll();
+	} else if (toSubmit > 0)
+		submitted = _Submit(toSubmit);
+
+	if ((flags & IO_RING_ENTER_GET_EVENTS) == 0 || minComplete == 0)
+		return submitted;
+
+	minComplete = std::min(minComplete, fCompletionMask + 1);
+
+	uint32 waitFlags = B_CAN_INTERRUPT;
+	if (timeout >= 0) {
+		waitFlags |= B_ABSOLUTE_TIMEOUT;
+		timeout += system_time();
+	}
+
+	while (_PendingCompletions() < minComplete) {
+		ConditionVariableEntry entry;
+		fCompletionCondition.Add(&entry);
+		locker.Unlock();
+
+		status_t status = entry.Wait(waitFlags, timeout);
+
+		locker.Lock();
+
+		if (status != B_OK)
+			return submitted > 0 ? submitted : status;
+	}
+
+	return submitted;
+}
+
+
+void
+IORing::Close()
+{
+	MutexLocker locker(fLock);
+
+	TRACE("%p: close\n", this);
+
+	fClosed = true;
+
+	fWorkCondition.NotifyAll();
+	fPollCondition.NotifyAll();
+	fCompletionCondition.NotifyAll(B_FILE_ERROR);
+}
+
+
+status_t
+IORing::Select(uint8 event, selectsync* sync)
+{
+	MutexLocker locker(fLock);
+
+	status_t error = add_select_sync_pool_entry(&fSelectPool, sync, event);
+	if (error != B_OK)
+		return error;
+
+	// signal right away, if completions are available already
+	if (event == B_SELECT_READ && _PendingCompletions() > 0)
+		return notify_select_event(sync, event);
+
+	return B_OK;
+}
+
+
+status_t
+IORing::Deselect(uint8 event, selectsync* sync)
+{
+	MutexLocker locker(fLock);
+
+	return remove_select_sync_pool_entry(&fSelectPool, sync, event);
+}
+
+
+/*!	Returns the number of completions the team hasn't consumed yet.
+	The ring's lock must be held.
+*/
+uint32
+IORing::_PendingCompletions() const
+{
+	uint32 head = (uint32)atomic_get((int32*)&fHeader->completion_head);
+	uint32 pending = fCompletionTail - head;
+
+	// The team owns the head index, so don't trust it.
+	return std::min(pending, fCompletionMask + 1);
+}
+
+
+/*!	Returns how many more submissions can be accepted without the completion
+	queue possibly overflowing. The ring's lock must be held.
+*/
+uint32
+IORing::_FreeRequestSlots() const
+{
+	uint32 used = fInFlight + _PendingCompletions();
+	uint32 entries = fCompletionMask + 1;
+	return used < entries ? entries - used : 0;
+}
+
+
+/*!	Moves up to \a count entries from the submission queue to the pending
+	list. The ring's lock must be held.
+	Returns the number of entries consumed.
+*/
+uint32
+IORing::_Submit(uint32 count)
+{
+	uint32 tail = (uint32)atomic_get((int32*)&fHeader->submission_tail);
+	memory_read_barrier();
+
+	uint32 available = tail - fSubmissionHead;
+	if (available > fSubmissionMask + 1) {
+		// The team has corrupted the tail index; ignore it until it is fixed.
+		return 0;
+	}
+
+	count = std::min(count, std::min(available, _FreeRequestSlots()));
+
+	for (uint32 i = 0; i < count; i++) {
+		IORingRequest* request = fFreeRequests.RemoveHead();
+		memcpy(&request->submission,
+			&fSubmissions[(fSubmissionHead + i) & fSubmissionMask],
+			sizeof(io_ring_submission));
+		fInFlight++;
+
+		const io_ring_submission& submission = request->submission;
+		if (submission.opcode >= IO_RING_OP_COUNT || submission.flags != 0) {
+			atomic_add((int32*)&fHeader->dropped, 1);
+			_Complete(request, B_BAD_VALUE);
+			continue;
+		}
+
+		if (submission.opcode == IO_RING_OP_NOP) {
+			_Complete(request, B_OK);
+			continue;
+		}
+
+		fPendingRequests.Add(request);
+		fWorkCondition.NotifyOne();
+	}
+
+	fSubmissionHead += count;
+	memory_write_barrier();
+	atomic_set((int32*)&fHeader->submission_head, fSubmissionHead);
+
+	return count;
+}
+
+
+/*!	Posts the completion for \a request and recycles it.
+	The ring's lock must be held.
+*/
+void
+IORing::_Complete(IORingRequest* request, int64 result)
+{
+	io_ring_completion& completion
+		= fCompletions[fCompletionTail & fCompletionMask];
+	completion.user_data = request->submission.user_data;
+	completion.result = result;
+	completion.flags = 0;
+	completion.reserved = 0;
+
+	fCompletionTail++;
+	memory_write_barrier();
+	atomic_set((int32*)&fHeader->completion_tail, fCompletionTail);
+
+	fInFlight--;
+	fFreeRequests.Add(request);
+
+	fCompletionCondition.NotifyAll();
+	if (fPollThreadWaitingForSlots)
+		fPollCondition.NotifyAll();
+	if (fSelectPool != NULL)
+		notify_select_event_pool(fSelectPool, B_SELECT_READ);
+}
+
+
+/*!	Executes the operation in the context of the ring's team. Must be called
+	by one of the ring's threads without holding the lock.
+*/
+int64
+IORing::_Execute(const io_ring_submission& submission)
+{
+	void* address = (void*)(addr_t)submission.address;
+
+	switch (submission.opcode) {
+		case IO_RING_OP_READ:
+			return _user_read(submission.fd, submission.offset, address,
+				submission.length);
+		case IO_RING_OP_WRITE:
+			return _user_write(submission.fd, submission.offset, address,
+				submission.length);
+		case IO_RING_OP_FSYNC:
+			return _user_fsync(submission.fd);
+		case IO_RING_OP_OPEN:
+			return _user_open(submission.fd, (const char*)address,
+				submission.op_flags, submission.mode);
+		case IO_RING_OP_CLOSE:
+			return _user_close(submission.fd);
+		case IO_RING_OP_POLL:
+		{
+			struct pollfd pollFD;
+			pollFD.fd = submission.fd;
+			pollFD.events = submission.op_flags;
+			pollFD.revents = 0;
+
+			ssize_t result = poll_fds(&pollFD, 1, submission.offset, false);
+			if (result < 0)
+				return result;
+			return pollFD.revents;
+		}
+		case IO_RING_OP_SEND:
+			return _user_send(submission.fd, address, submission.length,
+				submission.op_flags);
+		case IO_RING_OP_RECV:
+			return _user_recv(submission.fd, address, submission.length,
+				submission.op_flags);
+	}
+
+	return B_BAD_VALUE;
+}
+
+
+/*static*/ status_t
+IORing::_WorkerThreadEntry(void* data)
+{
+	IORing* ring = (IORing*)data;
+	ring->_WorkerLoop();
+	ring->ReleaseReference();
+	return B_OK;
+}
+
+
+void
+IORing::_WorkerLoop()
+{
+	MutexLocker locker(fLock);
+
+	while (true) {
+		IORingRequest* request = fPendingRequests.RemoveHead();
+		if (request == NULL) {
+			if (fClosed)
+				return;
+
+			ConditionVariableEntry entry;
+			fWorkCondition.Add(&entry);
+			locker.Unlock();
+
+			status_t status = entry.Wait(B_KILL_CAN_INTERRUPT);
+
+			locker.Lock();
+
+			// only a kill signal can interrupt us -- the team is going down
+			if (status == B_INTERRUPTED)
+				return;
+			continue;
+		}
+
+		locker.Unlock();
+		int64 result = _Execute(request->submission);
+		locker.Lock();
+
+		_Complete(request, result);
+	}
+}
+
+
+/*static*/ status_t
+IORing::_PollThreadEntry(void* data)
+{
+	IORing* ring = (IORing*)data;
+	ring->_PollLoop();
+	ring->ReleaseReference();
+	return B_OK;
+}
+
+
+/*!	Keeps consuming the submission queue until nothing has been submitted for
+	fPollIdleTime. Then IO_RING_SQ_NEED_WAKEUP is set and the thread sleeps
+	until the team wakes it up via _kern_io_ring_enter().
+*/
+void
+IORing::_PollLoop()
+{
+	MutexLocker locker(fLock);
+	bigtime_t lastActivity = system_time();
+
+	while (!fClosed) {
+		if (_Submit(UINT32_MAX) > 0) {
+			lastActivity = system_time();
+			continue;
+		}
+
+		bool ringFull = _FreeRequestSlots() == 0;
+		bool idle = system_time() - lastActivity >= fPollIdleTime;
+
+		if (!ringFull && !idle) {
+			// We don't block while polling, so check for the team going down.
+			if (thread_is_interrupted(thread_get_current_thread(),
+					B_KILL_CAN_INTERRUPT)) {
+				return;
+			}
+
+			locker.Unlock();
+			thread_yield();
+			locker.Lock();
+			continue;
+		}
+
+		if (!ringFull) {
+			atomic_or((int32*)&fHeader->flags, IO_RING_SQ_NEED_WAKEUP);
+
+			// check again, lest we miss a submission that raced with setting
+			// the flag
+			if (_Submit(UINT32_MAX) > 0) {
+				atomic_and((int32*)&fHeader->flags, ~IO_RING_SQ_NEED_WAKEUP);
+				lastActivity = system_time();
+				continue;
+			}
+		}
+
+		ConditionVariableEntry entry;
+		fPollCondition.Add(&entry);
+		fPollThreadWaitingForSlots = ringFull;
+		locker.Unlock();
+
+		status_t status = entry.Wait(B_KILL_CAN_INTERRUPT);
+
+		locker.Lock();
+		fPollThreadWaitingForSlots = false;
+		atomic_and((int32*)&fHeader->flags, ~IO_RING_SQ_NEED_WAKEUP);
+
+		if (status == B_INTERRUPTED)
+			return;
+
+		lastActivity = system_time();
+	}
+}
+
+
+// #pragma mark - file descriptor
+
+
+static status_t
+io_ring_select(struct file_descriptor* descriptor, uint8 event,
+	struct selectsync* sync)
+{
+	return ((IORing*)descriptor->cookie)->Select(event, sync);
+}
+
+
+static status_t
+io_ring_deselect(struct file_descriptor* descriptor, uint8 event,
+	struct selectsync* sync)
+{
+	return ((IORing*)descriptor->cookie)->Deselect(event, sync);
+}
+
+
+static status_t
+io_ring_close(struct file_descriptor* descriptor)
+{
+	((IORing*)descriptor->cookie)->Close();
+	return B_OK;
+}
+
+
+static void
+io_ring_free(struct file_descriptor* descriptor)
+{
+	((IORing*)descriptor->cookie)->ReleaseReference();
+}
+
+
+static struct fd_ops sIORingFDOps = {
+	NULL,	// fd_read
+	NULL,	// fd_write
+	NULL,	// fd_seek
+	NULL,	// fd_ioctl
+	NULL,	// fd_set_flags
+	&io_ring_select,
+	&io_ring_deselect,
+	NULL,	// fd_read_dir
+	NULL,	// fd_rewind_dir
+	NULL,	// fd_read_stat
+	NULL,	// fd_write_stat
+	&io_ring_close,
+	&io_ring_free
+};
+
+
+// #pragma mark - syscalls
+
+
+int
+_user_io_ring_create(io_ring_params* userParams)
+{
+	io_ring_params params;
+	if (userParams == NULL || !IS_USER_ADDRESS(userParams)
+		|| user_memcpy(&params, userParams, sizeof(params)) != B_OK) {
+		return B_BAD_ADDRESS;
+	}
+
+	IORing* ring = new(std::nothrow) IORing(team_get_current_team_id());
+	if (ring == NULL)
+		return B_NO_MEMORY;
+	BReference<IORing> ringReference(ring, true);
+
+	status_t error = ring->Init(params);
+	if (error != B_OK)
+		return error;
+
+	error = ring->StartThreads();
+	if (error != B_OK) {
+		ring->Close();
+		return error;
+	}
+
+	params.area = ring->UserArea();
+	params.address = ring->UserAddress();
+	params.size = ring->AreaSize();
+	if (user_memcpy(userParams, &params, sizeof(params)) != B_OK) {
+		ring->Close();
+		return B_BAD_ADDRESS;
+	}
+
+	file_descriptor* descriptor = alloc_fd();
+	if (descriptor == NULL) {
+		ring->Close();
+		return B_NO_MEMORY;
+	}
+
+	descriptor->type = FDTYPE_IO_RING;
+	descriptor->ops = &sIORingFDOps;
+	descriptor->cookie = ring;
+	descriptor->open_mode = O_RDWR;
+
+	io_context* context = get_current_io_context(false);
+	int fd = new_fd(context, descriptor);
+	if (fd < 0) {
+		free(descriptor);
+		ring->Close();
+		return fd;
+	}
+
+	// The threads belong to this team only, so the ring must not survive
+	// an exec().
+	fd_set_close_on_exec(context, fd, true);
+
+	// the descriptor owns our reference now
+	ringReference.Detach();
+	return fd;
+}
+
+
+ssize_t
+_user_io_ring_enter(int fd, uint32 toSubmit, uint32 minComplete, uint32 flags,
+	bigtime_t timeout)
+{
+	if ((flags & ~(uint32)(IO_RING_ENTER_GET_EVENTS | IO_RING_ENTER_SQ_WAKEUP))
+			!= 0) {
+		return B_BAD_VALUE;
+	}
+
+	file_descriptor* descriptor = get_fd(get_current_io_context(false), fd);
+	if (descriptor == NULL)
+		return B_FILE_ERROR;
+
+	ssize_t result;
+	IORing* ring = (IORing*)descriptor->cookie;
+	if (descriptor->type != FDTYPE_IO_RING)
+		result = B_BAD_VALUE;
+	else if (ring->Team() != team_get_current_team_id()) {
+		// A ring inherited via fork() still executes its operations in the
+		// parent team.
+		result = B_NOT_ALLOWED;
+	} else
+		result = ring->Enter(toSubmit, minComplete, flags, timeout);
+
+	put_fd(descriptor);
+	return result;
+}
@@ -1028,7 +1028,7 @@ free_vnode(struct vnode* vnode, bool reenter)
 	// long as the vnode is busy and in the hash, that won't happen, but as
 	// soon as we've removed it from the hash, it could reload the vnode -- with
 	// a new cache attached!
-	if (vnode->cache != NULL)
+	if (vnode->cache != NULL && vnode->cache->type == CACHE_TYPE_VNODE)
 		((VMVnodeCache*)vnode->cache)->VnodeDeleted();
 
 	// The file system has removed the resources of the vnode now, so we can
@@ -4765,6 +4765,44 @@ vfs_get_vnode_cache(struct vnode* vnode, VMCache** _cache, bool allocate)
 }
 
 
+/*!	Sets the vnode's VMCache object to a cache the file system maintains
+	itself, e.g. because it keeps the file's data in memory only. Mapping the
+	file will then map that cache directly.
+	Fails with \c B_NOT_ALLOWED, if the vnode already has another cache. On
+	success the vnode owns a reference to the cache.
+*/
+extern "C" status_t
+vfs_set_vnode_cache(struct vnode* vnode, VMCache* cache)
+{
+	if (vnode->cache == cache)
+		return B_OK;
+
+	cache->AcquireRef();
+
+	rw_lock_read_lock(&sVnodeLock);
+	vnode->Lock();
+
+	// The cache could have been set in the meantime
+	bool cacheSet = false;
+	if (vnode->cache == NULL) {
+		vnode->cache = cache;
+		cacheSet = true;
+	}
+	VMCache* vnodeCache = vnode->cache;
+
+	vnode->Unlock();
+	rw_lock_read_unlock(&sVnodeLock);
+
+	if (!cacheSet) {
+		cache->ReleaseRef();
+		if (vnodeCache != cache)
+			return B_NOT_ALLOWED;
+	}
+
+	return B_OK;
+}
+
+
 status_t
 vfs_get_file_map(struct vnode* vnode, off_t offset, size_t size,
 	file_io_vec* vecs, size_t* _count)
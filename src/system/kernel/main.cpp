@@ -52,6 +52,7 @@
 #include <timer.h>
 #include <user_debugger.h>
 #include <user_mutex.h>
+#include <util/crc32c.h>
 #include <vfs.h>
 #include <vm/vm.h>
 #include <boot/kernel_args.h>
@@ -132,6 +133,7 @@ _start(kernel_args *bootKernelArgs, int currentCPU)
 		TRACE("init CPU\n");
 		cpu_init(&sKernelArgs);
 		cpu_init_percpu(&sKernelArgs, currentCPU);
+		crc32c_init();
 		TRACE("init interrupts\n");
 		int_init(&sKernelArgs);
 
@@ -25,6 +25,7 @@
 #include <elf.h>
 #include <frame_buffer_console.h>
 #include <fs/fd.h>
+#include <fs/io_ring.h>
 #include <fs/node_monitor.h>
 #include <generic_syscall.h>
 #include <int.h>
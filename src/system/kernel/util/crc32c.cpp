@@ -0,0 +1,139 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+/*!	CRC-32C (Castagnoli), as used by btrfs, ext4, and iSCSI.
+
+	Where available, the SSE4.2 crc32 instruction is used; it only works on
+	general purpose registers, so no FPU state has to be saved. Otherwise,
+	the checksum is computed eight bytes at a time, using the
+	"slicing-by-8" tables.
+*/
+
+
+#include <util/crc32c.h>
+
+#include <ByteOrder.h>
+#include <cpu.h>
+
+
+#if (defined(__i386__) || defined(__x86_64__)) && __GNUC__ >= 4
+#	define CRC32C_INSTRUCTION
+#endif
+
+
+static const uint32 kPolynomial = 0x82f63b78;
+	// reversed 0x1edc6f41
+
+static uint32 sTables[8][256];
+static bool sUseInstruction = false;
+
+
+static uint32
+crc32c_tables(uint32 crc, const uint8* data, size_t length)
+{
+	while (length > 0 && ((addr_t)data & 7) != 0) {
+		crc = sTables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+		length--;
+	}
+
+	while (length >= 8) {
+		uint32 low = B_LENDIAN_TO_HOST_INT32(*(const uint32*)data) ^ crc;
+		uint32 high = B_LENDIAN_TO_HOST_INT32(*(const uint32*)(data + 4));
+
+		crc = sTables[7][low & 0xff] ^ sTables[6][(low >> 8) & 0xff]
+			^ sTables[5][(low >> 16) & 0xff] ^ sTables[4][low >> 24]
+			^ sTables[3][high & 0xff] ^ sTables[2][(high >> 8) & 0xff]
+			^ sTables[1][(high >> 16) & 0xff] ^ sTables[0][high >> 24];
+
+		data += 8;
+		length -= 8;
+	}
+
+	while (length-- > 0)
+		crc = sTables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+
+#ifdef CRC32C_INSTRUCTION
+
+static uint32
+crc32c_instruction(uint32 crc, const uint8* data, size_t length)
+{
+	while (length > 0 && ((addr_t)data & 7) != 0) {
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+		data++;
+		length--;
+	}
+
+#ifdef __x86_64__
+	uint64 crc64 = crc;
+	while (length >= 8) {
+		asm("crc32q %1, %0" : "+r" (crc64) : "rm" (*(const uint64*)data));
+		data += 8;
+		length -= 8;
+	}
+	crc = (uint32)crc64;
+#else
+	while (length >= 4) {
+		asm("crc32l %1, %0" : "+r" (crc) : "rm" (*(const uint32*)data));
+		data += 4;
+		length -= 4;
+	}
+#endif
+
+	while (length-- > 0) {
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+		data++;
+	}
+
+	return crc;
+}
+
+#endif	// CRC32C_INSTRUCTION
+
+
+//	#pragma mark -
+
+
+void
+crc32c_init(void)
+{
+	for (uint32 i = 0; i < 256; i++) {
+		uint32 crc = i;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ ((crc & 1) != 0 ? kPolynomial : 0);
+		sTables[0][i] = crc;
+	}
+
+	for (uint32 i = 0; i < 256; i++) {
+		for (int slice = 1; slice < 8; slice++) {
+			uint32 crc = sTables[slice - 1][i];
+			sTables[slice][i] = (crc >> 8) ^ sTables[0][crc & 0xff];
+		}
+	}
+
+#ifdef CRC32C_INSTRUCTION
+	sUseInstruction = x86_check_feature(IA32_FEATURE_EXT_SSE4_2, FEATURE_EXT);
+#endif
+}
+
+
+/*!	Continues the CRC-32C \a crc over \a length bytes of \a data.
+	As with Linux' crc32c(), the caller is responsible for the initial value
+	(usually ~0) and for inverting the result, if the format wants that.
+*/
+uint32
+crc32c(uint32 crc, const void* data, size_t length)
+{
+#ifdef CRC32C_INSTRUCTION
+	if (sUseInstruction)
+		return crc32c_instruction(crc, (const uint8*)data, length);
+#endif
+
+	return crc32c_tables(crc, (const uint8*)data, length);
+}
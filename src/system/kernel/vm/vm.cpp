@@ -658,9 +658,11 @@ cut_area(VMAddressSpace* addressSpace, VMArea* area, addr_t address,
 		unmap_pages(area, address, oldSize - newSize);
 
 		// If no one else uses the area's cache, we can resize it, too.
+		// Note, the cache of a mapped file may be a RAM cache, too (ramfs),
+		// so we need to look at the area's type.
 		if (cache->areas == area && area->cache_next == NULL
 			&& cache->consumers.IsEmpty()
-			&& cache->type == CACHE_TYPE_RAM) {
+			&& area->cache_type == CACHE_TYPE_RAM) {
 			// Since VMCache::Resize() can temporarily drop the lock, we must
 			// unlock all lower caches to prevent locking order inversion.
 			cacheChainLocker.Unlock(cache);
@@ -731,6 +733,7 @@ cut_area(VMAddressSpace* addressSpace, VMArea* area, addr_t address,
 
 	// We need a cache reference for the new area.
 	cache->AcquireRefLocked();
+	secondArea->cache_type = area->cache_type;
 
 	if (_secondArea != NULL)
 		*_secondArea = secondArea;
@@ -2512,6 +2515,7 @@ vm_copy_area(team_id team, const char* name, void** _address,
 		// The new area uses the old area's cache, but map_backing_store()
 		// hasn't acquired a ref. So we have to do that now.
 		cache->AcquireRefLocked();
+		target->cache_type = source->cache_type;
 	}
 
 	// If the source area is writable, we need to move it one layer up as well
@@ -5054,7 +5058,9 @@ vm_resize_area(area_id areaID, size_t newSize, bool kernel)
 		if (newSize == oldSize)
 			return B_OK;
 
-		if (cache->type != CACHE_TYPE_RAM)
+		// mapped files cannot be resized this way, even if they live in a
+		// RAM cache
+		if (area->cache_type != CACHE_TYPE_RAM)
 			return B_NOT_ALLOWED;
 
 		if (oldSize < newSize) {
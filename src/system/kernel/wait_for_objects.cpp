@@ -885,6 +885,24 @@ _kern_select(int numFDs, fd_set *readSet, fd_set *writeSet, fd_set *errorSet,
 }
 
 
+/*!	Polls the given FDs, which must live in kernel memory. Unlike _kern_poll()
+	the FDs can be looked up in the current team's I/O context (\a kernel
+	\c false), which allows kernel threads working on behalf of a team to poll
+	the team's FDs. \a timeout is relative, negative for infinite.
+*/
+ssize_t
+poll_fds(struct pollfd* fds, int numFDs, bigtime_t timeout, bool kernel)
+{
+	if (numFDs < 0)
+		return B_BAD_VALUE;
+
+	if (timeout >= 0)
+		timeout += system_time();
+
+	return common_poll(fds, numFDs, timeout, kernel);
+}
+
+
 ssize_t
 _kern_poll(struct pollfd *fds, int numFDs, bigtime_t timeout)
 {
@@ -13,7 +13,7 @@
 #include <file_cache.h>
 
 
-#define MAX_VECS	32
+#define MAX_VECS	256
 
 
 class Map {
@@ -29,6 +29,7 @@ public:
 	void Invalidate(off_t start, off_t size);
 	void SetMode(uint32 mode);
 	void Test();
+	void TestAll();
 
 	status_t GetFileMap(off_t offset, off_t length, file_io_vec* vecs,
 		size_t* _vecCount);
@@ -177,6 +178,37 @@ Map::Test()
 }
 
 
+/*!	Translates the whole file at once, and expects to get exactly the vecs
+	that were added. */
+void
+Map::TestAll()
+{
+	printf("  Test %lu (all at once)\n", ++fTest);
+
+	fTestOffset = 0;
+	fTestLength = fSize;
+
+	size_t count = MAX_VECS;
+	status_t status = file_map_translate(fMap, 0, fSize, fTestVecs, &count,
+		0);
+	fTestCount = count;
+	if (status != B_OK)
+		_Error("file_map_translate() failed: %s", strerror(status));
+	if (fTestCount != fCount)
+		_Error("got %lu vecs, should be %lu", fTestCount, fCount);
+
+	for (uint32 i = 0; i < fCount; i++) {
+		if (fTestVecs[i].offset != fVecs[i].offset
+			|| fTestVecs[i].length != fVecs[i].length) {
+			_Error("vec %lu mismatch: got offset %lld, length %lld", i,
+				fTestVecs[i].offset, fTestVecs[i].length);
+		}
+	}
+
+	fTestCount = 0;
+}
+
+
 status_t
 Map::GetFileMap(off_t offset, off_t length, file_io_vec* vecs,
 	size_t* _vecCount)
@@ -332,5 +364,19 @@ main(int argc, char** argv)
 	map.SetSize(0);
 	map.Test();
 
+	// more extents than fit into a single chunk of the map, none of them
+	// adjacent on disk
+	map.SetTo("fragmented", 200 * 512);
+	for (int32 i = 0; i < 200; i++)
+		map.Add(i * 512, 512, 1000000 - i * 4096);
+	map.Test();
+	map.TestAll();
+	map.Invalidate(20000, 30000);
+	map.TestAll();
+	map.Invalidate(0, 512);
+	map.Test();
+	map.SetSize(50000);
+	map.Test();
+
 	return 0;
 }
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <OS.h>
+
+#include <io_ring_defs.h>
+#include <syscalls.h>
+
+
+static const int kBlockCount = 64;
+static const size_t kBlockSize = 4096;
+
+
+struct Ring {
+	int						fd;
+	io_ring_header*			header;
+	io_ring_submission*		submissions;
+	io_ring_completion*		completions;
+};
+
+
+static void
+check(bool condition, const char* message)
+{
+	if (!condition) {
+		fprintf(stderr, "io_ring_test: %s\n", message);
+		exit(1);
+	}
+}
+
+
+static void
+create_ring(Ring& ring, uint32 entries, uint32 flags)
+{
+	io_ring_params params;
+	memset(&params, 0, sizeof(params));
+	params.submission_entries = entries;
+	params.flags = flags;
+
+	ring.fd = _kern_io_ring_create(&params);
+	check(ring.fd >= 0, "failed to create ring");
+
+	ring.header = (io_ring_header*)params.address;
+	ring.submissions = (io_ring_submission*)((uint8*)params.address
+		+ ring.header->submission_offset);
+	ring.completions = (io_ring_completion*)((uint8*)params.address
+		+ ring.header->completion_offset);
+}
+
+
+static io_ring_submission*
+next_submission(Ring& ring)
+{
+	uint32 tail = ring.header->submission_tail;
+	if (tail - atomic_get((int32*)&ring.header->submission_head)
+			>= ring.header->submission_entries) {
+		return NULL;
+	}
+
+	io_ring_submission* submission
+		= &ring.submissions[tail & ring.header->submission_mask];
+	memset(submission, 0, sizeof(*submission));
+	return submission;
+}
+
+
+static void
+commit_submission(Ring& ring)
+{
+	atomic_add((int32*)&ring.header->submission_tail, 1);
+}
+
+
+static uint32
+reap_completions(Ring& ring, int64* results, uint32 count)
+{
+	uint32 head = ring.header->completion_head;
+	uint32 tail = atomic_get((int32*)&ring.header->completion_tail);
+	uint32 reaped = 0;
+
+	while (head != tail && reaped < count) {
+		io_ring_completion& completion
+			= ring.completions[head & ring.header->completion_mask];
+		results[completion.user_data] = completion.result;
+		head++;
+		reaped++;
+	}
+
+	atomic_set((int32*)&ring.header->completion_head, head);
+	return reaped;
+}
+
+
+static void
+test_read_write(Ring& ring, const char* path)
+{
+	int file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	check(file >= 0, "failed to create test file");
+
+	uint8* buffer = (uint8*)malloc(kBlockCount * kBlockSize);
+	for (int i = 0; i < kBlockCount; i++)
+		memset(buffer + i * kBlockSize, i, kBlockSize);
+
+	int64 results[kBlockCount];
+
+	// write all blocks in one batch
+	for (int i = 0; i < kBlockCount; i++) {
+		io_ring_submission* submission = next_submission(ring);
+		check(submission != NULL, "submission queue full");
+		submission->opcode = IO_RING_OP_WRITE;
+		submission->fd = file;
+		submission->offset = i * kBlockSize;
+		submission->address = (addr_t)(buffer + i * kBlockSize);
+		submission->length = kBlockSize;
+		submission->user_data = i;
+		commit_submission(ring);
+	}
+
+	uint32 done = 0;
+	while (done < kBlockCount) {
+		ssize_t submitted = _kern_io_ring_enter(ring.fd, kBlockCount, 1,
+			IO_RING_ENTER_GET_EVENTS, B_INFINITE_TIMEOUT);
+		check(submitted >= 0, "enter failed");
+		done += reap_completions(ring, results, kBlockCount);
+	}
+
+	for (int i = 0; i < kBlockCount; i++)
+		check(results[i] == (int64)kBlockSize, "short write");
+
+	// read them back in reverse order
+	memset(buffer, 0xff, kBlockCount * kBlockSize);
+	for (int i = kBlockCount - 1; i >= 0; i--) {
+		io_ring_submission* submission = next_submission(ring);
+		submission->opcode = IO_RING_OP_READ;
+		submission->fd = file;
+		submission->offset = i * kBlockSize;
+		submission->address = (addr_t)(buffer + i * kBlockSize);
+		submission->length = kBlockSize;
+		submission->user_data = i;
+		commit_submission(ring);
+	}
+
+	done = 0;
+	while (done < kBlockCount) {
+		_kern_io_ring_enter(ring.fd, kBlockCount, kBlockCount - done,
+			IO_RING_ENTER_GET_EVENTS, B_INFINITE_TIMEOUT);
+		done += reap_completions(ring, results, kBlockCount);
+	}
+
+	for (int i = 0; i < kBlockCount; i++) {
+		check(results[i] == (int64)kBlockSize, "short read");
+		for (size_t j = 0; j < kBlockSize; j++)
+			check(buffer[i * kBlockSize + j] == i, "data mismatch");
+	}
+
+	free(buffer);
+	close(file);
+	unlink(path);
+
+	printf("read/write: ok\n");
+}
+
+
+static void
+test_poll(Ring& ring)
+{
+	int pipes[2];
+	check(pipe(pipes) == 0, "failed to create pipe");
+
+	io_ring_submission* submission = next_submission(ring);
+	submission->opcode = IO_RING_OP_POLL;
+	submission->fd = pipes[0];
+	submission->op_flags = POLLIN;
+	submission->offset = -1;
+	submission->user_data = 0;
+	commit_submission(ring);
+
+	check(_kern_io_ring_enter(ring.fd, 1, 0, 0, 0) == 1, "submit failed");
+
+	// nothing to read yet
+	int64 result = -1;
+	check(_kern_io_ring_enter(ring.fd, 0, 1, IO_RING_ENTER_GET_EVENTS, 100000)
+		== B_TIMED_OUT, "poll completed early");
+
+	// the ring FD itself becomes readable once the poll completes
+	write(pipes[1], "x", 1);
+
+	struct pollfd ringPoll = { ring.fd, POLLIN, 0 };
+	check(poll(&ringPoll, 1, 1000) == 1, "ring not readable");
+	check(reap_completions(ring, &result, 1) == 1, "no completion");
+	check((result & POLLIN) != 0, "POLLIN not reported");
+
+	close(pipes[0]);
+	close(pipes[1]);
+
+	printf("poll: ok\n");
+}
+
+
+static void
+test_sq_poll()
+{
+	Ring ring;
+	create_ring(ring, 16, IO_RING_SETUP_SQ_POLL);
+
+	int64 results[16];
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < 16; i++) {
+			io_ring_submission* submission = next_submission(ring);
+			check(submission != NULL, "submission queue full");
+			submission->opcode = IO_RING_OP_NOP;
+			submission->user_data = i;
+			commit_submission(ring);
+		}
+
+		// let the polling thread go to sleep in between rounds
+		uint32 flags = 0;
+		if ((atomic_get((int32*)&ring.header->flags)
+				& IO_RING_SQ_NEED_WAKEUP) != 0) {
+			flags |= IO_RING_ENTER_SQ_WAKEUP;
+		}
+
+		uint32 done = 0;
+		while (done < 16) {
+			_kern_io_ring_enter(ring.fd, 0, 16 - done,
+				flags | IO_RING_ENTER_GET_EVENTS, 1000000);
+			done += reap_completions(ring, results, 16);
+			flags = 0;
+		}
+
+		snooze(20000);
+	}
+
+	close(ring.fd);
+
+	printf("submission queue polling: ok\n");
+}
+
+
+int
+main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "/tmp/io_ring_test";
+
+	Ring ring;
+	create_ring(ring, kBlockCount, 0);
+
+	test_read_write(ring, path);
+	test_poll(ring);
+	test_sq_poll();
+
+	close(ring.fd);
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fs_volume.h>
+#include <OS.h>
+
+
+static const char* kMountPoint = "/tmp/mmap-ramfs-unmap-test";
+static const char* kFileName = "/tmp/mmap-ramfs-unmap-test/file";
+static const size_t kPageCount = 4;
+
+
+static void
+fail(const char* message, ...)
+{
+	va_list args;
+	va_start(args, message);
+	vfprintf(stderr, message, args);
+	va_end(args);
+
+	fs_unmount_volume(kMountPoint, 0);
+	exit(1);
+}
+
+
+static void
+check_file(size_t fileSize)
+{
+	int fd = open(kFileName, O_RDONLY);
+	if (fd < 0)
+		fail("Failed to reopen \"%s\": %s\n", kFileName, strerror(errno));
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		fail("Failed to stat the file: %s\n", strerror(errno));
+	if (st.st_size != (off_t)fileSize) {
+		fail("File size changed: %lld instead of %zu\n", (long long)st.st_size,
+			fileSize);
+	}
+
+	char buffer[B_PAGE_SIZE];
+	for (size_t i = 0; i < kPageCount; i++) {
+		if (read(fd, buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer))
+			fail("Failed to read page %zu: %s\n", i, strerror(errno));
+
+		for (size_t k = 0; k < sizeof(buffer); k++) {
+			if (buffer[k] != (char)('a' + i)) {
+				fail("Page %zu is corrupt at offset %zu: %#x\n", i, k,
+					(uint8)buffer[k]);
+			}
+		}
+	}
+
+	close(fd);
+}
+
+
+int
+main()
+{
+	const size_t fileSize = kPageCount * B_PAGE_SIZE;
+
+	// mount a ramfs
+	printf("mounting ramfs...\n");
+	if (mkdir(kMountPoint, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create \"%s\": %s\n", kMountPoint,
+			strerror(errno));
+		exit(1);
+	}
+
+	if (fs_mount_volume(kMountPoint, NULL, "ramfs", 0, NULL) < 0) {
+		fprintf(stderr, "Failed to mount ramfs: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	// create the file
+	printf("creating file...\n");
+	int fd = open(kFileName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0)
+		fail("Failed to open \"%s\": %s\n", kFileName, strerror(errno));
+
+	if (ftruncate(fd, fileSize) != 0)
+		fail("Failed to resize the file: %s\n", strerror(errno));
+
+	// map it shared, and write the data through the mapping
+	printf("mapping file...\n");
+	uint8* address = (uint8*)mmap(NULL, fileSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED)
+		fail("Failed to map the file: %s\n", strerror(errno));
+
+	close(fd);
+
+	for (size_t i = 0; i < kPageCount; i++)
+		memset(address + i * B_PAGE_SIZE, 'a' + i, B_PAGE_SIZE);
+
+	// neither resizing the area, nor cutting off its end must touch the file
+	printf("resizing the mapping's area...\n");
+	area_id area = area_for(address);
+	if (area < 0)
+		fail("Failed to find the area: %s\n", strerror(area));
+	if (resize_area(area, B_PAGE_SIZE) == B_OK)
+		fail("Resizing the area of a mapped file succeeded!\n");
+
+	printf("unmapping the end of the mapping...\n");
+	if (munmap(address + B_PAGE_SIZE, fileSize - B_PAGE_SIZE) != 0)
+		fail("Failed to unmap the end: %s\n", strerror(errno));
+
+	check_file(fileSize);
+
+	printf("unmapping the rest...\n");
+	if (munmap(address, B_PAGE_SIZE) != 0)
+		fail("Failed to unmap the rest: %s\n", strerror(errno));
+
+	check_file(fileSize);
+
+	unlink(kFileName);
+	fs_unmount_volume(kMountPoint, 0);
+
+	printf("All tests passed.\n");
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2026, Haiku, Inc. All rights reserved.
+ * Distributed under the terms of the MIT License.
+ */
+
+
+#include "fssh_stdio.h"
+#include "syscalls.h"
+
+#include "bfs.h"
+#include "bfs_control.h"
+
+
+namespace FSShell {
+
+
+fssh_status_t
+command_resizelog(int argc, const char* const* argv)
+{
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "--help"))) {
+		fssh_dprintf("Usage: %s [<blocks>]\n"
+			"  Changes the size of the log to <blocks>, or prints its current"
+			" size.\n", argv[0]);
+		return B_OK;
+	}
+
+	uint32 length = 0;
+	if (argc == 2) {
+		length = strtoul(argv[1], NULL, 0);
+		if (length == 0) {
+			fssh_dprintf("%s: invalid log size \"%s\"\n", argv[0], argv[1]);
+			return B_BAD_VALUE;
+		}
+	}
+
+	int rootDir = _kern_open_dir(-1, "/myfs");
+	if (rootDir < 0)
+		return rootDir;
+
+	fssh_status_t status = _kern_ioctl(rootDir, BFS_IOCTL_RESIZE_LOG, &length,
+		sizeof(length));
+
+	_kern_close(rootDir);
+
+	if (status != B_OK) {
+		fssh_dprintf("%s: resizing the log failed: %s\n", argv[0],
+			fssh_strerror(status));
+		return status;
+	}
+
+	fssh_dprintf("log size: %" B_PRIu32 " blocks\n", length);
+	return B_OK;
+}
+
+
+}	// namespace FSShell
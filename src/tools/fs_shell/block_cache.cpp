@@ -1743,3 +1743,15 @@ fssh_block_cache_put(void* _cache, fssh_off_t blockNumber)
 	put_cached_block(cache, blockNumber);
 }
 
+
+/*!	Prefetching is only a hint; the FS shell reads blocks when they are
+	needed, so this doesn't do anything.
+*/
+fssh_status_t
+fssh_block_cache_prefetch(void* _cache, fssh_off_t blockNumber,
+	fssh_size_t* _numBlocks)
+{
+	*_numBlocks = 0;
+	return FSSH_B_OK;
+}
+
@@ -360,3 +360,20 @@ fssh_file_cache_write(void *_cacheRef, void *cookie, fssh_off_t offset,
 	return status;
 }
 
+
+fssh_status_t
+fssh_file_cache_read_direct(void *_cacheRef, void *cookie, fssh_off_t offset,
+	void *bufferBase, fssh_size_t *_size)
+{
+	// there is no page cache to bypass here
+	return fssh_file_cache_read(_cacheRef, cookie, offset, bufferBase, _size);
+}
+
+
+fssh_status_t
+fssh_file_cache_write_direct(void *_cacheRef, void *cookie, fssh_off_t offset,
+	const void *buffer, fssh_size_t *_size)
+{
+	return fssh_file_cache_write(_cacheRef, cookie, offset, buffer, _size);
+}
+